@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MARLIN_AES_CIPHER_H__
+#define __MARLIN_AES_CIPHER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MH_AES_BLOCK_SIZE 16
+#define MH_AES_128_KEY_SIZE 16
+#define MH_AES_128_ROUNDS 10
+
+namespace marlincdm {
+
+/**
+ * @brief
+ * AES-128 software cipher for the software decryption of MarlinAgentHandler.
+ *
+ * The kernel is selected once at run time from the CPU features.
+ * - IMPL_VAES : VAES and AVX-512, 16 blocks per iteration
+ * - IMPL_AESNI : AES-NI, 8 blocks per iteration
+ * - IMPL_PORTABLE : Table based C++ code for any CPU
+ *
+ * The key schedule is not changed by decryption, so that one instance can be used by several threads.
+ */
+class MarlinAesCipher {
+
+public:
+
+  /**
+   * @brief Kernel of the cipher.
+   */
+  enum Implementation {
+    IMPL_PORTABLE = 0,
+    IMPL_AESNI,
+    IMPL_VAES,
+  };
+
+  MarlinAesCipher();
+  ~MarlinAesCipher();
+
+  /**
+   * @brief Expand the AES-128 key.
+   *
+   * @param [in] i_key Key (MH_AES_128_KEY_SIZE bytes)
+   */
+  void setKey(const uint8_t* i_key);
+
+  /**
+   * @brief Decryption of CBC mode.
+   *
+   * @param [in,out] io_iv IV (MH_AES_BLOCK_SIZE bytes). Updated to the last ciphertext block, so that the
+   * next call continues the chain.
+   * @param [in] i_src Encrypted data
+   * @param [out] o_dst Decrypted data. It may be equal to i_src.
+   * @param [in] i_blocks Number of blocks
+   */
+  void decryptCbc(uint8_t* io_iv, const uint8_t* i_src, uint8_t* o_dst, size_t i_blocks) const;
+
+  /**
+   * @brief Encryption or decryption of CTR mode.
+   *
+   * @param [in,out] io_counter Counter block (MH_AES_BLOCK_SIZE bytes).
+   * The low 64 bits are incremented as big endian for every block, and wrap around without carry.
+   * @param [in] i_src Input data
+   * @param [out] o_dst Output data. It may be equal to i_src.
+   * @param [in] i_blocks Number of blocks
+   */
+  void cryptCtr(uint8_t* io_counter, const uint8_t* i_src, uint8_t* o_dst, size_t i_blocks) const;
+
+  /**
+   * @brief Generate one key stream block of CTR mode for a trailing partial block.
+   *
+   * @param [in,out] io_counter Counter block. Incremented in the same way as cryptCtr().
+   * @param [out] o_key_stream Key stream (MH_AES_BLOCK_SIZE bytes)
+   */
+  void keyStreamCtr(uint8_t* io_counter, uint8_t* o_key_stream) const;
+
+  /**
+   * @brief Get the kernel used by all instances.
+   */
+  static Implementation getImplementation(void);
+
+  /**
+   * @brief Force the kernel used by all instances, to compare kernels on the same CPU.\n
+   * It must be called while no instance is decrypting.
+   *
+   * @param [in] i_impl Kernel
+   *
+   * @retval true The kernel is selected
+   * @retval false The kernel is not supported by the CPU or the compiler
+   */
+  static bool setImplementation(Implementation i_impl);
+
+private:
+  uint8_t mEncKey[(MH_AES_128_ROUNDS + 1) * MH_AES_BLOCK_SIZE] __attribute__((aligned(16)));
+  uint8_t mDecKey[(MH_AES_128_ROUNDS + 1) * MH_AES_BLOCK_SIZE] __attribute__((aligned(16)));
+  uint32_t mEncWords[(MH_AES_128_ROUNDS + 1) * 4];
+  uint32_t mDecWords[(MH_AES_128_ROUNDS + 1) * 4];
+
+  MarlinAesCipher(const MarlinAesCipher &o);
+  MarlinAesCipher& operator=(const MarlinAesCipher &o);
+};
+}; //namespace
+
+#endif /* __MARLIN_AES_CIPHER_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
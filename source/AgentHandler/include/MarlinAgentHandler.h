@@ -18,6 +18,7 @@
 #define __MARLIN_AGENT_HANDLER_H__
 
 #include "MarlinAgentHandlerType.h"
+#include "CMutex.h"
 
 #include <vector>
 
@@ -126,6 +127,19 @@ public:
    */
   MH_status_t checkKeyExist(MH_keyIdInfo_t* i_parameter, bool* o_is_key_exist);
 
+  /**
+   * @brief This function checks the presence of Keys of several KeyID information.\n
+   * An agent which can look up many keys at once should replace the loop over checkKeyExist().
+   *
+   * @param [in] i_parameters Array of KeyID information.(same as checkKeyExist())
+   * @param [in] i_num Number of KeyID information.
+   * @param [out] o_is_key_exist Array of i_num results. "true": Key is exist. "false": Key is not exist.
+   *
+   * @retval MH_ERR_OK Check key exist is success
+   * @retval MH_ERR_FAILURE Cannot check key exist
+   */
+  MH_status_t checkKeyExistBatch(MH_keyIdInfo_t* i_parameters, uint32_t i_num, bool* o_is_key_exist);
+
   /**
    * @brief Initialize Marlin IPTV-ES session.
    *
@@ -208,21 +222,217 @@ public:
    *
    * @param [in] i_parameter includes KeyID information(PSSH information or ECM information).\n
    * @param [in] i_src_ptr Input buffer of encrypted data
-   * @param [out] o_dst_ptr Output buffer of decrypted data
+   * @param [in,out] o_dst_ptr Output buffer of decrypted data. (see MH_buffer_t for the owner of the buffer)
+   *
+   * @retval MH_ERR_OK Decryption is success
+   * @retval MH_ERR_TOO_SMALL_BUFFER Out buffer is too small
+   * @retval MH_ERR_FAILURE Cannot decrypt content
+   */
+  MH_status_t decrypt(MH_keyIdInfo_t* i_parameter,
+                      MH_buffer_t* i_src_ptr,
+                      MH_buffer_t* o_dst_ptr);
+
+  /**
+   * @brief Decryption of media content which interleaves clear and encrypted ranges.\n
+   * Only the encrypted ranges are decrypted. The clear ranges are passed through to the output buffer untouched.
+   *
+   * @param [in] i_parameter includes KeyID information(PSSH information or ECM information).\n
+   * @param [in] i_subsamples Subsample map. Sum of all ranges is equal to the length of i_src_ptr.
+   * @param [in] i_subsample_num Number of subsamples
+   * @param [in] i_src_ptr Input buffer of encrypted data
+   * @param [in,out] o_dst_ptr Output buffer of decrypted data. (see MH_buffer_t for the owner of the buffer)
    *
    * @retval MH_ERR_OK Decryption is success
    * @retval MH_ERR_TOO_SMALL_BUFFER Out buffer is too small
    * @retval MH_ERR_FAILURE Cannot decrypt content
    */
   MH_status_t decrypt(MH_keyIdInfo_t* i_parameter,
+                      const MH_subsample_t* i_subsamples,
+                      uint32_t i_subsample_num,
                       MH_buffer_t* i_src_ptr,
                       MH_buffer_t* o_dst_ptr);
 
+  /**
+   * @brief Decryption of several samples which share one KeyID information.\n
+   * The content key is resolved once and is used for all samples.
+   *
+   * @param [in] i_parameter includes KeyID information(PSSH information or ECM information).\n
+   * @param [in,out] io_samples Array of samples. src is input buffer of encrypted data, dst is output buffer of decrypted data.\n
+   * The owner of dst is decided in the same way as o_dst_ptr of decrypt().(see MH_buffer_t)\n
+   * When subsamples of a sample is not NULL, only the encrypted ranges of the sample are decrypted.
+   * @param [in] i_sample_num Number of samples.
+   *
+   * @retval MH_ERR_OK Decryption of all samples is success
+   * @retval MH_ERR_TOO_SMALL_BUFFER Out buffer of a sample is too small
+   * @retval MH_ERR_FAILURE Cannot decrypt content
+   */
+  MH_status_t decryptBatch(MH_keyIdInfo_t* i_parameter,
+                           MH_sample_t* io_samples,
+                           uint32_t i_sample_num);
+
+
+  /**
+   * @brief Resolve the content key of KeyID information and open its key context.\n
+   * The key context stays valid until closeKeyContext() is called, so that the caller can
+   * decrypt with decryptWithKey() without resolving the content key again.
+   *
+   * @param [in] i_handle Agent handle
+   * @param [in] i_parameter includes KeyID information(PSSH information or ECM information).\n
+   * @param [out] o_key_handle Key context handle
+   *
+   * @retval MH_ERR_OK Opening key context is success
+   * @retval MH_ERR_FAILURE Cannot resolve the content key
+   */
+  MH_status_t openKeyContext(MH_agentHandle_t i_handle, MH_keyIdInfo_t* i_parameter, MH_keyHandle_t* o_key_handle);
+
+  /**
+   * @brief Close the key context opened by openKeyContext().
+   *
+   * @param [in] i_key_handle Key context handle
+   *
+   * @retval MH_ERR_OK Closing key context is success
+   * @retval MH_ERR_FAILURE Cannot close key context
+   */
+  MH_status_t closeKeyContext(MH_keyHandle_t i_key_handle);
+
+  /**
+   * @brief Decryption of media content with a key context opened by openKeyContext().
+   *
+   * @param [in] i_key_handle Key context handle
+   * @param [in] i_subsamples Subsample map. NULL when whole of i_src_ptr is encrypted.
+   * @param [in] i_subsample_num Number of subsamples
+   * @param [in] i_src_ptr Input buffer of encrypted data
+   * @param [in,out] o_dst_ptr Output buffer of decrypted data. (see MH_buffer_t for the owner of the buffer)
+   *
+   * @retval MH_ERR_OK Decryption is success
+   * @retval MH_ERR_TOO_SMALL_BUFFER Out buffer is too small
+   * @retval MH_ERR_FAILURE Cannot decrypt content
+   */
+  MH_status_t decryptWithKey(MH_keyHandle_t i_key_handle,
+                             const MH_subsample_t* i_subsamples,
+                             uint32_t i_subsample_num,
+                             MH_buffer_t* i_src_ptr,
+                             MH_buffer_t* o_dst_ptr);
+
+  /**
+   * @brief Decryption of several samples with a key context opened by openKeyContext().
+   *
+   * @param [in] i_key_handle Key context handle
+   * @param [in,out] io_samples Array of samples.(same as decryptBatch())
+   * @param [in] i_sample_num Number of samples.
+   *
+   * @retval MH_ERR_OK Decryption of all samples is success
+   * @retval MH_ERR_TOO_SMALL_BUFFER Out buffer of a sample is too small
+   * @retval MH_ERR_FAILURE Cannot decrypt content
+   */
+  MH_status_t decryptBatchWithKey(MH_keyHandle_t i_key_handle,
+                                  MH_sample_t* io_samples,
+                                  uint32_t i_sample_num);
+
+  /**
+   * @brief Decryption of payloads of scrambled MPEG-2 TS packets with a key context opened by openKeyContext().\n
+   * The key context of ECM information holds the even key and the odd key, and i_parity selects one of them.\n
+   * With the software decryption, the content key provisioned by setContentKey() is used for both parities.
+   *
+   * @param [in] i_key_handle Key context handle
+   * @param [in] i_parity Key parity of all samples
+   * @param [in,out] io_samples Array of samples.(same as decryptBatch())
+   * @param [in] i_sample_num Number of samples.
+   *
+   * @retval MH_ERR_OK Decryption of all samples is success
+   * @retval MH_ERR_TOO_SMALL_BUFFER Out buffer of a sample is too small
+   * @retval MH_ERR_FAILURE Cannot decrypt content
+   */
+  MH_status_t decryptBatchWithKey(MH_keyHandle_t i_key_handle,
+                                  MH_keyParity i_parity,
+                                  MH_sample_t* io_samples,
+                                  uint32_t i_sample_num);
+
+  /**
+   * @brief Open the decryption state of a stream with a key context opened by openKeyContext().\n
+   * The stream is decrypted by decryptStream() in chunks of any size, and the IV (CBC) or the counter (CTR)
+   * continues over the chunks. The key context must stay open until closeStreamContext() is called.
+   *
+   * @param [in] i_key_handle Key context handle
+   * @param [in] i_iv IV (CBC) or initial counter block (CTR) of the stream. NULL when the IV of the content key is used.
+   * @param [out] o_stream_handle Stream context handle
+   *
+   * @retval MH_ERR_OK Opening stream context is success
+   * @retval MH_ERR_FAILURE Cannot open stream context
+   */
+  MH_status_t openStreamContext(MH_keyHandle_t i_key_handle, const uint8_t* i_iv, MH_streamHandle_t* o_stream_handle);
+
+  /**
+   * @brief Decryption of the next chunk of a stream opened by openStreamContext().\n
+   * With CBC, a partial block at the tail of the chunk is held until the next chunk completes it,
+   * so that o_dst_ptr->len may differ from i_src_ptr->len. When i_last is true, the held bytes are
+   * output as clear data. (same as a trailing partial block of decryptWithKey())
+   *
+   * @param [in] i_stream_handle Stream context handle
+   * @param [in] i_src_ptr Input buffer of encrypted data
+   * @param [in] i_last The chunk is the end of the stream
+   * @param [in,out] o_dst_ptr Output buffer supplied by the caller. Its capacity must be i_src_ptr->len + MH_AES_BLOCK_SIZE - 1
+   * or more. The output buffer must not overlap the input buffer. o_dst_ptr->len is set to the size of decrypted data.
+   *
+   * @retval MH_ERR_OK Decryption is success
+   * @retval MH_ERR_TOO_SMALL_BUFFER Out buffer is too small
+   * @retval MH_ERR_FAILURE Cannot decrypt content
+   */
+  MH_status_t decryptStream(MH_streamHandle_t i_stream_handle, MH_buffer_t* i_src_ptr, bool i_last, MH_buffer_t* o_dst_ptr);
+
+  /**
+   * @brief Close the stream context opened by openStreamContext(). Bytes held by the stream are discarded.
+   *
+   * @param [in] i_stream_handle Stream context handle
+   *
+   * @retval MH_ERR_OK Closing stream context is success
+   * @retval MH_ERR_FAILURE Cannot close stream context
+   */
+  MH_status_t closeStreamContext(MH_streamHandle_t i_stream_handle);
+
+  /**
+   * @brief Provision the content key of KeyID information for the software decryption.\n
+   * The content keys are shared by all instances of MarlinAgentHandler.\n
+   * Key contexts opened after this call decrypt with MarlinAesCipher instead of Marlin DRM Agent.\n
+   * It is called by the porting layer when the agent exports content keys, or to measure the decryption
+   * path on platforms without the agent.
+   *
+   * @param [in] i_parameter includes KeyID information(PSSH information or ECM information).\n
+   * @param [in] i_key Content key
+   *
+   * @retval MH_ERR_OK Provisioning is success
+   * @retval MH_ERR_FAILURE Cannot provision the content key
+   */
+  MH_status_t setContentKey(MH_keyIdInfo_t* i_parameter, MH_contentKey_t* i_key);
+
+  /**
+   * @brief Remove the content key provisioned by setContentKey().\n
+   * Key contexts opened before this call keep decrypting with the content key until they are closed.
+   *
+   * @param [in] i_parameter includes KeyID information(PSSH information or ECM information).\n
+   *
+   * @retval MH_ERR_OK Removing is success
+   * @retval MH_ERR_FAILURE The content key is not provisioned
+   */
+  MH_status_t removeContentKey(MH_keyIdInfo_t* i_parameter);
 
 protected:
 
 private:
 
+  struct ContentKey {
+    MH_keyIdInfoType type;
+    vector<uint8_t> kid;
+    MH_contentKey_t key;
+  };
+
+  static vector<ContentKey> sContentKeys; // shared by all instances
+  static CMutex sContentKeyMutex;
+
+  bool findContentKey(const MH_keyIdInfo_t* i_parameter, MH_contentKey_t* o_key);
+
+  MarlinAgentHandler(const MarlinAgentHandler &o);
+  MarlinAgentHandler& operator=(const MarlinAgentHandler &o);
 };
 }; //namespace
 
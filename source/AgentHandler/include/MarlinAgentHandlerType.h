@@ -22,6 +22,8 @@
 
 #define MH_PRIVATE_DATA_SIZE 28
 #define MH_URR_DATA_SIZE 16
+#define MH_CONTENT_KEY_SIZE 16
+#define MH_CONTENT_IV_SIZE 16
 
 using namespace std;
 
@@ -36,6 +38,7 @@ enum MH_status_t {
   MH_ERR_INVALID_ACTION_ID, //!< ActionID error.
   MH_ERR_INVALID_ACTION_PARAM, //!< ActionParameter error.
   MH_ERR_INVALID_RESPONSE_MSG, //!< Response message error.
+  MH_ERR_TOO_SMALL_BUFFER, //!< Output buffer is too small.
 };
 
 /**
@@ -48,6 +51,16 @@ typedef void* MH_agentHandle_t;
  */
 typedef void* MH_iptvesHandle_t;
 
+/**
+ * @brief This parameter show keyHandle.(resolved content key context)
+ */
+typedef void* MH_keyHandle_t;
+
+/**
+ * @brief This parameter show streamHandle.(decryption state of a stream of chunks)
+ */
+typedef void* MH_streamHandle_t;
+
 /**
  * @brief Unique string to identify Marlin CDM object
  */
@@ -55,11 +68,64 @@ typedef string MH_session_id_t;
 
 /**
  * @brief This structure includes buf length and data buffer and fd for platform specific buffer.
+ *
+ * When this structure is used as output buffer of decryption (o_dst_ptr of decrypt(), dst of MH_sample_t),
+ * the owner of the memory is decided by the value of data at the call.
+ * - data is NULL : The agent allocates the output buffer and sets len, data and fd.
+ * - data is equal to data of the input buffer : In-place decryption.
+ *   The agent overwrites the input buffer and sets len to the size of decrypted data.
+ * - Otherwise : The output buffer is supplied by the caller and len is its capacity.
+ *   The agent writes into it and sets len to the size of decrypted data,
+ *   or returns MH_ERR_TOO_SMALL_BUFFER without writing.
  */
 struct MH_buffer_t {
     size_t len; //!< data size
     uint8_t* data; //!< data buffer
     int fd; //!< File descriptor for platform specific buffer
+    size_t offset; //!< Byte offset of data in fd. data is mapped by the caller when it is given by fd.
+};
+
+/**
+ * @brief This structure describes one subsample.(clear range followed by encrypted range)
+ */
+struct MH_subsample_t {
+    uint32_t clear_bytes; //!< Number of clear bytes at the head of the subsample
+    uint32_t encrypted_bytes; //!< Number of encrypted bytes following the clear bytes
+};
+
+/**
+ * @brief This structure includes a pair of input and output buffers for one sample.
+ */
+struct MH_sample_t {
+    MH_buffer_t src; //!< Input buffer of encrypted data
+    MH_buffer_t dst; //!< Output buffer of decrypted data
+    const MH_subsample_t* subsamples; //!< Subsample map (NULL : whole of src is encrypted)
+    uint32_t subsample_num; //!< Number of subsamples
+};
+
+/**
+ * @brief Key parity of scrambled MPEG-2 TS packets (transport_scrambling_control)
+ */
+enum MH_keyParity {
+    KEY_PARITY_EVEN = 0, //!< transport_scrambling_control '10'
+    KEY_PARITY_ODD, //!< transport_scrambling_control '11'
+};
+
+/**
+ * @brief Cipher mode of content key for the software decryption
+ */
+enum MH_cipherMode {
+    CIPHER_MODE_AES_128_CBC = 0, //!< AES-128 CBC. A trailing partial block of an encrypted range is clear.
+    CIPHER_MODE_AES_128_CTR, //!< AES-128 CTR. The low 64 bits of the counter block are incremented.
+};
+
+/**
+ * @brief This structure includes content key for the software decryption.
+ */
+struct MH_contentKey_t {
+    MH_cipherMode mode; //!< Cipher mode
+    uint8_t key[MH_CONTENT_KEY_SIZE]; //!< AES-128 content key
+    uint8_t iv[MH_CONTENT_IV_SIZE]; //!< IV (CBC) or initial counter block (CTR) at the head of every sample
 };
 
 /**
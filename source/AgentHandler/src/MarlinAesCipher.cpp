@@ -0,0 +1,632 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <cstring>
+
+#include "MarlinAesCipher.h"
+
+/* AES-NI kernels need the target attribute with intrinsics, VAES intrinsics need GCC 8. */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define MH_AES_AESNI 1
+#if defined(__clang__) || (__GNUC__ >= 8)
+#define MH_AES_VAES 1
+#endif
+#endif
+
+#ifdef MH_AES_AESNI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+using namespace marlincdm;
+
+namespace {
+
+typedef void (*CbcKernel)(const uint8_t* key, const uint32_t* words, uint8_t* iv,
+                          const uint8_t* src, uint8_t* dst, size_t blocks);
+typedef void (*CtrKernel)(const uint8_t* key, const uint32_t* words, uint8_t* counter,
+                          const uint8_t* src, uint8_t* dst, size_t blocks);
+
+uint8_t sSbox[256];
+uint8_t sInvSbox[256];
+uint32_t sTe[4][256];
+uint32_t sTd[4][256];
+
+bool sAesniSupported = false;
+bool sVaesSupported = false;
+MarlinAesCipher::Implementation sImpl = MarlinAesCipher::IMPL_PORTABLE;
+CbcKernel sCbcKernel = NULL;
+CtrKernel sCtrKernel = NULL;
+pthread_once_t sOnce = PTHREAD_ONCE_INIT;
+
+inline uint32_t getU32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+inline void putU32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+inline uint8_t xtime(uint8_t x) {
+    return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00));
+}
+
+uint8_t gmul(uint8_t a, uint8_t b) {
+    uint8_t p = 0;
+    while (b != 0) {
+        if (b & 1) {
+            p ^= a;
+        }
+        a = xtime(a);
+        b >>= 1;
+    }
+    return p;
+}
+
+inline uint8_t rotl8(uint8_t x, int shift) {
+    return (uint8_t)((x << shift) | (x >> (8 - shift)));
+}
+
+inline uint32_t rotr32(uint32_t x, int shift) {
+    return (shift == 0) ? x : ((x >> shift) | (x << (32 - shift)));
+}
+
+void secureZero(void* p, size_t len) {
+    volatile uint8_t* v = (volatile uint8_t*)p;
+    while (len-- > 0) {
+        *v++ = 0;
+    }
+}
+
+/* Increment the low 64 bits of the counter block as big endian. */
+inline void incrementCounter(uint8_t* counter) {
+    for (int i = MH_AES_BLOCK_SIZE - 1; i >= MH_AES_BLOCK_SIZE - 8; i--) {
+        if (++counter[i] != 0) {
+            break;
+        }
+    }
+}
+
+/*
+ * Portable kernel
+ */
+
+void encryptBlockPortable(const uint32_t* rk, const uint8_t* in, uint8_t* out) {
+    uint32_t s0 = getU32(in) ^ rk[0];
+    uint32_t s1 = getU32(in + 4) ^ rk[1];
+    uint32_t s2 = getU32(in + 8) ^ rk[2];
+    uint32_t s3 = getU32(in + 12) ^ rk[3];
+    uint32_t t0, t1, t2, t3;
+
+    for (int r = 1; r < MH_AES_128_ROUNDS; r++) {
+        rk += 4;
+        t0 = sTe[0][s0 >> 24] ^ sTe[1][(s1 >> 16) & 0xff] ^ sTe[2][(s2 >> 8) & 0xff] ^ sTe[3][s3 & 0xff] ^ rk[0];
+        t1 = sTe[0][s1 >> 24] ^ sTe[1][(s2 >> 16) & 0xff] ^ sTe[2][(s3 >> 8) & 0xff] ^ sTe[3][s0 & 0xff] ^ rk[1];
+        t2 = sTe[0][s2 >> 24] ^ sTe[1][(s3 >> 16) & 0xff] ^ sTe[2][(s0 >> 8) & 0xff] ^ sTe[3][s1 & 0xff] ^ rk[2];
+        t3 = sTe[0][s3 >> 24] ^ sTe[1][(s0 >> 16) & 0xff] ^ sTe[2][(s1 >> 8) & 0xff] ^ sTe[3][s2 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+    rk += 4;
+
+    putU32(out, (((uint32_t)sSbox[s0 >> 24] << 24) | ((uint32_t)sSbox[(s1 >> 16) & 0xff] << 16) |
+                 ((uint32_t)sSbox[(s2 >> 8) & 0xff] << 8) | (uint32_t)sSbox[s3 & 0xff]) ^ rk[0]);
+    putU32(out + 4, (((uint32_t)sSbox[s1 >> 24] << 24) | ((uint32_t)sSbox[(s2 >> 16) & 0xff] << 16) |
+                     ((uint32_t)sSbox[(s3 >> 8) & 0xff] << 8) | (uint32_t)sSbox[s0 & 0xff]) ^ rk[1]);
+    putU32(out + 8, (((uint32_t)sSbox[s2 >> 24] << 24) | ((uint32_t)sSbox[(s3 >> 16) & 0xff] << 16) |
+                     ((uint32_t)sSbox[(s0 >> 8) & 0xff] << 8) | (uint32_t)sSbox[s1 & 0xff]) ^ rk[2]);
+    putU32(out + 12, (((uint32_t)sSbox[s3 >> 24] << 24) | ((uint32_t)sSbox[(s0 >> 16) & 0xff] << 16) |
+                      ((uint32_t)sSbox[(s1 >> 8) & 0xff] << 8) | (uint32_t)sSbox[s2 & 0xff]) ^ rk[3]);
+}
+
+void decryptBlockPortable(const uint32_t* rk, const uint8_t* in, uint8_t* out) {
+    uint32_t s0 = getU32(in) ^ rk[0];
+    uint32_t s1 = getU32(in + 4) ^ rk[1];
+    uint32_t s2 = getU32(in + 8) ^ rk[2];
+    uint32_t s3 = getU32(in + 12) ^ rk[3];
+    uint32_t t0, t1, t2, t3;
+
+    for (int r = 1; r < MH_AES_128_ROUNDS; r++) {
+        rk += 4;
+        t0 = sTd[0][s0 >> 24] ^ sTd[1][(s3 >> 16) & 0xff] ^ sTd[2][(s2 >> 8) & 0xff] ^ sTd[3][s1 & 0xff] ^ rk[0];
+        t1 = sTd[0][s1 >> 24] ^ sTd[1][(s0 >> 16) & 0xff] ^ sTd[2][(s3 >> 8) & 0xff] ^ sTd[3][s2 & 0xff] ^ rk[1];
+        t2 = sTd[0][s2 >> 24] ^ sTd[1][(s1 >> 16) & 0xff] ^ sTd[2][(s0 >> 8) & 0xff] ^ sTd[3][s3 & 0xff] ^ rk[2];
+        t3 = sTd[0][s3 >> 24] ^ sTd[1][(s2 >> 16) & 0xff] ^ sTd[2][(s1 >> 8) & 0xff] ^ sTd[3][s0 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+    rk += 4;
+
+    putU32(out, (((uint32_t)sInvSbox[s0 >> 24] << 24) | ((uint32_t)sInvSbox[(s3 >> 16) & 0xff] << 16) |
+                 ((uint32_t)sInvSbox[(s2 >> 8) & 0xff] << 8) | (uint32_t)sInvSbox[s1 & 0xff]) ^ rk[0]);
+    putU32(out + 4, (((uint32_t)sInvSbox[s1 >> 24] << 24) | ((uint32_t)sInvSbox[(s0 >> 16) & 0xff] << 16) |
+                     ((uint32_t)sInvSbox[(s3 >> 8) & 0xff] << 8) | (uint32_t)sInvSbox[s2 & 0xff]) ^ rk[1]);
+    putU32(out + 8, (((uint32_t)sInvSbox[s2 >> 24] << 24) | ((uint32_t)sInvSbox[(s1 >> 16) & 0xff] << 16) |
+                     ((uint32_t)sInvSbox[(s0 >> 8) & 0xff] << 8) | (uint32_t)sInvSbox[s3 & 0xff]) ^ rk[2]);
+    putU32(out + 12, (((uint32_t)sInvSbox[s3 >> 24] << 24) | ((uint32_t)sInvSbox[(s2 >> 16) & 0xff] << 16) |
+                      ((uint32_t)sInvSbox[(s1 >> 8) & 0xff] << 8) | (uint32_t)sInvSbox[s0 & 0xff]) ^ rk[3]);
+}
+
+void cbcDecryptPortable(const uint8_t* /* key */, const uint32_t* words, uint8_t* iv,
+                        const uint8_t* src, uint8_t* dst, size_t blocks) {
+    uint8_t cipher[MH_AES_BLOCK_SIZE];
+    uint8_t plain[MH_AES_BLOCK_SIZE];
+
+    for (size_t n = 0; n < blocks; n++) {
+        /* Keep the ciphertext, dst may be equal to src. */
+        memcpy(cipher, src, MH_AES_BLOCK_SIZE);
+        decryptBlockPortable(words, cipher, plain);
+        for (int i = 0; i < MH_AES_BLOCK_SIZE; i++) {
+            dst[i] = plain[i] ^ iv[i];
+        }
+        memcpy(iv, cipher, MH_AES_BLOCK_SIZE);
+        src += MH_AES_BLOCK_SIZE;
+        dst += MH_AES_BLOCK_SIZE;
+    }
+}
+
+void ctrCryptPortable(const uint8_t* /* key */, const uint32_t* words, uint8_t* counter,
+                      const uint8_t* src, uint8_t* dst, size_t blocks) {
+    uint8_t stream[MH_AES_BLOCK_SIZE];
+
+    for (size_t n = 0; n < blocks; n++) {
+        encryptBlockPortable(words, counter, stream);
+        incrementCounter(counter);
+        for (int i = 0; i < MH_AES_BLOCK_SIZE; i++) {
+            dst[i] = src[i] ^ stream[i];
+        }
+        src += MH_AES_BLOCK_SIZE;
+        dst += MH_AES_BLOCK_SIZE;
+    }
+}
+
+#ifdef MH_AES_AESNI
+
+/*
+ * AES-NI kernel : 8 independent blocks are in flight to hide the latency of AESDEC/AESENC.
+ */
+
+#define MH_AESNI_LANES 8
+
+__attribute__((target("aes,ssse3")))
+void cbcDecryptAesni(const uint8_t* key, const uint32_t* /* words */, uint8_t* iv,
+                     const uint8_t* src, uint8_t* dst, size_t blocks) {
+    __m128i rk[MH_AES_128_ROUNDS + 1];
+    __m128i b[MH_AESNI_LANES];
+    __m128i prev = _mm_loadu_si128((const __m128i*)iv);
+
+    for (int r = 0; r <= MH_AES_128_ROUNDS; r++) {
+        rk[r] = _mm_load_si128((const __m128i*)(key + r * MH_AES_BLOCK_SIZE));
+    }
+
+    for (; blocks >= MH_AESNI_LANES; blocks -= MH_AESNI_LANES) {
+        const __m128i* in = (const __m128i*)src;
+        __m128i next = _mm_loadu_si128(in + MH_AESNI_LANES - 1);
+
+        for (int j = 0; j < MH_AESNI_LANES; j++) {
+            b[j] = _mm_xor_si128(_mm_loadu_si128(in + j), rk[0]);
+        }
+        for (int r = 1; r < MH_AES_128_ROUNDS; r++) {
+            for (int j = 0; j < MH_AESNI_LANES; j++) {
+                b[j] = _mm_aesdec_si128(b[j], rk[r]);
+            }
+        }
+        for (int j = 0; j < MH_AESNI_LANES; j++) {
+            b[j] = _mm_aesdeclast_si128(b[j], rk[MH_AES_128_ROUNDS]);
+        }
+
+        /* From the last block, so that in-place decryption reads each ciphertext block before it is overwritten. */
+        for (int j = MH_AESNI_LANES - 1; j > 0; j--) {
+            _mm_storeu_si128((__m128i*)dst + j, _mm_xor_si128(b[j], _mm_loadu_si128(in + j - 1)));
+        }
+        _mm_storeu_si128((__m128i*)dst, _mm_xor_si128(b[0], prev));
+        prev = next;
+
+        src += MH_AESNI_LANES * MH_AES_BLOCK_SIZE;
+        dst += MH_AESNI_LANES * MH_AES_BLOCK_SIZE;
+    }
+
+    for (; blocks > 0; blocks--) {
+        __m128i cipher = _mm_loadu_si128((const __m128i*)src);
+        __m128i block = _mm_xor_si128(cipher, rk[0]);
+        for (int r = 1; r < MH_AES_128_ROUNDS; r++) {
+            block = _mm_aesdec_si128(block, rk[r]);
+        }
+        block = _mm_aesdeclast_si128(block, rk[MH_AES_128_ROUNDS]);
+        _mm_storeu_si128((__m128i*)dst, _mm_xor_si128(block, prev));
+        prev = cipher;
+
+        src += MH_AES_BLOCK_SIZE;
+        dst += MH_AES_BLOCK_SIZE;
+    }
+
+    _mm_storeu_si128((__m128i*)iv, prev);
+}
+
+__attribute__((target("aes,ssse3")))
+void ctrCryptAesni(const uint8_t* key, const uint32_t* /* words */, uint8_t* counter,
+                   const uint8_t* src, uint8_t* dst, size_t blocks) {
+    /* The counter is kept byte-reversed, so that the low 64 bits are incremented by PADDQ. */
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i rk[MH_AES_128_ROUNDS + 1];
+    __m128i b[MH_AESNI_LANES];
+    __m128i ctr = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)counter), reverse);
+
+    for (int r = 0; r <= MH_AES_128_ROUNDS; r++) {
+        rk[r] = _mm_load_si128((const __m128i*)(key + r * MH_AES_BLOCK_SIZE));
+    }
+
+    for (; blocks >= MH_AESNI_LANES; blocks -= MH_AESNI_LANES) {
+        const __m128i* in = (const __m128i*)src;
+
+        for (int j = 0; j < MH_AESNI_LANES; j++) {
+            b[j] = _mm_shuffle_epi8(_mm_add_epi64(ctr, _mm_set_epi64x(0, j)), reverse);
+            b[j] = _mm_xor_si128(b[j], rk[0]);
+        }
+        ctr = _mm_add_epi64(ctr, _mm_set_epi64x(0, MH_AESNI_LANES));
+        for (int r = 1; r < MH_AES_128_ROUNDS; r++) {
+            for (int j = 0; j < MH_AESNI_LANES; j++) {
+                b[j] = _mm_aesenc_si128(b[j], rk[r]);
+            }
+        }
+        for (int j = 0; j < MH_AESNI_LANES; j++) {
+            b[j] = _mm_aesenclast_si128(b[j], rk[MH_AES_128_ROUNDS]);
+            _mm_storeu_si128((__m128i*)dst + j, _mm_xor_si128(b[j], _mm_loadu_si128(in + j)));
+        }
+
+        src += MH_AESNI_LANES * MH_AES_BLOCK_SIZE;
+        dst += MH_AESNI_LANES * MH_AES_BLOCK_SIZE;
+    }
+
+    for (; blocks > 0; blocks--) {
+        __m128i block = _mm_xor_si128(_mm_shuffle_epi8(ctr, reverse), rk[0]);
+        ctr = _mm_add_epi64(ctr, _mm_set_epi64x(0, 1));
+        for (int r = 1; r < MH_AES_128_ROUNDS; r++) {
+            block = _mm_aesenc_si128(block, rk[r]);
+        }
+        block = _mm_aesenclast_si128(block, rk[MH_AES_128_ROUNDS]);
+        _mm_storeu_si128((__m128i*)dst, _mm_xor_si128(block, _mm_loadu_si128((const __m128i*)src)));
+
+        src += MH_AES_BLOCK_SIZE;
+        dst += MH_AES_BLOCK_SIZE;
+    }
+
+    _mm_storeu_si128((__m128i*)counter, _mm_shuffle_epi8(ctr, reverse));
+}
+
+#endif /* MH_AES_AESNI */
+
+#ifdef MH_AES_VAES
+
+/* The AVX-512 intrinsics of GCC start from a self-initialized undefined register, which -Wall reports. */
+#if !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+/*
+ * VAES kernel : 4 ZMM registers of 4 blocks, 16 blocks per iteration. The rest is done by the AES-NI kernel.
+ */
+
+#define MH_VAES_REGS 4
+#define MH_VAES_BLOCKS (MH_VAES_REGS * 4)
+
+__attribute__((target("aes,ssse3,avx512f,avx512bw,vaes")))
+void cbcDecryptVaes(const uint8_t* key, const uint32_t* words, uint8_t* iv,
+                    const uint8_t* src, uint8_t* dst, size_t blocks) {
+    __m512i rk[MH_AES_128_ROUNDS + 1];
+    __m512i c[MH_VAES_REGS];
+    __m512i b[MH_VAES_REGS];
+    /* Only the highest block is used as the previous ciphertext of the first block. */
+    __m512i prev = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)iv));
+
+    if (blocks < MH_VAES_BLOCKS) {
+        cbcDecryptAesni(key, words, iv, src, dst, blocks);
+        return;
+    }
+
+    for (int r = 0; r <= MH_AES_128_ROUNDS; r++) {
+        rk[r] = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i*)(key + r * MH_AES_BLOCK_SIZE)));
+    }
+
+    for (; blocks >= MH_VAES_BLOCKS; blocks -= MH_VAES_BLOCKS) {
+        for (int j = 0; j < MH_VAES_REGS; j++) {
+            c[j] = _mm512_loadu_si512((const void*)(src + j * 64));
+            b[j] = _mm512_xor_si512(c[j], rk[0]);
+        }
+        for (int r = 1; r < MH_AES_128_ROUNDS; r++) {
+            for (int j = 0; j < MH_VAES_REGS; j++) {
+                b[j] = _mm512_aesdec_epi128(b[j], rk[r]);
+            }
+        }
+        for (int j = 0; j < MH_VAES_REGS; j++) {
+            b[j] = _mm512_aesdeclast_epi128(b[j], rk[MH_AES_128_ROUNDS]);
+        }
+
+        /* Previous ciphertext blocks : the highest block of the previous register and the lower 3 blocks. */
+        b[0] = _mm512_xor_si512(b[0], _mm512_alignr_epi64(c[0], prev, 6));
+        for (int j = 1; j < MH_VAES_REGS; j++) {
+            b[j] = _mm512_xor_si512(b[j], _mm512_alignr_epi64(c[j], c[j - 1], 6));
+        }
+        for (int j = 0; j < MH_VAES_REGS; j++) {
+            _mm512_storeu_si512((void*)(dst + j * 64), b[j]);
+        }
+        prev = c[MH_VAES_REGS - 1];
+
+        src += MH_VAES_BLOCKS * MH_AES_BLOCK_SIZE;
+        dst += MH_VAES_BLOCKS * MH_AES_BLOCK_SIZE;
+    }
+
+    _mm_storeu_si128((__m128i*)iv, _mm512_extracti32x4_epi32(prev, 3));
+    cbcDecryptAesni(key, words, iv, src, dst, blocks);
+}
+
+__attribute__((target("aes,ssse3,avx512f,avx512bw,vaes")))
+void ctrCryptVaes(const uint8_t* key, const uint32_t* words, uint8_t* counter,
+                  const uint8_t* src, uint8_t* dst, size_t blocks) {
+    const __m512i reverse = _mm512_broadcast_i32x4(
+        _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    const __m512i step = _mm512_set_epi64(0, 4, 0, 4, 0, 4, 0, 4);
+    __m512i rk[MH_AES_128_ROUNDS + 1];
+    __m512i b[MH_VAES_REGS];
+    __m512i ctr;
+    __m128i ctr128;
+
+    if (blocks < MH_VAES_BLOCKS) {
+        ctrCryptAesni(key, words, counter, src, dst, blocks);
+        return;
+    }
+
+    for (int r = 0; r <= MH_AES_128_ROUNDS; r++) {
+        rk[r] = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i*)(key + r * MH_AES_BLOCK_SIZE)));
+    }
+
+    /* Byte-reversed counters of 4 consecutive blocks */
+    ctr = _mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)counter)), reverse);
+    ctr = _mm512_add_epi64(ctr, _mm512_set_epi64(0, 3, 0, 2, 0, 1, 0, 0));
+
+    for (; blocks >= MH_VAES_BLOCKS; blocks -= MH_VAES_BLOCKS) {
+        for (int j = 0; j < MH_VAES_REGS; j++) {
+            b[j] = _mm512_xor_si512(_mm512_shuffle_epi8(ctr, reverse), rk[0]);
+            ctr = _mm512_add_epi64(ctr, step);
+        }
+        for (int r = 1; r < MH_AES_128_ROUNDS; r++) {
+            for (int j = 0; j < MH_VAES_REGS; j++) {
+                b[j] = _mm512_aesenc_epi128(b[j], rk[r]);
+            }
+        }
+        for (int j = 0; j < MH_VAES_REGS; j++) {
+            b[j] = _mm512_aesenclast_epi128(b[j], rk[MH_AES_128_ROUNDS]);
+            b[j] = _mm512_xor_si512(b[j], _mm512_loadu_si512((const void*)(src + j * 64)));
+            _mm512_storeu_si512((void*)(dst + j * 64), b[j]);
+        }
+
+        src += MH_VAES_BLOCKS * MH_AES_BLOCK_SIZE;
+        dst += MH_VAES_BLOCKS * MH_AES_BLOCK_SIZE;
+    }
+
+    /* The lowest block holds the counter of the next block. */
+    ctr128 = _mm_shuffle_epi8(_mm512_castsi512_si128(ctr), _mm512_castsi512_si128(reverse));
+    _mm_storeu_si128((__m128i*)counter, ctr128);
+    ctrCryptAesni(key, words, counter, src, dst, blocks);
+}
+
+#if !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif /* MH_AES_VAES */
+
+void detectCpu() {
+#ifdef MH_AES_AESNI
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+        return;
+    }
+    /* AES-NI : CPUID.1:ECX[25], SSSE3 : CPUID.1:ECX[9] */
+    sAesniSupported = ((ecx & (1U << 25)) != 0) && ((ecx & (1U << 9)) != 0);
+
+#ifdef MH_AES_VAES
+    /* The OS must save the AVX-512 state : OSXSAVE (CPUID.1:ECX[27]) and XCR0 bits 1,2,5,6,7 */
+    if (!sAesniSupported || ((ecx & (1U << 27)) == 0) || (__get_cpuid_max(0, NULL) < 7)) {
+        return;
+    }
+    uint32_t xcr0_lo = 0, xcr0_hi = 0;
+    __asm__ __volatile__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0xe6) != 0xe6) {
+        return;
+    }
+    /* AVX512F : CPUID.7:EBX[16], AVX512BW : CPUID.7:EBX[30], VAES : CPUID.7:ECX[9] */
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    sVaesSupported = ((ebx & (1U << 16)) != 0) && ((ebx & (1U << 30)) != 0) && ((ecx & (1U << 9)) != 0);
+#endif
+#endif
+}
+
+bool selectKernel(MarlinAesCipher::Implementation impl) {
+    switch (impl) {
+    case MarlinAesCipher::IMPL_PORTABLE:
+        sCbcKernel = cbcDecryptPortable;
+        sCtrKernel = ctrCryptPortable;
+        break;
+#ifdef MH_AES_AESNI
+    case MarlinAesCipher::IMPL_AESNI:
+        if (!sAesniSupported) {
+            return false;
+        }
+        sCbcKernel = cbcDecryptAesni;
+        sCtrKernel = ctrCryptAesni;
+        break;
+#endif
+#ifdef MH_AES_VAES
+    case MarlinAesCipher::IMPL_VAES:
+        if (!sVaesSupported) {
+            return false;
+        }
+        sCbcKernel = cbcDecryptVaes;
+        sCtrKernel = ctrCryptVaes;
+        break;
+#endif
+    default:
+        return false;
+    }
+    sImpl = impl;
+    return true;
+}
+
+void initialize() {
+    uint8_t p = 1;
+    uint8_t q = 1;
+
+    /* S-box from the multiplicative inverse : p runs over the field by 3, q by 1/3. */
+    do {
+        p = p ^ xtime(p);
+        q ^= (uint8_t)(q << 1);
+        q ^= (uint8_t)(q << 2);
+        q ^= (uint8_t)(q << 4);
+        if (q & 0x80) {
+            q ^= 0x09;
+        }
+        sSbox[p] = q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4) ^ 0x63;
+    } while (p != 1);
+    sSbox[0] = 0x63;
+
+    for (int i = 0; i < 256; i++) {
+        sInvSbox[sSbox[i]] = (uint8_t)i;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        uint8_t s = sSbox[i];
+        uint8_t si = sInvSbox[i];
+        uint32_t te = ((uint32_t)xtime(s) << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) | (uint32_t)(xtime(s) ^ s);
+        uint32_t td = ((uint32_t)gmul(si, 14) << 24) | ((uint32_t)gmul(si, 9) << 16) |
+                      ((uint32_t)gmul(si, 13) << 8) | (uint32_t)gmul(si, 11);
+        for (int k = 0; k < 4; k++) {
+            sTe[k][i] = rotr32(te, 8 * k);
+            sTd[k][i] = rotr32(td, 8 * k);
+        }
+    }
+
+    detectCpu();
+    if (!selectKernel(MarlinAesCipher::IMPL_VAES) && !selectKernel(MarlinAesCipher::IMPL_AESNI)) {
+        selectKernel(MarlinAesCipher::IMPL_PORTABLE);
+    }
+}
+
+} // namespace
+
+MarlinAesCipher::MarlinAesCipher()
+{
+    pthread_once(&sOnce, initialize);
+    memset(mEncKey, 0, sizeof(mEncKey));
+    memset(mDecKey, 0, sizeof(mDecKey));
+    memset(mEncWords, 0, sizeof(mEncWords));
+    memset(mDecWords, 0, sizeof(mDecWords));
+}
+
+MarlinAesCipher::~MarlinAesCipher()
+{
+    /* Do not leave the key schedule in the memory. */
+    secureZero(mEncKey, sizeof(mEncKey));
+    secureZero(mDecKey, sizeof(mDecKey));
+    secureZero(mEncWords, sizeof(mEncWords));
+    secureZero(mDecWords, sizeof(mDecWords));
+}
+
+void MarlinAesCipher::setKey(const uint8_t* i_key)
+{
+    const int words = (MH_AES_128_ROUNDS + 1) * 4;
+    uint8_t rcon = 0x01;
+
+    for (int i = 0; i < 4; i++) {
+        mEncWords[i] = getU32(i_key + 4 * i);
+    }
+    for (int i = 4; i < words; i++) {
+        uint32_t t = mEncWords[i - 1];
+        if ((i % 4) == 0) {
+            /* SubWord(RotWord(t)) ^ Rcon */
+            t = ((uint32_t)sSbox[(t >> 16) & 0xff] << 24) | ((uint32_t)sSbox[(t >> 8) & 0xff] << 16) |
+                ((uint32_t)sSbox[t & 0xff] << 8) | (uint32_t)sSbox[t >> 24];
+            t ^= (uint32_t)rcon << 24;
+            rcon = xtime(rcon);
+        }
+        mEncWords[i] = mEncWords[i - 4] ^ t;
+    }
+
+    /* Equivalent inverse cipher : reversed round keys, InvMixColumns applied to the inner rounds. */
+    for (int r = 0; r <= MH_AES_128_ROUNDS; r++) {
+        for (int c = 0; c < 4; c++) {
+            uint32_t w = mEncWords[4 * (MH_AES_128_ROUNDS - r) + c];
+            if ((r > 0) && (r < MH_AES_128_ROUNDS)) {
+                uint8_t b0 = (uint8_t)(w >> 24), b1 = (uint8_t)(w >> 16), b2 = (uint8_t)(w >> 8), b3 = (uint8_t)w;
+                w = ((uint32_t)(gmul(b0, 14) ^ gmul(b1, 11) ^ gmul(b2, 13) ^ gmul(b3, 9)) << 24) |
+                    ((uint32_t)(gmul(b0, 9) ^ gmul(b1, 14) ^ gmul(b2, 11) ^ gmul(b3, 13)) << 16) |
+                    ((uint32_t)(gmul(b0, 13) ^ gmul(b1, 9) ^ gmul(b2, 14) ^ gmul(b3, 11)) << 8) |
+                    (uint32_t)(gmul(b0, 11) ^ gmul(b1, 13) ^ gmul(b2, 9) ^ gmul(b3, 14));
+            }
+            mDecWords[4 * r + c] = w;
+        }
+    }
+
+    for (int i = 0; i < words; i++) {
+        putU32(&mEncKey[4 * i], mEncWords[i]);
+        putU32(&mDecKey[4 * i], mDecWords[i]);
+    }
+}
+
+void MarlinAesCipher::decryptCbc(uint8_t* io_iv, const uint8_t* i_src, uint8_t* o_dst, size_t i_blocks) const
+{
+    sCbcKernel(mDecKey, mDecWords, io_iv, i_src, o_dst, i_blocks);
+}
+
+void MarlinAesCipher::cryptCtr(uint8_t* io_counter, const uint8_t* i_src, uint8_t* o_dst, size_t i_blocks) const
+{
+    sCtrKernel(mEncKey, mEncWords, io_counter, i_src, o_dst, i_blocks);
+}
+
+void MarlinAesCipher::keyStreamCtr(uint8_t* io_counter, uint8_t* o_key_stream) const
+{
+    encryptBlockPortable(mEncWords, io_counter, o_key_stream);
+    incrementCounter(io_counter);
+}
+
+MarlinAesCipher::Implementation MarlinAesCipher::getImplementation(void)
+{
+    pthread_once(&sOnce, initialize);
+    return sImpl;
+}
+
+bool MarlinAesCipher::setImplementation(Implementation i_impl)
+{
+    pthread_once(&sOnce, initialize);
+    return selectKernel(i_impl);
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -14,11 +14,179 @@
  * limitations under the License.
  */
 
+#include <pthread.h>
+#include <cstring>
+
 #include "MarlinAgentHandler.h"
+#include "MarlinAesCipher.h"
 
 
 using namespace marlincdm;
 
+namespace {
+
+/* Agent handle of initAgent() until the call of Marlin DRM Agent replaces it, so that the software decryption works alone */
+uint8_t sSoftwareAgent;
+
+/* Key context handle of openKeyContext() */
+struct AgentKeyContext {
+    MarlinAesCipher *cipher; // software decryption (NULL : decrypted by Marlin DRM Agent)
+    MH_cipherMode mode;
+    uint8_t iv[MH_CONTENT_IV_SIZE];
+};
+
+/* Stream context handle of openStreamContext() */
+struct AgentStreamContext {
+    const AgentKeyContext *key;
+    uint8_t chain[MH_AES_BLOCK_SIZE]; // IV of the next block (CBC) or counter block (CTR)
+    uint8_t keyStream[MH_AES_BLOCK_SIZE]; // CTR : key stream of the partial block at the end of the last chunk
+    size_t keyStreamUsed;
+    uint8_t pending[MH_AES_BLOCK_SIZE]; // CBC : partial block at the end of the last chunk
+    size_t pendingLen;
+};
+
+/* Output buffer of the software decryption allocated by the agent. (see MH_buffer_t) */
+struct OutputBuffer {
+    uint8_t *data;
+    size_t size;
+};
+
+pthread_key_t sOutputBufferKey;
+pthread_once_t sOutputBufferOnce = PTHREAD_ONCE_INIT;
+
+void freeOutputBuffer(void* arg)
+{
+    OutputBuffer* buffer = static_cast<OutputBuffer*>(arg);
+    delete [] buffer->data;
+    delete buffer;
+}
+
+void createOutputBufferKey(void)
+{
+    pthread_key_create(&sOutputBufferKey, freeOutputBuffer);
+}
+
+/* One buffer per thread, valid until the next decryption into an agent buffer on the same thread. */
+uint8_t* getOutputBuffer(size_t size)
+{
+    pthread_once(&sOutputBufferOnce, createOutputBufferKey);
+
+    OutputBuffer* buffer = static_cast<OutputBuffer*>(pthread_getspecific(sOutputBufferKey));
+    if (buffer == NULL) {
+        buffer = new OutputBuffer();
+        buffer->data = NULL;
+        buffer->size = 0;
+        pthread_setspecific(sOutputBufferKey, buffer);
+    }
+    if (buffer->size < size) {
+        delete [] buffer->data;
+        buffer->data = new uint8_t[size];
+        buffer->size = size;
+    }
+    return buffer->data;
+}
+
+MH_status_t prepareOutputBuffer(MH_buffer_t* i_src_ptr, MH_buffer_t* o_dst_ptr)
+{
+    if (o_dst_ptr->data == NULL) {
+        o_dst_ptr->data = getOutputBuffer((i_src_ptr->len > 0) ? i_src_ptr->len : 1);
+        o_dst_ptr->fd = -1;
+        o_dst_ptr->offset = 0;
+    } else if ((o_dst_ptr->data != i_src_ptr->data) && (o_dst_ptr->len < i_src_ptr->len)) {
+        return MH_ERR_TOO_SMALL_BUFFER;
+    }
+    o_dst_ptr->len = i_src_ptr->len;
+    return MH_ERR_OK;
+}
+
+/* Decrypt one encrypted range. chain and key stream continue over the encrypted ranges of a sample. */
+void decryptRange(const AgentKeyContext* context, uint8_t* chain, uint8_t* key_stream, size_t* key_stream_used,
+                  const uint8_t* src, uint8_t* dst, size_t len)
+{
+    size_t done = 0;
+
+    if (context->mode == CIPHER_MODE_AES_128_CBC) {
+        size_t blocks = len / MH_AES_BLOCK_SIZE;
+        context->cipher->decryptCbc(chain, src, dst, blocks);
+        done = blocks * MH_AES_BLOCK_SIZE;
+        if ((done < len) && (src != dst)) {
+            memmove(dst + done, src + done, len - done);
+        }
+        return;
+    }
+
+    /* CTR : the rest of the key stream of the previous range first */
+    for (; (done < len) && (*key_stream_used < MH_AES_BLOCK_SIZE); done++) {
+        dst[done] = src[done] ^ key_stream[(*key_stream_used)++];
+    }
+    size_t blocks = (len - done) / MH_AES_BLOCK_SIZE;
+    context->cipher->cryptCtr(chain, src + done, dst + done, blocks);
+    done += blocks * MH_AES_BLOCK_SIZE;
+    if (done < len) {
+        context->cipher->keyStreamCtr(chain, key_stream);
+        *key_stream_used = 0;
+        for (; done < len; done++) {
+            dst[done] = src[done] ^ key_stream[(*key_stream_used)++];
+        }
+    }
+}
+
+MH_status_t decryptSoftware(const AgentKeyContext* context,
+                            const MH_subsample_t* i_subsamples,
+                            uint32_t i_subsample_num,
+                            MH_buffer_t* i_src_ptr,
+                            MH_buffer_t* o_dst_ptr)
+{
+    MH_status_t retCode = MH_ERR_OK;
+    uint8_t chain[MH_AES_BLOCK_SIZE];
+    uint8_t key_stream[MH_AES_BLOCK_SIZE];
+    size_t key_stream_used = MH_AES_BLOCK_SIZE;
+    size_t total = 0;
+
+    if ((i_src_ptr == NULL) || (o_dst_ptr == NULL) || ((i_src_ptr->data == NULL) && (i_src_ptr->len > 0))) {
+        return MH_ERR_FAILURE;
+    }
+    for (uint32_t i = 0; i < i_subsample_num; i++) {
+        total += (size_t)i_subsamples[i].clear_bytes + i_subsamples[i].encrypted_bytes;
+    }
+    if ((i_subsamples != NULL) && (total != i_src_ptr->len)) {
+        return MH_ERR_FAILURE;
+    }
+
+    retCode = prepareOutputBuffer(i_src_ptr, o_dst_ptr);
+    if (retCode != MH_ERR_OK) {
+        return retCode;
+    }
+
+    const uint8_t* src = i_src_ptr->data;
+    uint8_t* dst = o_dst_ptr->data;
+    memcpy(chain, context->iv, MH_AES_BLOCK_SIZE);
+
+    if (i_subsamples == NULL) {
+        decryptRange(context, chain, key_stream, &key_stream_used, src, dst, i_src_ptr->len);
+        return MH_ERR_OK;
+    }
+
+    for (uint32_t i = 0; i < i_subsample_num; i++) {
+        if (src != dst) {
+            memmove(dst, src, i_subsamples[i].clear_bytes);
+        }
+        src += i_subsamples[i].clear_bytes;
+        dst += i_subsamples[i].clear_bytes;
+        decryptRange(context, chain, key_stream, &key_stream_used, src, dst, i_subsamples[i].encrypted_bytes);
+        src += i_subsamples[i].encrypted_bytes;
+        dst += i_subsamples[i].encrypted_bytes;
+    }
+
+    return MH_ERR_OK;
+}
+
+} // namespace
+
+/* The content keys are shared by all handlers, e.g. of AgentHandlerPool, like the license store of the agent. */
+vector<MarlinAgentHandler::ContentKey> MarlinAgentHandler::sContentKeys;
+CMutex MarlinAgentHandler::sContentKeyMutex;
+
 MarlinAgentHandler::MarlinAgentHandler()
 {
     /* Add marlin agent specific call if needed */
@@ -87,6 +255,11 @@ MH_status_t MarlinAgentHandler::initAgent(MH_agentHandle_t* o_handle)
 {
     MH_status_t retCode = MH_ERR_OK;
 
+    if (o_handle == NULL) {
+        return MH_ERR_FAILURE;
+    }
+    *o_handle = &sSoftwareAgent;
+
     /* Add marlin agent specific call if needed */
 
     return retCode;
@@ -104,6 +277,36 @@ MH_status_t MarlinAgentHandler::finAgent(MH_agentHandle_t i_handle)
 MH_status_t MarlinAgentHandler::checkKeyExist(MH_keyIdInfo_t* i_parameter, bool* o_is_key_exist)
 {
     MH_status_t retCode = MH_ERR_OK;
+    MH_contentKey_t content_key;
+
+    if ((i_parameter != NULL) && (o_is_key_exist != NULL) && findContentKey(i_parameter, &content_key)) {
+        memset(&content_key, 0, sizeof(MH_contentKey_t));
+        *o_is_key_exist = true;
+        return retCode;
+    }
+
+    /* Add marlin agent specific call if needed */
+
+    return retCode;
+}
+
+MH_status_t MarlinAgentHandler::checkKeyExistBatch(MH_keyIdInfo_t* i_parameters,
+                                                   uint32_t i_num,
+                                                   bool* o_is_key_exist)
+{
+    MH_status_t retCode = MH_ERR_OK;
+
+    if (((i_parameters == NULL) || (o_is_key_exist == NULL)) && (i_num > 0)) {
+        return MH_ERR_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < i_num; i++) {
+        o_is_key_exist[i] = false;
+        retCode = checkKeyExist(&i_parameters[i], &o_is_key_exist[i]);
+        if (retCode != MH_ERR_OK) {
+            return retCode;
+        }
+    }
 
     /* Add marlin agent specific call if needed */
 
@@ -177,12 +380,370 @@ MH_status_t MarlinAgentHandler::decrypt(MH_keyIdInfo_t* i_parameter,
                                         MH_buffer_t* o_dst_ptr)
 {
     MH_status_t retCode = MH_ERR_OK;
+    MH_keyHandle_t key_handle = NULL;
+    MH_contentKey_t content_key;
+
+    if ((i_parameter != NULL) && findContentKey(i_parameter, &content_key)) {
+        memset(&content_key, 0, sizeof(MH_contentKey_t));
+        retCode = openKeyContext(NULL, i_parameter, &key_handle);
+        if (retCode == MH_ERR_OK) {
+            retCode = decryptWithKey(key_handle, NULL, 0, i_src_ptr, o_dst_ptr);
+            closeKeyContext(key_handle);
+        }
+        return retCode;
+    }
 
     /* Add marlin agent specific call if needed */
 
     return retCode;
 }
 
+MH_status_t MarlinAgentHandler::decrypt(MH_keyIdInfo_t* i_parameter,
+                                        const MH_subsample_t* i_subsamples,
+                                        uint32_t i_subsample_num,
+                                        MH_buffer_t* i_src_ptr,
+                                        MH_buffer_t* o_dst_ptr)
+{
+    MH_status_t retCode = MH_ERR_OK;
+    MH_keyHandle_t key_handle = NULL;
+    MH_contentKey_t content_key;
+
+    if ((i_parameter != NULL) && findContentKey(i_parameter, &content_key)) {
+        memset(&content_key, 0, sizeof(MH_contentKey_t));
+        retCode = openKeyContext(NULL, i_parameter, &key_handle);
+        if (retCode == MH_ERR_OK) {
+            retCode = decryptWithKey(key_handle, i_subsamples, i_subsample_num, i_src_ptr, o_dst_ptr);
+            closeKeyContext(key_handle);
+        }
+        return retCode;
+    }
+
+    /* Add marlin agent specific call if needed */
+
+    return retCode;
+}
+
+MH_status_t MarlinAgentHandler::decryptBatch(MH_keyIdInfo_t* i_parameter,
+                                             MH_sample_t* io_samples,
+                                             uint32_t i_sample_num)
+{
+    MH_status_t retCode = MH_ERR_OK;
+    MH_keyHandle_t key_handle = NULL;
+    MH_contentKey_t content_key;
+
+    if ((i_parameter != NULL) && findContentKey(i_parameter, &content_key)) {
+        memset(&content_key, 0, sizeof(MH_contentKey_t));
+        retCode = openKeyContext(NULL, i_parameter, &key_handle);
+        if (retCode == MH_ERR_OK) {
+            retCode = decryptBatchWithKey(key_handle, io_samples, i_sample_num);
+            closeKeyContext(key_handle);
+        }
+        return retCode;
+    }
+
+    /* Add marlin agent specific call if needed */
+
+    return retCode;
+}
+
+MH_status_t MarlinAgentHandler::openKeyContext(MH_agentHandle_t i_handle,
+                                               MH_keyIdInfo_t* i_parameter,
+                                               MH_keyHandle_t* o_key_handle)
+{
+    MH_status_t retCode = MH_ERR_OK;
+    MH_contentKey_t content_key;
+    AgentKeyContext* context = NULL;
+
+    if ((i_parameter == NULL) || (o_key_handle == NULL)) {
+        return MH_ERR_FAILURE;
+    }
+
+    context = new AgentKeyContext();
+    memset(context, 0, sizeof(AgentKeyContext));
+
+    if (findContentKey(i_parameter, &content_key)) {
+        context->cipher = new MarlinAesCipher();
+        context->cipher->setKey(content_key.key);
+        context->mode = content_key.mode;
+        memcpy(context->iv, content_key.iv, MH_CONTENT_IV_SIZE);
+        memset(&content_key, 0, sizeof(MH_contentKey_t));
+    } else {
+        /* Add marlin agent specific call if needed */
+    }
+
+    *o_key_handle = context;
+    return retCode;
+}
+
+MH_status_t MarlinAgentHandler::closeKeyContext(MH_keyHandle_t i_key_handle)
+{
+    MH_status_t retCode = MH_ERR_OK;
+    AgentKeyContext* context = static_cast<AgentKeyContext*>(i_key_handle);
+
+    if (context == NULL) {
+        return MH_ERR_FAILURE;
+    }
+
+    if (context->cipher == NULL) {
+        /* Add marlin agent specific call if needed */
+    }
+
+    delete context->cipher;
+    delete context;
+    return retCode;
+}
+
+MH_status_t MarlinAgentHandler::decryptWithKey(MH_keyHandle_t i_key_handle,
+                                               const MH_subsample_t* i_subsamples,
+                                               uint32_t i_subsample_num,
+                                               MH_buffer_t* i_src_ptr,
+                                               MH_buffer_t* o_dst_ptr)
+{
+    MH_status_t retCode = MH_ERR_OK;
+    const AgentKeyContext* context = static_cast<const AgentKeyContext*>(i_key_handle);
+
+    if (context == NULL) {
+        return MH_ERR_FAILURE;
+    }
+
+    if (context->cipher != NULL) {
+        return decryptSoftware(context, i_subsamples, i_subsample_num, i_src_ptr, o_dst_ptr);
+    }
+
+    /* Add marlin agent specific call if needed */
+
+    return retCode;
+}
+
+MH_status_t MarlinAgentHandler::decryptBatchWithKey(MH_keyHandle_t i_key_handle,
+                                                    MH_sample_t* io_samples,
+                                                    uint32_t i_sample_num)
+{
+    MH_status_t retCode = MH_ERR_OK;
+    const AgentKeyContext* context = static_cast<const AgentKeyContext*>(i_key_handle);
+
+    if ((context == NULL) || ((io_samples == NULL) && (i_sample_num > 0))) {
+        return MH_ERR_FAILURE;
+    }
+
+    if (context->cipher != NULL) {
+        for (uint32_t i = 0; (i < i_sample_num) && (retCode == MH_ERR_OK); i++) {
+            retCode = decryptSoftware(context, io_samples[i].subsamples, io_samples[i].subsample_num,
+                                      &io_samples[i].src, &io_samples[i].dst);
+        }
+        return retCode;
+    }
+
+    /* Add marlin agent specific call if needed */
+
+    return retCode;
+}
+
+MH_status_t MarlinAgentHandler::decryptBatchWithKey(MH_keyHandle_t i_key_handle,
+                                                    MH_keyParity i_parity,
+                                                    MH_sample_t* io_samples,
+                                                    uint32_t i_sample_num)
+{
+    MH_status_t retCode = MH_ERR_OK;
+    const AgentKeyContext* context = static_cast<const AgentKeyContext*>(i_key_handle);
+
+    if ((context == NULL) || ((i_parity != KEY_PARITY_EVEN) && (i_parity != KEY_PARITY_ODD))) {
+        return MH_ERR_FAILURE;
+    }
+
+    if (context->cipher != NULL) {
+        /* One content key is provisioned per KeyID information, it serves both parities. */
+        return decryptBatchWithKey(i_key_handle, io_samples, i_sample_num);
+    }
+
+    /* Add marlin agent specific call if needed */
+
+    return retCode;
+}
+
+MH_status_t MarlinAgentHandler::openStreamContext(MH_keyHandle_t i_key_handle,
+                                                  const uint8_t* i_iv,
+                                                  MH_streamHandle_t* o_stream_handle)
+{
+    MH_status_t retCode = MH_ERR_OK;
+    const AgentKeyContext* key = static_cast<const AgentKeyContext*>(i_key_handle);
+    AgentStreamContext* context = NULL;
+
+    if ((key == NULL) || (o_stream_handle == NULL)) {
+        return MH_ERR_FAILURE;
+    }
+
+    context = new AgentStreamContext();
+    memset(context, 0, sizeof(AgentStreamContext));
+    context->key = key;
+    context->keyStreamUsed = MH_AES_BLOCK_SIZE;
+    memcpy(context->chain, (i_iv != NULL) ? i_iv : key->iv, MH_AES_BLOCK_SIZE);
+
+    if (key->cipher == NULL) {
+        /* Add marlin agent specific call if needed */
+    }
+
+    *o_stream_handle = context;
+    return retCode;
+}
+
+MH_status_t MarlinAgentHandler::decryptStream(MH_streamHandle_t i_stream_handle,
+                                              MH_buffer_t* i_src_ptr,
+                                              bool i_last,
+                                              MH_buffer_t* o_dst_ptr)
+{
+    MH_status_t retCode = MH_ERR_OK;
+    AgentStreamContext* context = static_cast<AgentStreamContext*>(i_stream_handle);
+
+    if ((context == NULL) || (i_src_ptr == NULL) || (o_dst_ptr == NULL) ||
+        ((i_src_ptr->data == NULL) && (i_src_ptr->len > 0)) || (o_dst_ptr->data == NULL)) {
+        return MH_ERR_FAILURE;
+    }
+
+    if (context->key->cipher == NULL) {
+        /* Add marlin agent specific call if needed */
+        return retCode;
+    }
+
+    const MarlinAesCipher* cipher = context->key->cipher;
+    const uint8_t* src = i_src_ptr->data;
+    size_t len = i_src_ptr->len;
+    uint8_t* dst = o_dst_ptr->data;
+
+    if (context->key->mode != CIPHER_MODE_AES_128_CBC) {
+        /* CTR : the key stream continues from the last chunk. */
+        if (o_dst_ptr->len < len) {
+            return MH_ERR_TOO_SMALL_BUFFER;
+        }
+        decryptRange(context->key, context->chain, context->keyStream, &context->keyStreamUsed, src, dst, len);
+        o_dst_ptr->len = len;
+        return MH_ERR_OK;
+    }
+
+    /* CBC : only whole blocks are decrypted, and the partial block is held for the next chunk. */
+    size_t out = ((context->pendingLen + len) / MH_AES_BLOCK_SIZE) * MH_AES_BLOCK_SIZE;
+    if (i_last) {
+        out = context->pendingLen + len;
+    }
+    if (o_dst_ptr->len < out) {
+        return MH_ERR_TOO_SMALL_BUFFER;
+    }
+    if ((context->pendingLen > 0) && (context->pendingLen + len >= MH_AES_BLOCK_SIZE)) {
+        size_t fill = MH_AES_BLOCK_SIZE - context->pendingLen;
+        memcpy(context->pending + context->pendingLen, src, fill);
+        cipher->decryptCbc(context->chain, context->pending, dst, 1);
+        context->pendingLen = 0;
+        src += fill;
+        len -= fill;
+        dst += MH_AES_BLOCK_SIZE;
+    }
+    size_t blocks = (context->pendingLen > 0) ? 0 : len / MH_AES_BLOCK_SIZE;
+    cipher->decryptCbc(context->chain, src, dst, blocks);
+    src += blocks * MH_AES_BLOCK_SIZE;
+    len -= blocks * MH_AES_BLOCK_SIZE;
+    dst += blocks * MH_AES_BLOCK_SIZE;
+    memcpy(context->pending + context->pendingLen, src, len);
+    context->pendingLen += len;
+    if (i_last) {
+        /* A trailing partial block is clear. */
+        memcpy(dst, context->pending, context->pendingLen);
+        context->pendingLen = 0;
+    }
+
+    o_dst_ptr->len = out;
+    return MH_ERR_OK;
+}
+
+MH_status_t MarlinAgentHandler::closeStreamContext(MH_streamHandle_t i_stream_handle)
+{
+    MH_status_t retCode = MH_ERR_OK;
+    AgentStreamContext* context = static_cast<AgentStreamContext*>(i_stream_handle);
+
+    if (context == NULL) {
+        return MH_ERR_FAILURE;
+    }
+
+    if (context->key->cipher == NULL) {
+        /* Add marlin agent specific call if needed */
+    }
+
+    memset(context, 0, sizeof(AgentStreamContext));
+    delete context;
+    return retCode;
+}
+
+MH_status_t MarlinAgentHandler::setContentKey(MH_keyIdInfo_t* i_parameter, MH_contentKey_t* i_key)
+{
+    MH_status_t retCode = MH_ERR_OK;
+
+    if ((i_parameter == NULL) || (i_key == NULL) || ((i_parameter->data == NULL) && (i_parameter->length > 0)) ||
+        ((i_key->mode != CIPHER_MODE_AES_128_CBC) && (i_key->mode != CIPHER_MODE_AES_128_CTR))) {
+        return MH_ERR_FAILURE;
+    }
+
+    ContentKey entry;
+    entry.type = i_parameter->type;
+    entry.kid.assign(i_parameter->data, i_parameter->data + i_parameter->length);
+    entry.key = *i_key;
+
+    sContentKeyMutex.lock();
+    vector<ContentKey>::iterator it = sContentKeys.begin();
+    for (; it != sContentKeys.end(); ++it) {
+        if ((it->type == entry.type) && (it->kid == entry.kid)) {
+            it->key = entry.key;
+            break;
+        }
+    }
+    if (it == sContentKeys.end()) {
+        sContentKeys.push_back(entry);
+    }
+    sContentKeyMutex.unlock();
+
+    memset(&entry.key, 0, sizeof(MH_contentKey_t));
+    return retCode;
+}
+
+MH_status_t MarlinAgentHandler::removeContentKey(MH_keyIdInfo_t* i_parameter)
+{
+    MH_status_t retCode = MH_ERR_FAILURE;
+
+    if ((i_parameter == NULL) || ((i_parameter->data == NULL) && (i_parameter->length > 0))) {
+        return MH_ERR_FAILURE;
+    }
+
+    sContentKeyMutex.lock();
+    for (vector<ContentKey>::iterator it = sContentKeys.begin(); it != sContentKeys.end(); ++it) {
+        if ((it->type == i_parameter->type) && (it->kid.size() == i_parameter->length) &&
+            ((i_parameter->length == 0) || (memcmp(&it->kid[0], i_parameter->data, i_parameter->length) == 0))) {
+            memset(&it->key, 0, sizeof(MH_contentKey_t));
+            sContentKeys.erase(it);
+            retCode = MH_ERR_OK;
+            break;
+        }
+    }
+    sContentKeyMutex.unlock();
+
+    return retCode;
+}
+
+bool MarlinAgentHandler::findContentKey(const MH_keyIdInfo_t* i_parameter, MH_contentKey_t* o_key)
+{
+    bool found = false;
+
+    sContentKeyMutex.lock();
+    for (vector<ContentKey>::iterator it = sContentKeys.begin(); it != sContentKeys.end(); ++it) {
+        if ((it->type == i_parameter->type) && (it->kid.size() == i_parameter->length) &&
+            ((i_parameter->length == 0) || (memcmp(&it->kid[0], i_parameter->data, i_parameter->length) == 0))) {
+            *o_key = it->key;
+            found = true;
+            break;
+        }
+    }
+    sContentKeyMutex.unlock();
+
+    return found;
+}
+
 
 
 /*
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __AGENT_HANDLER_POOL_H__
+#define __AGENT_HANDLER_POOL_H__
+
+#include "CAtomic.h"
+#include "MarlinAgentHandler.h"
+
+/* Number of agent handlers owned by the engine, each with its own handle of initAgent() */
+#ifndef MCDM_AGENT_HANDLER_NUM
+#define MCDM_AGENT_HANDLER_NUM 1
+#endif
+
+/* Maximum number of agent handlers */
+#define MCDM_AGENT_HANDLER_MAX 16
+
+namespace marlincdm {
+
+/**
+ * Agent handlers of the engine.
+ *
+ * The first one is the primary agent, which takes the calls for the state of the whole agent:
+ * the reference count of the engine and the key releases. A session is bound to the agent which
+ * has the fewest sessions when it is opened, and all calls of the session go to that agent.
+ * Calls with no session, e.g. decryption, go to the agent with the fewest calls running.
+ *
+ * The agent must share its licenses between its handles, as the licenses added by a session are
+ * used by all agents.
+ */
+class AgentHandlerPool {
+private:
+    struct Agent {
+        MarlinAgentHandler *handler;
+        MH_agentHandle_t handle;
+        volatile uint32_t load; // calls running on the agent
+        volatile uint32_t sessions; // IPTV-ES handles initialized on the agent
+        uint8_t pad[MCDM_CACHE_LINE_SIZE];
+    };
+
+    Agent mAgents[MCDM_AGENT_HANDLER_MAX];
+    uint32_t mNum;
+
+    AgentHandlerPool(const AgentHandlerPool &o);
+    AgentHandlerPool& operator=(const AgentHandlerPool &o);
+
+public:
+    /**
+     * Create agent_num agents. An agent other than the primary one is dropped when initAgent() fails.
+     * The handle of the primary agent is NULL when its initAgent() fails.
+     */
+    explicit AgentHandlerPool(uint32_t agent_num);
+
+    /**
+     * finAgent() is called for each agent.
+     */
+    virtual ~AgentHandlerPool();
+
+    uint32_t size();
+
+    MarlinAgentHandler* handler(uint32_t index);
+
+    MH_agentHandle_t handle(uint32_t index);
+
+    /**
+     * Bind a new IPTV-ES handle to the agent with the fewest of them. It is given back by unassign().
+     */
+    uint32_t assign();
+
+    void unassign(uint32_t index);
+
+    /**
+     * Get the agent with the fewest calls running. The primary agent is taken when the agents are equal.
+     */
+    uint32_t select();
+
+    /**
+     * Count a call running on the agent, until leave() is called.
+     */
+    void enter(uint32_t index);
+
+    void leave(uint32_t index);
+
+};  //class
+};  //namespace
+
+#endif /* __AGENT_HANDLER_POOL_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
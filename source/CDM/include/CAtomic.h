@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MARLIN_CATOMIC_H__
+#define __MARLIN_CATOMIC_H__
+
+#include <stdint.h>
+
+/* Size of a cache line. Values written by different threads are kept on different lines. */
+#ifndef MCDM_CACHE_LINE_SIZE
+#define MCDM_CACHE_LINE_SIZE 64
+#endif
+
+namespace marlincdm {
+
+/**
+ * Atomic operations on integers and pointers.
+ * All operations are full memory barriers.
+ */
+
+/**
+ * Add value and return the new value.
+ */
+template <typename T>
+inline T atomicAdd(volatile T* ptr, T value) {
+  return __sync_add_and_fetch(ptr, value);
+}
+
+/**
+ * Subtract value and return the new value.
+ */
+template <typename T>
+inline T atomicSub(volatile T* ptr, T value) {
+  return __sync_sub_and_fetch(ptr, value);
+}
+
+template <typename T>
+inline T atomicLoad(volatile T* ptr) {
+  return __sync_fetch_and_add(ptr, (T)0);
+}
+
+template <typename T>
+inline void atomicStore(volatile T* ptr, T value) {
+  __sync_synchronize();
+  __sync_lock_test_and_set(ptr, value);
+}
+
+/**
+ * Load with acquire ordering. Unlike atomicLoad(), it does not write the cache line,
+ * so that a reader does not slow down the writer of the value.
+ */
+template <typename T>
+inline T atomicLoadAcquire(volatile T* ptr) {
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Store with release ordering. Writes before it are visible to a thread which loads the value by atomicLoadAcquire().
+ */
+template <typename T>
+inline void atomicStoreRelease(volatile T* ptr, T value) {
+  __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+/**
+ * Store new_value when the current value is expected.
+ *
+ * @return true when new_value is stored
+ */
+template <typename T>
+inline bool atomicCompareAndSwap(volatile T* ptr, T expected, T new_value) {
+  return __sync_bool_compare_and_swap(ptr, expected, new_value);
+}
+
+} // namespace marlincdm
+
+#endif /* __MARLIN_CATOMIC_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
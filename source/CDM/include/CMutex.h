@@ -24,6 +24,8 @@
 
 namespace marlincdm {
 
+class CCondition;
+
 class CMutex {
 public:
   CMutex();
@@ -52,11 +54,82 @@ public:
   int32_t tryLock();
 
 private:
+  friend class CCondition;
   CMutex(const CMutex&);
   CMutex& operator =(const CMutex&);
   pthread_mutex_t mMutex;
 };
 
+class CCondition {
+public:
+  CCondition();
+  ~CCondition();
+
+  /**
+   * Release the lock and wait for signal() or broadcast(). The lock is held again on return.
+   *
+   * @param mutex Lock held by the caller
+   */
+  void wait(CMutex& mutex);
+
+  /**
+   * Wait in the same way as wait() until the time of CLOCK_MONOTONIC.
+   *
+   * @param mutex Lock held by the caller
+   * @param deadline Time of CLOCK_MONOTONIC
+   * @return 0          woken up by signal() or broadcast()
+   * @return -ETIMEDOUT deadline has passed
+   */
+  int32_t waitUntil(CMutex& mutex, const struct timespec& deadline);
+
+  /**
+   * Wake up one waiting thread.
+   */
+  void signal();
+
+  /**
+   * Wake up all waiting threads.
+   */
+  void broadcast();
+
+private:
+  CCondition(const CCondition&);
+  CCondition& operator =(const CCondition&);
+  pthread_cond_t mCond;
+};
+
+class CRWLock {
+public:
+  CRWLock();
+  ~CRWLock();
+
+  /**
+   * Get shared Lock. Readers do not block each other.
+   *
+   * @return 0        successfully
+   * @return -EDEADLK lock has been held for writing by the calling thread
+   */
+  int32_t readLock();
+
+  /**
+   * Get exclusive Lock.
+   *
+   * @return 0        successfully
+   * @return -EDEADLK lock has been held by the calling thread
+   */
+  int32_t writeLock();
+
+  /**
+   * Release shared or exclusive Lock.
+   */
+  void unlock();
+
+private:
+  CRWLock(const CRWLock&);
+  CRWLock& operator =(const CRWLock&);
+  pthread_rwlock_t mLock;
+};
+
 inline CMutex::CMutex() {
   pthread_mutex_init(&mMutex, NULL);
 }
@@ -73,6 +146,45 @@ inline int32_t CMutex::tryLock() {
   return -pthread_mutex_trylock(&mMutex);
 }
 
+inline CRWLock::CRWLock() {
+  pthread_rwlock_init(&mLock, NULL);
+}
+inline CRWLock::~CRWLock() {
+  pthread_rwlock_destroy(&mLock);
+}
+inline int32_t CRWLock::readLock() {
+  return -pthread_rwlock_rdlock(&mLock);
+}
+inline int32_t CRWLock::writeLock() {
+  return -pthread_rwlock_wrlock(&mLock);
+}
+inline void CRWLock::unlock() {
+  pthread_rwlock_unlock(&mLock);
+}
+
+inline CCondition::CCondition() {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&mCond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+inline CCondition::~CCondition() {
+  pthread_cond_destroy(&mCond);
+}
+inline void CCondition::wait(CMutex& mutex) {
+  pthread_cond_wait(&mCond, &mutex.mMutex);
+}
+inline int32_t CCondition::waitUntil(CMutex& mutex, const struct timespec& deadline) {
+  return -pthread_cond_timedwait(&mCond, &mutex.mMutex, &deadline);
+}
+inline void CCondition::signal() {
+  pthread_cond_signal(&mCond);
+}
+inline void CCondition::broadcast() {
+  pthread_cond_broadcast(&mCond);
+}
+
 } // namespace marlincdm
 
 #endif /* __MARLIN_CMUTEX_H__ */
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CDM_BUFFER_POOL_H__
+#define __CDM_BUFFER_POOL_H__
+
+#include "CMutex.h"
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+
+/* Size classes of the buffer pool : 2^MIN_SHIFT - 2^MAX_SHIFT bytes */
+#define MCDM_BUFFER_POOL_MIN_SHIFT 8
+#define MCDM_BUFFER_POOL_MAX_SHIFT 22
+#define MCDM_BUFFER_POOL_CLASS_NUM (MCDM_BUFFER_POOL_MAX_SHIFT - MCDM_BUFFER_POOL_MIN_SHIFT + 1)
+
+/* Alignment of data of buffers, for the vector kernels of decryption. The header of a buffer is in front of it. */
+#define MCDM_BUFFER_POOL_ALIGN 64
+
+/* Maximum number of free buffers kept per size class */
+#ifndef MCDM_BUFFER_POOL_FREE_MAX
+#define MCDM_BUFFER_POOL_FREE_MAX 16
+#endif
+
+namespace marlincdm {
+
+/**
+ * Size-classed pool of output buffers of decryption and of key request messages.
+ *
+ * A buffer is taken from the free list of the smallest power of two class which holds the requested size,
+ * and goes back to the free list when it is released. A buffer larger than the largest class is freed
+ * when it is released.
+ *
+ * The bookkeeping of a buffer is kept in a header in front of its data, and the free lists and the list of
+ * buffers handed out are linked through the headers, so that acquire() and release() of a pooled buffer
+ * do not allocate. release() rejects buffers of another owner and buffers which are released twice while
+ * they are in a free list. Pointers which are not taken from the pool must not be given to release().
+ */
+class CdmBufferPool {
+private:
+    struct Buffer {
+        CdmBufferPool *pool; // the pool while the buffer is handed out, NULL while it is in a free list
+        const void *owner;
+        size_t capacity;
+        Buffer *prev;
+        Buffer *next;
+    };
+    typedef char BufferHeaderSizeCheck[(sizeof(Buffer) <= MCDM_BUFFER_POOL_ALIGN) ? 1 : -1];
+
+    Buffer *mFree[MCDM_BUFFER_POOL_CLASS_NUM]; // free buffers per size class, linked by next
+    uint32_t mFreeNum[MCDM_BUFFER_POOL_CLASS_NUM];
+    Buffer *mInUse; // buffers handed out
+    uint64_t mAllocations;
+    uint64_t mReuses;
+    uint64_t mReleases;
+    size_t mBytesInUse;
+    size_t mHighWater;
+    size_t mBytesCached;
+    CMutex mMutex;
+
+    CdmBufferPool(const CdmBufferPool &o);
+    CdmBufferPool& operator=(const CdmBufferPool &o);
+
+    static int32_t classOf(size_t size);
+    static size_t classSize(int32_t index);
+    static uint8_t* dataOf(Buffer* buffer);
+    static Buffer* bufferOf(uint8_t* data);
+    void unlink(Buffer* buffer);
+
+public:
+    CdmBufferPool();
+    virtual ~CdmBufferPool();
+
+    /**
+     * Take a buffer of size bytes or more for owner. It returns NULL when memory is exhausted.
+     */
+    uint8_t* acquire(size_t size, const void* owner);
+
+    /**
+     * Give back a buffer taken by acquire() with the same owner.
+     */
+    mcdm_status_t release(uint8_t* data, const void* owner);
+
+    /**
+     * Free all buffers in the free lists.
+     */
+    void trim();
+
+    void getStatistics(mcdm_buffer_pool_stats_t* stats);
+
+};  //class
+};  //namespace
+
+#endif /* __CDM_BUFFER_POOL_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
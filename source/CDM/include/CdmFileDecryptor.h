@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CDM_FILE_DECRYPTOR_H__
+#define __CDM_FILE_DECRYPTOR_H__
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+
+/* Maximum number of threads of a file decryption */
+#define MCDM_FILE_DECRYPT_THREAD_MAX 64
+
+/* Bytes read and written at once. A multiple of both the TS packet size and the page size (188 * 4096). */
+#ifndef MCDM_FILE_DECRYPT_CHUNK_SIZE
+#define MCDM_FILE_DECRYPT_CHUNK_SIZE (188 * 4096 * 4)
+#endif
+
+namespace marlincdm {
+
+class MarlinCdmEngine;
+
+/**
+ * Bulk decryption of recorded MPEG-2 TS files.
+ *
+ * The file is split into chunks aligned to both TS packets and pages. Threads take the chunks in order,
+ * read each chunk by one pread(), descramble it in place by DescrambleTs() and write it by one pwrite()
+ * at the same offset, so that chunks are decrypted in parallel and the I/O stays large and nearly sequential.
+ */
+class CdmFileDecryptor {
+private:
+    struct Job {
+        CdmFileDecryptor *decryptor;
+        const mcdm_buffer_t *initData;
+        int srcFd;
+        int dstFd;
+        off_t size;
+        volatile uint64_t nextChunk;
+        volatile uint32_t status; // mcdm_status_t of the first error
+    };
+
+    MarlinCdmEngine *mEngine;
+
+    CdmFileDecryptor(const CdmFileDecryptor &o);
+    CdmFileDecryptor& operator=(const CdmFileDecryptor &o);
+
+    static void* threadEntry(void* arg);
+    void run(Job* job);
+    static void fail(Job* job, mcdm_status_t status);
+
+public:
+    explicit CdmFileDecryptor(MarlinCdmEngine* engine);
+    virtual ~CdmFileDecryptor();
+
+    /**
+     * Decrypt src_fd into dst_fd. thread_num 0 uses one thread per online CPU.
+     */
+    mcdm_status_t decryptTs(const mcdm_buffer_t& init_data, int src_fd, int dst_fd, uint32_t thread_num);
+
+};  //class
+};  //namespace
+
+#endif /* __CDM_FILE_DECRYPTOR_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
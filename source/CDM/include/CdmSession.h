@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CDM_SESSION_H__
+#define __CDM_SESSION_H__
+
+#include "CMutex.h"
+#include "MarlinAgentHandler.h"
+#include "MarlinCommonTypes.h"
+
+namespace marlincdm {
+
+/**
+ * State of a session opened by OpenSession().
+ *
+ * The session table holds one reference while the session is open, and each call of the session holds
+ * one while it runs, so that the session is freed when the last of them releases it. The calls of a session
+ * are serialized by mutex. The fields below mutex are only accessed with mutex held.
+ *
+ * lastUsed and memorySize are read by the reaper of idle sessions without mutex.
+ */
+struct CdmSession {
+    mcdm_session_id_t sessionId;
+    mcdm_session_handle_t handle;
+    MH_iptvesHandle_t iptvesHandle;
+    uint32_t agent; // index of the agent in AgentHandlerPool which iptvesHandle is bound to
+    volatile uint32_t refCount;
+    volatile uint32_t lastUsed; // seconds of CdmTaskRunner::now() when the last call of the session finished
+    volatile uint32_t memorySize; // bytes accounted to the session by CdmSessionTable::account()
+    CMutex mutex;
+    bool closed; // set by CloseSession(), the calls waiting on mutex fail
+    bool keyRequested; // a key request is made on iptvesHandle, a prepared request message is not given any more
+    bool responseProcessed; // processResponse() is called on iptvesHandle, which may hold licenses since
+    uint8_t *request; // pooled copy of the last request message, owned by the caller until it is released
+    uint32_t requestSize; // bytes of request
+    bool agentRequest; // the agent holds the last request message (given by fd) until freeRequestBuffer()
+};
+
+};  //namespace
+
+#endif /* __CDM_SESSION_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
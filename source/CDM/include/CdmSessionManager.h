@@ -17,6 +17,7 @@
 #ifndef __SESSION_MANAGER_H__
 #define __SESSION_MANAGER_H__
 
+#include "CAtomic.h"
 #include "CMutex.h"
 #include "MarlinCommonTypes.h"
 #include "MarlinError.h"
@@ -27,11 +28,10 @@ namespace marlincdm {
 
 class CdmSessionManager {
 private:
-    static CdmSessionManager *sInstance;
+    static CdmSessionManager * volatile sInstance;
     static CMutex sMutex;
 
-    long long mSessionId;
-    CMutex mSessionIdMutex;
+    volatile uint64_t mSessionId; // next session ID, taken by compare-and-swap
     CdmSessionManager(const CdmSessionManager &o);
     CdmSessionManager& operator=(const CdmSessionManager &o);
 
@@ -41,19 +41,27 @@ protected:
 
 public:
     static inline CdmSessionManager* getCdmSessionManager() {
+        /* The lock is only taken until the instance is created. */
+        CdmSessionManager *instance = atomicLoadAcquire(&sInstance);
+        if (instance != NULL) {
+            return instance;
+        }
         sMutex.lock();
-        CdmSessionManager *instance = sInstance;
+        instance = sInstance;
         if (instance == NULL) {
             instance = new CdmSessionManager();
             if (instance == NULL) {
                 LOGE("ERROR : Could not allocate instance of CdmSessionManager.\n");
             }
-            sInstance = instance;
+            atomicStoreRelease(&sInstance, instance);
         }
         sMutex.unlock();
         return instance;
     }
 
+    /**
+     * Take the next session ID. IDs run from MCDM_SESSION_ID_INIT to LLONG_MAX - 1 and then wrap around.
+     */
     mcdm_status_t getCdmSessionId(mcdm_session_id_t &sessionId);
 
 };  //class
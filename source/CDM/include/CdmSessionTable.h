@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CDM_SESSION_TABLE_H__
+#define __CDM_SESSION_TABLE_H__
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "CAtomic.h"
+#include "CMutex.h"
+#include "CdmSession.h"
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+
+/* Number of shards of the session table (power of two) */
+#ifndef MCDM_SESSION_TABLE_SHARD_NUM
+#define MCDM_SESSION_TABLE_SHARD_NUM 16
+#endif
+
+/* Number of slots of session handles (1 - 65536) */
+#ifndef MCDM_SESSION_TABLE_SLOT_NUM
+#define MCDM_SESSION_TABLE_SLOT_NUM 1024
+#endif
+
+namespace marlincdm {
+
+/**
+ * Table of open sessions keyed by session ID.
+ *
+ * The sessions are split into shards by a hash of the session ID. Each shard has its own map and
+ * reader/writer lock on its own cache line, so that lookups run in parallel and opening or closing
+ * a session only blocks the sessions of one shard.
+ *
+ * Each session also takes a slot of a fixed array, and its handle is the slot index in the low bits and the
+ * generation of the slot in the remaining bits. A session is found by its handle without hashing, under a shared
+ * lock of a stripe of slots. The generation is changed when the slot is freed, so that a handle of a closed session
+ * is not found. Free slots are taken in the order they are freed, so that a slot is reused only after all other
+ * free slots, and a generation wraps around after (2^(32 - index bits) - 1) * free slots sessions.
+ *
+ * find() takes a reference of the session, which is given back by the caller. remove() gives the reference
+ * of the table to the caller.
+ *
+ * The memory of each session is accounted from insert() until releaseHandle(), so that the total stays
+ * the sum of the sessions which hold a slot.
+ */
+class CdmSessionTable {
+private:
+    struct Shard {
+        CRWLock lock;
+        map<mcdm_session_id_t, CdmSession*> sessions;
+        uint8_t pad[MCDM_CACHE_LINE_SIZE];
+    };
+
+    struct Slot {
+        mcdm_session_handle_t handle; // MCDM_SESSION_HANDLE_INVALID while no session is found by the slot
+        CdmSession *session;
+        uint32_t generation; // 1 - mGenerationMax
+    };
+
+    /* Lock of the slots whose index modulo MCDM_SESSION_TABLE_SHARD_NUM is the same */
+    struct SlotStripe {
+        CRWLock lock;
+        uint8_t pad[MCDM_CACHE_LINE_SIZE];
+    };
+
+    Shard mShards[MCDM_SESSION_TABLE_SHARD_NUM];
+    Slot mSlots[MCDM_SESSION_TABLE_SLOT_NUM];
+    SlotStripe mStripes[MCDM_SESSION_TABLE_SHARD_NUM];
+    deque<uint32_t> mFreeSlots; // FIFO
+    uint32_t mIndexBits; // bits of the slot index in a handle
+    uint32_t mGenerationMax;
+    CMutex mSlotMutex;
+    volatile uint32_t mCount;
+    volatile uint64_t mMemory;
+    volatile uint64_t mMemoryHighWater;
+
+    CdmSessionTable(const CdmSessionTable &o);
+    CdmSessionTable& operator=(const CdmSessionTable &o);
+
+    Shard& shardOf(const mcdm_session_id_t& session_id);
+    Slot* slotOf(mcdm_session_handle_t handle);
+    CRWLock& stripeOf(mcdm_session_handle_t handle);
+    void eraseFromShard(CdmSession* session);
+    void addMemory(uint32_t size);
+
+public:
+    CdmSessionTable();
+    virtual ~CdmSessionTable();
+
+    /**
+     * Add a session and set its handle. It returns ERROR_ILLEGAL_ARGUMENT when the session ID is in the table
+     * already, and ERROR_UNKNOWN when all slots are used.
+     */
+    mcdm_status_t insert(CdmSession* session);
+
+    /**
+     * Find a session and take a reference of it. It returns NULL when the session is not in the table.
+     */
+    CdmSession* find(const mcdm_session_id_t& session_id);
+
+    CdmSession* find(mcdm_session_handle_t handle);
+
+    /**
+     * Take a session out of the table. It returns NULL when the session is not in the table.
+     * The slot of the session stays reserved until releaseHandle() is called.
+     */
+    CdmSession* remove(const mcdm_session_id_t& session_id);
+
+    CdmSession* remove(mcdm_session_handle_t handle);
+
+    /**
+     * Free the slot of a session taken by remove(). The handle of the session is not valid any more.
+     */
+    void releaseHandle(CdmSession* session);
+
+    /**
+     * Take all sessions out of the table and free their slots.
+     */
+    void removeAll(vector<CdmSession*>& sessions);
+
+    /**
+     * Set the memory of a session. It is called with the mutex of the session held, before the session is closed.
+     */
+    void account(CdmSession* session, uint32_t size);
+
+    /**
+     * Find the least recently used sessions whose memory adds up to size, by one scan of the slots, and take
+     * a reference of each. The sessions are given oldest first, fewer when the table does not hold enough memory.
+     */
+    void findLeastRecentlyUsed(uint64_t size, vector<CdmSession*>& sessions);
+
+    /**
+     * Get the handles of the sessions in the table.
+     */
+    void getHandles(vector<mcdm_session_handle_t>& handles);
+
+    uint64_t memorySize();
+
+    void getStatistics(mcdm_session_stats_t* stats);
+
+};  //class
+};  //namespace
+
+#endif /* __CDM_SESSION_TABLE_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
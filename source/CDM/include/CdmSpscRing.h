@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CDM_SPSC_RING_H__
+#define __CDM_SPSC_RING_H__
+
+#include <stdint.h>
+
+#include "CAtomic.h"
+
+namespace marlincdm {
+
+/**
+ * Bounded lock-free ring of entries between one producer thread and one consumer thread.
+ *
+ * Only the producer calls push() and only the consumer calls pop(). Each side writes its own index,
+ * and reads the index of the other side to find the entries or the space available.
+ * The capacity is rounded up to a power of two.
+ */
+template <typename T>
+class CdmSpscRing {
+public:
+  explicit CdmSpscRing(uint32_t capacity)
+      : mEntries(NULL), mMask(0), mHead(0), mTail(0) {
+    uint32_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mEntries = new T[size];
+    mMask = size - 1;
+  }
+
+  ~CdmSpscRing() {
+    delete [] mEntries;
+  }
+
+  /**
+   * Append an entry. Called by the producer.
+   *
+   * @return false when the ring is full
+   */
+  bool push(const T& entry) {
+    uint32_t tail = atomicLoadAcquire(&mTail);
+    if (tail - atomicLoadAcquire(&mHead) > mMask) {
+      return false;
+    }
+    mEntries[tail & mMask] = entry;
+    /* The entry is visible before the new index. */
+    atomicStoreRelease(&mTail, tail + 1);
+    return true;
+  }
+
+  /**
+   * Take the oldest entry. Called by the consumer.
+   *
+   * @return false when the ring is empty
+   */
+  bool pop(T* entry) {
+    uint32_t head = atomicLoadAcquire(&mHead);
+    if (head == atomicLoadAcquire(&mTail)) {
+      return false;
+    }
+    *entry = mEntries[head & mMask];
+    /* The entry is copied out before the slot is given back to the producer. */
+    atomicStoreRelease(&mHead, head + 1);
+    return true;
+  }
+
+  bool empty() {
+    return atomicLoadAcquire(&mHead) == atomicLoadAcquire(&mTail);
+  }
+
+  bool full() {
+    return atomicLoadAcquire(&mTail) - atomicLoadAcquire(&mHead) > mMask;
+  }
+
+  uint32_t capacity() const {
+    return mMask + 1;
+  }
+
+private:
+  CdmSpscRing(const CdmSpscRing&);
+  CdmSpscRing& operator=(const CdmSpscRing&);
+
+  T* mEntries;
+  uint32_t mMask;
+  uint8_t mPad0[MCDM_CACHE_LINE_SIZE];
+  volatile uint32_t mHead; // written by the consumer
+  uint8_t mPad1[MCDM_CACHE_LINE_SIZE - sizeof(uint32_t)];
+  volatile uint32_t mTail; // written by the producer
+  uint8_t mPad2[MCDM_CACHE_LINE_SIZE - sizeof(uint32_t)];
+};
+
+} // namespace marlincdm
+
+#endif /* __CDM_SPSC_RING_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CDM_STREAM_ID_H__
+#define __CDM_STREAM_ID_H__
+
+#include <stdint.h>
+#include <map>
+
+namespace marlincdm {
+
+using namespace std;
+
+/**
+ * Take a stream ID for a new entry of streams, and advance next_stream_id.
+ *
+ * 0 is not used as stream ID, and an ID in use is skipped after wraparound.
+ * Called with the lock of streams held.
+ */
+template <typename T>
+inline uint32_t allocateStreamId(const map<uint32_t, T>& streams, uint32_t* next_stream_id) {
+  while ((*next_stream_id == 0) || (streams.find(*next_stream_id) != streams.end())) {
+    (*next_stream_id)++;
+  }
+  return (*next_stream_id)++;
+}
+
+} // namespace marlincdm
+
+#endif /* __CDM_STREAM_ID_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CDM_TASK_RUNNER_H__
+#define __CDM_TASK_RUNNER_H__
+
+#include <deque>
+#include <map>
+
+#include "CMutex.h"
+#include "MarlinError.h"
+
+namespace marlincdm {
+
+using namespace std;
+
+/**
+ * One background thread which runs internal tasks of the engine in the posted order,
+ * e.g. resolving key contexts ahead of their use. Delayed tasks are run in the order of their time.
+ */
+class CdmTaskRunner {
+public:
+    typedef void (*Task)(void* arg);
+
+private:
+    struct Entry {
+        Task task;
+        void *arg;
+    };
+
+    deque<Entry> mTasks;
+    multimap<uint64_t, Entry> mDelayed; // keyed by the time of now()
+    pthread_t mThread;
+    bool mRunning;
+    bool mStopping;
+    CMutex mMutex;
+    CCondition mCond;
+
+    CdmTaskRunner(const CdmTaskRunner &o);
+    CdmTaskRunner& operator=(const CdmTaskRunner &o);
+
+    static void* threadEntry(void* arg);
+    void run();
+    void takeDelayed(bool all);
+
+public:
+    CdmTaskRunner();
+    virtual ~CdmTaskRunner();
+
+    mcdm_status_t start();
+
+    /**
+     * Run all posted tasks and join the thread. Delayed tasks are run at once.
+     */
+    void stop();
+
+    /**
+     * Queue a task. When it returns an error, the task is not run and arg stays owned by the caller.
+     */
+    mcdm_status_t post(Task task, void* arg);
+
+    /**
+     * Queue a task which is run delay_ms milliseconds later, or when the runner is stopped.
+     * When it returns an error, the task is not run and arg stays owned by the caller.
+     */
+    mcdm_status_t postDelayed(Task task, void* arg, uint32_t delay_ms);
+
+    /**
+     * Milliseconds of CLOCK_MONOTONIC, the clock of the delayed tasks.
+     */
+    static uint64_t now();
+
+};  //class
+};  //namespace
+
+#endif /* __CDM_TASK_RUNNER_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __CHALLENGE_CACHE_H__
+#define __CHALLENGE_CACHE_H__
+
+#include <deque>
+#include <vector>
+
+#include "CMutex.h"
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+
+/* Maximum number of request messages prepared ahead of GenerateKeyRequest() */
+#define MCDM_CHALLENGE_CACHE_MAX 8
+
+namespace marlincdm {
+
+/**
+ * Request messages of GenerateKeyRequest() prepared ahead for sessions opened for likely next channels.
+ *
+ * A request message is made by the engine on the IPTV-ES handle of its own session, so the licenses which it
+ * brings are bound to the session ID known by the host. reserve() marks a preparation which the engine posts,
+ * put() keeps the request message made by it until its TTL is over, and take() gives it to the first key
+ * request of the session with the same init_data.
+ *
+ * Each session has one entry, which is replaced by a new preparation of the session. The oldest entry makes
+ * room when MCDM_CHALLENGE_CACHE_MAX entries are kept.
+ */
+class ChallengeCache {
+private:
+    struct Entry {
+        mcdm_session_handle_t session;
+        vector<uint8_t> initData;
+        vector<uint8_t> request; // empty while the preparation is posted
+        uint64_t sequence; // preparation which the entry waits for
+        uint32_t ttl; // milliseconds
+        uint64_t expiry; // time of CdmTaskRunner::now(), set by put()
+    };
+
+    deque<Entry> mEntries;
+    uint64_t mNextSequence;
+    CMutex mMutex;
+
+    ChallengeCache(const ChallengeCache &o);
+    ChallengeCache& operator=(const ChallengeCache &o);
+
+    deque<Entry>::iterator findEntry(mcdm_session_handle_t session);
+
+public:
+    ChallengeCache();
+
+    virtual ~ChallengeCache();
+
+    /**
+     * Mark a preparation of the request message of session for init_data. It returns false when the request
+     * message is prepared or posted already, otherwise the entry of session for other init_data is dropped.
+     */
+    bool reserve(mcdm_session_handle_t session, const mcdm_buffer_t& init_data, uint32_t ttl_ms, uint64_t* sequence);
+
+    /**
+     * Keep the request message made by the preparation of sequence. It is dropped when the entry of session has been
+     * replaced or taken since. An empty request message drops the entry, as the preparation has failed.
+     */
+    void put(mcdm_session_handle_t session, uint64_t sequence, vector<uint8_t>& request);
+
+    /**
+     * Take the request message of session prepared for init_data. The entry of session is dropped in any case,
+     * and it returns false when no request message is ready.
+     */
+    bool take(mcdm_session_handle_t session, const mcdm_buffer_t& init_data, vector<uint8_t>& request);
+
+    /**
+     * Drop the entry of session, also when its preparation is posted.
+     */
+    void drop(mcdm_session_handle_t session);
+
+};  //class
+};  //namespace
+
+#endif /* __CHALLENGE_CACHE_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DECRYPT_RING_MANAGER_H__
+#define __DECRYPT_RING_MANAGER_H__
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <vector>
+
+#include "CMutex.h"
+#include "CdmSpscRing.h"
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+
+/* Maximum number of decrypt rings open at the same time */
+#define MCDM_DECRYPT_RING_MAX 16
+
+/* Number of entries of a ring when 0 is given, and the largest number */
+#define MCDM_DECRYPT_RING_DEFAULT_CAPACITY 256
+#define MCDM_DECRYPT_RING_MAX_CAPACITY 65536
+
+namespace marlincdm {
+
+class MarlinCdmEngine;
+
+/**
+ * Decrypt rings between a demux thread and a consumer thread of the engine.
+ *
+ * A ring has an input ring of encrypted entries and an output ring of decrypted entries,
+ * both single-producer/single-consumer rings without locks. The consumer thread sleeps on a
+ * doorbell only when the input ring is empty or the output ring is full, and the other side
+ * rings the doorbell only when the consumer is sleeping, so that a busy ring makes no system call.
+ * Rings are looked up in a fixed table without locks; only open() and close() take the lock.
+ * push() and pop() count themselves as users of the slot, and close() waits for the users of the
+ * ring to leave before it frees the ring.
+ */
+class DecryptRingManager {
+private:
+    struct DecryptRing {
+        DecryptRingManager *manager;
+        vector<uint8_t> initData;
+        CdmSpscRing<mcdm_decrypt_ring_entry_t> *input;
+        CdmSpscRing<mcdm_decrypt_ring_entry_t> *output;
+        volatile uint32_t sleeping; // the consumer waits for the doorbell
+        volatile uint32_t stopping;
+        sem_t doorbell;
+        pthread_t thread;
+    };
+
+    struct Slot {
+        DecryptRing* volatile ring;
+        volatile uint32_t users; // push() and pop() which use the ring
+        uint8_t pad[MCDM_CACHE_LINE_SIZE];
+    };
+
+    MarlinCdmEngine *mEngine;
+    Slot mSlots[MCDM_DECRYPT_RING_MAX];
+    CMutex mMutex; // open() and close()
+
+    DecryptRingManager(const DecryptRingManager &o);
+    DecryptRingManager& operator=(const DecryptRingManager &o);
+
+    static void* threadEntry(void* arg);
+    void run(DecryptRing* ring);
+    DecryptRing* acquire(uint32_t ring_id);
+    void release(uint32_t ring_id);
+    static void wake(DecryptRing* ring);
+    static void destroy(DecryptRing* ring);
+
+public:
+    explicit DecryptRingManager(MarlinCdmEngine* engine);
+    virtual ~DecryptRingManager();
+
+    mcdm_status_t open(const mcdm_buffer_t& init_data, uint32_t capacity, uint32_t* ring_id);
+
+    /**
+     * Stop the consumer thread of a ring. Entries which are not taken yet are dropped.
+     */
+    mcdm_status_t close(uint32_t ring_id);
+
+    /**
+     * Append an encrypted entry. Called by the producer. It returns ERROR_BUFFER_FULL when the input ring is full.
+     */
+    mcdm_status_t push(uint32_t ring_id, const mcdm_decrypt_ring_entry_t& entry);
+
+    /**
+     * Take decrypted entries. Called by one thread at a time.
+     */
+    mcdm_status_t pop(uint32_t ring_id, mcdm_decrypt_ring_entry_t* entries, uint32_t max_num, uint32_t* num);
+
+};  //class
+};  //namespace
+
+#endif /* __DECRYPT_RING_MANAGER_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DECRYPT_STREAM_MANAGER_H__
+#define __DECRYPT_STREAM_MANAGER_H__
+
+#include <map>
+
+#include "CMutex.h"
+#include "MarlinAgentHandler.h"
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+#include "KeyContextCache.h"
+#include "AgentHandlerPool.h"
+
+namespace marlincdm {
+
+/**
+ * Decryption state of streams which are decrypted in chunks of any size.
+ *
+ * A stream holds its key context and the stream context of the agent, which carries the IV or the counter
+ * and a partial block from one chunk to the next. Chunks of one stream are decrypted in order, and a stream
+ * which is closed during a decryption is destroyed when the decryption returns. The stream context is
+ * made by the agent of the key context.
+ */
+class DecryptStreamManager {
+private:
+    struct DecryptStream {
+        KeyContext *context; // holds one reference
+        MH_streamHandle_t streamHandle;
+        uint32_t refCount;
+        bool closed;
+        CMutex mutex; // serializes chunks
+    };
+
+    AgentHandlerPool *mAgents;
+    KeyContextCache *mKeyCache;
+    map<uint32_t, DecryptStream*> mStreams;
+    uint32_t mNextStreamId;
+    CMutex mMutex;
+
+    DecryptStreamManager(const DecryptStreamManager &o);
+    DecryptStreamManager& operator=(const DecryptStreamManager &o);
+
+    void unref(DecryptStream* stream);
+    void destroy(DecryptStream* stream);
+
+public:
+    DecryptStreamManager(AgentHandlerPool* agents, KeyContextCache* key_cache);
+    virtual ~DecryptStreamManager();
+
+    /**
+     * Open a stream with the key of kid_info. iv is NULL when the IV of the content key is used.
+     */
+    mcdm_status_t open(MH_keyIdInfo_t& kid_info, const uint8_t* iv, uint32_t* stream_id);
+
+    /**
+     * Decrypt the next chunk of a stream. dst is supplied by the caller.
+     */
+    mcdm_status_t decrypt(uint32_t stream_id, MH_buffer_t* src, bool last, MH_buffer_t* dst);
+
+    mcdm_status_t close(uint32_t stream_id);
+
+};  //class
+};  //namespace
+
+#endif /* __DECRYPT_STREAM_MANAGER_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
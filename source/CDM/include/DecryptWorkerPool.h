@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DECRYPT_WORKER_POOL_H__
+#define __DECRYPT_WORKER_POOL_H__
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "CMutex.h"
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+
+/* Maximum number of decrypt worker threads */
+#define MCDM_DECRYPT_WORKER_MAX 64
+
+namespace marlincdm {
+
+class MarlinCdmEngine;
+
+/**
+ * Work-stealing worker threads which run decryption submitted by DecryptAsync().
+ *
+ * Every worker owns a queue. A request is queued to the home worker of its stream,
+ * and a worker whose queue is empty steals the newer half of the queue of another worker,
+ * so that a heavy stream is spread over idle workers.
+ * Requests of one stream may be decrypted in parallel, but their completions are
+ * delivered in the submitted order.
+ */
+class DecryptWorkerPool {
+private:
+    struct Stream;
+
+    struct Job {
+        uint64_t requestId;
+        uint32_t streamId;
+        uint64_t sequence; // order in the stream
+        Stream *stream;
+        mcdm_buffer_t initData;
+        mcdm_sample_t *sample;
+        mcdm_decrypt_callback_t callback;
+        void *userData;
+    };
+
+    struct Finished {
+        mcdm_decrypt_completion_t completion;
+        mcdm_decrypt_callback_t callback;
+    };
+
+    /* Keeps completions of one stream in the submitted order. */
+    struct Stream {
+        uint64_t nextSequence; // given to the next submitted request
+        uint64_t nextDelivery; // sequence of the next completion to deliver
+        uint32_t outstanding; // submitted and not delivered yet
+        bool delivering; // a worker is delivering completions of this stream
+        map<uint64_t, Finished> finished; // finished ahead of nextDelivery
+        CMutex mutex;
+        Stream() : nextSequence(0), nextDelivery(0), outstanding(0), delivering(false) {}
+    };
+
+    struct Worker {
+        DecryptWorkerPool *pool;
+        uint32_t index;
+        pthread_t thread;
+        deque<Job> jobs;
+        uint64_t executed;
+        uint64_t steals;
+        uint64_t stolen;
+        CMutex mutex;
+        Worker() : pool(NULL), index(0), executed(0), steals(0), stolen(0) {}
+    };
+
+    MarlinCdmEngine *mEngine;
+    vector<Worker*> mWorkers;
+    map<uint32_t, Stream*> mStreams;
+    deque<mcdm_decrypt_completion_t> mCompletions;
+    uint64_t mNextRequestId;
+    volatile uint32_t mPending; // requests queued and not taken by a worker yet
+    volatile uint64_t mReordered;
+    bool mRunning;
+    bool mStopping;
+    CMutex mMutex; // mWorkers, mStreams, mNextRequestId, mRunning, mStopping
+    CMutex mCompletionMutex;
+    CCondition mCond;
+
+    DecryptWorkerPool(const DecryptWorkerPool &o);
+    DecryptWorkerPool& operator=(const DecryptWorkerPool &o);
+
+    static void* threadEntry(void* arg);
+    void run(Worker* self);
+    bool popLocal(Worker* self, Job& job);
+    bool steal(Worker* self, Job& job);
+    void execute(const Job& job);
+    void deliver(const vector<Finished>& ready);
+    void sweepStreams();
+    void deleteWorkers();
+
+public:
+    explicit DecryptWorkerPool(MarlinCdmEngine* engine);
+    virtual ~DecryptWorkerPool();
+
+    /**
+     * Start worker threads. worker_num 0 starts one worker per online CPU.
+     */
+    mcdm_status_t start(uint32_t worker_num);
+
+    /**
+     * Finish all submitted requests and join the worker threads.
+     */
+    void stop();
+
+    mcdm_status_t submit(uint32_t stream_id,
+                         const mcdm_buffer_t& init_data,
+                         mcdm_sample_t* sample,
+                         mcdm_decrypt_callback_t callback,
+                         void* user_data,
+                         uint64_t* request_id);
+
+    uint32_t poll(mcdm_decrypt_completion_t* completions, uint32_t max_num);
+
+    void getStatistics(mcdm_decrypt_worker_stats_t* stats);
+
+};  //class
+};  //namespace
+
+#endif /* __DECRYPT_WORKER_POOL_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
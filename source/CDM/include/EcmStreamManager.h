@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ECM_STREAM_MANAGER_H__
+#define __ECM_STREAM_MANAGER_H__
+
+#include <map>
+#include <vector>
+
+#include "CMutex.h"
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+#include "KeyContextCache.h"
+#include "CdmTaskRunner.h"
+
+namespace marlincdm {
+
+/**
+ * Double-buffered key contexts of ECM streams.
+ *
+ * An ECM stream keeps one key context per key parity. While the packets of one parity are on air,
+ * the ECM of the next crypto-period arrives with the other parity and its key context is resolved
+ * on the task runner, so that the descrambler finds it resolved when the packets switch the parity.
+ * Repeated ECMs with the same data are ignored.
+ */
+class EcmStreamManager {
+private:
+    struct Slot {
+        vector<uint8_t> ecm; // ECM information of the latest push
+        uint64_t pushed; // sequence of the latest push
+        uint64_t applied; // sequence of the ECM which context is resolved
+        KeyContext *context; // holds one reference
+        Slot() : pushed(0), applied(0), context(NULL) {}
+    };
+
+    struct EcmStream {
+        Slot slots[2]; // indexed by mcdm_key_parity_t
+    };
+
+    struct Prefetch {
+        EcmStreamManager *manager;
+        uint32_t streamId;
+        mcdm_key_parity_t parity;
+        uint64_t sequence;
+        vector<uint8_t> ecm;
+    };
+
+    KeyContextCache *mKeyCache;
+    CdmTaskRunner *mRunner;
+    map<uint32_t, EcmStream*> mStreams;
+    uint32_t mNextStreamId;
+    uint64_t mPrefetched;
+    uint64_t mStalls;
+    uint64_t mRotations;
+    CMutex mMutex;
+
+    EcmStreamManager(const EcmStreamManager &o);
+    EcmStreamManager& operator=(const EcmStreamManager &o);
+
+    static void prefetchEntry(void* arg);
+    void prefetch(Prefetch* request);
+    mcdm_status_t resolve(vector<uint8_t>& ecm, KeyContext** o_context);
+    bool install(uint32_t stream_id, mcdm_key_parity_t parity, uint64_t sequence, KeyContext* context);
+
+public:
+    EcmStreamManager(KeyContextCache* key_cache, CdmTaskRunner* runner);
+    virtual ~EcmStreamManager();
+
+    mcdm_status_t open(uint32_t* stream_id);
+
+    mcdm_status_t close(uint32_t stream_id);
+
+    /**
+     * Record the ECM of a parity and resolve its key context in the background.
+     */
+    mcdm_status_t push(uint32_t stream_id, mcdm_key_parity_t parity, const MH_keyIdInfo_t& kid_info);
+
+    /**
+     * Get the key context of the latest ECM of a parity. When it is not resolved yet,
+     * it is resolved on the calling thread. The context must be given back by KeyContextCache::release().
+     */
+    mcdm_status_t acquire(uint32_t stream_id, mcdm_key_parity_t parity, KeyContext** o_context);
+
+    void getStatistics(mcdm_ecm_stream_stats_t* stats);
+
+};  //class
+};  //namespace
+
+#endif /* __ECM_STREAM_MANAGER_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
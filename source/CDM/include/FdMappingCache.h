@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __FD_MAPPING_CACHE_H__
+#define __FD_MAPPING_CACHE_H__
+
+#include <sys/types.h>
+#include <vector>
+
+#include "CMutex.h"
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+
+/* Maximum number of fd mappings kept by the engine */
+#ifndef MCDM_FD_MAPPING_CACHE_SIZE
+#define MCDM_FD_MAPPING_CACHE_SIZE 32
+#endif
+
+namespace marlincdm {
+
+/**
+ * Shared mapping of a whole buffer given by fd (memfd, dma-buf or a regular file).
+ * A mapping which is removed from the cache while it is in use is unmapped
+ * when the last user releases it.
+ */
+struct FdMapping {
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    uint8_t *base;
+    size_t size;
+    bool writable;
+    bool dmaBuf; // CPU access is bracketed by DMA_BUF_IOCTL_SYNC
+    uint32_t refCount;
+    uint64_t lastUsed;
+    bool stale;
+};
+
+/**
+ * Bounded LRU of fd mappings keyed by fd.
+ *
+ * The mapping holds a reference of the file, so that its inode is not reused while it is cached.
+ * Every lookup compares the device and inode of fd with the mapping, and a mapping of a closed
+ * and reused fd number is replaced.
+ */
+class FdMappingCache {
+private:
+    uint32_t mCapacity;
+    vector<FdMapping*> mEntries;
+    uint64_t mTick;
+    CMutex mMutex;
+
+    FdMappingCache(const FdMappingCache &o);
+    FdMappingCache& operator=(const FdMappingCache &o);
+
+    FdMapping* find(int fd, dev_t dev, ino_t ino, size_t size, bool writable);
+    FdMapping* map(int fd, dev_t dev, ino_t ino, size_t size, bool writable);
+    void retire(FdMapping* mapping);
+    void destroy(FdMapping* mapping);
+    static void syncDmaBuf(FdMapping* mapping, bool start, bool writable);
+
+public:
+    explicit FdMappingCache(uint32_t capacity);
+    virtual ~FdMappingCache();
+
+    /**
+     * Get the address of [offset, offset + len) of the buffer of fd. The buffer is mapped on a miss.
+     * For a dma-buf, CPU access is started. The mapping must be given back by release().
+     */
+    mcdm_status_t acquire(int fd, size_t offset, size_t len, bool writable,
+                          FdMapping** o_mapping, uint8_t** o_data);
+
+    void release(FdMapping* mapping, bool writable);
+
+    /**
+     * Drop the mapping of fd. Called before fd is closed by the owner.
+     */
+    void unmap(int fd);
+
+    /**
+     * Drop all mappings.
+     */
+    void invalidate();
+
+};  //class
+};  //namespace
+
+#endif /* __FD_MAPPING_CACHE_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
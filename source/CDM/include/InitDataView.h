@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MARLIN_INIT_DATA_VIEW_H__
+#define __MARLIN_INIT_DATA_VIEW_H__
+
+#include <cstring>
+
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+#include "MarlinAgentHandlerType.h"
+
+namespace marlincdm {
+
+/**
+ * Non-owning view over Initialization data. (see MCDM_INDEX_* in MarlinCommonTypes.h)
+ *
+ * Every field is checked against the length of init_data while it is decoded.
+ * MH_keyIdInfo_t and MH_challengeParameter_t filled by the view borrow their data
+ * pointers from init_data, so nothing is allocated and nothing has to be freed,
+ * but init_data must stay valid as long as they are used.
+ */
+class InitDataView {
+public:
+  explicit InitDataView(const mcdm_buffer_t& init_data);
+
+  /**
+   * Decode KeyID information for CheckKeyExist()/Decrypt().
+   */
+  mcdm_status_t decodeKeyIdInfo(MH_keyIdInfo_t& kid_info) const;
+
+  /**
+   * Decode challenge parameter for GenerateKeyRequest()/AddKey().
+   */
+  mcdm_status_t decodeChallengeParameter(MH_challengeParameter_t& chal_param) const;
+
+private:
+  uint8_t *mData;
+  size_t mLen;
+
+  bool contains(size_t index, size_t size) const;
+  mcdm_status_t decodeKeyIdInfoAt(size_t index, MH_keyIdInfo_t& kid_info) const;
+};
+
+/* Fixed-size fields are copied with the sizes of Initialization data. */
+typedef char InitDataPrivateDataSizeCheck[(MCDM_SIZE_PRIVATE_DATA == MH_PRIVATE_DATA_SIZE) ? 1 : -1];
+typedef char InitDataUrrDataSizeCheck[(MCDM_SIZE_URR_DATA == MH_URR_DATA_SIZE) ? 1 : -1];
+
+inline InitDataView::InitDataView(const mcdm_buffer_t& init_data)
+  : mData(init_data.data), mLen(init_data.len) {
+}
+
+inline bool InitDataView::contains(size_t index, size_t size) const {
+  return (mData != NULL) && (index <= mLen) && (size <= mLen - index);
+}
+
+inline mcdm_status_t InitDataView::decodeKeyIdInfoAt(size_t index, MH_keyIdInfo_t& kid_info) const {
+  const size_t data_index = index + MCDM_SIZE_KID_INFO_TYPE + MCDM_SIZE_KID_INFO_LEN;
+
+  if (!contains(index, MCDM_SIZE_KID_INFO_TYPE + MCDM_SIZE_KID_INFO_LEN)) {
+    return ERROR_ILLEGAL_ARGUMENT;
+  }
+
+  /* KeyID information Type */
+  kid_info.type = (MH_keyIdInfoType)mData[index];
+
+  /* KeyID information length */
+  kid_info.length = (size_t)MCDM_GET_LEN(&mData[index + MCDM_SIZE_KID_INFO_TYPE]);
+  if (!contains(data_index, kid_info.length)) {
+    return ERROR_ILLEGAL_ARGUMENT;
+  }
+
+  /* KeyID information data */
+  kid_info.data = (kid_info.length > 0) ? &mData[data_index] : NULL;
+
+  return OK;
+}
+
+inline mcdm_status_t InitDataView::decodeKeyIdInfo(MH_keyIdInfo_t& kid_info) const {
+  return decodeKeyIdInfoAt(MCDM_INDEX_KID_INFO_TYPE, kid_info);
+}
+
+inline mcdm_status_t InitDataView::decodeChallengeParameter(MH_challengeParameter_t& chal_param) const {
+  if (!contains(MCDM_INDEX_REQ_TYPE, MCDM_INDEX_SERVER_URI_DATA)) {
+    return ERROR_ILLEGAL_ARGUMENT;
+  }
+
+  /* RequestType */
+  chal_param.req_type = (MH_requestType)mData[MCDM_INDEX_REQ_TYPE];
+
+  /* ActionID */
+  chal_param.action_id = (MH_actionId)mData[MCDM_INDEX_ACT_ID];
+
+  /* ActionParameter */
+  chal_param.act_param = (MH_actionParam)mData[MCDM_INDEX_ACT_PARAM];
+
+  /* PrivateDataTag & PrivateData */
+  memcpy(chal_param.private_data, &mData[MCDM_INDEX_PRIVATE_DATA], MCDM_SIZE_PRIVATE_DATA);
+
+  /* UsageRuleReference */
+  memcpy(chal_param.urr_data, &mData[MCDM_INDEX_URR_DATA], MCDM_SIZE_URR_DATA);
+
+  /* DRMServerURI length */
+  chal_param.server_uri_length = (size_t)MCDM_GET_LEN(&mData[MCDM_INDEX_SERVER_URI_LEN]);
+  if (!contains(MCDM_INDEX_SERVER_URI_DATA, chal_param.server_uri_length)) {
+    return ERROR_ILLEGAL_ARGUMENT;
+  }
+
+  /* DRMServerURI data */
+  chal_param.server_uri_data =
+      (chal_param.server_uri_length > 0) ? &mData[MCDM_INDEX_SERVER_URI_DATA] : NULL;
+
+  /* KeyID information */
+  return decodeKeyIdInfoAt(MCDM_INDEX_KID_INFO_TYPE_EXT(chal_param.server_uri_length), chal_param.kid_info);
+}
+
+} // namespace marlincdm
+
+#endif /* __MARLIN_INIT_DATA_VIEW_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KEY_CONTEXT_CACHE_H__
+#define __KEY_CONTEXT_CACHE_H__
+
+#include <vector>
+
+#include "CAtomic.h"
+#include "CMutex.h"
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+#include "MarlinAgentHandler.h"
+#include "AgentHandlerPool.h"
+
+/* Maximum number of resolved key contexts kept by the engine for each agent */
+#ifndef MCDM_KEY_CONTEXT_CACHE_SIZE
+#define MCDM_KEY_CONTEXT_CACHE_SIZE 16
+#endif
+
+namespace marlincdm {
+
+/**
+ * Key context resolved by one of the agents for one KeyID information.
+ * The cache holds one reference while the context is in the cache. A context which is removed
+ * from the cache while it is in use is closed when the last user releases it.
+ */
+struct KeyContext {
+    uint64_t hash;
+    MH_keyIdInfoType type;
+    size_t length;
+    uint8_t *data;
+    MH_keyHandle_t keyHandle;
+    uint32_t agent; // index of the agent in AgentHandlerPool which resolved the context
+    volatile uint32_t refCount;
+    volatile uint64_t lastUsed;
+    bool stale;
+};
+
+/**
+ * Bounded LRU of resolved key contexts keyed by KeyID information (type and data).
+ *
+ * Lookups hold the lock shared and update the reference count and the LRU tick atomically, so that
+ * decryptions on many threads do not wait for each other. The lock is only held exclusively to add
+ * or drop contexts.
+ *
+ * A key context can only be used with the agent which resolved it. acquire() looks for the context of
+ * the agent with the fewest calls running, so that a KeyID used on many threads gets a context on each agent.
+ */
+class KeyContextCache {
+private:
+    AgentHandlerPool *mAgents;
+    uint32_t mCapacity;
+    vector<KeyContext*> mEntries;
+    volatile uint64_t mTick;
+    volatile uint64_t mHits;
+    volatile uint64_t mMisses;
+    uint64_t mEvictions;
+    volatile uint64_t mGeneration; // incremented by invalidate() and endChange()
+    volatile uint32_t mChanging; // changes of licenses begun by beginChange() and not ended
+    CRWLock mLock;
+
+    KeyContextCache(const KeyContextCache &o);
+    KeyContextCache& operator=(const KeyContextCache &o);
+
+    KeyContext* find(uint64_t hash, const MH_keyIdInfo_t& kid_info, uint32_t agent);
+    KeyContext* findAny(uint64_t hash, const MH_keyIdInfo_t& kid_info);
+    static bool matches(const KeyContext* context, uint64_t hash, const MH_keyIdInfo_t& kid_info);
+    void use(KeyContext* context);
+    void retire(KeyContext* context);
+    void unref(KeyContext* context);
+    void destroy(KeyContext* context);
+
+public:
+    KeyContextCache(AgentHandlerPool* agents, uint32_t capacity);
+    virtual ~KeyContextCache();
+
+    /**
+     * Get the key context of kid_info. On a miss the content key is resolved by the selected agent
+     * and the context is added to the cache. The context must be given back by release().
+     */
+    mcdm_status_t acquire(MH_keyIdInfo_t& kid_info, KeyContext** o_context);
+
+    void release(KeyContext* context);
+
+    /**
+     * Take one more reference of an acquired context, which must be given back by release().
+     * It fails when the context is dropped from the cache, e.g. by invalidate().
+     */
+    bool retain(KeyContext* context);
+
+    /**
+     * Check whether a key context of kid_info is resolved by any agent without calling the agent.
+     */
+    bool contains(const MH_keyIdInfo_t& kid_info);
+
+    /**
+     * Drop all key contexts. Called when licenses are changed.
+     */
+    void invalidate();
+
+    /**
+     * Drop all key contexts for licenses which the agent drops later, e.g. with an IPTV-ES handle finalized
+     * on the task runner. Until endChange(), resolved contexts are only used by their callers.
+     */
+    void beginChange();
+
+    /**
+     * End the change of beginChange() after the agent has dropped the licenses. Contexts are not dropped again.
+     */
+    void endChange();
+
+    /**
+     * false while a change of licenses is begun and not ended. It is read before generation().
+     */
+    bool stable();
+
+    /**
+     * Generation of licenses, changed by invalidate() and endChange(). Results about licenses which are
+     * taken from the agent are valid while it is not changed and the licenses are stable.
+     */
+    uint64_t generation();
+
+    void getStatistics(mcdm_key_cache_stats_t* stats);
+
+    /**
+     * FNV-1a hash of the type and data of kid_info. It is also used by KeyExistIndex.
+     */
+    static uint64_t hashKeyIdInfo(const MH_keyIdInfo_t& kid_info);
+
+};  //class
+};  //namespace
+
+#endif /* __KEY_CONTEXT_CACHE_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __KEY_EXIST_INDEX_H__
+#define __KEY_EXIST_INDEX_H__
+
+#include <map>
+#include <vector>
+
+#include "CMutex.h"
+#include "KeyContextCache.h"
+#include "MarlinAgentHandler.h"
+#include "MarlinCommonTypes.h"
+
+/* Maximum number of KeyID information whose presence of key is remembered */
+#ifndef MCDM_KEY_EXIST_INDEX_SIZE
+#define MCDM_KEY_EXIST_INDEX_SIZE 1024
+#endif
+
+/* Time in milliseconds for which an answer of the agent is kept, e.g. until a time-limited license expires */
+#ifndef MCDM_KEY_EXIST_INDEX_TTL
+#define MCDM_KEY_EXIST_INDEX_TTL 30000
+#endif
+
+/* Bits of the filter for each KeyID information of the index, and bits set for each of them */
+#define MCDM_KEY_EXIST_FILTER_BITS_PER_ENTRY 8
+#define MCDM_KEY_EXIST_FILTER_PROBES 3
+#define MCDM_KEY_EXIST_FILTER_BITS (MCDM_KEY_EXIST_INDEX_SIZE * MCDM_KEY_EXIST_FILTER_BITS_PER_ENTRY)
+
+namespace marlincdm {
+
+/**
+ * Presence of keys answered by the agent for KeyID information, for CheckKeyExistBatch().
+ *
+ * The answers are exact, both for keys which exist and which do not. They are kept for MCDM_KEY_EXIST_INDEX_TTL
+ * while the generation of KeyContextCache is not changed, and they are dropped together when licenses are changed.
+ * An answer taken from the agent before or during a change of licenses is not added. When the index is full, expired
+ * answers and then the least recently used answer make room for a new one.
+ *
+ * A Bloom filter of the KeyID information in the index is checked first, so that most KeyID information
+ * which is not in the index is given to the agent without searching the index. The filter never decides
+ * the presence of a key by itself. It is rebuilt after as many answers as the index holds have been dropped.
+ */
+class KeyExistIndex {
+private:
+    struct Entry {
+        bool isKeyExist;
+        uint64_t expiry; // time of CdmTaskRunner::now()
+        volatile uint64_t lastUsed;
+    };
+
+    KeyContextCache *mKeyCache;
+    map<vector<uint8_t>, Entry> mEntries; // type and data of KeyID information -> answer
+    vector<uint32_t> mFilter;
+    uint32_t mDropped; // answers dropped since the filter was built
+    uint64_t mGeneration;
+    volatile uint64_t mTick;
+    CRWLock mLock;
+
+    KeyExistIndex(const KeyExistIndex &o);
+    KeyExistIndex& operator=(const KeyExistIndex &o);
+
+    static void makeKey(const MH_keyIdInfo_t& kid_info, vector<uint8_t>& key);
+    bool filterContains(uint64_t hash) const;
+    void filterAdd(uint64_t hash);
+    void makeRoom(uint64_t now);
+    void rebuildFilter();
+
+public:
+    explicit KeyExistIndex(KeyContextCache* key_cache);
+    virtual ~KeyExistIndex();
+
+    /**
+     * Generation of licenses which answers of the agent are taken for. It is read before the agent is called.
+     */
+    uint64_t generation();
+
+    /**
+     * Get the presence of the key of kid_info. It returns false when it is not in the index or it is expired.
+     */
+    bool lookup(const MH_keyIdInfo_t& kid_info, bool* is_key_exist);
+
+    /**
+     * Add the answer of the agent taken for generation. It is not added when licenses are changed since then,
+     * or are being changed.
+     */
+    void add(const MH_keyIdInfo_t& kid_info, bool is_key_exist, uint64_t generation);
+
+};  //class
+};  //namespace
+
+#endif /* __KEY_EXIST_INDEX_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
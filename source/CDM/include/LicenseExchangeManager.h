@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LICENSE_EXCHANGE_MANAGER_H__
+#define __LICENSE_EXCHANGE_MANAGER_H__
+
+#include <map>
+#include <vector>
+
+#include "CMutex.h"
+#include "CdmTaskRunner.h"
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+
+/* Maximum number of license acquisitions in flight */
+#define MCDM_LICENSE_EXCHANGE_MAX 256
+
+namespace marlincdm {
+
+class MarlinCdmEngine;
+
+/**
+ * Asynchronous license acquisitions of AcquireLicenseAsync().
+ *
+ * Each acquisition runs GenerateKeyRequest() and then AddKey() until the agent sets endflag, as steps on
+ * the step runner. Between the steps the request message is given to the transport of the host, and
+ * the next step is posted when the response is submitted, so that no thread waits for the server.
+ *
+ * The steps run on the step runner, which is only used by the license acquisitions, so a round trip to
+ * the agent does not hold up the other tasks of the engine. The timeouts and the cancellations run on
+ * the timer runner and finish the acquisition at once, also while its step is running. Then the step
+ * does not give its request message to the transport, and cancels the key request and frees the
+ * acquisition when the agent returns.
+ */
+class LicenseExchangeManager {
+private:
+    struct Exchange {
+        uint64_t token;
+        mcdm_session_handle_t session;
+        vector<uint8_t> initData;
+        vector<uint8_t> response;
+        mcdm_license_transport_t transport;
+        mcdm_license_callback_t callback;
+        void *userData;
+        mcdm_license_state_t state;
+        bool canceled;
+        bool running;  // a step calls the agent or the transport
+        bool finished; // finished while the step was running, freed by the step
+    };
+
+    struct Job {
+        LicenseExchangeManager *manager;
+        uint64_t token;
+        uint64_t deadline; // time of CdmTaskRunner::now() for a timeout
+    };
+
+    MarlinCdmEngine *mEngine;
+    CdmTaskRunner *mStepRunner;
+    CdmTaskRunner *mTimerRunner;
+    map<uint64_t, Exchange*> mExchanges;
+    uint64_t mNextToken;
+    bool mShuttingDown; // set by shutdown()
+    CMutex mMutex;
+
+    LicenseExchangeManager(const LicenseExchangeManager &o);
+    LicenseExchangeManager& operator=(const LicenseExchangeManager &o);
+
+    static void stepTask(void* arg);
+    static void cancelTask(void* arg);
+    static void timeoutTask(void* arg);
+    mcdm_status_t post(CdmTaskRunner* runner, CdmTaskRunner::Task task, uint64_t token, uint32_t delay_ms);
+    void step(uint64_t token);
+    void finish(uint64_t token, mcdm_status_t status);
+
+public:
+    LicenseExchangeManager(MarlinCdmEngine* engine, CdmTaskRunner* step_runner, CdmTaskRunner* timer_runner);
+
+    /**
+     * Both task runners must be stopped before. Acquisitions in flight are finished with ERROR_CANCELED.
+     */
+    virtual ~LicenseExchangeManager();
+
+    /**
+     * Called before the task runners are stopped. The steps which run after it, also those run by
+     * CdmTaskRunner::stop(), finish their acquisitions with ERROR_CANCELED without calling the agent
+     * or the transport.
+     */
+    void shutdown();
+
+    mcdm_status_t start(mcdm_session_handle_t session,
+                        const mcdm_buffer_t& init_data,
+                        mcdm_license_transport_t transport,
+                        mcdm_license_callback_t callback,
+                        void* user_data,
+                        uint32_t timeout_ms,
+                        uint64_t* token);
+
+    mcdm_status_t submit(uint64_t token, const mcdm_buffer_t& response);
+
+    mcdm_status_t cancel(uint64_t token);
+
+    mcdm_status_t getState(uint64_t token, mcdm_license_state_t* state);
+
+};  //class
+};  //namespace
+
+#endif /* __LICENSE_EXCHANGE_MANAGER_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
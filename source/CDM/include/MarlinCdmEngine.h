@@ -26,31 +26,173 @@ namespace marlincdm {
 
 using namespace std;
 
+struct KeyContext;
+struct CdmSession;
+class TsPacketScanner;
+
 class MarlinCdmEngine {
  public:
 
   mcdm_status_t CheckKeyExist(const mcdm_buffer_t& init_data, bool* is_key_exist);
 
+  mcdm_status_t CheckKeyExistBatch(const mcdm_buffer_t* init_data,
+                                   uint32_t init_data_num,
+                                   uint8_t* is_key_exist);
+
   mcdm_status_t OpenSession(mcdm_session_id_t& session_id);
 
+  mcdm_status_t OpenSession(mcdm_session_id_t& session_id,
+                            mcdm_session_handle_t* handle);
+
   mcdm_status_t CloseSession(const mcdm_session_id_t& session_id);
 
+  mcdm_status_t CloseSession(mcdm_session_handle_t handle);
+
   mcdm_status_t GenerateKeyRequest(const mcdm_session_id_t& session_id,
                                    const mcdm_buffer_t& init_data,
                                    mcdm_buffer_t* request);
 
+  mcdm_status_t GenerateKeyRequest(mcdm_session_handle_t session_handle,
+                                   const mcdm_buffer_t& init_data,
+                                   mcdm_buffer_t* request);
+
   mcdm_status_t AddKey(const mcdm_session_id_t& session_id,
                        const mcdm_buffer_t& key,
                        const mcdm_buffer_t& init_data,
                        bool* endflag,
                        mcdm_buffer_t* request);
 
+  mcdm_status_t AddKey(mcdm_session_handle_t session_handle,
+                       const mcdm_buffer_t& key,
+                       const mcdm_buffer_t& init_data,
+                       bool* endflag,
+                       mcdm_buffer_t* request);
+
   mcdm_status_t CancelKeyRequest(const mcdm_session_id_t& session_id);
 
+  mcdm_status_t CancelKeyRequest(mcdm_session_handle_t session_handle);
+
   mcdm_status_t Decrypt(const mcdm_buffer_t& init_data,
                         mcdm_buffer_t* src_ptr,
                         mcdm_buffer_t* dst_ptr);
 
+  mcdm_status_t Decrypt(const mcdm_buffer_t& init_data,
+                        const mcdm_subsample_t* subsamples,
+                        uint32_t subsample_num,
+                        mcdm_buffer_t* src_ptr,
+                        mcdm_buffer_t* dst_ptr);
+
+  mcdm_status_t Decrypt(const mcdm_buffer_t& init_data,
+                        mcdm_decrypt_mode_t mode,
+                        mcdm_buffer_t* src_ptr,
+                        mcdm_buffer_t* dst_ptr);
+
+  mcdm_status_t DecryptBatch(const mcdm_buffer_t& init_data,
+                             mcdm_sample_t* samples,
+                             uint32_t sample_num);
+
+  mcdm_status_t UnmapFdBuffer(int fd);
+
+  mcdm_status_t ReleaseBuffer(mcdm_buffer_t* buffer);
+
+  mcdm_status_t ReleaseKeyRequestBuffer(const mcdm_session_id_t& session_id,
+                                        mcdm_buffer_t* request);
+
+  mcdm_status_t ReleaseKeyRequestBuffer(mcdm_session_handle_t session_handle,
+                                        mcdm_buffer_t* request);
+
+  mcdm_status_t AcquireLicenseAsync(const mcdm_session_id_t& session_id,
+                                    const mcdm_buffer_t& init_data,
+                                    mcdm_license_transport_t transport,
+                                    mcdm_license_callback_t callback,
+                                    void* user_data,
+                                    uint32_t timeout_ms,
+                                    uint64_t* token);
+
+  mcdm_status_t AcquireLicenseAsync(mcdm_session_handle_t session_handle,
+                                    const mcdm_buffer_t& init_data,
+                                    mcdm_license_transport_t transport,
+                                    mcdm_license_callback_t callback,
+                                    void* user_data,
+                                    uint32_t timeout_ms,
+                                    uint64_t* token);
+
+  mcdm_status_t SubmitLicenseResponse(uint64_t token, const mcdm_buffer_t& response);
+
+  mcdm_status_t CancelLicenseRequest(uint64_t token);
+
+  mcdm_status_t GetLicenseState(uint64_t token, mcdm_license_state_t* state);
+
+  mcdm_status_t DescrambleTs(const mcdm_buffer_t& init_data,
+                             mcdm_buffer_t* ts);
+
+  mcdm_status_t OpenEcmStream(uint32_t* stream_id);
+
+  mcdm_status_t PushEcm(uint32_t stream_id,
+                        mcdm_key_parity_t parity,
+                        const mcdm_buffer_t& init_data);
+
+  mcdm_status_t DescrambleTs(uint32_t stream_id,
+                             mcdm_buffer_t* ts);
+
+  mcdm_status_t CloseEcmStream(uint32_t stream_id);
+
+  mcdm_status_t OpenDecryptStream(const mcdm_buffer_t& init_data,
+                                  const uint8_t* iv,
+                                  uint32_t* stream_id);
+
+  mcdm_status_t DecryptStreamChunk(uint32_t stream_id,
+                                   mcdm_buffer_t* src_ptr,
+                                   bool last,
+                                   mcdm_buffer_t* dst_ptr);
+
+  mcdm_status_t CloseDecryptStream(uint32_t stream_id);
+
+  mcdm_status_t OpenDecryptRing(const mcdm_buffer_t& init_data,
+                                uint32_t capacity,
+                                uint32_t* ring_id);
+
+  mcdm_status_t PushDecryptRing(uint32_t ring_id,
+                                const mcdm_decrypt_ring_entry_t& entry);
+
+  mcdm_status_t PopDecryptRing(uint32_t ring_id,
+                               mcdm_decrypt_ring_entry_t* entries,
+                               uint32_t max_num,
+                               uint32_t* num);
+
+  mcdm_status_t CloseDecryptRing(uint32_t ring_id);
+
+  mcdm_status_t DecryptTsFile(const mcdm_buffer_t& init_data,
+                              int src_fd,
+                              int dst_fd,
+                              uint32_t thread_num);
+
+  mcdm_status_t SetSessionPoolSize(uint32_t size);
+
+  mcdm_status_t PrepareKeyRequests(const mcdm_session_handle_t* session_handles,
+                                   const mcdm_buffer_t* init_data,
+                                   uint32_t num,
+                                   uint32_t ttl_ms);
+
+  mcdm_status_t SetSessionIdleTimeout(uint32_t idle_timeout);
+
+  mcdm_status_t SetSessionMemoryBudget(uint64_t memory_budget);
+
+  mcdm_status_t StartDecryptWorkers(uint32_t worker_num);
+
+  mcdm_status_t StopDecryptWorkers();
+
+  mcdm_status_t DecryptAsync(uint32_t stream_id,
+                             const mcdm_buffer_t& init_data,
+                             mcdm_sample_t* sample,
+                             mcdm_decrypt_callback_t callback,
+                             void* user_data,
+                             uint64_t* request_id);
+
+  mcdm_status_t PollDecryptCompletions(mcdm_decrypt_completion_t* completions,
+                                       uint32_t max_num,
+                                       uint32_t* num);
+
   mcdm_status_t GetKeyReleases(mcdm_key_release_t** key_release,
                                uint32_t* key_release_num);
 
@@ -59,6 +201,16 @@ class MarlinCdmEngine {
   mcdm_status_t FreeKeyReleasesBuffer(mcdm_key_release_t* key_release,
                                       uint32_t key_release_num);
 
+  mcdm_status_t GetKeyCacheStats(mcdm_key_cache_stats_t* stats);
+
+  mcdm_status_t GetDecryptWorkerStats(mcdm_decrypt_worker_stats_t* stats);
+
+  mcdm_status_t GetEcmStreamStats(mcdm_ecm_stream_stats_t* stats);
+
+  mcdm_status_t GetBufferPoolStats(mcdm_buffer_pool_stats_t* stats);
+
+  mcdm_status_t GetSessionStats(mcdm_session_stats_t* stats);
+
   static MarlinCdmEngine* getMarlinCdmEngine();
 
   static mcdm_status_t releaseMarlinCdmEngine(bool &end_flag);
@@ -72,8 +224,40 @@ class MarlinCdmEngine {
   MarlinCdmEngine& operator=(const MarlinCdmEngine &o);
 
   MH_iptvesHandle_t getIPTVEShandle(const mcdm_session_id_t& session_id);
-  mcdm_status_t parseInitDataForKeyIdInfo(const mcdm_buffer_t& init_data, MH_keyIdInfo_t& kid_info);
-  mcdm_status_t parseInitDataForChallengeParameter(const mcdm_buffer_t& init_data, MH_challengeParameter_t& chal_param);
+  CdmSession* getSession(const mcdm_session_id_t& session_id);
+  CdmSession* getSession(mcdm_session_handle_t handle);
+  CdmSession* lockSession(const mcdm_session_id_t& session_id);
+  CdmSession* lockSession(mcdm_session_handle_t handle);
+  void unlockSession(CdmSession* session);
+  void releaseSession(CdmSession* session);
+  mcdm_status_t closeSession(CdmSession* session);
+  uint32_t sessionMemorySize(CdmSession* session);
+  void startReaper();
+  static void reapTask(void* arg);
+  void reapSessions();
+  void expireSession(mcdm_session_handle_t handle, uint32_t now);
+  bool keepMemoryBudget(uint32_t reserved);
+  mcdm_status_t generateKeyRequest(CdmSession* session, const mcdm_buffer_t& init_data, mcdm_buffer_t* request);
+  static void prepareTask(void* arg);
+  void prepareKeyRequest(mcdm_session_handle_t session_handle, const vector<uint8_t>& init_data, uint64_t sequence);
+  mcdm_status_t addKey(CdmSession* session, const mcdm_buffer_t& key, const mcdm_buffer_t& init_data,
+                       bool* endflag, mcdm_buffer_t* request);
+  mcdm_status_t cancelKeyRequest(CdmSession* session);
+  mcdm_status_t releaseKeyRequestBuffer(CdmSession* session, mcdm_buffer_t* request);
+  mcdm_status_t setRequest(CdmSession* session, const MH_buffer_t& mh_request, mcdm_buffer_t* request);
+  mcdm_status_t copyRequest(CdmSession* session, const uint8_t* data, uint32_t len, mcdm_buffer_t* request);
+  void releaseRequest(CdmSession* session);
+  mcdm_status_t decryptSample(const mcdm_buffer_t& init_data,
+                              mcdm_decrypt_mode_t mode,
+                              const mcdm_subsample_t* subsamples,
+                              uint32_t subsample_num,
+                              mcdm_buffer_t* src_ptr,
+                              mcdm_buffer_t* dst_ptr);
+  mcdm_status_t descramblePackets(KeyContext* key_context,
+                                  mcdm_key_parity_t parity,
+                                  vector<MH_sample_t>& samples,
+                                  TsPacketScanner& scanner);
+  mcdm_status_t checkSubsampleMap(const mcdm_subsample_t* subsamples, uint32_t subsample_num, size_t len);
 
 };
 
@@ -46,6 +46,13 @@
  * @image html marlincdm_seq_license_2.jpg
  * @image html marlincdm_seq_license_3.jpg
  *
+ * @brief
+ * Thread safety : the functions can be called from multiple threads.
+ * - The calls of one session are serialized, and the calls of different sessions run in parallel.
+ *   CloseSession() waits for the running calls of the session, and the calls waiting for it fail with ERROR_SESSION_NOT_OPENED.
+ * - Decryption and the other functions without a session do not take an engine-wide lock.
+ * - The Marlin Agent Handler must allow concurrent calls for different IPTV-ES handles and concurrent decryption.
+ *
  * @version 1.0
  */
 
@@ -91,6 +98,27 @@ class MarlinCdmInterface {
      */
     mcdm_status_t CheckKeyExist(const mcdm_buffer_t& init_data, bool* is_key_exist);
 
+    /**
+     * @brief This function checks the presence of Keys of several Initialization data at once.
+     *
+     * The answers of the agent are remembered for up to MCDM_KEY_EXIST_INDEX_SIZE KeyID information, for keys
+     * which exist and which do not, so that only KeyID information which is not checked yet is given to the agent,
+     * in one call. They are dropped when licenses are changed by AddKey(), CloseSession() or AddKeyReleaseCommit().
+     * Licenses which are changed without Marlin CDM are not seen until then.
+     *
+     * @param[in] init_data Array of Initialization data (same format as CheckKeyExist())
+     * @param[in] init_data_num Number of init_data
+     * @param[out] is_key_exist Bitmap of (init_data_num + 7) / 8 bytes. Bit (i % 8) of byte (i / 8), from the least
+     *                          significant bit, is set when the key of init_data[i] exists.
+     *
+     * @retval OK Check key exist is success
+     * @retval ERROR_ILLEGAL_ARGUMENT Parameter is NULL, or one of init_data is invalid
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t CheckKeyExistBatch(const mcdm_buffer_t* init_data,
+                                     uint32_t init_data_num,
+                                     uint8_t* is_key_exist);
+
     /**
      * @brief This function is opening new session associated with Marlin CDM object.
      *
@@ -100,6 +128,22 @@ class MarlinCdmInterface {
      */
     mcdm_status_t OpenSession(mcdm_session_id_t& session_id);
 
+    /**
+     * @brief This function opens new session, and also gives the handle of the session.
+     *
+     * The handle can be given to the functions of the session instead of the session ID.
+     * The session is found by the handle without string operations. A handle of a closed session is not valid,
+     * even when its slot is used by a new session.
+     *
+     * @param[out] session_id Session ID that can be used by application to identify Marlin CDM objects.
+     * @param[out] handle Handle of the session
+     * @retval OK Openning session is success
+     * @retval ERROR_ILLEGAL_ARGUMENT Output parameter is NULL
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t OpenSession(mcdm_session_id_t& session_id,
+                              mcdm_session_handle_t* handle);
+
     /**
      * @brief This function closes session opened by OpenSession().
      *
@@ -111,6 +155,16 @@ class MarlinCdmInterface {
      */
     mcdm_status_t CloseSession(const mcdm_session_id_t& session_id);
 
+    /**
+     * @brief This function closes session in the same way as CloseSession() with the session ID.
+     *
+     * @param[in] handle Handle of the session which is given by OpenSession()
+     * @retval OK Closing session is success
+     * @retval ERROR_SESSION_NOT_OPENED Handle is not valid
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t CloseSession(mcdm_session_handle_t handle);
+
     /**
      * @brief This function generates key request and acquires license.
      *
@@ -195,7 +249,9 @@ class MarlinCdmInterface {
      *  PSSH or ECM information data.\n
      *  Only use when RequestType is "Get Permission Protocol".\n
      *  When KeyID information type is "None", do not set anything.
-     * @param[out] request Request message data.
+     * @param[out] request Request message data.\n
+     * The message is owned by the caller until [ReleaseKeyRequestBuffer()](@ref ReleaseKeyRequestBuffer) is called.
+     * When it is not released, it is reclaimed by the next call for the session or by CloseSession().
      *
      * @retval OK Generating request message is success
      * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid
@@ -206,6 +262,21 @@ class MarlinCdmInterface {
                                      const mcdm_buffer_t& init_data,
                                      mcdm_buffer_t* request);
 
+    /**
+     * @brief This function generates key request in the same way as GenerateKeyRequest() with the session ID.
+     *
+     * @param[in] session_handle Handle of the session which is given by OpenSession()
+     * @param[in] init_data Initialization data of acquisition process
+     * @param[out] request Request message data
+     * @retval OK Generating request message is success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid
+     * @retval ERROR_SESSION_NOT_OPENED Handle is not valid
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t GenerateKeyRequest(mcdm_session_handle_t session_handle,
+                                     const mcdm_buffer_t& init_data,
+                                     mcdm_buffer_t* request);
+
     /**
      * @brief This function is adding key to Marlin CDM to be associated with Session ID.\n
      * After calling [GenerateKeyRequest()](@ref GenerateKeyRequest) function, caller should call this function.
@@ -216,7 +287,8 @@ class MarlinCdmInterface {
      * init_data is same format as GenerateKeyRequest(). There is also a case of NULL.
      *
      * @param[out] endflag flag whether step remained
-     * @param[out] request Request message data. only set when continue acquisitions
+     * @param[out] request Request message data. only set when continue acquisitions\n
+     * The message is released in the same way as the request of [GenerateKeyRequest()](@ref GenerateKeyRequest).
      *
      * @retval OK Adding key is success
      * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid
@@ -229,6 +301,25 @@ class MarlinCdmInterface {
                          bool* endflag,
                          mcdm_buffer_t* request);
 
+    /**
+     * @brief This function adds key in the same way as AddKey() with the session ID.
+     *
+     * @param[in] session_handle Handle of the session which is given by OpenSession()
+     * @param[in] key Response data that should be sent to Marlin CDM.
+     * @param[in] init_data Initialization data of acquisition process
+     * @param[out] endflag flag whether step remained
+     * @param[out] request Request message data. only set when continue acquisitions
+     * @retval OK Adding key is success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid
+     * @retval ERROR_SESSION_NOT_OPENED Handle is not valid
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t AddKey(mcdm_session_handle_t session_handle,
+                         const mcdm_buffer_t& key,
+                         const mcdm_buffer_t& init_data,
+                         bool* endflag,
+                         mcdm_buffer_t* request);
+
     /**
      * @brief This function is canceling session linked request information which is generated by GenerateKeyRequest().
      *
@@ -238,6 +329,16 @@ class MarlinCdmInterface {
      */
     mcdm_status_t CancelKeyRequest(const mcdm_session_id_t& session_id);
 
+    /**
+     * @brief This function cancels key request in the same way as CancelKeyRequest() with the session ID.
+     *
+     * @param[in] session_handle Handle of the session which is given by OpenSession()
+     * @retval OK Canceling request is success
+     * @retval ERROR_SESSION_NOT_OPENED Handle is not valid
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t CancelKeyRequest(mcdm_session_handle_t session_handle);
+
     /**
      * @brief This function provides decryption of media content.
      *
@@ -272,6 +373,648 @@ class MarlinCdmInterface {
                           mcdm_buffer_t* src_ptr,
                           mcdm_buffer_t* dst_ptr);
 
+    /**
+     * @brief This function provides decryption of media content which interleaves clear and encrypted ranges.
+     *
+     * Only the encrypted ranges described by the subsample map are decrypted, and the clear ranges are
+     * passed through to the output buffer untouched. The host does not need to gather the encrypted
+     * ranges into a contiguous buffer before decryption nor to scatter the result afterwards.
+     *
+     * @param[in] init_data Initialization data of media file. \n
+     * init_data is same format as [Decrypt()](@ref Decrypt).
+     * @param[in] subsamples Subsample map. Each entry is a pair of clear bytes and encrypted bytes.\n
+     * Sum of all clear bytes and encrypted bytes must be equal to the length of src_ptr.
+     * @param[in] subsample_num Number of subsamples
+     * @param[in] src_ptr Input buffer of encrypted data
+     * @param[out] dst_ptr Output buffer of decrypted data
+     *
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t Decrypt(const mcdm_buffer_t& init_data,
+                          const mcdm_subsample_t* subsamples,
+                          uint32_t subsample_num,
+                          mcdm_buffer_t* src_ptr,
+                          mcdm_buffer_t* dst_ptr);
+
+    /**
+     * @brief This function provides decryption of media content with an explicit owner of the output buffer.
+     *
+     * - MCDM_DECRYPT_MODE_AGENT_BUFFER : Output buffer is allocated by Marlin CDM. (same as [Decrypt()](@ref Decrypt))
+     * - MCDM_DECRYPT_MODE_IN_PLACE : Decrypted data overwrites src_ptr. No output buffer is used.\n
+     *   dst_ptr may be NULL. When dst_ptr is not NULL, it is set to the decrypted data in src_ptr.
+     * - MCDM_DECRYPT_MODE_CALLER_BUFFER : dst_ptr->data is supplied and owned by the caller, and dst_ptr->len is its capacity.\n
+     *   The capacity must be equal to or larger than src_ptr->len. dst_ptr->len is set to the size of decrypted data.
+     * - MCDM_DECRYPT_MODE_FD_BUFFER : dst_ptr->data is NULL, and the output buffer is dst_ptr->len bytes from dst_ptr->offset
+     *   in dst_ptr->fd (memfd, dma-buf or a regular file), e.g. a buffer of the decoder.\n
+     *   Decrypted data is written into the buffer without copy. dst_ptr->len is set to the size of decrypted data.
+     * - MCDM_DECRYPT_MODE_POOL_BUFFER : Output buffer is taken from the buffer pool of Marlin CDM, and it is owned by
+     *   the caller until [ReleaseBuffer()](@ref ReleaseBuffer) is called. Released buffers are reused by the next calls.
+     *
+     * When src_ptr->data is NULL, src_ptr->fd is valid and src_ptr->len is not 0, the input buffer is src_ptr->len bytes
+     * from src_ptr->offset in src_ptr->fd, and it is decrypted without copy. With MCDM_DECRYPT_MODE_IN_PLACE, decrypted
+     * data overwrites it and dst_ptr is set to the same fd and offset.\n
+     * Buffers given by fd are mapped at the first use and the mappings are kept for the next calls.
+     * [UnmapFdBuffer()](@ref UnmapFdBuffer) must be called before the fd is closed or its buffer is resized.
+     *
+     * @param[in] init_data Initialization data of media file. \n
+     * init_data is same format as [Decrypt()](@ref Decrypt).
+     * @param[in] mode Owner of the output buffer
+     * @param[in,out] src_ptr Input buffer of encrypted data
+     * @param[in,out] dst_ptr Output buffer of decrypted data
+     *
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid or output buffer is too small
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t Decrypt(const mcdm_buffer_t& init_data,
+                          mcdm_decrypt_mode_t mode,
+                          mcdm_buffer_t* src_ptr,
+                          mcdm_buffer_t* dst_ptr);
+
+    /**
+     * @brief This function provides decryption of several samples which share one KeyID information.
+     *
+     * The init_data is parsed and the key is resolved only once for the whole array,
+     * so that this function should be preferred to calling [Decrypt()](@ref Decrypt) for each sample
+     * when several samples of the same track are available.
+     *
+     * @param[in] init_data Initialization data of media file. \n
+     * init_data is same format as [Decrypt()](@ref Decrypt).
+     * @param[in,out] samples Array of samples.\n
+     * src of each sample is input buffer of encrypted data and dst of each sample is output buffer of decrypted data.\n
+     * When subsamples of a sample is not NULL, only the encrypted ranges of the sample are decrypted.(see above)
+     * The owner of dst of each sample is decided by its value at the call:\n
+     * dst.data is NULL : taken from the buffer pool of Marlin CDM for each sample and given back by
+     * [ReleaseBuffer()](@ref ReleaseBuffer), dst.data is equal to src.data : in-place,
+     * otherwise : supplied by the caller and dst.len is its capacity.\n
+     * When this function fails, the buffers taken from the pool are given back and dst.data is reset to NULL.
+     * @param[in] sample_num Number of samples.
+     *
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid or output buffer is too small
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t DecryptBatch(const mcdm_buffer_t& init_data,
+                               mcdm_sample_t* samples,
+                               uint32_t sample_num);
+
+    /**
+     * @brief This function drops the mapping of a buffer given by fd to [Decrypt()](@ref Decrypt).
+     *
+     * - It must be called before the fd is closed, so that the memory of the buffer is freed.
+     * - A decryption in progress with the fd keeps the mapping until it returns.
+     *
+     * @param[in] fd File descriptor of the buffer
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT fd is invalid
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t UnmapFdBuffer(int fd);
+
+    /**
+     * @brief This function gives back an output buffer of [Decrypt()](@ref Decrypt) with MCDM_DECRYPT_MODE_POOL_BUFFER,
+     * or an output buffer of [DecryptBatch()](@ref DecryptBatch) of a sample whose dst.data was NULL.
+     *
+     * buffer->data is set to NULL and buffer->len is set to 0.
+     * buffer->data must be a buffer given by Marlin CDM, other pointers are not detected in all cases.
+     *
+     * @param[in,out] buffer Output buffer of decrypted data
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT buffer is a request message, or it has been released already
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t ReleaseBuffer(mcdm_buffer_t* buffer);
+
+    /**
+     * @brief This function gives back the request message of [GenerateKeyRequest()](@ref GenerateKeyRequest)
+     * or [AddKey()](@ref AddKey).
+     *
+     * request->data is set to NULL and request->len is set to 0.
+     *
+     * @param[in] session_id Session ID which is opened by OpenSession()
+     * @param[in,out] request Request message data
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT request is not the last request message of the session
+     * @retval ERROR_SESSION_NOT_OPENED Session ID does not exist
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t ReleaseKeyRequestBuffer(const mcdm_session_id_t& session_id,
+                                          mcdm_buffer_t* request);
+
+    /**
+     * @brief This function gives back the request message in the same way as ReleaseKeyRequestBuffer()
+     * with the session ID.
+     *
+     * @param[in] session_handle Handle of the session which is given by OpenSession()
+     * @param[in,out] request Request message data
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT request is not the last request message of the session
+     * @retval ERROR_SESSION_NOT_OPENED Handle is not valid
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t ReleaseKeyRequestBuffer(mcdm_session_handle_t session_handle,
+                                          mcdm_buffer_t* request);
+
+    /**
+     * @brief This function starts a license acquisition of a session and returns immediately.
+     *
+     * The acquisition runs [GenerateKeyRequest()](@ref GenerateKeyRequest) and then [AddKey()](@ref AddKey)
+     * until the agent sets endflag, on the license thread of Marlin CDM. Each request message is given to transport,
+     * which sends it to the license server without blocking, and the response is given back by
+     * [SubmitLicenseResponse()](@ref SubmitLicenseResponse). The result is given to callback.
+     *
+     * - init_data is copied, and it is given to each AddKey() as well.
+     * - One acquisition of a session can be in flight at a time. The session must not be used by other functions
+     *   until the acquisition is finished.
+     * - Up to MCDM_LICENSE_EXCHANGE_MAX acquisitions can be in flight.
+     * - The timeout and [CancelLicenseRequest()](@ref CancelLicenseRequest) do not wait for a running call of
+     *   the agent. callback is called at once, and the call finishes on the license thread afterwards.
+     * - transport runs on the license thread, and callback on the license thread or, for the timeout and
+     *   the cancellation, on the task thread of Marlin CDM. They must not call
+     *   [releaseMarlinCdmInterface()](@ref releaseMarlinCdmInterface) or [CloseSession()](@ref CloseSession),
+     *   which wait for these threads or finalize the session in use by the acquisition.
+     *
+     * @param[in] session_id Session ID which is opened by OpenSession()
+     * @param[in] init_data Initialization data (same format as GenerateKeyRequest())
+     * @param[in] transport Transport of the request messages
+     * @param[in] callback Completion callback
+     * @param[in] user_data User data given to transport and callback
+     * @param[in] timeout_ms Time in milliseconds until the acquisition is finished with ERROR_TIMEOUT. (0: no timeout)
+     * @param[out] token Token of the acquisition
+     * @retval OK The acquisition is started
+     * @retval ERROR_ILLEGAL_ARGUMENT Parameter is NULL, or an acquisition of the session is in flight
+     * @retval ERROR_SESSION_NOT_OPENED Session ID does not exist
+     * @retval ERROR_BUFFER_FULL Too many acquisitions are in flight
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t AcquireLicenseAsync(const mcdm_session_id_t& session_id,
+                                      const mcdm_buffer_t& init_data,
+                                      mcdm_license_transport_t transport,
+                                      mcdm_license_callback_t callback,
+                                      void* user_data,
+                                      uint32_t timeout_ms,
+                                      uint64_t* token);
+
+    /**
+     * @brief This function starts a license acquisition in the same way as AcquireLicenseAsync() with the session ID.
+     *
+     * @param[in] session_handle Handle of the session which is given by OpenSession()
+     * @param[in] init_data Initialization data (same format as GenerateKeyRequest())
+     * @param[in] transport Transport of the request messages
+     * @param[in] callback Completion callback
+     * @param[in] user_data User data given to transport and callback
+     * @param[in] timeout_ms Time in milliseconds until the acquisition is finished with ERROR_TIMEOUT. (0: no timeout)
+     * @param[out] token Token of the acquisition
+     * @retval OK The acquisition is started
+     * @retval ERROR_ILLEGAL_ARGUMENT Parameter is NULL, or an acquisition of the session is in flight
+     * @retval ERROR_SESSION_NOT_OPENED Handle is not valid
+     * @retval ERROR_BUFFER_FULL Too many acquisitions are in flight
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t AcquireLicenseAsync(mcdm_session_handle_t session_handle,
+                                      const mcdm_buffer_t& init_data,
+                                      mcdm_license_transport_t transport,
+                                      mcdm_license_callback_t callback,
+                                      void* user_data,
+                                      uint32_t timeout_ms,
+                                      uint64_t* token);
+
+    /**
+     * @brief This function gives the response of the license server to a license acquisition.
+     *
+     * It can be called on any thread, also in the transport. The response is copied and processed
+     * on the license thread of Marlin CDM.
+     *
+     * @param[in] token Token returned by AcquireLicenseAsync()
+     * @param[in] response Response message data (given by data, not by fd)
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Parameter is invalid, or the acquisition is not waiting for a response
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t SubmitLicenseResponse(uint64_t token, const mcdm_buffer_t& response);
+
+    /**
+     * @brief This function cancels a license acquisition.
+     *
+     * The acquisition is finished with ERROR_CANCELED and the key request of the session is canceled.
+     * A step which is running in the agent is not interrupted, but callback does not wait for it and its request
+     * message is not given to the transport.
+     * A transport failure is reported by this function as well.
+     *
+     * @param[in] token Token returned by AcquireLicenseAsync()
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT The acquisition is finished already
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t CancelLicenseRequest(uint64_t token);
+
+    /**
+     * @brief This function gets the state of a license acquisition.
+     *
+     * @param[in] token Token returned by AcquireLicenseAsync()
+     * @param[out] state State of the acquisition
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Output parameter is NULL, or the acquisition is finished
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t GetLicenseState(uint64_t token, mcdm_license_state_t* state);
+
+    /**
+     * @brief This function descrambles a chunk of MPEG-2 TS packets in place.
+     *
+     * The payload of every packet whose transport_scrambling_control is '10' (even key) or '11' (odd key)
+     * is decrypted in place, and transport_scrambling_control of the packet is set to '00'.
+     * The adaptation field of a packet is kept clear. Clear packets and packets with
+     * transport_error_indicator are not changed.\n
+     * The content key is resolved once for the chunk, so that a whole read from a tuner or a file
+     * (e.g. 64 KiB) should be passed at once.
+     *
+     * - ts.data must start with a sync byte and ts.len must be a multiple of 188.
+     * - All packets are checked before decryption. When the chunk is rejected, ts is not changed.
+     * - When decryption fails, the packets still marked as scrambled keep their scrambled payloads,
+     *   so that the same chunk can be passed again.
+     *
+     * @param[in] init_data Initialization data of media file. \n
+     * init_data is same format as [Decrypt()](@ref Decrypt).
+     * @param[in,out] ts Chunk of TS packets.
+     *
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid or the chunk is not aligned to TS packets
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t DescrambleTs(const mcdm_buffer_t& init_data,
+                               mcdm_buffer_t* ts);
+
+    /**
+     * @brief This function opens an ECM stream, which keeps the key contexts of the even key and the odd key
+     * of one scrambled MPEG-2 TS.
+     *
+     * ECMs are given by [PushEcm()](@ref PushEcm) as they arrive, and the key context of a new ECM is
+     * resolved in the background. The TS packets are descrambled by
+     * [DescrambleTs()](@ref DescrambleTs) with the stream ID, which uses the key context of the parity of
+     * each packet, so that the descrambling does not wait for the agent when the crypto-period changes.
+     *
+     * @param[out] stream_id ID of the ECM stream
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Output parameter is NULL
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t OpenEcmStream(uint32_t* stream_id);
+
+    /**
+     * @brief This function gives an ECM of an ECM stream.
+     *
+     * The key context of the ECM replaces the previous one of the same parity as soon as it is resolved.
+     * It is resolved in the background, and the function returns immediately.
+     * An ECM with the same data as the previous one of the same parity is ignored, so that repeated ECMs
+     * can be given as they are received.
+     *
+     * - The ECM of the next crypto-period should be given while the packets of the other parity are on air.
+     *
+     * @param[in] stream_id ID of the ECM stream
+     * @param[in] parity Key parity of the ECM (e.g. even for table_id 0x80, odd for table_id 0x81)
+     * @param[in] init_data Initialization data of which KeyID information type is ECM. \n
+     * init_data is same format as [Decrypt()](@ref Decrypt).
+     *
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid or the stream is not open
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t PushEcm(uint32_t stream_id,
+                          mcdm_key_parity_t parity,
+                          const mcdm_buffer_t& init_data);
+
+    /**
+     * @brief This function descrambles a chunk of MPEG-2 TS packets in place with the keys of an ECM stream.
+     *
+     * The packets are descrambled in the same way as [DescrambleTs()](@ref DescrambleTs) with init_data,
+     * except that the packets of each parity are decrypted with the key context of the latest ECM of the
+     * parity. When the key context is not resolved yet, it is resolved before the decryption.
+     *
+     * @param[in] stream_id ID of the ECM stream
+     * @param[in,out] ts Chunk of TS packets.
+     *
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid, the chunk is not aligned to TS packets
+     * or the stream is not open
+     * @retval ERROR_UNKNOWN No ECM of a parity of the packets is given, or error by other reasons
+     */
+    mcdm_status_t DescrambleTs(uint32_t stream_id,
+                               mcdm_buffer_t* ts);
+
+    /**
+     * @brief This function closes an ECM stream and releases its key contexts.
+     *
+     * @param[in] stream_id ID of the ECM stream
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT The stream is not open
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t CloseEcmStream(uint32_t stream_id);
+
+    /**
+     * @brief This function opens a decrypt stream, which decrypts a content in chunks of any size.
+     *
+     * The key of init_data is resolved once for the stream, and the IV (CBC) or the counter (CTR)
+     * continues from one chunk to the next, so that data read from a socket or a file can be passed
+     * as it is, without splitting it at samples or AES blocks. The whole of the stream is encrypted.
+     *
+     * @param[in] init_data Initialization data of media file. \n
+     * init_data is same format as [Decrypt()](@ref Decrypt).
+     * @param[in] iv IV (CBC) or initial counter block (CTR) of MCDM_SIZE_AES_BLOCK bytes at the head of the stream.\n
+     * NULL when the IV of the content key is used.
+     * @param[out] stream_id ID of the decrypt stream
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t OpenDecryptStream(const mcdm_buffer_t& init_data,
+                                    const uint8_t* iv,
+                                    uint32_t* stream_id);
+
+    /**
+     * @brief This function decrypts the next chunk of a decrypt stream.
+     *
+     * With CBC, a partial block at the tail of a chunk is held until the next chunk, so that dst_ptr->len
+     * may be up to MCDM_SIZE_AES_BLOCK - 1 bytes smaller or larger than src_ptr->len.
+     * The last chunk of the stream is passed with last set to true, and then the held bytes are output
+     * as clear data. (same as a trailing partial block of [Decrypt()](@ref Decrypt))\n
+     * Chunks of one stream are decrypted in the order of the calls.
+     *
+     * @param[in] stream_id ID of the decrypt stream
+     * @param[in] src_ptr Input buffer of encrypted data. src_ptr->len may be 0.
+     * @param[in] last src_ptr is the end of the stream
+     * @param[in,out] dst_ptr Output buffer of decrypted data.\n
+     * When dst_ptr->data is NULL, the output buffer is taken from the buffer pool and it must be given back by
+     * [ReleaseBuffer()](@ref ReleaseBuffer). dst_ptr->data stays NULL when no data is output.\n
+     * Otherwise the output buffer is supplied by the caller, and dst_ptr->len is its capacity.
+     * The capacity must be src_ptr->len + MCDM_SIZE_AES_BLOCK - 1 or more, and the buffer must not overlap src_ptr.\n
+     * dst_ptr->len is set to the size of decrypted data.
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid, output buffer is too small or the stream is not open
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t DecryptStreamChunk(uint32_t stream_id,
+                                     mcdm_buffer_t* src_ptr,
+                                     bool last,
+                                     mcdm_buffer_t* dst_ptr);
+
+    /**
+     * @brief This function closes a decrypt stream. Bytes held by the stream are discarded.
+     *
+     * @param[in] stream_id ID of the decrypt stream
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT The stream is not open
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t CloseDecryptStream(uint32_t stream_id);
+
+    /**
+     * @brief This function opens a decrypt ring, which hands encrypted payloads from a demux thread to a
+     * consumer thread of Marlin CDM and hands them back decrypted.
+     *
+     * A decrypt ring has an input ring and an output ring of entries, both single-producer/single-consumer
+     * rings without locks. One thread pushes entries by [PushDecryptRing()](@ref PushDecryptRing), the consumer
+     * thread of the ring decrypts them in order as [DecryptBatch()](@ref DecryptBatch) with init_data, and one
+     * thread pops the decrypted entries by [PopDecryptRing()](@ref PopDecryptRing). The consumer thread sleeps
+     * only when there is no entry to decrypt or the output ring is full.
+     *
+     * @param[in] init_data Initialization data of media file. \n
+     * init_data is same format as [Decrypt()](@ref Decrypt). It is copied, and applies to all entries of the ring.
+     * @param[in] capacity Number of entries of each ring, rounded up to a power of two.
+     * 0 selects MCDM_DECRYPT_RING_DEFAULT_CAPACITY.
+     * @param[out] ring_id ID of the decrypt ring
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid or capacity is too large
+     * @retval ERROR_UNKNOWN Too many rings are open, or error by other reasons
+     */
+    mcdm_status_t OpenDecryptRing(const mcdm_buffer_t& init_data,
+                                  uint32_t capacity,
+                                  uint32_t* ring_id);
+
+    /**
+     * @brief This function appends an encrypted payload to a decrypt ring.
+     *
+     * - Only one thread may push entries to a ring. No lock is taken.
+     * - The buffers of the entry must stay valid until the entry is popped.
+     *
+     * @param[in] ring_id ID of the decrypt ring
+     * @param[in] entry Entry of the payload. entry.sample.dst.data must be supplied by the caller,
+     * or be equal to entry.sample.src.data for in-place decryption.
+     * @retval OK success
+     * @retval ERROR_BUFFER_FULL The input ring is full. Pop decrypted entries and push again.
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid or the ring is not open
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t PushDecryptRing(uint32_t ring_id,
+                                  const mcdm_decrypt_ring_entry_t& entry);
+
+    /**
+     * @brief This function takes decrypted entries of a decrypt ring in the pushed order.
+     *
+     * Only one thread may pop entries from a ring. No lock is taken and it does not wait for entries.
+     * entry.status of each entry is the result of its decryption.
+     *
+     * @param[in] ring_id ID of the decrypt ring
+     * @param[out] entries Array of decrypted entries
+     * @param[in] max_num Number of elements of entries
+     * @param[out] num Number of entries taken
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Output parameter is NULL or the ring is not open
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t PopDecryptRing(uint32_t ring_id,
+                                 mcdm_decrypt_ring_entry_t* entries,
+                                 uint32_t max_num,
+                                 uint32_t* num);
+
+    /**
+     * @brief This function closes a decrypt ring and joins its consumer thread.
+     *
+     * Entries which are not popped are dropped. Calls of [PushDecryptRing()](@ref PushDecryptRing) and
+     * [PopDecryptRing()](@ref PopDecryptRing) running at the same time finish before the ring is freed, and
+     * later calls return ERROR_ILLEGAL_ARGUMENT until ring_id is given to a new ring by OpenDecryptRing().
+     *
+     * @param[in] ring_id ID of the decrypt ring
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT The ring is not open
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t CloseDecryptRing(uint32_t ring_id);
+
+    /**
+     * @brief This function decrypts a recorded MPEG-2 TS file.
+     *
+     * The file is split into chunks of MCDM_FILE_DECRYPT_CHUNK_SIZE bytes, which are read, descrambled
+     * in the same way as [DescrambleTs()](@ref DescrambleTs) with init_data and written on thread_num
+     * threads in parallel. Each chunk is read and written at the same offset, so that dst_fd may be src_fd
+     * to decrypt the file in place. A partial packet at the end of the file is written as it is.
+     * The calling thread is one of the threads and the function returns when the whole file is written.
+     *
+     * @param[in] init_data Initialization data
+     * @param[in] src_fd File descriptor of the encrypted regular file, opened for reading
+     * @param[in] dst_fd File descriptor of the output file, opened for writing. (It is resized to the input size)
+     * @param[in] thread_num Number of threads. (0 - 64, 0 uses one thread per online CPU)
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is NULL or invalid
+     * @retval ERROR_UNKNOWN I/O error or error by other reasons
+     */
+    mcdm_status_t DecryptTsFile(const mcdm_buffer_t& init_data,
+                                int src_fd,
+                                int dst_fd,
+                                uint32_t thread_num);
+
+    /**
+     * @brief This function sets the number of IPTV-ES handles kept initialized for OpenSession().
+     *
+     * A session ID is reserved for each handle of the pool, and the handles are initialized on the
+     * task thread of the CDM. OpenSession() takes a handle of the pool when there is one, and the pool
+     * is refilled in the background, so that a channel change does not wait on the initialization.
+     * Handles of closed sessions are finalized in the background as well.
+     *
+     * @param[in] size Number of handles. (0 - 16, 0 disables the pool)
+     *
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Number of handles is invalid
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t SetSessionPoolSize(uint32_t size);
+
+    /**
+     * @brief This function prepares the request messages of GenerateKeyRequest() for likely next channels.
+     *
+     * The host opens a session for each likely next channel (see [SetSessionPoolSize()](@ref SetSessionPoolSize)),
+     * and the request message of the session for its init_data is made on the IPTV-ES handle of the session on
+     * the task thread of the CDM. GenerateKeyRequest() of the session with the same init_data, which is the first
+     * key request of the session, gives the prepared request message at once. The licenses are bound to the
+     * session ID of the session as with a request message made by GenerateKeyRequest().
+     *
+     * - A prepared request message is dropped ttl_ms after it is made. The TTL should be shorter than
+     *   the time in which the license server accepts a request message.
+     * - A session has one prepared request message. Preparing other init_data for the session drops it,
+     *   and the same init_data is not prepared again until its TTL is over.
+     * - Up to MCDM_CHALLENGE_CACHE_MAX request messages are kept, the oldest ones are dropped for new ones.
+     * - A session which has made a key request, and a request message which the agent gives by fd,
+     *   are not prepared.
+     * - Sessions which are not used for a channel should be closed by CloseSession().
+     *
+     * @param[in] session_handles Array of handles of sessions opened by OpenSession()
+     * @param[in] init_data Array of Initialization data (same format as GenerateKeyRequest()), one per session
+     * @param[in] num Number of sessions (0 - MCDM_CHALLENGE_CACHE_MAX)
+     * @param[in] ttl_ms Time to live of the request messages in milliseconds
+     *
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is NULL or invalid
+     * @retval ERROR_SESSION_NOT_OPENED A session is not opened
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t PrepareKeyRequests(const mcdm_session_handle_t* session_handles,
+                                     const mcdm_buffer_t* init_data,
+                                     uint32_t num,
+                                     uint32_t ttl_ms);
+
+    /**
+     * @brief This function sets the time after which a session which is not called is closed.
+     *
+     * A session is used by the functions of the session, e.g. GenerateKeyRequest() and AddKey().
+     * Idle sessions are closed once a second on the task thread of the CDM, in the same way as
+     * CloseSession(), and the functions of a closed session return ERROR_SESSION_NOT_OPENED.
+     * The default is MCDM_SESSION_IDLE_TIMEOUT.
+     *
+     * @param[in] idle_timeout Idle timeout in seconds. (0 does not close idle sessions)
+     *
+     * @retval OK success
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t SetSessionIdleTimeout(uint32_t idle_timeout);
+
+    /**
+     * @brief This function sets the budget of the memory of the open sessions.
+     *
+     * The memory of a session is the memory held for it by the CDM, including its last request message,
+     * and MCDM_SESSION_HANDLE_MEMORY_SIZE for its IPTV-ES handle. When the budget is exceeded, the least
+     * recently used sessions are closed. OpenSession() closes them before the new session is added, and
+     * fails when the new session does not fit in the budget. The growth of request messages is checked
+     * once a second. The default is MCDM_SESSION_MEMORY_BUDGET.
+     *
+     * @param[in] memory_budget Budget in bytes. (0 does not limit the memory)
+     *
+     * @retval OK success
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t SetSessionMemoryBudget(uint64_t memory_budget);
+
+    /**
+     * @brief This function starts worker threads for asynchronous decryption.
+     *
+     * Every worker thread has its own queue of samples. A worker which has nothing to do takes samples
+     * queued to a busy worker, so that a heavy stream is decrypted on all idle cores.
+     *
+     * @param[in] worker_num Number of worker threads. (0 - 64, 0 starts one worker per online CPU)
+     *
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Number of worker threads is invalid
+     * @retval ERROR_UNKNOWN Workers are started already or error by other reasons
+     */
+    mcdm_status_t StartDecryptWorkers(uint32_t worker_num);
+
+    /**
+     * @brief This function finishes all submitted asynchronous decryptions and stops the worker threads.
+     *
+     * - It must not be called from a completion callback.
+     *
+     * @retval OK success
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t StopDecryptWorkers();
+
+    /**
+     * @brief This function submits decryption of one sample to the worker threads and returns immediately.
+     *
+     * The sample is decrypted in the same way as [DecryptBatch()](@ref DecryptBatch) with one sample.\n
+     * Samples are decrypted in parallel, also samples submitted with the same stream_id.
+     * Completions of the same stream_id are delivered in the submitted order, one at a time.
+     *
+     * - init_data, sample and the buffers of sample must stay valid until the completion is delivered.
+     * - When callback is NULL, the completion is kept until it is taken by [PollDecryptCompletions()](@ref PollDecryptCompletions).
+     *
+     * @param[in] stream_id ID chosen by the caller to identify the stream (e.g. PID or track ID)
+     * @param[in] init_data Initialization data of media file. (same format as [Decrypt()](@ref Decrypt))
+     * @param[in,out] sample Sample to decrypt
+     * @param[in] callback Completion callback called on a worker thread, or NULL
+     * @param[in] user_data User data passed to the completion
+     * @param[out] request_id ID of the submitted request. NULL is allowed.
+     *
+     * @retval OK Submission is success
+     * @retval ERROR_ILLEGAL_ARGUMENT Input parameter is invalid
+     * @retval ERROR_UNKNOWN Workers are not started or error by other reasons
+     */
+    mcdm_status_t DecryptAsync(uint32_t stream_id,
+                               const mcdm_buffer_t& init_data,
+                               mcdm_sample_t* sample,
+                               mcdm_decrypt_callback_t callback,
+                               void* user_data,
+                               uint64_t* request_id);
+
+    /**
+     * @brief This function takes completions of asynchronous decryptions submitted without callback.
+     *
+     * It does not wait, and num is set to 0 when no completion is available.
+     *
+     * @param[out] completions Array to store completions
+     * @param[in] max_num Number of elements of completions
+     * @param[out] num Number of stored completions
+     *
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Output parameter is NULL
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t PollDecryptCompletions(mcdm_decrypt_completion_t* completions,
+                                         uint32_t max_num,
+                                         uint32_t* num);
+
     /**
      * @brief This function generates one or more key release messages.
      *
@@ -301,6 +1044,70 @@ class MarlinCdmInterface {
      */
     mcdm_status_t FreeKeyReleasesBuffer(mcdm_key_release_t* key_release, uint32_t key_release_num);
 
+    /**
+     * @brief This function gets statistics of the resolved key context cache.
+     *
+     * Decrypt functions and CheckKeyExist() look up the content key of KeyID information in the cache
+     * before calling the agent. The cache is cleared when licenses are changed by AddKey(),
+     * CloseSession() or AddKeyReleaseCommit().
+     *
+     * @param[out] stats Hit and miss counters of the cache
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Output parameter is NULL
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t GetKeyCacheStats(mcdm_key_cache_stats_t* stats);
+
+    /**
+     * @brief This function gets statistics of the key rotation of ECM streams.
+     *
+     * stalls counts the descrambles which resolved a key context because the ECM was given too late
+     * for the background resolution.
+     *
+     * @param[out] stats Counters of ECM streams
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Output parameter is NULL
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t GetEcmStreamStats(mcdm_ecm_stream_stats_t* stats);
+
+    /**
+     * @brief This function gets statistics of the asynchronous decrypt workers.
+     *
+     * The counters are reset by [StartDecryptWorkers()](@ref StartDecryptWorkers).
+     *
+     * @param[out] stats Decrypted and stolen sample counters of the workers
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Output parameter is NULL
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t GetDecryptWorkerStats(mcdm_decrypt_worker_stats_t* stats);
+
+    /**
+     * @brief This function gets statistics of the buffer pool of decrypted data and request messages.
+     *
+     * bytes_in_use_high_water tells the memory which the pool needs for the peak load.
+     *
+     * @param[out] stats Allocation counters and memory usage of the pool
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Output parameter is NULL
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t GetBufferPoolStats(mcdm_buffer_pool_stats_t* stats);
+
+    /**
+     * @brief This function gets statistics of the open sessions and their memory.
+     *
+     * memory_size stays flat while sessions are not leaked, and evictions count the sessions closed
+     * by [SetSessionIdleTimeout()](@ref SetSessionIdleTimeout) and [SetSessionMemoryBudget()](@ref SetSessionMemoryBudget).
+     *
+     * @param[out] stats Number, memory and evictions of sessions
+     * @retval OK success
+     * @retval ERROR_ILLEGAL_ARGUMENT Output parameter is NULL
+     * @retval ERROR_UNKNOWN Error by other reasons
+     */
+    mcdm_status_t GetSessionStats(mcdm_session_stats_t* stats);
+
     /**
      * @brief This function get the MarlinCdmInterface instance. (singleton)
      *
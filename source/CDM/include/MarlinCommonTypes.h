@@ -21,6 +21,8 @@
 #include <cstring>
 #include <stdint.h>
 
+#include "MarlinError.h"
+
 /* Size of Initialization data */
 #define MCDM_SIZE_REQ_TYPE                   1
 #define MCDM_SIZE_ACT_ID                     1
@@ -31,6 +33,9 @@
 #define MCDM_SIZE_KID_INFO_TYPE              1
 #define MCDM_SIZE_KID_INFO_LEN               4
 
+/* Size of AES block, IV and counter block of content */
+#define MCDM_SIZE_AES_BLOCK                  16
+
 /* Byte index of Initialization data for CheckKeyExist()/Decrypt() */
 #define MCDM_INDEX_KID_INFO_TYPE             0
 #define MCDM_INDEX_KID_INFO_LEN              (MCDM_INDEX_KID_INFO_TYPE + MCDM_SIZE_KID_INFO_TYPE)
@@ -99,15 +104,184 @@ namespace marlincdm {
  */
 typedef string mcdm_session_id_t;
 
+/**
+ * @brief Compact handle of a session, returned by OpenSession() together with the session ID
+ *
+ * The lower bits are the index of the slot of the session (as many as needed for MCDM_SESSION_TABLE_SLOT_NUM),
+ * and the upper bits are the generation of the slot. A handle of a closed session is not valid again when the slot
+ * is reused.
+ */
+typedef uint32_t mcdm_session_handle_t;
+
+/**
+ * @brief Value of mcdm_session_handle_t which is never given to a session
+ */
+#define MCDM_SESSION_HANDLE_INVALID          0
+
 /**
  * @brief This structure includes data length and data buffer and fd
+ *
+ * A buffer of decryption can be given by fd (memfd, dma-buf or a regular file) instead of data.
+ * Then data is NULL and len is not 0, and the buffer is len bytes from offset in fd.
  */
 struct mcdm_buffer_t {
     size_t len; //!< data size
     uint8_t *data; //!< data buffer
     int fd; //!< File descriptor
+    size_t offset; //!< Byte offset of the buffer in fd (used when the buffer is given by fd)
+};
+
+/**
+ * @brief Owner of the output buffer of decryption
+ */
+enum mcdm_decrypt_mode_t {
+    MCDM_DECRYPT_MODE_AGENT_BUFFER = 0, //!< Output buffer is allocated by Marlin CDM
+    MCDM_DECRYPT_MODE_IN_PLACE, //!< Decrypted data overwrites the input buffer
+    MCDM_DECRYPT_MODE_CALLER_BUFFER, //!< Output buffer is supplied by the caller
+    MCDM_DECRYPT_MODE_FD_BUFFER, //!< Output buffer is supplied by the caller as fd and offset
+    MCDM_DECRYPT_MODE_POOL_BUFFER, //!< Output buffer is taken from the buffer pool and owned by the caller until it is released
+};
+
+/**
+ * @brief This structure describes one subsample.(clear range followed by encrypted range)
+ */
+struct mcdm_subsample_t {
+    uint32_t clear_bytes; //!< Number of clear bytes at the head of the subsample
+    uint32_t encrypted_bytes; //!< Number of encrypted bytes following the clear bytes
+};
+
+/**
+ * @brief This structure includes a pair of input and output buffers for one sample.
+ */
+struct mcdm_sample_t {
+    mcdm_buffer_t src; //!< Input buffer of encrypted data
+    mcdm_buffer_t dst; //!< Output buffer of decrypted data (data NULL : taken from the buffer pool of Marlin CDM and given back by ReleaseBuffer(), data equal to src : in-place, otherwise : supplied by the caller)
+    const mcdm_subsample_t *subsamples; //!< Subsample map (NULL : whole of src is encrypted)
+    uint32_t subsample_num; //!< Number of subsamples
+};
+
+/**
+ * @brief This structure includes the result of an asynchronous decryption.
+ */
+struct mcdm_decrypt_completion_t {
+    uint32_t stream_id; //!< Stream ID given at the submission
+    uint64_t request_id; //!< Request ID returned at the submission
+    mcdm_status_t status; //!< Result of decryption
+    mcdm_sample_t *sample; //!< Sample given at the submission (dst is set when status is OK)
+    void *user_data; //!< User data given at the submission
+};
+
+/**
+ * @brief Completion callback of an asynchronous decryption. It is called on a worker thread of Marlin CDM.
+ */
+typedef void (*mcdm_decrypt_callback_t)(const mcdm_decrypt_completion_t& completion);
+
+/**
+ * @brief This structure includes statistics of the resolved key context cache.
+ */
+struct mcdm_key_cache_stats_t {
+    uint64_t hits; //!< Number of lookups answered by a resolved key context
+    uint64_t misses; //!< Number of lookups which needed the agent to resolve the key
+    uint64_t evictions; //!< Number of key contexts dropped to keep the cache bounded
+    uint32_t entries; //!< Number of key contexts in the cache
+};
+
+/**
+ * @brief This structure includes statistics of the asynchronous decrypt workers.
+ */
+struct mcdm_decrypt_worker_stats_t {
+    uint32_t worker_num; //!< Number of running worker threads
+    uint64_t executed; //!< Number of samples decrypted by the workers
+    uint64_t steals; //!< Number of times an idle worker took samples queued to another worker
+    uint64_t stolen; //!< Number of samples taken by the steals
+    uint64_t reordered; //!< Number of samples finished before an earlier sample of the same stream
 };
 
+/**
+ * @brief This structure includes one entry of a decrypt ring. (see OpenDecryptRing())
+ */
+struct mcdm_decrypt_ring_entry_t {
+    uint64_t tag; //!< Value given by the producer and returned with the decrypted entry, e.g. the index of the payload
+    mcdm_sample_t sample; //!< Input and output buffers of the payload. dst is supplied by the producer (in-place when equal to src)
+    mcdm_status_t status; //!< Result of the decryption (set in the decrypted entry)
+};
+
+/**
+ * @brief This structure includes statistics of the buffer pool of decrypted data and key request messages.
+ */
+struct mcdm_buffer_pool_stats_t {
+    uint64_t allocations; //!< Number of buffers allocated from the heap
+    uint64_t reuses; //!< Number of buffers taken from the free lists of the pool
+    uint64_t releases; //!< Number of buffers given back to the pool
+    uint64_t bytes_in_use; //!< Bytes of buffers handed out and not released yet
+    uint64_t bytes_in_use_high_water; //!< Maximum of bytes_in_use since the engine is created
+    uint64_t bytes_cached; //!< Bytes of free buffers kept by the pool
+};
+
+/**
+ * @brief Key parity of ECM and of scrambled MPEG-2 TS packets
+ */
+enum mcdm_key_parity_t {
+    MCDM_KEY_PARITY_EVEN = 0, //!< Even key (transport_scrambling_control '10')
+    MCDM_KEY_PARITY_ODD, //!< Odd key (transport_scrambling_control '11')
+};
+
+/**
+ * @brief This structure includes statistics of the key rotation of ECM streams.
+ */
+struct mcdm_ecm_stream_stats_t {
+    uint32_t streams; //!< Number of open ECM streams
+    uint64_t prefetched; //!< Number of key contexts resolved in the background before their crypto-period
+    uint64_t stalls; //!< Number of descrambles which had to resolve a key context synchronously
+    uint64_t rotations; //!< Number of times a new key context replaced the previous one of the same parity
+};
+
+/**
+ * @brief This structure includes statistics of the open sessions and their memory.
+ */
+struct mcdm_session_stats_t {
+    uint32_t sessions; //!< Number of open sessions
+    uint64_t memory_size; //!< Bytes accounted to the open sessions
+    uint64_t memory_size_high_water; //!< Maximum of memory_size since the engine is created
+    uint64_t idle_evictions; //!< Number of sessions closed by the idle timeout
+    uint64_t memory_evictions; //!< Number of least recently used sessions closed to keep the memory budget
+};
+
+/**
+ * @brief State of an asynchronous license acquisition. (see AcquireLicenseAsync())
+ */
+enum mcdm_license_state_t {
+    MCDM_LICENSE_STATE_GENERATING = 0, //!< The request message is made by the agent
+    MCDM_LICENSE_STATE_WAITING_RESPONSE, //!< The request message is given to the transport, the response is waited for
+    MCDM_LICENSE_STATE_PROCESSING, //!< The response is processed by the agent
+};
+
+/**
+ * @brief This structure includes the result of an asynchronous license acquisition.
+ */
+struct mcdm_license_completion_t {
+    uint64_t token; //!< Token returned by AcquireLicenseAsync()
+    mcdm_session_handle_t session_handle; //!< Handle of the session
+    mcdm_status_t status; //!< OK when the agent ended the exchange, ERROR_CANCELED, ERROR_TIMEOUT or the error of the failed step
+    void *user_data; //!< User data given to AcquireLicenseAsync()
+};
+
+/**
+ * @brief Transport of an asynchronous license acquisition. It is called on the task thread of Marlin CDM and must not block.
+ *
+ * The request message is sent to the license server, and the response is given back by SubmitLicenseResponse() with the token.
+ * request is valid only until the transport returns.
+ * It must not call releaseMarlinCdmInterface() or CloseSession().
+ */
+typedef void (*mcdm_license_transport_t)(uint64_t token, const mcdm_buffer_t& request, void* user_data);
+
+/**
+ * @brief Completion callback of an asynchronous license acquisition. It is called on the task thread of Marlin CDM.
+ *
+ * It must not call releaseMarlinCdmInterface() or CloseSession().
+ */
+typedef void (*mcdm_license_callback_t)(const mcdm_license_completion_t& completion);
+
 /**
  * @brief This structure includes keyRelease information.
  */
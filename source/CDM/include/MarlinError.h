@@ -28,6 +28,9 @@ enum mcdm_status_t {
     ERROR_UNKNOWN,  //!< Error by other reasons
     ERROR_ILLEGAL_ARGUMENT,  //!< Invalid parameter
     ERROR_SESSION_NOT_OPENED,  //!< Session is discarded
+    ERROR_BUFFER_FULL,  //!< Queue is full, retry after the consumer takes entries
+    ERROR_CANCELED,  //!< Request is canceled
+    ERROR_TIMEOUT,  //!< Request is not finished in time
 };
 
 } // marlincdm
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SESSION_HANDLE_POOL_H__
+#define __SESSION_HANDLE_POOL_H__
+
+#include <deque>
+
+#include "CMutex.h"
+#include "CdmTaskRunner.h"
+#include "KeyContextCache.h"
+#include "AgentHandlerPool.h"
+#include "MarlinAgentHandler.h"
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+
+/* Number of IPTV-ES handles initialized ahead of OpenSession() when the engine starts */
+#ifndef MCDM_SESSION_POOL_SIZE
+#define MCDM_SESSION_POOL_SIZE 0
+#endif
+
+/* Maximum number of IPTV-ES handles initialized ahead */
+#define MCDM_SESSION_POOL_MAX 16
+
+namespace marlincdm {
+
+/**
+ * Pool of IPTV-ES handles initialized ahead of OpenSession() on the task runner.
+ *
+ * A handle is initialized for a session ID, so each entry keeps the session ID taken for it, and the agent
+ * which the handle is bound to.
+ * OpenSession() takes a ready entry, and the pool is refilled by one handle per task, so that other
+ * tasks of the runner are not kept waiting. Handles of closed sessions are finalized on the task runner
+ * as well, off the thread of CloseSession(). When a handle may hold licenses, the key cache is invalidated
+ * once by retire(), and contexts resolved until the handle is finalized are not kept (see
+ * KeyContextCache::beginChange()). Handles which have not processed a response (ready handles, handles of
+ * sessions which never added a key or of a failed OpenSession()) leave the key cache as it is.
+ */
+class SessionHandlePool {
+private:
+    struct Entry {
+        mcdm_session_id_t sessionId;
+        uint32_t agent;
+        MH_iptvesHandle_t handle;
+    };
+
+    struct RetireJob {
+        SessionHandlePool *pool;
+        uint32_t agent;
+        MH_iptvesHandle_t handle;
+        bool licensesChanged;
+    };
+
+    AgentHandlerPool *mAgents;
+    CdmTaskRunner *mTaskRunner;
+    KeyContextCache *mKeyCache;
+    deque<Entry> mReady;
+    uint32_t mSize;
+    bool mRefilling; // a refill task is posted
+    CMutex mMutex;
+
+    SessionHandlePool(const SessionHandlePool &o);
+    SessionHandlePool& operator=(const SessionHandlePool &o);
+
+    static void refillTask(void* arg);
+    static void retireTask(void* arg);
+    void refill();
+    bool needRefill();
+    bool init(Entry& entry);
+    void finalize(uint32_t agent, MH_iptvesHandle_t handle);
+
+public:
+    SessionHandlePool(AgentHandlerPool* agents, CdmTaskRunner* task_runner, KeyContextCache* key_cache);
+
+    /**
+     * The task runner must be stopped before, the handles which are ready are finalized.
+     */
+    virtual ~SessionHandlePool();
+
+    /**
+     * Set the number of handles kept ready. Surplus handles are finalized by the refill task.
+     */
+    mcdm_status_t setSize(uint32_t size);
+
+    /**
+     * Take a ready handle, the session ID which it is initialized for and its agent.
+     * It returns false when no handle is ready.
+     */
+    bool take(mcdm_session_id_t& session_id, uint32_t* agent, MH_iptvesHandle_t* handle);
+
+    /**
+     * Take a ready handle, or initialize one on the thread of the caller when no handle is ready.
+     */
+    mcdm_status_t acquire(mcdm_session_id_t& session_id, uint32_t* agent, MH_iptvesHandle_t* handle);
+
+    /**
+     * Finalize the handle of a closed session on the task runner, and give back its agent by
+     * AgentHandlerPool::unassign().
+     *
+     * @param licenses_changed true when the handle may have processed a response, then the key contexts
+     * are dropped before it returns, and none are kept until the handle is finalized
+     */
+    void retire(uint32_t agent, MH_iptvesHandle_t handle, bool licenses_changed);
+
+};  //class
+};  //namespace
+
+#endif /* __SESSION_HANDLE_POOL_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
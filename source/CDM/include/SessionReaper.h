@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SESSION_REAPER_H__
+#define __SESSION_REAPER_H__
+
+#include <set>
+#include <vector>
+
+#include "CAtomic.h"
+#include "CMutex.h"
+#include "CdmTaskRunner.h"
+#include "MarlinCommonTypes.h"
+
+/* Idle timeout of sessions in seconds when the engine starts (0: idle sessions are not closed) */
+#ifndef MCDM_SESSION_IDLE_TIMEOUT
+#define MCDM_SESSION_IDLE_TIMEOUT 0
+#endif
+
+/* Budget of the memory of sessions in bytes when the engine starts (0: not limited) */
+#ifndef MCDM_SESSION_MEMORY_BUDGET
+#define MCDM_SESSION_MEMORY_BUDGET 0
+#endif
+
+/* Bytes accounted to the IPTV-ES handle of each session. The agent does not report the memory of its handles. */
+#ifndef MCDM_SESSION_HANDLE_MEMORY_SIZE
+#define MCDM_SESSION_HANDLE_MEMORY_SIZE 4096
+#endif
+
+/* Number of one-second ticks of the timer wheel */
+#define MCDM_SESSION_REAPER_WHEEL_SIZE 64
+
+/* Interval of the reaper in milliseconds */
+#define MCDM_SESSION_REAPER_INTERVAL 1000
+
+namespace marlincdm {
+
+using namespace std;
+
+/**
+ * Timer wheel of the idle timeouts of sessions, and the limits and counters of the reaper.
+ *
+ * Each session is scheduled once, at the tick when it becomes idle for the timeout. A call of the session
+ * only updates lastUsed of the session and does not touch the wheel. When the tick comes, the engine checks
+ * lastUsed and either closes the session or schedules it again. Deadlines beyond the wheel stay in their
+ * slot until the wheel comes round to them.
+ */
+class SessionReaper {
+private:
+    struct Timer {
+        mcdm_session_handle_t handle;
+        uint32_t deadline;
+    };
+
+    vector<Timer> mWheel[MCDM_SESSION_REAPER_WHEEL_SIZE];
+    set<mcdm_session_handle_t> mScheduled;
+    uint32_t mTick; // last tick which is expired
+    CMutex mMutex;
+    volatile uint32_t mIdleTimeout;
+    volatile uint64_t mMemoryBudget;
+    volatile uint32_t mRunning; // the reap task is posted
+    volatile uint64_t mIdleEvictions;
+    volatile uint64_t mMemoryEvictions;
+
+    SessionReaper(const SessionReaper &o);
+    SessionReaper& operator=(const SessionReaper &o);
+
+public:
+    SessionReaper(uint32_t idle_timeout, uint64_t memory_budget);
+    virtual ~SessionReaper();
+
+    /**
+     * Seconds of CdmTaskRunner::now(), the clock of lastUsed of sessions.
+     */
+    static uint32_t now();
+
+    void setIdleTimeout(uint32_t idle_timeout);
+    uint32_t idleTimeout();
+    void setMemoryBudget(uint64_t memory_budget);
+    uint64_t memoryBudget();
+    bool isEnabled();
+
+    /**
+     * Schedule a session at the tick of deadline. A session which is scheduled already is not scheduled twice.
+     */
+    void schedule(mcdm_session_handle_t handle, uint32_t deadline);
+
+    /**
+     * Take the sessions whose deadline is not later than now out of the wheel.
+     */
+    void expire(uint32_t now, vector<mcdm_session_handle_t>& handles);
+
+    void clear();
+
+    /**
+     * Mark the reap task as posted. It returns false when it is posted already.
+     */
+    bool start();
+
+    void stop();
+
+    void countEviction(bool idle);
+
+    void getStatistics(mcdm_session_stats_t* stats);
+
+};  //class
+};  //namespace
+
+#endif /* __SESSION_REAPER_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
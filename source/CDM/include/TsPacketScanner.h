@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MARLIN_TS_PACKET_SCANNER_H__
+#define __MARLIN_TS_PACKET_SCANNER_H__
+
+#include <cstring>
+#include <vector>
+
+#include "MarlinCommonTypes.h"
+#include "MarlinError.h"
+#include "MarlinAgentHandlerType.h"
+
+/* MPEG-2 TS packet */
+#define MCDM_TS_PACKET_SIZE 188
+#define MCDM_TS_HEADER_SIZE 4
+#define MCDM_TS_SYNC_BYTE 0x47
+
+/* Fields of the 4 byte packet header read as big endian */
+#define MCDM_TS_HEADER_SYNC_MASK 0xFF000000U
+#define MCDM_TS_HEADER_SYNC 0x47000000U
+#define MCDM_TS_HEADER_TEI 0x00800000U
+#define MCDM_TS_HEADER_TSC_MASK 0x000000C0U
+#define MCDM_TS_HEADER_TSC_EVEN 0x00000080U
+#define MCDM_TS_HEADER_TSC_ODD 0x000000C0U
+#define MCDM_TS_HEADER_ADAPTATION 0x00000020U
+#define MCDM_TS_HEADER_PAYLOAD 0x00000010U
+
+namespace marlincdm {
+
+/**
+ * Scanner of a chunk of MPEG-2 TS packets for descrambling in place.
+ *
+ * scan() checks every packet and collects the payloads of the scrambled packets per key parity
+ * (transport_scrambling_control '10' : even, '11' : odd) as MH_sample_t which decrypt in place.
+ * Packets with transport_error_indicator are left untouched.
+ * The payloads of a parity are saved by savePayloads() before they are decrypted, and either
+ * clearScramblingControl() marks the packets of the parity as clear, or restorePayloads() puts back
+ * the scrambled payloads when the decryption fails, so that every packet stays consistent with its header.
+ * The payloads are saved into a buffer of the caller, which keeps its size over the chunks.
+ */
+class TsPacketScanner {
+public:
+  TsPacketScanner(uint8_t* data, size_t len, std::vector<uint8_t>& saved);
+
+  /**
+   * @return ERROR_ILLEGAL_ARGUMENT when the chunk is not a whole number of packets,
+   *         a sync byte is lost or an adaptation field is broken. Nothing is collected then.
+   */
+  mcdm_status_t scan(std::vector<MH_sample_t>& even, std::vector<MH_sample_t>& odd);
+
+  void savePayloads(const std::vector<MH_sample_t>& samples);
+  void restorePayloads(const std::vector<MH_sample_t>& samples);
+  void clearScramblingControl(mcdm_key_parity_t parity);
+
+  size_t getScrambledNum() const { return mScrambled[MCDM_KEY_PARITY_EVEN].size() + mScrambled[MCDM_KEY_PARITY_ODD].size(); }
+
+private:
+  uint8_t *mData;
+  size_t mLen;
+  std::vector<uint32_t> mScrambled[2]; // packet index per mcdm_key_parity_t
+  std::vector<uint8_t>& mSaved; // scrambled payloads given to savePayloads()
+  size_t mSavedLen;
+
+  static uint32_t readHeader(const uint8_t* packet);
+  mcdm_status_t collect(uint32_t index, uint32_t header,
+                        std::vector<MH_sample_t>& even, std::vector<MH_sample_t>& odd);
+};
+
+inline TsPacketScanner::TsPacketScanner(uint8_t* data, size_t len, std::vector<uint8_t>& saved)
+  : mData(data), mLen(len), mSaved(saved), mSavedLen(0) {
+}
+
+inline uint32_t TsPacketScanner::readHeader(const uint8_t* packet) {
+  return ((uint32_t)packet[0] << 24) | ((uint32_t)packet[1] << 16) | ((uint32_t)packet[2] << 8) | (uint32_t)packet[3];
+}
+
+inline mcdm_status_t TsPacketScanner::scan(std::vector<MH_sample_t>& even, std::vector<MH_sample_t>& odd) {
+  mcdm_status_t status = OK;
+  uint32_t packet_num = 0;
+  uint32_t i = 0;
+
+  even.clear();
+  odd.clear();
+  mScrambled[MCDM_KEY_PARITY_EVEN].clear();
+  mScrambled[MCDM_KEY_PARITY_ODD].clear();
+
+  if ((mData == NULL) || (mLen == 0) || ((mLen % MCDM_TS_PACKET_SIZE) != 0)) {
+    return ERROR_ILLEGAL_ARGUMENT;
+  }
+  packet_num = (uint32_t)(mLen / MCDM_TS_PACKET_SIZE);
+
+  /*
+   * Four headers are checked at once : when all of them have the sync byte, are clear and have no
+   * adaptation field, which is the usual case of PSI and clear PIDs, the group has nothing more to check.
+   */
+  for (; i + 4 <= packet_num; i += 4) {
+    const uint8_t* packet = mData + (size_t)i * MCDM_TS_PACKET_SIZE;
+    uint32_t h0 = readHeader(packet);
+    uint32_t h1 = readHeader(packet + MCDM_TS_PACKET_SIZE);
+    uint32_t h2 = readHeader(packet + 2 * MCDM_TS_PACKET_SIZE);
+    uint32_t h3 = readHeader(packet + 3 * MCDM_TS_PACKET_SIZE);
+
+    if ((((h0 ^ MCDM_TS_HEADER_SYNC) | (h1 ^ MCDM_TS_HEADER_SYNC) | (h2 ^ MCDM_TS_HEADER_SYNC) |
+          (h3 ^ MCDM_TS_HEADER_SYNC)) &
+         (MCDM_TS_HEADER_SYNC_MASK | MCDM_TS_HEADER_TSC_MASK | MCDM_TS_HEADER_ADAPTATION)) == 0) {
+      continue;
+    }
+    if (((status = collect(i, h0, even, odd)) != OK) ||
+        ((status = collect(i + 1, h1, even, odd)) != OK) ||
+        ((status = collect(i + 2, h2, even, odd)) != OK) ||
+        ((status = collect(i + 3, h3, even, odd)) != OK)) {
+      break;
+    }
+  }
+  for (; (status == OK) && (i < packet_num); i++) {
+    status = collect(i, readHeader(mData + (size_t)i * MCDM_TS_PACKET_SIZE), even, odd);
+  }
+
+  if (status != OK) {
+    even.clear();
+    odd.clear();
+    mScrambled[MCDM_KEY_PARITY_EVEN].clear();
+    mScrambled[MCDM_KEY_PARITY_ODD].clear();
+  }
+  return status;
+}
+
+inline mcdm_status_t TsPacketScanner::collect(uint32_t index, uint32_t header,
+                                              std::vector<MH_sample_t>& even, std::vector<MH_sample_t>& odd) {
+  uint8_t* packet = mData + (size_t)index * MCDM_TS_PACKET_SIZE;
+  size_t offset = MCDM_TS_HEADER_SIZE;
+  MH_sample_t sample;
+
+  if ((header & MCDM_TS_HEADER_SYNC_MASK) != MCDM_TS_HEADER_SYNC) {
+    return ERROR_ILLEGAL_ARGUMENT;
+  }
+  if (header & MCDM_TS_HEADER_ADAPTATION) {
+    /* adaptation_field_length : 0 - 183, up to 182 when a payload follows */
+    offset += 1 + (size_t)packet[MCDM_TS_HEADER_SIZE];
+    if (offset > MCDM_TS_PACKET_SIZE) {
+      return ERROR_ILLEGAL_ARGUMENT;
+    }
+  }
+  if (((header & MCDM_TS_HEADER_TSC_MASK) < MCDM_TS_HEADER_TSC_EVEN) || (header & MCDM_TS_HEADER_TEI)) {
+    /* Clear, reserved or broken packet */
+    return OK;
+  }
+
+  if ((header & MCDM_TS_HEADER_TSC_MASK) == MCDM_TS_HEADER_TSC_ODD) {
+    mScrambled[MCDM_KEY_PARITY_ODD].push_back(index);
+  } else {
+    mScrambled[MCDM_KEY_PARITY_EVEN].push_back(index);
+  }
+  if (((header & MCDM_TS_HEADER_PAYLOAD) == 0) || (offset == MCDM_TS_PACKET_SIZE)) {
+    /* No payload to decrypt, only the scrambling control is cleared. */
+    return OK;
+  }
+
+  sample.src.len = MCDM_TS_PACKET_SIZE - offset;
+  sample.src.data = packet + offset;
+  sample.src.fd = -1;
+  sample.src.offset = 0;
+  sample.dst = sample.src;
+  sample.subsamples = NULL;
+  sample.subsample_num = 0;
+  if ((header & MCDM_TS_HEADER_TSC_MASK) == MCDM_TS_HEADER_TSC_ODD) {
+    odd.push_back(sample);
+  } else {
+    even.push_back(sample);
+  }
+  return OK;
+}
+
+inline void TsPacketScanner::savePayloads(const std::vector<MH_sample_t>& samples) {
+  std::vector<MH_sample_t>::const_iterator it;
+  size_t total = 0;
+
+  for (it = samples.begin(); it != samples.end(); ++it) {
+    total += it->src.len;
+  }
+  /* Only grown, so that a buffer of the same size chunks is allocated once. */
+  if (mSaved.size() < total) {
+    mSaved.resize(total);
+  }
+  mSavedLen = 0;
+  for (it = samples.begin(); it != samples.end(); ++it) {
+    memcpy(&mSaved[mSavedLen], it->src.data, it->src.len);
+    mSavedLen += it->src.len;
+  }
+}
+
+inline void TsPacketScanner::restorePayloads(const std::vector<MH_sample_t>& samples) {
+  size_t saved = 0;
+
+  for (std::vector<MH_sample_t>::const_iterator it = samples.begin();
+       (it != samples.end()) && (saved + it->src.len <= mSavedLen); ++it) {
+    memcpy(it->src.data, &mSaved[saved], it->src.len);
+    saved += it->src.len;
+  }
+  mSavedLen = 0;
+}
+
+inline void TsPacketScanner::clearScramblingControl(mcdm_key_parity_t parity) {
+  std::vector<uint32_t>& scrambled = mScrambled[parity];
+
+  for (std::vector<uint32_t>::iterator it = scrambled.begin(); it != scrambled.end(); ++it) {
+    mData[(size_t)*it * MCDM_TS_PACKET_SIZE + 3] &= (uint8_t)~MCDM_TS_HEADER_TSC_MASK;
+  }
+  scrambled.clear();
+  mSavedLen = 0;
+}
+
+} // namespace marlincdm
+
+#endif /* __MARLIN_TS_PACKET_SCANNER_H__ */
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AgentHandlerPool"
+#include "MarlinLog.h"
+
+#include "AgentHandlerPool.h"
+
+using namespace marlincdm;
+
+AgentHandlerPool::AgentHandlerPool(uint32_t agent_num)
+    : mNum(0)
+{
+    MARLINLOG_ENTER();
+
+    MH_status_t agentStatus = MH_ERR_OK;
+    MH_agentHandle_t handle = NULL;
+
+    if (agent_num == 0) {
+        agent_num = 1;
+    } else if (agent_num > MCDM_AGENT_HANDLER_MAX) {
+        agent_num = MCDM_AGENT_HANDLER_MAX;
+    }
+
+    for (uint32_t i = 0; i < agent_num; i++) {
+        MarlinAgentHandler* handler = new MarlinAgentHandler();
+        if (handler == NULL) {
+            LOGE("ERROR : Could not allocate instance of MarlinAgentHandler.\n");
+            break;
+        }
+        handle = NULL;
+        agentStatus = handler->initAgent(&handle);
+        if (agentStatus != MH_ERR_OK) {
+            LOGE("ERROR : calling initAgent (%d).\n", agentStatus);
+            if (i > 0) {
+                delete handler;
+                break;
+            }
+        }
+        mAgents[mNum].handler = handler;
+        mAgents[mNum].handle = handle;
+        mAgents[mNum].load = 0;
+        mAgents[mNum].sessions = 0;
+        mNum++;
+    }
+}
+
+AgentHandlerPool::~AgentHandlerPool()
+{
+    MARLINLOG_ENTER();
+
+    MH_status_t agentStatus = MH_ERR_OK;
+
+    for (uint32_t i = 0; i < mNum; i++) {
+        if (mAgents[i].handle != NULL) {
+            agentStatus = mAgents[i].handler->finAgent(mAgents[i].handle);
+            if (agentStatus != MH_ERR_OK) {
+                LOGE("ERROR : calling finAgent (%d).\n", agentStatus);
+            }
+        }
+        delete mAgents[i].handler;
+    }
+    mNum = 0;
+}
+
+uint32_t AgentHandlerPool::size()
+{
+    return mNum;
+}
+
+MarlinAgentHandler* AgentHandlerPool::handler(uint32_t index)
+{
+    return (index < mNum) ? mAgents[index].handler : NULL;
+}
+
+MH_agentHandle_t AgentHandlerPool::handle(uint32_t index)
+{
+    return (index < mNum) ? mAgents[index].handle : NULL;
+}
+
+uint32_t AgentHandlerPool::assign()
+{
+    uint32_t index = 0;
+
+    for (uint32_t i = 1; i < mNum; i++) {
+        if (atomicLoad(&mAgents[i].sessions) < atomicLoad(&mAgents[index].sessions)) {
+            index = i;
+        }
+    }
+    atomicAdd(&mAgents[index].sessions, (uint32_t)1);
+    return index;
+}
+
+void AgentHandlerPool::unassign(uint32_t index)
+{
+    if (index < mNum) {
+        atomicSub(&mAgents[index].sessions, (uint32_t)1);
+    }
+}
+
+uint32_t AgentHandlerPool::select()
+{
+    uint32_t index = 0;
+    uint32_t load = 0;
+
+    if (mNum == 1) {
+        return 0;
+    }
+    load = atomicLoad(&mAgents[0].load);
+    for (uint32_t i = 1; (i < mNum) && (load > 0); i++) {
+        uint32_t agent_load = atomicLoad(&mAgents[i].load);
+        if (agent_load < load) {
+            index = i;
+            load = agent_load;
+        }
+    }
+    return index;
+}
+
+void AgentHandlerPool::enter(uint32_t index)
+{
+    if (mNum > 1) {
+        atomicAdd(&mAgents[index].load, (uint32_t)1);
+    }
+}
+
+void AgentHandlerPool::leave(uint32_t index)
+{
+    if (mNum > 1) {
+        atomicSub(&mAgents[index].load, (uint32_t)1);
+    }
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#define LOG_TAG "CdmBufferPool"
+#include "MarlinLog.h"
+
+#include "CdmBufferPool.h"
+
+using namespace marlincdm;
+
+CdmBufferPool::CdmBufferPool()
+    : mInUse(NULL),
+      mAllocations(0),
+      mReuses(0),
+      mReleases(0),
+      mBytesInUse(0),
+      mHighWater(0),
+      mBytesCached(0)
+{
+    MARLINLOG_ENTER();
+
+    for (int32_t i = 0; i < MCDM_BUFFER_POOL_CLASS_NUM; i++) {
+        mFree[i] = NULL;
+        mFreeNum[i] = 0;
+    }
+}
+
+CdmBufferPool::~CdmBufferPool()
+{
+    MARLINLOG_ENTER();
+
+    trim();
+    /* Buffers which are not released by the caller are freed with the pool. */
+    while (mInUse != NULL) {
+        Buffer* buffer = mInUse;
+        mInUse = buffer->next;
+        free(buffer);
+    }
+}
+
+uint8_t* CdmBufferPool::acquire(size_t size, const void* owner)
+{
+    int32_t index = classOf(size);
+    size_t capacity = (index >= 0) ? classSize(index) : size;
+    Buffer* buffer = NULL;
+    void* memory = NULL;
+
+    mMutex.lock();
+    if ((index >= 0) && (mFree[index] != NULL)) {
+        buffer = mFree[index];
+        mFree[index] = buffer->next;
+        mFreeNum[index]--;
+        mBytesCached -= capacity;
+        mReuses++;
+    } else {
+        mAllocations++;
+    }
+    mMutex.unlock();
+
+    if (buffer == NULL) {
+        /* Allocate without holding the lock. */
+        if (posix_memalign(&memory, MCDM_BUFFER_POOL_ALIGN, MCDM_BUFFER_POOL_ALIGN + capacity) != 0) {
+            LOGE("ERROR : Could not allocate buffer (%zu).\n", capacity);
+            return NULL;
+        }
+        buffer = static_cast<Buffer*>(memory);
+        buffer->capacity = capacity;
+    }
+    buffer->pool = this;
+    buffer->owner = owner;
+
+    mMutex.lock();
+    buffer->prev = NULL;
+    buffer->next = mInUse;
+    if (mInUse != NULL) {
+        mInUse->prev = buffer;
+    }
+    mInUse = buffer;
+    mBytesInUse += capacity;
+    if (mBytesInUse > mHighWater) {
+        mHighWater = mBytesInUse;
+    }
+    mMutex.unlock();
+
+    return dataOf(buffer);
+}
+
+mcdm_status_t CdmBufferPool::release(uint8_t* data, const void* owner)
+{
+    int32_t index = -1;
+    Buffer* buffer = NULL;
+
+    if (data == NULL) {
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    buffer = bufferOf(data);
+
+    mMutex.lock();
+    if ((buffer->pool != this) || (buffer->owner != owner)) {
+        mMutex.unlock();
+        LOGE("ERROR : Buffer is not taken from the pool.\n");
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    unlink(buffer);
+    buffer->pool = NULL;
+    mBytesInUse -= buffer->capacity;
+    mReleases++;
+
+    index = classOf(buffer->capacity);
+    if ((index >= 0) && (classSize(index) == buffer->capacity) && (mFreeNum[index] < MCDM_BUFFER_POOL_FREE_MAX)) {
+        buffer->next = mFree[index];
+        mFree[index] = buffer;
+        mFreeNum[index]++;
+        mBytesCached += buffer->capacity;
+        buffer = NULL;
+    }
+    mMutex.unlock();
+
+    free(buffer);
+    return OK;
+}
+
+void CdmBufferPool::trim()
+{
+    Buffer* buffers = NULL;
+
+    mMutex.lock();
+    for (int32_t i = 0; i < MCDM_BUFFER_POOL_CLASS_NUM; i++) {
+        while (mFree[i] != NULL) {
+            Buffer* buffer = mFree[i];
+            mFree[i] = buffer->next;
+            buffer->next = buffers;
+            buffers = buffer;
+        }
+        mFreeNum[i] = 0;
+    }
+    mBytesCached = 0;
+    mMutex.unlock();
+
+    while (buffers != NULL) {
+        Buffer* buffer = buffers;
+        buffers = buffer->next;
+        free(buffer);
+    }
+}
+
+void CdmBufferPool::getStatistics(mcdm_buffer_pool_stats_t* stats)
+{
+    mMutex.lock();
+    stats->allocations = mAllocations;
+    stats->reuses = mReuses;
+    stats->releases = mReleases;
+    stats->bytes_in_use = mBytesInUse;
+    stats->bytes_in_use_high_water = mHighWater;
+    stats->bytes_cached = mBytesCached;
+    mMutex.unlock();
+}
+
+/* Index of the smallest class which holds size, or -1 when size is larger than all classes. */
+int32_t CdmBufferPool::classOf(size_t size)
+{
+    int32_t index = 0;
+
+    while (classSize(index) < size) {
+        if (++index >= MCDM_BUFFER_POOL_CLASS_NUM) {
+            return -1;
+        }
+    }
+    return index;
+}
+
+size_t CdmBufferPool::classSize(int32_t index)
+{
+    return (size_t)1 << (MCDM_BUFFER_POOL_MIN_SHIFT + index);
+}
+
+uint8_t* CdmBufferPool::dataOf(Buffer* buffer)
+{
+    return reinterpret_cast<uint8_t*>(buffer) + MCDM_BUFFER_POOL_ALIGN;
+}
+
+CdmBufferPool::Buffer* CdmBufferPool::bufferOf(uint8_t* data)
+{
+    return reinterpret_cast<Buffer*>(data - MCDM_BUFFER_POOL_ALIGN);
+}
+
+/* Called with mMutex held. */
+void CdmBufferPool::unlink(Buffer* buffer)
+{
+    if (buffer->prev != NULL) {
+        buffer->prev->next = buffer->next;
+    } else {
+        mInUse = buffer->next;
+    }
+    if (buffer->next != NULL) {
+        buffer->next->prev = buffer->prev;
+    }
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOG_TAG "CdmFileDecryptor"
+#include "MarlinLog.h"
+
+#include "CdmFileDecryptor.h"
+#include "CAtomic.h"
+#include "MarlinCdmEngine.h"
+#include "TsPacketScanner.h"
+
+/* Alignment of the chunk buffers, for direct I/O by the file system */
+#define MCDM_FILE_DECRYPT_ALIGN 4096
+
+using namespace marlincdm;
+
+namespace {
+
+/* pread() and pwrite() may transfer less than asked, e.g. when interrupted by a signal. */
+bool readFully(int fd, uint8_t* data, size_t len, off_t offset)
+{
+    while (len > 0) {
+        ssize_t done = pread(fd, data, len, offset);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (done == 0) {
+            return false;
+        }
+        data += done;
+        len -= (size_t)done;
+        offset += done;
+    }
+    return true;
+}
+
+bool writeFully(int fd, const uint8_t* data, size_t len, off_t offset)
+{
+    while (len > 0) {
+        ssize_t done = pwrite(fd, data, len, offset);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += done;
+        len -= (size_t)done;
+        offset += done;
+    }
+    return true;
+}
+
+}
+
+CdmFileDecryptor::CdmFileDecryptor(MarlinCdmEngine* engine)
+    : mEngine(engine)
+{
+    MARLINLOG_ENTER();
+}
+
+CdmFileDecryptor::~CdmFileDecryptor()
+{
+    MARLINLOG_ENTER();
+}
+
+mcdm_status_t CdmFileDecryptor::decryptTs(const mcdm_buffer_t& init_data, int src_fd, int dst_fd, uint32_t thread_num)
+{
+    struct stat st;
+    pthread_t threads[MCDM_FILE_DECRYPT_THREAD_MAX];
+    uint32_t started = 0;
+    Job job;
+
+    if ((src_fd < 0) || (dst_fd < 0) || (fstat(src_fd, &st) != 0) || !S_ISREG(st.st_mode)) {
+        LOGE("ERROR : Input file is not a regular file (%d).\n", src_fd);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    if (thread_num == 0) {
+        long cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_num = (cpu_num > 0) ? (uint32_t)cpu_num : 1;
+    }
+    if (thread_num > MCDM_FILE_DECRYPT_THREAD_MAX) {
+        thread_num = MCDM_FILE_DECRYPT_THREAD_MAX;
+    }
+    /* No more threads than chunks. */
+    uint64_t chunk_num = ((uint64_t)st.st_size + MCDM_FILE_DECRYPT_CHUNK_SIZE - 1) / MCDM_FILE_DECRYPT_CHUNK_SIZE;
+    if (thread_num > chunk_num) {
+        thread_num = (chunk_num > 0) ? (uint32_t)chunk_num : 1;
+    }
+
+    if (dst_fd != src_fd) {
+        /* A larger old output file is cut to the size of the input. */
+        struct stat dst_st;
+        if ((fstat(dst_fd, &dst_st) == 0) && S_ISREG(dst_st.st_mode) && (ftruncate(dst_fd, st.st_size) != 0)) {
+            LOGE("ERROR : Could not resize output file. errno(%d).\n", errno);
+            return ERROR_UNKNOWN;
+        }
+    }
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    job.decryptor = this;
+    job.initData = &init_data;
+    job.srcFd = src_fd;
+    job.dstFd = dst_fd;
+    job.size = st.st_size;
+    job.nextChunk = 0;
+    job.status = OK;
+
+    /* The calling thread works as one of the threads. */
+    for (; started + 1 < thread_num; started++) {
+        if (pthread_create(&threads[started], NULL, threadEntry, &job) != 0) {
+            LOGE("ERROR : Could not create thread of file decryption.\n");
+            break;
+        }
+    }
+    run(&job);
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    return (mcdm_status_t)job.status;
+}
+
+void* CdmFileDecryptor::threadEntry(void* arg)
+{
+    Job* job = static_cast<Job*>(arg);
+    job->decryptor->run(job);
+    return NULL;
+}
+
+void CdmFileDecryptor::run(Job* job)
+{
+    void* memory = NULL;
+    mcdm_buffer_t chunk;
+
+    if (posix_memalign(&memory, MCDM_FILE_DECRYPT_ALIGN, MCDM_FILE_DECRYPT_CHUNK_SIZE) != 0) {
+        LOGE("ERROR : Could not allocate chunk buffer.\n");
+        fail(job, ERROR_UNKNOWN);
+        return;
+    }
+    memset(&chunk, 0, sizeof(mcdm_buffer_t));
+    chunk.data = static_cast<uint8_t*>(memory);
+    chunk.fd = -1;
+
+    while (atomicLoadAcquire(&job->status) == OK) {
+        uint64_t index = atomicAdd(&job->nextChunk, (uint64_t)1) - 1;
+        off_t offset = (off_t)(index * MCDM_FILE_DECRYPT_CHUNK_SIZE);
+        if (offset >= job->size) {
+            break;
+        }
+        size_t len = MCDM_FILE_DECRYPT_CHUNK_SIZE;
+        if ((off_t)len > job->size - offset) {
+            len = (size_t)(job->size - offset);
+        }
+
+        if (!readFully(job->srcFd, chunk.data, len, offset)) {
+            LOGE("ERROR : Could not read input file at %lld. errno(%d).\n", (long long)offset, errno);
+            fail(job, ERROR_UNKNOWN);
+            break;
+        }
+        /* A partial packet at the end of a truncated recording is written as it is. */
+        chunk.len = len - (len % MCDM_TS_PACKET_SIZE);
+        if (chunk.len > 0) {
+            mcdm_status_t status = mEngine->DescrambleTs(*job->initData, &chunk);
+            if (status != OK) {
+                LOGE("ERROR : Could not descramble chunk at %lld.\n", (long long)offset);
+                fail(job, status);
+                break;
+            }
+        }
+        if (!writeFully(job->dstFd, chunk.data, len, offset)) {
+            LOGE("ERROR : Could not write output file at %lld. errno(%d).\n", (long long)offset, errno);
+            fail(job, ERROR_UNKNOWN);
+            break;
+        }
+    }
+
+    free(memory);
+}
+
+void CdmFileDecryptor::fail(Job* job, mcdm_status_t status)
+{
+    /* The first error is reported. */
+    atomicCompareAndSwap(&job->status, (uint32_t)OK, (uint32_t)status);
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
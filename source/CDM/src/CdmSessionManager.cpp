@@ -13,7 +13,6 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-#include <sstream>
 
 #define LOG_TAG "CdmSessionManager"
 #include "MarlinLog.h"
@@ -24,7 +23,7 @@
 using namespace marlincdm;
 
 // singleton instance and lock
-CdmSessionManager *CdmSessionManager::sInstance = NULL;
+CdmSessionManager * volatile CdmSessionManager::sInstance = NULL;
 CMutex CdmSessionManager::sMutex;
 
 CdmSessionManager::CdmSessionManager() : mSessionId(MCDM_SESSION_ID_INIT)
@@ -41,24 +40,24 @@ mcdm_status_t CdmSessionManager::getCdmSessionId(mcdm_session_id_t &sessionId)
 {
     MARLINLOG_ENTER();
 
-    ostringstream stream;
+    uint64_t current = 0;
+    uint64_t id = 0;
+    char digits[24];
+    char* p = digits + sizeof(digits);
 
-    mSessionIdMutex.lock();
-    if (mSessionId < 0) {
-        //error;
-        LOGV("Error: Session ID: [%lld]\n", mSessionId);
-        MARLINLOG_EXIT();
-        return ERROR_UNKNOWN;
-    }
+    /* Concurrent callers retry on the counter instead of waiting on a lock. */
+    do {
+        current = atomicLoadAcquire(&mSessionId);
+        id = (current >= (uint64_t)LLONG_MAX) ? MCDM_SESSION_ID_INIT : current;
+    } while (!atomicCompareAndSwap(&mSessionId, current, id + 1));
 
-    if (mSessionId >= LLONG_MAX) {
-        mSessionId = MCDM_SESSION_ID_INIT;
-    }
-    stream << mSessionId;
-    sessionId =  stream.str();
-    LOGV("Session ID: str[%s] [%lld]\n",sessionId.c_str(), mSessionId);
-    mSessionId++;
-    mSessionIdMutex.unlock();
+    /* Decimal digits are written from the end of a stack buffer, without a stream. */
+    do {
+        *--p = (char)('0' + (id % 10));
+        id /= 10;
+    } while (id != 0);
+    sessionId.assign(p, (size_t)(digits + sizeof(digits) - p));
+    LOGV("Session ID: str[%s]\n", sessionId.c_str());
 
     MARLINLOG_EXIT();
     return OK;
@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#define LOG_TAG "CdmSessionTable"
+#include "MarlinLog.h"
+
+#include "CdmSessionTable.h"
+
+using namespace marlincdm;
+
+CdmSessionTable::CdmSessionTable()
+    : mIndexBits(0),
+      mGenerationMax(0),
+      mCount(0),
+      mMemory(0),
+      mMemoryHighWater(0)
+{
+    MARLINLOG_ENTER();
+
+    /* The slot index takes as few bits as possible, the generation takes the rest of the handle. */
+    while ((1U << mIndexBits) < MCDM_SESSION_TABLE_SLOT_NUM) {
+        mIndexBits++;
+    }
+    mGenerationMax = 0xFFFFFFFFU >> mIndexBits;
+
+    /* Slot 0 is taken first. */
+    for (uint32_t i = 0; i < MCDM_SESSION_TABLE_SLOT_NUM; i++) {
+        mSlots[i].handle = MCDM_SESSION_HANDLE_INVALID;
+        mSlots[i].session = NULL;
+        mSlots[i].generation = 1;
+        mFreeSlots.push_back(i);
+    }
+}
+
+CdmSessionTable::~CdmSessionTable()
+{
+    MARLINLOG_ENTER();
+}
+
+mcdm_status_t CdmSessionTable::insert(CdmSession* session)
+{
+    Shard& shard = shardOf(session->sessionId);
+    mcdm_status_t status = OK;
+    uint32_t index = 0;
+
+    mSlotMutex.lock();
+    if (mFreeSlots.empty()) {
+        mSlotMutex.unlock();
+        LOGE("ERROR : No free session slot.\n");
+        return ERROR_UNKNOWN;
+    }
+    index = mFreeSlots.front();
+    mFreeSlots.pop_front();
+    mSlotMutex.unlock();
+    /* Given back by releaseHandle(). */
+    atomicAdd(&mCount, (uint32_t)1);
+    addMemory(session->memorySize);
+
+    CRWLock& stripe = mStripes[index % MCDM_SESSION_TABLE_SHARD_NUM].lock;
+    stripe.writeLock();
+    session->handle = ((mcdm_session_handle_t)mSlots[index].generation << mIndexBits) | index;
+    mSlots[index].session = session;
+    stripe.unlock();
+
+    shard.lock.writeLock();
+    if (!shard.sessions.insert(make_pair(session->sessionId, session)).second) {
+        status = ERROR_ILLEGAL_ARGUMENT;
+    }
+    shard.lock.unlock();
+
+    if (status != OK) {
+        LOGE("ERROR : session id is used already. session_id(%s).\n", session->sessionId.c_str());
+        releaseHandle(session);
+        return status;
+    }
+    /* The session is found by the handle from here. */
+    stripe.writeLock();
+    mSlots[index].handle = session->handle;
+    stripe.unlock();
+    return OK;
+}
+
+CdmSession* CdmSessionTable::find(const mcdm_session_id_t& session_id)
+{
+    Shard& shard = shardOf(session_id);
+    CdmSession* session = NULL;
+
+    shard.lock.readLock();
+    map<mcdm_session_id_t, CdmSession*>::iterator it = shard.sessions.find(session_id);
+    if (it != shard.sessions.end()) {
+        session = it->second;
+        atomicAdd(&session->refCount, (uint32_t)1);
+    }
+    shard.lock.unlock();
+
+    return session;
+}
+
+CdmSession* CdmSessionTable::find(mcdm_session_handle_t handle)
+{
+    Slot* slot = slotOf(handle);
+    CdmSession* session = NULL;
+
+    if (slot == NULL) {
+        return NULL;
+    }
+    CRWLock& stripe = stripeOf(handle);
+    stripe.readLock();
+    if (slot->handle == handle) {
+        session = slot->session;
+        atomicAdd(&session->refCount, (uint32_t)1);
+    }
+    stripe.unlock();
+
+    return session;
+}
+
+CdmSession* CdmSessionTable::remove(const mcdm_session_id_t& session_id)
+{
+    Shard& shard = shardOf(session_id);
+    CdmSession* session = NULL;
+
+    shard.lock.writeLock();
+    map<mcdm_session_id_t, CdmSession*>::iterator it = shard.sessions.find(session_id);
+    if (it != shard.sessions.end()) {
+        /* A remove() by the handle may have taken the session already. */
+        Slot* slot = slotOf(it->second->handle);
+        CRWLock& stripe = stripeOf(it->second->handle);
+        stripe.writeLock();
+        if (slot->handle == it->second->handle) {
+            slot->handle = MCDM_SESSION_HANDLE_INVALID;
+            session = it->second;
+        }
+        stripe.unlock();
+        if (session != NULL) {
+            shard.sessions.erase(it);
+        }
+    }
+    shard.lock.unlock();
+
+    return session;
+}
+
+CdmSession* CdmSessionTable::remove(mcdm_session_handle_t handle)
+{
+    Slot* slot = slotOf(handle);
+    CdmSession* session = NULL;
+
+    if (slot == NULL) {
+        return NULL;
+    }
+    /* Only one of concurrent remove() calls of the session clears the handle of the slot. */
+    CRWLock& stripe = stripeOf(handle);
+    stripe.writeLock();
+    if (slot->handle == handle) {
+        slot->handle = MCDM_SESSION_HANDLE_INVALID;
+        session = slot->session;
+    }
+    stripe.unlock();
+
+    if (session != NULL) {
+        eraseFromShard(session);
+    }
+    return session;
+}
+
+void CdmSessionTable::releaseHandle(CdmSession* session)
+{
+    Slot* slot = slotOf(session->handle);
+
+    if (slot == NULL) {
+        return;
+    }
+    CRWLock& stripe = stripeOf(session->handle);
+    stripe.writeLock();
+    slot->session = NULL;
+    /* Generation 0 is skipped, so that no handle is MCDM_SESSION_HANDLE_INVALID. */
+    if (++slot->generation > mGenerationMax) {
+        slot->generation = 1;
+    }
+    stripe.unlock();
+
+    mSlotMutex.lock();
+    mFreeSlots.push_back(session->handle & ((1U << mIndexBits) - 1));
+    mSlotMutex.unlock();
+    session->handle = MCDM_SESSION_HANDLE_INVALID;
+    atomicSub(&mMemory, (uint64_t)session->memorySize);
+    atomicSub(&mCount, (uint32_t)1);
+}
+
+void CdmSessionTable::removeAll(vector<CdmSession*>& sessions)
+{
+    size_t first = sessions.size();
+
+    for (uint32_t i = 0; i < MCDM_SESSION_TABLE_SHARD_NUM; i++) {
+        Shard& shard = mShards[i];
+        shard.lock.writeLock();
+        for (map<mcdm_session_id_t, CdmSession*>::iterator it = shard.sessions.begin();
+             it != shard.sessions.end(); ++it) {
+            CRWLock& stripe = stripeOf(it->second->handle);
+            stripe.writeLock();
+            slotOf(it->second->handle)->handle = MCDM_SESSION_HANDLE_INVALID;
+            stripe.unlock();
+            sessions.push_back(it->second);
+        }
+        shard.sessions.clear();
+        shard.lock.unlock();
+    }
+    for (size_t i = first; i < sessions.size(); i++) {
+        releaseHandle(sessions[i]);
+    }
+}
+
+void CdmSessionTable::account(CdmSession* session, uint32_t size)
+{
+    uint32_t old_size = session->memorySize;
+
+    if (size == old_size) {
+        return;
+    }
+    session->memorySize = size;
+    if (size > old_size) {
+        addMemory(size - old_size);
+    } else {
+        atomicSub(&mMemory, (uint64_t)(old_size - size));
+    }
+}
+
+void CdmSessionTable::findLeastRecentlyUsed(uint64_t size, vector<CdmSession*>& sessions)
+{
+    vector<pair<uint32_t, mcdm_session_handle_t> > candidates; // lastUsed and handle
+    vector<uint32_t> memory_sizes;
+    uint32_t oldest = 0;
+    uint64_t found = 0;
+
+    for (uint32_t i = 0; i < MCDM_SESSION_TABLE_SLOT_NUM; i++) {
+        CRWLock& stripe = mStripes[i % MCDM_SESSION_TABLE_SHARD_NUM].lock;
+        stripe.readLock();
+        if (mSlots[i].handle != MCDM_SESSION_HANDLE_INVALID) {
+            if (candidates.empty() || ((int32_t)(mSlots[i].session->lastUsed - oldest) < 0)) {
+                oldest = mSlots[i].session->lastUsed;
+            }
+            candidates.push_back(make_pair((uint32_t)mSlots[i].session->lastUsed, mSlots[i].handle));
+        }
+        stripe.unlock();
+    }
+
+    /* Ordered by the time since the oldest, which does not wrap around. */
+    for (size_t i = 0; i < candidates.size(); i++) {
+        candidates[i].first -= oldest;
+    }
+    sort(candidates.begin(), candidates.end());
+
+    for (size_t i = 0; (i < candidates.size()) && (found < size); i++) {
+        /* Skipped when the session is closed after the scan. */
+        CdmSession* session = find(candidates[i].second);
+        if (session != NULL) {
+            found += session->memorySize;
+            sessions.push_back(session);
+        }
+    }
+}
+
+void CdmSessionTable::getHandles(vector<mcdm_session_handle_t>& handles)
+{
+    for (uint32_t i = 0; i < MCDM_SESSION_TABLE_SLOT_NUM; i++) {
+        CRWLock& stripe = mStripes[i % MCDM_SESSION_TABLE_SHARD_NUM].lock;
+        stripe.readLock();
+        if (mSlots[i].handle != MCDM_SESSION_HANDLE_INVALID) {
+            handles.push_back(mSlots[i].handle);
+        }
+        stripe.unlock();
+    }
+}
+
+uint64_t CdmSessionTable::memorySize()
+{
+    return atomicLoad(&mMemory);
+}
+
+void CdmSessionTable::getStatistics(mcdm_session_stats_t* stats)
+{
+    stats->sessions = atomicLoad(&mCount);
+    stats->memory_size = atomicLoad(&mMemory);
+    stats->memory_size_high_water = atomicLoad(&mMemoryHighWater);
+}
+
+void CdmSessionTable::addMemory(uint32_t size)
+{
+    uint64_t memory = atomicAdd(&mMemory, (uint64_t)size);
+    uint64_t high_water = atomicLoad(&mMemoryHighWater);
+
+    while ((memory > high_water) && !atomicCompareAndSwap(&mMemoryHighWater, high_water, memory)) {
+        high_water = atomicLoad(&mMemoryHighWater);
+    }
+}
+
+void CdmSessionTable::eraseFromShard(CdmSession* session)
+{
+    Shard& shard = shardOf(session->sessionId);
+
+    shard.lock.writeLock();
+    map<mcdm_session_id_t, CdmSession*>::iterator it = shard.sessions.find(session->sessionId);
+    if ((it != shard.sessions.end()) && (it->second == session)) {
+        shard.sessions.erase(it);
+    }
+    shard.lock.unlock();
+}
+
+/* NULL when the index of the handle is out of the slots. */
+CdmSessionTable::Slot* CdmSessionTable::slotOf(mcdm_session_handle_t handle)
+{
+    uint32_t index = handle & ((1U << mIndexBits) - 1);
+
+    if ((handle == MCDM_SESSION_HANDLE_INVALID) || (index >= MCDM_SESSION_TABLE_SLOT_NUM)) {
+        return NULL;
+    }
+    return &mSlots[index];
+}
+
+CRWLock& CdmSessionTable::stripeOf(mcdm_session_handle_t handle)
+{
+    return mStripes[(handle & ((1U << mIndexBits) - 1)) % MCDM_SESSION_TABLE_SHARD_NUM].lock;
+}
+
+/* FNV-1a hash of the session ID. Consecutive IDs differ in the last digits, which spreads them over the shards. */
+CdmSessionTable::Shard& CdmSessionTable::shardOf(const mcdm_session_id_t& session_id)
+{
+    uint32_t hash = 2166136261U;
+
+    for (size_t i = 0; i < session_id.size(); i++) {
+        hash ^= (uint8_t)session_id[i];
+        hash *= 16777619U;
+    }
+    return mShards[hash & (MCDM_SESSION_TABLE_SHARD_NUM - 1)];
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
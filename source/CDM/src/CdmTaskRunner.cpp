@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CdmTaskRunner"
+#include "MarlinLog.h"
+
+#include "CdmTaskRunner.h"
+
+using namespace marlincdm;
+
+CdmTaskRunner::CdmTaskRunner()
+    : mRunning(false),
+      mStopping(false)
+{
+    MARLINLOG_ENTER();
+}
+
+CdmTaskRunner::~CdmTaskRunner()
+{
+    MARLINLOG_ENTER();
+    stop();
+}
+
+mcdm_status_t CdmTaskRunner::start()
+{
+    MARLINLOG_ENTER();
+
+    mMutex.lock();
+    if (mRunning) {
+        LOGE("ERROR : Task runner is started already.\n");
+        mMutex.unlock();
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+    mStopping = false;
+    if (pthread_create(&mThread, NULL, threadEntry, this) != 0) {
+        LOGE("ERROR : Could not create task runner thread.\n");
+        mMutex.unlock();
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+    mRunning = true;
+    mMutex.unlock();
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+void CdmTaskRunner::stop()
+{
+    MARLINLOG_ENTER();
+
+    mMutex.lock();
+    if (!mRunning || mStopping) {
+        mMutex.unlock();
+        MARLINLOG_EXIT();
+        return;
+    }
+    mStopping = true;
+    mCond.signal();
+    mMutex.unlock();
+
+    pthread_join(mThread, NULL);
+
+    mMutex.lock();
+    mRunning = false;
+    mMutex.unlock();
+
+    MARLINLOG_EXIT();
+}
+
+mcdm_status_t CdmTaskRunner::post(Task task, void* arg)
+{
+    Entry entry;
+
+    entry.task = task;
+    entry.arg = arg;
+
+    mMutex.lock();
+    if (!mRunning || mStopping) {
+        mMutex.unlock();
+        return ERROR_UNKNOWN;
+    }
+    mTasks.push_back(entry);
+    mCond.signal();
+    mMutex.unlock();
+
+    return OK;
+}
+
+mcdm_status_t CdmTaskRunner::postDelayed(Task task, void* arg, uint32_t delay_ms)
+{
+    Entry entry;
+
+    entry.task = task;
+    entry.arg = arg;
+
+    mMutex.lock();
+    if (!mRunning || mStopping) {
+        mMutex.unlock();
+        return ERROR_UNKNOWN;
+    }
+    mDelayed.insert(make_pair(now() + delay_ms, entry));
+    /* The thread may wait for a later task. */
+    mCond.signal();
+    mMutex.unlock();
+
+    return OK;
+}
+
+uint64_t CdmTaskRunner::now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void* CdmTaskRunner::threadEntry(void* arg)
+{
+    static_cast<CdmTaskRunner*>(arg)->run();
+    return NULL;
+}
+
+void CdmTaskRunner::run()
+{
+    Entry entry;
+
+    struct timespec deadline;
+
+    mMutex.lock();
+    for (;;) {
+        takeDelayed(mStopping);
+        while (mTasks.empty() && !mStopping) {
+            if (mDelayed.empty()) {
+                mCond.wait(mMutex);
+            } else {
+                deadline.tv_sec = mDelayed.begin()->first / 1000;
+                deadline.tv_nsec = (mDelayed.begin()->first % 1000) * 1000000;
+                mCond.waitUntil(mMutex, deadline);
+            }
+            takeDelayed(mStopping);
+        }
+        if (mTasks.empty()) {
+            /* Stopping and all posted tasks are run. */
+            break;
+        }
+        entry = mTasks.front();
+        mTasks.pop_front();
+        mMutex.unlock();
+        entry.task(entry.arg);
+        mMutex.lock();
+    }
+    mMutex.unlock();
+}
+
+/* Called with mMutex held. It moves the delayed tasks whose time has come, or all of them, to mTasks. */
+void CdmTaskRunner::takeDelayed(bool all)
+{
+    uint64_t current = mDelayed.empty() ? 0 : now();
+
+    while (!mDelayed.empty() && (all || (mDelayed.begin()->first <= current))) {
+        mTasks.push_back(mDelayed.begin()->second);
+        mDelayed.erase(mDelayed.begin());
+    }
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
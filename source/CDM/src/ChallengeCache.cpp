@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "ChallengeCache"
+#include "MarlinLog.h"
+
+#include <string.h>
+
+#include "ChallengeCache.h"
+#include "CdmTaskRunner.h"
+
+using namespace marlincdm;
+
+ChallengeCache::ChallengeCache()
+    : mNextSequence(1)
+{
+    MARLINLOG_ENTER();
+}
+
+ChallengeCache::~ChallengeCache()
+{
+    MARLINLOG_ENTER();
+
+    mEntries.clear();
+}
+
+bool ChallengeCache::reserve(mcdm_session_handle_t session,
+                             const mcdm_buffer_t& init_data,
+                             uint32_t ttl_ms,
+                             uint64_t* sequence)
+{
+    Entry entry;
+
+    mMutex.lock();
+    deque<Entry>::iterator it = findEntry(session);
+    if (it != mEntries.end()) {
+        if ((it->initData.size() == init_data.len) &&
+            (memcmp(&it->initData[0], init_data.data, init_data.len) == 0) &&
+            (it->request.empty() || (it->expiry > CdmTaskRunner::now()))) {
+            mMutex.unlock();
+            return false;
+        }
+        mEntries.erase(it);
+    }
+    if (mEntries.size() >= MCDM_CHALLENGE_CACHE_MAX) {
+        /* The oldest prediction makes room for the new one. */
+        mEntries.pop_front();
+    }
+    entry.session = session;
+    entry.initData.assign(init_data.data, init_data.data + init_data.len);
+    entry.sequence = mNextSequence++;
+    entry.ttl = ttl_ms;
+    entry.expiry = 0;
+    mEntries.push_back(entry);
+    *sequence = entry.sequence;
+    mMutex.unlock();
+
+    return true;
+}
+
+void ChallengeCache::put(mcdm_session_handle_t session, uint64_t sequence, vector<uint8_t>& request)
+{
+    mMutex.lock();
+    deque<Entry>::iterator it = findEntry(session);
+    if ((it != mEntries.end()) && (it->sequence == sequence)) {
+        if (request.empty()) {
+            mEntries.erase(it);
+        } else {
+            it->request.swap(request);
+            it->expiry = CdmTaskRunner::now() + it->ttl;
+        }
+    }
+    mMutex.unlock();
+}
+
+bool ChallengeCache::take(mcdm_session_handle_t session, const mcdm_buffer_t& init_data, vector<uint8_t>& request)
+{
+    bool taken = false;
+
+    mMutex.lock();
+    deque<Entry>::iterator it = findEntry(session);
+    if (it != mEntries.end()) {
+        /* Stale request messages are not given. */
+        if (!it->request.empty() &&
+            (it->expiry > CdmTaskRunner::now()) &&
+            (it->initData.size() == init_data.len) &&
+            (memcmp(&it->initData[0], init_data.data, init_data.len) == 0)) {
+            request.swap(it->request);
+            taken = true;
+        }
+        mEntries.erase(it);
+    }
+    mMutex.unlock();
+
+    return taken;
+}
+
+void ChallengeCache::drop(mcdm_session_handle_t session)
+{
+    mMutex.lock();
+    deque<Entry>::iterator it = findEntry(session);
+    if (it != mEntries.end()) {
+        mEntries.erase(it);
+    }
+    mMutex.unlock();
+}
+
+/* Called with mMutex held. */
+deque<ChallengeCache::Entry>::iterator ChallengeCache::findEntry(mcdm_session_handle_t session)
+{
+    deque<Entry>::iterator it = mEntries.begin();
+
+    while ((it != mEntries.end()) && (it->session != session)) {
+        ++it;
+    }
+    return it;
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <sched.h>
+
+#define LOG_TAG "DecryptRingManager"
+#include "MarlinLog.h"
+
+#include "DecryptRingManager.h"
+#include "MarlinCdmEngine.h"
+
+using namespace marlincdm;
+
+DecryptRingManager::DecryptRingManager(MarlinCdmEngine* engine)
+    : mEngine(engine)
+{
+    MARLINLOG_ENTER();
+
+    for (uint32_t i = 0; i < MCDM_DECRYPT_RING_MAX; i++) {
+        mSlots[i].ring = NULL;
+        mSlots[i].users = 0;
+    }
+}
+
+DecryptRingManager::~DecryptRingManager()
+{
+    MARLINLOG_ENTER();
+
+    for (uint32_t i = 0; i < MCDM_DECRYPT_RING_MAX; i++) {
+        if (mSlots[i].ring != NULL) {
+            destroy(mSlots[i].ring);
+            mSlots[i].ring = NULL;
+        }
+    }
+}
+
+mcdm_status_t DecryptRingManager::open(const mcdm_buffer_t& init_data, uint32_t capacity, uint32_t* ring_id)
+{
+    uint32_t index = 0;
+
+    if (capacity == 0) {
+        capacity = MCDM_DECRYPT_RING_DEFAULT_CAPACITY;
+    }
+    if (capacity > MCDM_DECRYPT_RING_MAX_CAPACITY) {
+        LOGE("ERROR : Capacity of decrypt ring is too large (%u).\n", capacity);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    DecryptRing* ring = new DecryptRing();
+    ring->manager = this;
+    ring->initData.assign(init_data.data, init_data.data + init_data.len);
+    ring->input = new CdmSpscRing<mcdm_decrypt_ring_entry_t>(capacity);
+    ring->output = new CdmSpscRing<mcdm_decrypt_ring_entry_t>(capacity);
+    ring->sleeping = 0;
+    ring->stopping = 0;
+    sem_init(&ring->doorbell, 0, 0);
+
+    mMutex.lock();
+    while ((index < MCDM_DECRYPT_RING_MAX) && (mSlots[index].ring != NULL)) {
+        index++;
+    }
+    if (index == MCDM_DECRYPT_RING_MAX) {
+        mMutex.unlock();
+        LOGE("ERROR : Too many decrypt rings.\n");
+        sem_destroy(&ring->doorbell);
+        delete ring->input;
+        delete ring->output;
+        delete ring;
+        return ERROR_UNKNOWN;
+    }
+    if (pthread_create(&ring->thread, NULL, threadEntry, ring) != 0) {
+        mMutex.unlock();
+        LOGE("ERROR : Could not create consumer thread of decrypt ring.\n");
+        sem_destroy(&ring->doorbell);
+        delete ring->input;
+        delete ring->output;
+        delete ring;
+        return ERROR_UNKNOWN;
+    }
+    atomicStoreRelease(&mSlots[index].ring, ring);
+    mMutex.unlock();
+
+    *ring_id = index + 1;
+    return OK;
+}
+
+mcdm_status_t DecryptRingManager::close(uint32_t ring_id)
+{
+    DecryptRing* ring = NULL;
+
+    if ((ring_id == 0) || (ring_id > MCDM_DECRYPT_RING_MAX)) {
+        LOGE("ERROR : Decrypt ring is not found (%u).\n", ring_id);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    Slot* slot = &mSlots[ring_id - 1];
+
+    mMutex.lock();
+    ring = slot->ring;
+    if ((ring == NULL) || !atomicCompareAndSwap(&slot->ring, ring, (DecryptRing*)NULL)) {
+        mMutex.unlock();
+        LOGE("ERROR : Decrypt ring is not found (%u).\n", ring_id);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    /*
+     * push() and pop() which found the ring leave it shortly. The lock is kept, so that open()
+     * does not put a new ring into the slot until then.
+     */
+    while (atomicLoad(&slot->users) != 0) {
+        sched_yield();
+    }
+    mMutex.unlock();
+
+    destroy(ring);
+    return OK;
+}
+
+mcdm_status_t DecryptRingManager::push(uint32_t ring_id, const mcdm_decrypt_ring_entry_t& entry)
+{
+    DecryptRing* ring = acquire(ring_id);
+
+    if (ring == NULL) {
+        LOGE("ERROR : Decrypt ring is not found (%u).\n", ring_id);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    if (!ring->input->push(entry)) {
+        /* Back-pressure : the consumer is behind or the decrypted entries are not taken. */
+        release(ring_id);
+        return ERROR_BUFFER_FULL;
+    }
+    wake(ring);
+    release(ring_id);
+    return OK;
+}
+
+mcdm_status_t DecryptRingManager::pop(uint32_t ring_id, mcdm_decrypt_ring_entry_t* entries, uint32_t max_num, uint32_t* num)
+{
+    DecryptRing* ring = acquire(ring_id);
+    uint32_t count = 0;
+
+    if (ring == NULL) {
+        LOGE("ERROR : Decrypt ring is not found (%u).\n", ring_id);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    while ((count < max_num) && ring->output->pop(&entries[count])) {
+        count++;
+    }
+    if (count > 0) {
+        /* The consumer may wait for space of the output ring. */
+        wake(ring);
+    }
+    release(ring_id);
+    *num = count;
+    return OK;
+}
+
+void* DecryptRingManager::threadEntry(void* arg)
+{
+    DecryptRing* ring = static_cast<DecryptRing*>(arg);
+    ring->manager->run(ring);
+    return NULL;
+}
+
+void DecryptRingManager::run(DecryptRing* ring)
+{
+    mcdm_decrypt_ring_entry_t entry;
+    mcdm_buffer_t init_data;
+
+    init_data.len = ring->initData.size();
+    init_data.data = ring->initData.empty() ? NULL : &ring->initData[0];
+    init_data.fd = -1;
+    init_data.offset = 0;
+
+    while (atomicLoad(&ring->stopping) == 0) {
+        if (!ring->output->full() && ring->input->pop(&entry)) {
+            entry.status = mEngine->DecryptBatch(init_data, &entry.sample, 1);
+            /* Only this thread pushes to the output ring, and it is not full. */
+            ring->output->push(entry);
+            continue;
+        }
+
+        atomicStore(&ring->sleeping, (uint32_t)1);
+        /* Check again, an entry or space may come before the flag is seen. */
+        if ((atomicLoad(&ring->stopping) != 0) || (!ring->output->full() && !ring->input->empty())) {
+            if (atomicCompareAndSwap(&ring->sleeping, (uint32_t)1, (uint32_t)0)) {
+                continue;
+            }
+            /* The other side took the flag and rings the doorbell. */
+        }
+        while ((sem_wait(&ring->doorbell) != 0) && (errno == EINTR)) {
+        }
+    }
+}
+
+/* The ring is not freed by close() until release() is called. */
+DecryptRingManager::DecryptRing* DecryptRingManager::acquire(uint32_t ring_id)
+{
+    DecryptRing* ring = NULL;
+
+    if ((ring_id == 0) || (ring_id > MCDM_DECRYPT_RING_MAX)) {
+        return NULL;
+    }
+    Slot* slot = &mSlots[ring_id - 1];
+
+    /* The count is seen by close() before the ring is loaded, or the ring is seen as NULL. */
+    atomicAdd(&slot->users, (uint32_t)1);
+    ring = atomicLoadAcquire(&slot->ring);
+    if (ring == NULL) {
+        atomicSub(&slot->users, (uint32_t)1);
+    }
+    return ring;
+}
+
+void DecryptRingManager::release(uint32_t ring_id)
+{
+    atomicSub(&mSlots[ring_id - 1].users, (uint32_t)1);
+}
+
+void DecryptRingManager::wake(DecryptRing* ring)
+{
+    if (atomicCompareAndSwap(&ring->sleeping, (uint32_t)1, (uint32_t)0)) {
+        sem_post(&ring->doorbell);
+    }
+}
+
+void DecryptRingManager::destroy(DecryptRing* ring)
+{
+    atomicStore(&ring->stopping, (uint32_t)1);
+    sem_post(&ring->doorbell);
+    pthread_join(ring->thread, NULL);
+
+    sem_destroy(&ring->doorbell);
+    delete ring->input;
+    delete ring->output;
+    delete ring;
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
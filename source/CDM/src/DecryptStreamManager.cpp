@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "DecryptStreamManager"
+#include "MarlinLog.h"
+
+#include "DecryptStreamManager.h"
+#include "CdmStreamId.h"
+
+using namespace marlincdm;
+
+DecryptStreamManager::DecryptStreamManager(AgentHandlerPool* agents, KeyContextCache* key_cache)
+    : mAgents(agents),
+      mKeyCache(key_cache),
+      mNextStreamId(1)
+{
+    MARLINLOG_ENTER();
+}
+
+DecryptStreamManager::~DecryptStreamManager()
+{
+    MARLINLOG_ENTER();
+
+    for (map<uint32_t, DecryptStream*>::iterator it = mStreams.begin(); it != mStreams.end(); ++it) {
+        destroy(it->second);
+    }
+    mStreams.clear();
+}
+
+mcdm_status_t DecryptStreamManager::open(MH_keyIdInfo_t& kid_info, const uint8_t* iv, uint32_t* stream_id)
+{
+    mcdm_status_t status = OK;
+    MH_status_t agentStatus = MH_ERR_OK;
+    KeyContext* context = NULL;
+    MH_streamHandle_t stream_handle = NULL;
+
+    status = mKeyCache->acquire(kid_info, &context);
+    if (status != OK) {
+        LOGE("ERROR : Could not resolve key context.\n");
+        return status;
+    }
+
+    agentStatus = mAgents->handler(context->agent)->openStreamContext(context->keyHandle, iv, &stream_handle);
+    if (agentStatus != MH_ERR_OK) {
+        LOGE("ERROR : calling openStreamContext (%d).\n", agentStatus);
+        mKeyCache->release(context);
+        return ERROR_UNKNOWN;
+    }
+
+    DecryptStream* stream = new DecryptStream();
+    stream->context = context;
+    stream->streamHandle = stream_handle;
+    stream->refCount = 1;
+    stream->closed = false;
+
+    mMutex.lock();
+    *stream_id = allocateStreamId(mStreams, &mNextStreamId);
+    mStreams[*stream_id] = stream;
+    mMutex.unlock();
+
+    return OK;
+}
+
+mcdm_status_t DecryptStreamManager::decrypt(uint32_t stream_id, MH_buffer_t* src, bool last, MH_buffer_t* dst)
+{
+    MH_status_t agentStatus = MH_ERR_OK;
+    DecryptStream* stream = NULL;
+
+    mMutex.lock();
+    map<uint32_t, DecryptStream*>::iterator it = mStreams.find(stream_id);
+    if (it == mStreams.end()) {
+        mMutex.unlock();
+        LOGE("ERROR : Decrypt stream is not found (%u).\n", stream_id);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    stream = it->second;
+    stream->refCount++;
+    mMutex.unlock();
+
+    stream->mutex.lock();
+    mAgents->enter(stream->context->agent);
+    agentStatus = mAgents->handler(stream->context->agent)->decryptStream(stream->streamHandle, src, last, dst);
+    mAgents->leave(stream->context->agent);
+    stream->mutex.unlock();
+    unref(stream);
+
+    if (agentStatus != MH_ERR_OK) {
+        LOGE("ERROR : calling decryptStream (%d).\n", agentStatus);
+        return (agentStatus == MH_ERR_TOO_SMALL_BUFFER) ? ERROR_ILLEGAL_ARGUMENT : ERROR_UNKNOWN;
+    }
+    return OK;
+}
+
+mcdm_status_t DecryptStreamManager::close(uint32_t stream_id)
+{
+    DecryptStream* stream = NULL;
+
+    mMutex.lock();
+    map<uint32_t, DecryptStream*>::iterator it = mStreams.find(stream_id);
+    if (it == mStreams.end()) {
+        mMutex.unlock();
+        LOGE("ERROR : Decrypt stream is not found (%u).\n", stream_id);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    stream = it->second;
+    stream->closed = true;
+    mStreams.erase(it);
+    mMutex.unlock();
+
+    unref(stream);
+    return OK;
+}
+
+void DecryptStreamManager::unref(DecryptStream* stream)
+{
+    bool last = false;
+
+    mMutex.lock();
+    stream->refCount--;
+    last = (stream->refCount == 0);
+    mMutex.unlock();
+
+    if (last) {
+        destroy(stream);
+    }
+}
+
+void DecryptStreamManager::destroy(DecryptStream* stream)
+{
+    MH_status_t agentStatus = mAgents->handler(stream->context->agent)->closeStreamContext(stream->streamHandle);
+    if (agentStatus != MH_ERR_OK) {
+        LOGE("ERROR : calling closeStreamContext (%d).\n", agentStatus);
+    }
+    mKeyCache->release(stream->context);
+    delete stream;
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#define LOG_TAG "DecryptWorkerPool"
+#include "MarlinLog.h"
+
+#include "CAtomic.h"
+#include "DecryptWorkerPool.h"
+#include "MarlinCdmEngine.h"
+
+using namespace marlincdm;
+
+DecryptWorkerPool::DecryptWorkerPool(MarlinCdmEngine* engine)
+    : mEngine(engine),
+      mNextRequestId(1),
+      mPending(0),
+      mReordered(0),
+      mRunning(false),
+      mStopping(false)
+{
+    MARLINLOG_ENTER();
+}
+
+DecryptWorkerPool::~DecryptWorkerPool()
+{
+    MARLINLOG_ENTER();
+    stop();
+    deleteWorkers();
+}
+
+mcdm_status_t DecryptWorkerPool::start(uint32_t worker_num)
+{
+    MARLINLOG_ENTER();
+
+    uint32_t started = 0;
+
+    if (worker_num == 0) {
+        long cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_num = (cpu_num > 0) ? (uint32_t)cpu_num : 1;
+        if (worker_num > MCDM_DECRYPT_WORKER_MAX) {
+            worker_num = MCDM_DECRYPT_WORKER_MAX;
+        }
+    }
+    if (worker_num > MCDM_DECRYPT_WORKER_MAX) {
+        LOGE("ERROR : Invalid number of workers (%u).\n", worker_num);
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    mMutex.lock();
+    if (mRunning) {
+        LOGE("ERROR : Workers are started already.\n");
+        mMutex.unlock();
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    /* All workers exist before any thread runs, steal() looks at every queue. */
+    deleteWorkers();
+    for (uint32_t i = 0; i < worker_num; i++) {
+        Worker* worker = new Worker();
+        worker->pool = this;
+        worker->index = i;
+        mWorkers.push_back(worker);
+    }
+    mReordered = 0;
+    mStopping = false;
+    mRunning = true;
+
+    for (started = 0; started < worker_num; started++) {
+        if (pthread_create(&mWorkers[started]->thread, NULL, threadEntry, mWorkers[started]) != 0) {
+            LOGE("ERROR : Could not create worker thread (%u).\n", started);
+            break;
+        }
+    }
+
+    if (started != worker_num) {
+        mStopping = true;
+        mCond.broadcast();
+        mMutex.unlock();
+        for (uint32_t i = 0; i < started; i++) {
+            pthread_join(mWorkers[i]->thread, NULL);
+        }
+        mMutex.lock();
+        mRunning = false;
+        mMutex.unlock();
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+    mMutex.unlock();
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+void DecryptWorkerPool::stop()
+{
+    MARLINLOG_ENTER();
+
+    mMutex.lock();
+    if (!mRunning || mStopping) {
+        mMutex.unlock();
+        MARLINLOG_EXIT();
+        return;
+    }
+    mStopping = true;
+    mCond.broadcast();
+    mMutex.unlock();
+
+    /* mWorkers is not changed while mStopping is set. */
+    for (vector<Worker*>::iterator it = mWorkers.begin(); it != mWorkers.end(); ++it) {
+        pthread_join((*it)->thread, NULL);
+    }
+
+    mMutex.lock();
+    sweepStreams();
+    mRunning = false;
+    mMutex.unlock();
+
+    MARLINLOG_EXIT();
+}
+
+mcdm_status_t DecryptWorkerPool::submit(uint32_t stream_id,
+                                        const mcdm_buffer_t& init_data,
+                                        mcdm_sample_t* sample,
+                                        mcdm_decrypt_callback_t callback,
+                                        void* user_data,
+                                        uint64_t* request_id)
+{
+    Job job;
+
+    job.streamId = stream_id;
+    job.initData = init_data;
+    job.sample = sample;
+    job.callback = callback;
+    job.userData = user_data;
+
+    mMutex.lock();
+    if (!mRunning || mStopping) {
+        LOGE("ERROR : Workers are not started.\n");
+        mMutex.unlock();
+        return ERROR_UNKNOWN;
+    }
+    job.requestId = mNextRequestId++;
+
+    map<uint32_t, Stream*>::iterator it = mStreams.find(stream_id);
+    if (it == mStreams.end()) {
+        sweepStreams();
+        it = mStreams.insert(make_pair(stream_id, new Stream())).first;
+    }
+    job.stream = it->second;
+    job.stream->mutex.lock();
+    job.sequence = job.stream->nextSequence++;
+    job.stream->outstanding++;
+    job.stream->mutex.unlock();
+
+    Worker* home = mWorkers[stream_id % mWorkers.size()];
+    home->mutex.lock();
+    home->jobs.push_back(job);
+    home->mutex.unlock();
+
+    /* mPending is raised under mMutex, so that a worker going to sleep does not miss it. */
+    atomicAdd(&mPending, 1u);
+    mCond.signal();
+    mMutex.unlock();
+
+    if (request_id != NULL) {
+        *request_id = job.requestId;
+    }
+    return OK;
+}
+
+uint32_t DecryptWorkerPool::poll(mcdm_decrypt_completion_t* completions, uint32_t max_num)
+{
+    uint32_t num = 0;
+
+    mCompletionMutex.lock();
+    while ((num < max_num) && !mCompletions.empty()) {
+        completions[num++] = mCompletions.front();
+        mCompletions.pop_front();
+    }
+    mCompletionMutex.unlock();
+
+    return num;
+}
+
+void DecryptWorkerPool::getStatistics(mcdm_decrypt_worker_stats_t* stats)
+{
+    stats->executed = 0;
+    stats->steals = 0;
+    stats->stolen = 0;
+
+    mMutex.lock();
+    stats->worker_num = mRunning ? (uint32_t)mWorkers.size() : 0;
+    for (vector<Worker*>::iterator it = mWorkers.begin(); it != mWorkers.end(); ++it) {
+        (*it)->mutex.lock();
+        stats->executed += (*it)->executed;
+        stats->steals += (*it)->steals;
+        stats->stolen += (*it)->stolen;
+        (*it)->mutex.unlock();
+    }
+    stats->reordered = atomicLoad(&mReordered);
+    mMutex.unlock();
+}
+
+void* DecryptWorkerPool::threadEntry(void* arg)
+{
+    Worker* worker = static_cast<Worker*>(arg);
+    worker->pool->run(worker);
+    return NULL;
+}
+
+void DecryptWorkerPool::run(Worker* self)
+{
+    Job job;
+
+    for (;;) {
+        if (popLocal(self, job) || steal(self, job)) {
+            atomicSub(&mPending, 1u);
+            execute(job);
+            continue;
+        }
+
+        /* Requests counted in mPending are in some queue, try again when there are any. */
+        mMutex.lock();
+        while ((atomicLoad(&mPending) == 0) && !mStopping) {
+            mCond.wait(mMutex);
+        }
+        bool finished = (atomicLoad(&mPending) == 0);
+        mMutex.unlock();
+
+        if (finished) {
+            /* Stopping and all submitted requests are taken. */
+            break;
+        }
+    }
+}
+
+bool DecryptWorkerPool::popLocal(Worker* self, Job& job)
+{
+    bool found = false;
+
+    self->mutex.lock();
+    if (!self->jobs.empty()) {
+        job = self->jobs.front();
+        self->jobs.pop_front();
+        self->executed++;
+        found = true;
+    }
+    self->mutex.unlock();
+
+    return found;
+}
+
+bool DecryptWorkerPool::steal(Worker* self, Job& job)
+{
+    const uint32_t worker_num = (uint32_t)mWorkers.size();
+    vector<Job> batch;
+
+    for (uint32_t i = 1; (i < worker_num) && batch.empty(); i++) {
+        Worker* victim = mWorkers[(self->index + i) % worker_num];
+
+        /* Take the newer half, the owner keeps working on the older requests from the front. */
+        victim->mutex.lock();
+        size_t take = (victim->jobs.size() + 1) / 2;
+        if (take > 0) {
+            batch.assign(victim->jobs.end() - take, victim->jobs.end());
+            victim->jobs.erase(victim->jobs.end() - take, victim->jobs.end());
+        }
+        victim->mutex.unlock();
+    }
+
+    if (batch.empty()) {
+        return false;
+    }
+
+    self->mutex.lock();
+    job = batch.front();
+    self->jobs.insert(self->jobs.end(), batch.begin() + 1, batch.end());
+    self->executed++;
+    self->steals++;
+    self->stolen += batch.size();
+    self->mutex.unlock();
+
+    return true;
+}
+
+void DecryptWorkerPool::execute(const Job& job)
+{
+    Stream* stream = job.stream;
+    Finished done;
+    vector<Finished> ready;
+
+    done.callback = job.callback;
+    done.completion.stream_id = job.streamId;
+    done.completion.request_id = job.requestId;
+    done.completion.sample = job.sample;
+    done.completion.user_data = job.userData;
+    done.completion.status = mEngine->DecryptBatch(job.initData, job.sample, 1);
+
+    stream->mutex.lock();
+    if (job.sequence != stream->nextDelivery) {
+        atomicAdd(&mReordered, (uint64_t)1);
+    }
+    stream->finished[job.sequence] = done;
+    if (stream->delivering) {
+        /* The delivering worker picks it up in order. */
+        stream->mutex.unlock();
+        return;
+    }
+
+    stream->delivering = true;
+    for (;;) {
+        ready.clear();
+        while (!stream->finished.empty() &&
+               (stream->finished.begin()->first == stream->nextDelivery)) {
+            ready.push_back(stream->finished.begin()->second);
+            stream->finished.erase(stream->finished.begin());
+            stream->nextDelivery++;
+            stream->outstanding--;
+        }
+        if (ready.empty()) {
+            break;
+        }
+        stream->mutex.unlock();
+        deliver(ready);
+        stream->mutex.lock();
+    }
+    stream->delivering = false;
+    stream->mutex.unlock();
+}
+
+void DecryptWorkerPool::deliver(const vector<Finished>& ready)
+{
+    bool locked = false;
+
+    for (vector<Finished>::const_iterator it = ready.begin(); it != ready.end(); ++it) {
+        if (it->callback != NULL) {
+            it->callback(it->completion);
+            continue;
+        }
+        if (!locked) {
+            mCompletionMutex.lock();
+            locked = true;
+        }
+        mCompletions.push_back(it->completion);
+    }
+    if (locked) {
+        mCompletionMutex.unlock();
+    }
+}
+
+/* Called with mMutex held. Deletes streams no worker refers to. */
+void DecryptWorkerPool::sweepStreams()
+{
+    map<uint32_t, Stream*>::iterator it = mStreams.begin();
+
+    while (it != mStreams.end()) {
+        Stream* stream = it->second;
+        stream->mutex.lock();
+        bool idle = (stream->outstanding == 0) && !stream->delivering;
+        stream->mutex.unlock();
+        if (idle) {
+            delete stream;
+            mStreams.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DecryptWorkerPool::deleteWorkers()
+{
+    for (vector<Worker*>::iterator it = mWorkers.begin(); it != mWorkers.end(); ++it) {
+        delete *it;
+    }
+    mWorkers.clear();
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
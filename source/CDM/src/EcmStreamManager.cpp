@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#define LOG_TAG "EcmStreamManager"
+#include "MarlinLog.h"
+
+#include "EcmStreamManager.h"
+#include "CdmStreamId.h"
+
+using namespace marlincdm;
+
+EcmStreamManager::EcmStreamManager(KeyContextCache* key_cache, CdmTaskRunner* runner)
+    : mKeyCache(key_cache),
+      mRunner(runner),
+      mNextStreamId(1),
+      mPrefetched(0),
+      mStalls(0),
+      mRotations(0)
+{
+    MARLINLOG_ENTER();
+}
+
+EcmStreamManager::~EcmStreamManager()
+{
+    MARLINLOG_ENTER();
+
+    /* The task runner is stopped before, no prefetch refers to the streams. */
+    for (map<uint32_t, EcmStream*>::iterator it = mStreams.begin(); it != mStreams.end(); ++it) {
+        mKeyCache->release(it->second->slots[MCDM_KEY_PARITY_EVEN].context);
+        mKeyCache->release(it->second->slots[MCDM_KEY_PARITY_ODD].context);
+        delete it->second;
+    }
+    mStreams.clear();
+}
+
+mcdm_status_t EcmStreamManager::open(uint32_t* stream_id)
+{
+    mMutex.lock();
+    *stream_id = allocateStreamId(mStreams, &mNextStreamId);
+    mStreams[*stream_id] = new EcmStream();
+    mMutex.unlock();
+
+    return OK;
+}
+
+mcdm_status_t EcmStreamManager::close(uint32_t stream_id)
+{
+    EcmStream* stream = NULL;
+
+    mMutex.lock();
+    map<uint32_t, EcmStream*>::iterator it = mStreams.find(stream_id);
+    if (it == mStreams.end()) {
+        mMutex.unlock();
+        LOGE("ERROR : ECM stream is not found (%u).\n", stream_id);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    stream = it->second;
+    mStreams.erase(it);
+    mMutex.unlock();
+
+    /* A prefetch still queued for the stream finds it closed and gives its context back. */
+    mKeyCache->release(stream->slots[MCDM_KEY_PARITY_EVEN].context);
+    mKeyCache->release(stream->slots[MCDM_KEY_PARITY_ODD].context);
+    delete stream;
+
+    return OK;
+}
+
+mcdm_status_t EcmStreamManager::push(uint32_t stream_id, mcdm_key_parity_t parity, const MH_keyIdInfo_t& kid_info)
+{
+    Prefetch* request = NULL;
+
+    mMutex.lock();
+    map<uint32_t, EcmStream*>::iterator it = mStreams.find(stream_id);
+    if (it == mStreams.end()) {
+        mMutex.unlock();
+        LOGE("ERROR : ECM stream is not found (%u).\n", stream_id);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    Slot& slot = it->second->slots[parity];
+    if ((slot.pushed > 0) &&
+        (slot.ecm.size() == kid_info.length) &&
+        equal(slot.ecm.begin(), slot.ecm.end(), kid_info.data)) {
+        /* ECMs are repeated during a crypto-period. */
+        mMutex.unlock();
+        return OK;
+    }
+    slot.ecm.assign(kid_info.data, kid_info.data + kid_info.length);
+    slot.pushed++;
+
+    request = new Prefetch();
+    request->manager = this;
+    request->streamId = stream_id;
+    request->parity = parity;
+    request->sequence = slot.pushed;
+    request->ecm = slot.ecm;
+    mMutex.unlock();
+
+    if (mRunner->post(prefetchEntry, request) != OK) {
+        /* The context is resolved by the first descramble of the parity instead. */
+        LOGE("ERROR : Could not post prefetch of ECM stream (%u).\n", stream_id);
+        delete request;
+    }
+
+    return OK;
+}
+
+mcdm_status_t EcmStreamManager::acquire(uint32_t stream_id, mcdm_key_parity_t parity, KeyContext** o_context)
+{
+    mcdm_status_t status = OK;
+    KeyContext* context = NULL;
+    vector<uint8_t> ecm;
+    uint64_t sequence = 0;
+
+    mMutex.lock();
+    map<uint32_t, EcmStream*>::iterator it = mStreams.find(stream_id);
+    if (it == mStreams.end()) {
+        mMutex.unlock();
+        LOGE("ERROR : ECM stream is not found (%u).\n", stream_id);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    Slot& slot = it->second->slots[parity];
+    if (slot.pushed == 0) {
+        mMutex.unlock();
+        LOGE("ERROR : No ECM of the parity (%d) is pushed to ECM stream (%u).\n", parity, stream_id);
+        return ERROR_UNKNOWN;
+    }
+    if ((slot.context != NULL) && (slot.applied == slot.pushed) && mKeyCache->retain(slot.context)) {
+        *o_context = slot.context;
+        mMutex.unlock();
+        return OK;
+    }
+    /* The prefetch is not finished yet, or licenses are changed since it. */
+    ecm = slot.ecm;
+    sequence = slot.pushed;
+    mStalls++;
+    mMutex.unlock();
+
+    status = resolve(ecm, &context);
+    if (status != OK) {
+        return status;
+    }
+    if (mKeyCache->retain(context)) {
+        install(stream_id, parity, sequence, context);
+    }
+
+    *o_context = context;
+    return OK;
+}
+
+void EcmStreamManager::getStatistics(mcdm_ecm_stream_stats_t* stats)
+{
+    mMutex.lock();
+    stats->streams = (uint32_t)mStreams.size();
+    stats->prefetched = mPrefetched;
+    stats->stalls = mStalls;
+    stats->rotations = mRotations;
+    mMutex.unlock();
+}
+
+void EcmStreamManager::prefetchEntry(void* arg)
+{
+    Prefetch* request = static_cast<Prefetch*>(arg);
+    request->manager->prefetch(request);
+    delete request;
+}
+
+void EcmStreamManager::prefetch(Prefetch* request)
+{
+    KeyContext* context = NULL;
+    bool current = false;
+
+    mMutex.lock();
+    map<uint32_t, EcmStream*>::iterator it = mStreams.find(request->streamId);
+    current = (it != mStreams.end()) && (it->second->slots[request->parity].pushed == request->sequence);
+    mMutex.unlock();
+    if (!current) {
+        /* The stream is closed or a newer ECM of the parity is pushed. */
+        return;
+    }
+
+    if (resolve(request->ecm, &context) != OK) {
+        return;
+    }
+    if (install(request->streamId, request->parity, request->sequence, context)) {
+        mMutex.lock();
+        mPrefetched++;
+        mMutex.unlock();
+    }
+}
+
+mcdm_status_t EcmStreamManager::resolve(vector<uint8_t>& ecm, KeyContext** o_context)
+{
+    mcdm_status_t status = OK;
+    MH_keyIdInfo_t kid_info;
+
+    kid_info.type = KEY_ID_INFO_TYPE_ECM;
+    kid_info.length = ecm.size();
+    kid_info.data = &ecm[0];
+
+    status = mKeyCache->acquire(kid_info, o_context);
+    if (status != OK) {
+        LOGE("ERROR : Could not resolve key context of ECM.\n");
+    }
+    return status;
+}
+
+/* Takes the reference of context. Returns false when the context is given back instead. */
+bool EcmStreamManager::install(uint32_t stream_id, mcdm_key_parity_t parity, uint64_t sequence, KeyContext* context)
+{
+    KeyContext* replaced = context;
+    bool installed = false;
+
+    mMutex.lock();
+    map<uint32_t, EcmStream*>::iterator it = mStreams.find(stream_id);
+    if (it != mStreams.end()) {
+        Slot& slot = it->second->slots[parity];
+        if ((sequence > slot.applied) || ((sequence == slot.applied) && (slot.context != context))) {
+            if (slot.context != context) {
+                if ((slot.context != NULL) && (sequence > slot.applied)) {
+                    mRotations++;
+                }
+                replaced = slot.context;
+                slot.context = context;
+            }
+            slot.applied = sequence;
+            installed = true;
+        }
+    }
+    mMutex.unlock();
+
+    /* Closing a context calls the agent, it is done without the lock. */
+    mKeyCache->release(replaced);
+    return installed;
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
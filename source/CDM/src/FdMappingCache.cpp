@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/dma-buf.h>
+#endif
+
+#define LOG_TAG "FdMappingCache"
+#include "MarlinLog.h"
+
+#include "FdMappingCache.h"
+
+using namespace marlincdm;
+
+FdMappingCache::FdMappingCache(uint32_t capacity)
+    : mCapacity(capacity),
+      mTick(0)
+{
+    MARLINLOG_ENTER();
+    mEntries.reserve(capacity);
+}
+
+FdMappingCache::~FdMappingCache()
+{
+    MARLINLOG_ENTER();
+    invalidate();
+}
+
+mcdm_status_t FdMappingCache::acquire(int fd, size_t offset, size_t len, bool writable,
+                                      FdMapping** o_mapping, uint8_t** o_data)
+{
+    struct stat st;
+    size_t size = 0;
+    FdMapping* mapping = NULL;
+    FdMapping* created = NULL;
+
+    if ((fd < 0) || (fstat(fd, &st) != 0)) {
+        LOGE("ERROR : Invalid fd (%d).\n", fd);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    if (S_ISREG(st.st_mode) || (st.st_size > 0)) {
+        size = (size_t)st.st_size;
+    } else {
+        /* dma-buf tells its size by lseek(). Its file position has no meaning. */
+        off_t end = lseek(fd, 0, SEEK_END);
+        size = (end > 0) ? (size_t)end : 0;
+    }
+    if ((len == 0) || (offset > size) || (len > size - offset)) {
+        LOGE("ERROR : Buffer is out of fd (%d). offset(%zu) len(%zu) size(%zu).\n", fd, offset, len, size);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    mMutex.lock();
+    mapping = find(fd, st.st_dev, st.st_ino, size, writable);
+    if (mapping != NULL) {
+        mapping->refCount++;
+        mapping->lastUsed = ++mTick;
+    }
+    mMutex.unlock();
+
+    if (mapping == NULL) {
+        /* Map without holding the lock. */
+        created = map(fd, st.st_dev, st.st_ino, size, writable);
+        if (created == NULL) {
+            return ERROR_UNKNOWN;
+        }
+
+        mMutex.lock();
+        mapping = find(fd, st.st_dev, st.st_ino, size, writable);
+        if (mapping != NULL) {
+            /* Mapped by another caller in the meantime. */
+            mapping->refCount++;
+            mapping->lastUsed = ++mTick;
+        } else {
+            if (mEntries.size() >= mCapacity) {
+                vector<FdMapping*>::iterator victim = mEntries.begin();
+                for (vector<FdMapping*>::iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+                    if ((*it)->lastUsed < (*victim)->lastUsed) {
+                        victim = it;
+                    }
+                }
+                FdMapping* evicted = *victim;
+                mEntries.erase(victim);
+                retire(evicted);
+            }
+            mapping = created;
+            created = NULL;
+            mapping->refCount = 1;
+            mapping->lastUsed = ++mTick;
+            mEntries.push_back(mapping);
+        }
+        mMutex.unlock();
+
+        if (created != NULL) {
+            destroy(created);
+        }
+    }
+
+    syncDmaBuf(mapping, true, writable);
+
+    *o_mapping = mapping;
+    *o_data = mapping->base + offset;
+    return OK;
+}
+
+void FdMappingCache::release(FdMapping* mapping, bool writable)
+{
+    bool last = false;
+
+    if (mapping == NULL) {
+        return;
+    }
+
+    syncDmaBuf(mapping, false, writable);
+
+    mMutex.lock();
+    mapping->refCount--;
+    last = (mapping->stale && (mapping->refCount == 0));
+    mMutex.unlock();
+
+    if (last) {
+        destroy(mapping);
+    }
+}
+
+void FdMappingCache::unmap(int fd)
+{
+    mMutex.lock();
+    vector<FdMapping*>::iterator it = mEntries.begin();
+    while (it != mEntries.end()) {
+        if ((*it)->fd == fd) {
+            retire(*it);
+            it = mEntries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    mMutex.unlock();
+}
+
+void FdMappingCache::invalidate()
+{
+    MARLINLOG_ENTER();
+
+    mMutex.lock();
+    for (vector<FdMapping*>::iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+        retire(*it);
+    }
+    mEntries.clear();
+    mMutex.unlock();
+
+    MARLINLOG_EXIT();
+}
+
+/* Called with mMutex held. A mapping of another file on the same fd number is retired. */
+FdMapping* FdMappingCache::find(int fd, dev_t dev, ino_t ino, size_t size, bool writable)
+{
+    vector<FdMapping*>::iterator it = mEntries.begin();
+
+    while (it != mEntries.end()) {
+        FdMapping* mapping = *it;
+        if (mapping->fd != fd) {
+            ++it;
+            continue;
+        }
+        if ((mapping->dev == dev) && (mapping->ino == ino) &&
+            (mapping->size == size) && (mapping->writable || !writable)) {
+            return mapping;
+        }
+        /* fd is reused, the buffer is resized or write access is needed. */
+        retire(mapping);
+        it = mEntries.erase(it);
+    }
+    return NULL;
+}
+
+FdMapping* FdMappingCache::map(int fd, dev_t dev, ino_t ino, size_t size, bool writable)
+{
+    void* base = MAP_FAILED;
+    bool mapped_writable = true;
+
+    /* Map for read and write when fd allows it, so that the mapping serves both input and output. */
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if ((base == MAP_FAILED) && (errno == EACCES) && !writable) {
+        base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        mapped_writable = false;
+    }
+    if (base == MAP_FAILED) {
+        LOGE("ERROR : Could not map fd (%d). errno(%d).\n", fd, errno);
+        return NULL;
+    }
+
+    FdMapping* mapping = new FdMapping();
+    mapping->fd = fd;
+    mapping->dev = dev;
+    mapping->ino = ino;
+    mapping->base = static_cast<uint8_t*>(base);
+    mapping->size = size;
+    mapping->writable = mapped_writable;
+    mapping->dmaBuf = false;
+    mapping->refCount = 0;
+    mapping->lastUsed = 0;
+    mapping->stale = false;
+
+#if defined(DMA_BUF_IOCTL_SYNC)
+    /* Only dma-buf knows the ioctl, other files fail with ENOTTY. */
+    struct dma_buf_sync sync;
+    sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ;
+    if (ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) == 0) {
+        sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ;
+        ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+        mapping->dmaBuf = true;
+    }
+#endif
+
+    return mapping;
+}
+
+/* Called with mMutex held, after the mapping is removed from mEntries. */
+void FdMappingCache::retire(FdMapping* mapping)
+{
+    mapping->stale = true;
+    if (mapping->refCount == 0) {
+        destroy(mapping);
+    }
+}
+
+void FdMappingCache::destroy(FdMapping* mapping)
+{
+    munmap(mapping->base, mapping->size);
+    delete mapping;
+}
+
+void FdMappingCache::syncDmaBuf(FdMapping* mapping, bool start, bool writable)
+{
+#if defined(DMA_BUF_IOCTL_SYNC)
+    struct dma_buf_sync sync;
+
+    if (!mapping->dmaBuf) {
+        return;
+    }
+    sync.flags = (start ? DMA_BUF_SYNC_START : DMA_BUF_SYNC_END) |
+                 (writable ? DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ);
+    if (ioctl(mapping->fd, DMA_BUF_IOCTL_SYNC, &sync) != 0) {
+        LOGE("ERROR : Could not sync dma-buf (%d). errno(%d).\n", mapping->fd, errno);
+    }
+#else
+    (void)mapping;
+    (void)start;
+    (void)writable;
+#endif
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
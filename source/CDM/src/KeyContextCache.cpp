@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+
+#define LOG_TAG "KeyContextCache"
+#include "MarlinLog.h"
+
+#include "KeyContextCache.h"
+
+using namespace marlincdm;
+
+KeyContextCache::KeyContextCache(AgentHandlerPool* agents, uint32_t capacity)
+    : mAgents(agents),
+      mCapacity(capacity),
+      mTick(0),
+      mHits(0),
+      mMisses(0),
+      mEvictions(0),
+      mGeneration(0),
+      mChanging(0)
+{
+    MARLINLOG_ENTER();
+    mEntries.reserve(capacity);
+}
+
+KeyContextCache::~KeyContextCache()
+{
+    MARLINLOG_ENTER();
+    invalidate();
+}
+
+mcdm_status_t KeyContextCache::acquire(MH_keyIdInfo_t& kid_info, KeyContext** o_context)
+{
+    MARLINLOG_ENTER();
+
+    MH_status_t agentStatus = MH_ERR_OK;
+    MH_keyHandle_t key_handle = NULL;
+    KeyContext* context = NULL;
+    uint64_t hash = hashKeyIdInfo(kid_info);
+    uint32_t agent = mAgents->select();
+    uint64_t generation = 0;
+
+    mLock.readLock();
+    context = find(hash, kid_info, agent);
+    if (context != NULL) {
+        use(context);
+        atomicAdd(&mHits, (uint64_t)1);
+        mLock.unlock();
+        *o_context = context;
+        MARLINLOG_EXIT();
+        return OK;
+    }
+    mLock.unlock();
+    atomicAdd(&mMisses, (uint64_t)1);
+
+    /* Resolve without holding the lock, the agent call may be slow. */
+    generation = atomicLoadAcquire(&mGeneration);
+    agentStatus = mAgents->handler(agent)->openKeyContext(mAgents->handle(agent), &kid_info, &key_handle);
+    if (agentStatus != MH_ERR_OK) {
+        LOGE("ERROR : calling openKeyContext (%d).\n", agentStatus);
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    context = new KeyContext();
+    context->hash = hash;
+    context->type = kid_info.type;
+    context->length = kid_info.length;
+    context->data = NULL;
+    if (kid_info.length > 0) {
+        context->data = new uint8_t[kid_info.length];
+        memcpy(context->data, kid_info.data, kid_info.length);
+    }
+    context->keyHandle = key_handle;
+    context->agent = agent;
+    context->refCount = 2; // the caller and the cache
+    context->lastUsed = 0;
+    context->stale = false;
+
+    mLock.writeLock();
+    KeyContext* existing = find(hash, kid_info, agent);
+    if (existing != NULL) {
+        /* Resolved by another caller in the meantime. */
+        use(existing);
+        mLock.unlock();
+        destroy(context);
+        *o_context = existing;
+        MARLINLOG_EXIT();
+        return OK;
+    }
+
+    /* mChanging is read first, endChange() changes the generation before it. */
+    if ((atomicLoadAcquire(&mChanging) != 0) || (atomicLoadAcquire(&mGeneration) != generation)) {
+        /* Licenses are changed while the context is resolved, it is only used by the caller. */
+        context->refCount = 1;
+        context->stale = true;
+        mLock.unlock();
+        *o_context = context;
+        MARLINLOG_EXIT();
+        return OK;
+    }
+
+    if (mEntries.size() >= mCapacity) {
+        vector<KeyContext*>::iterator victim = mEntries.begin();
+        for (vector<KeyContext*>::iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+            if (atomicLoadAcquire(&(*it)->lastUsed) < atomicLoadAcquire(&(*victim)->lastUsed)) {
+                victim = it;
+            }
+        }
+        KeyContext* evicted = *victim;
+        mEntries.erase(victim);
+        mEvictions++;
+        retire(evicted);
+    }
+
+    atomicStoreRelease(&context->lastUsed, atomicAdd(&mTick, (uint64_t)1));
+    mEntries.push_back(context);
+    mLock.unlock();
+
+    *o_context = context;
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+void KeyContextCache::release(KeyContext* context)
+{
+    if (context == NULL) {
+        return;
+    }
+    unref(context);
+}
+
+bool KeyContextCache::retain(KeyContext* context)
+{
+    bool retained = false;
+
+    mLock.readLock();
+    if (!context->stale) {
+        use(context);
+        retained = true;
+    }
+    mLock.unlock();
+
+    return retained;
+}
+
+bool KeyContextCache::contains(const MH_keyIdInfo_t& kid_info)
+{
+    bool found = false;
+    uint64_t hash = hashKeyIdInfo(kid_info);
+
+    mLock.readLock();
+    KeyContext* context = findAny(hash, kid_info);
+    if (context != NULL) {
+        atomicStoreRelease(&context->lastUsed, atomicAdd(&mTick, (uint64_t)1));
+        found = true;
+    }
+    mLock.unlock();
+    atomicAdd(found ? &mHits : &mMisses, (uint64_t)1);
+
+    return found;
+}
+
+void KeyContextCache::invalidate()
+{
+    MARLINLOG_ENTER();
+
+    vector<KeyContext*> entries;
+
+    mLock.writeLock();
+    entries.swap(mEntries);
+    for (vector<KeyContext*>::iterator it = entries.begin(); it != entries.end(); ++it) {
+        (*it)->stale = true;
+    }
+    atomicAdd(&mGeneration, (uint64_t)1);
+    mLock.unlock();
+
+    /* Contexts which are not in use are closed without holding the lock. */
+    for (vector<KeyContext*>::iterator it = entries.begin(); it != entries.end(); ++it) {
+        unref(*it);
+    }
+
+    MARLINLOG_EXIT();
+}
+
+void KeyContextCache::beginChange()
+{
+    atomicAdd(&mChanging, (uint32_t)1);
+    invalidate();
+}
+
+void KeyContextCache::endChange()
+{
+    /* Results taken from the agent while the licenses were changing are not kept. */
+    atomicAdd(&mGeneration, (uint64_t)1);
+    atomicSub(&mChanging, (uint32_t)1);
+}
+
+bool KeyContextCache::stable()
+{
+    return atomicLoadAcquire(&mChanging) == 0;
+}
+
+uint64_t KeyContextCache::generation()
+{
+    return atomicLoadAcquire(&mGeneration);
+}
+
+void KeyContextCache::getStatistics(mcdm_key_cache_stats_t* stats)
+{
+    mLock.readLock();
+    stats->hits = atomicLoadAcquire(&mHits);
+    stats->misses = atomicLoadAcquire(&mMisses);
+    stats->evictions = mEvictions;
+    stats->entries = (uint32_t)mEntries.size();
+    mLock.unlock();
+}
+
+uint64_t KeyContextCache::hashKeyIdInfo(const MH_keyIdInfo_t& kid_info)
+{
+    /* FNV-1a over KeyID information type and data */
+    uint64_t hash = 14695981039346656037ULL;
+
+    hash = (hash ^ (uint8_t)kid_info.type) * 1099511628211ULL;
+    for (size_t i = 0; i < kid_info.length; i++) {
+        hash = (hash ^ kid_info.data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+KeyContext* KeyContextCache::find(uint64_t hash, const MH_keyIdInfo_t& kid_info, uint32_t agent)
+{
+    for (vector<KeyContext*>::iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+        if (((*it)->agent == agent) && matches(*it, hash, kid_info)) {
+            return *it;
+        }
+    }
+    return NULL;
+}
+
+KeyContext* KeyContextCache::findAny(uint64_t hash, const MH_keyIdInfo_t& kid_info)
+{
+    for (vector<KeyContext*>::iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+        if (matches(*it, hash, kid_info)) {
+            return *it;
+        }
+    }
+    return NULL;
+}
+
+bool KeyContextCache::matches(const KeyContext* context, uint64_t hash, const MH_keyIdInfo_t& kid_info)
+{
+    return (context->hash == hash) &&
+           (context->type == kid_info.type) &&
+           (context->length == kid_info.length) &&
+           ((kid_info.length == 0) || (memcmp(context->data, kid_info.data, kid_info.length) == 0));
+}
+
+/* Called with mLock held, shared or exclusive. The context is alive by the reference of the cache. */
+void KeyContextCache::use(KeyContext* context)
+{
+    atomicAdd(&context->refCount, (uint32_t)1);
+    atomicStoreRelease(&context->lastUsed, atomicAdd(&mTick, (uint64_t)1));
+}
+
+/* Called with mLock held exclusively, after the context is removed from mEntries. */
+void KeyContextCache::retire(KeyContext* context)
+{
+    context->stale = true;
+    unref(context);
+}
+
+void KeyContextCache::unref(KeyContext* context)
+{
+    if (atomicSub(&context->refCount, (uint32_t)1) == 0) {
+        destroy(context);
+    }
+}
+
+void KeyContextCache::destroy(KeyContext* context)
+{
+    MH_status_t agentStatus = mAgents->handler(context->agent)->closeKeyContext(context->keyHandle);
+    if (agentStatus != MH_ERR_OK) {
+        LOGE("ERROR : calling closeKeyContext (%d).\n", agentStatus);
+    }
+    delete [] context->data;
+    delete context;
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "KeyExistIndex"
+#include "MarlinLog.h"
+
+#include "KeyExistIndex.h"
+#include "CdmTaskRunner.h"
+#include "CAtomic.h"
+
+using namespace marlincdm;
+
+KeyExistIndex::KeyExistIndex(KeyContextCache* key_cache)
+    : mKeyCache(key_cache),
+      mFilter((MCDM_KEY_EXIST_FILTER_BITS + 31) / 32, 0),
+      mDropped(0),
+      mGeneration(key_cache->generation()),
+      mTick(0)
+{
+    MARLINLOG_ENTER();
+}
+
+KeyExistIndex::~KeyExistIndex()
+{
+    MARLINLOG_ENTER();
+}
+
+uint64_t KeyExistIndex::generation()
+{
+    return mKeyCache->generation();
+}
+
+bool KeyExistIndex::lookup(const MH_keyIdInfo_t& kid_info, bool* is_key_exist)
+{
+    bool found = false;
+    vector<uint8_t> key;
+
+    makeKey(kid_info, key);
+
+    mLock.readLock();
+    /* The answers of an old generation are dropped by the next add(), expired answers when room is made. */
+    if ((mGeneration == mKeyCache->generation()) && filterContains(KeyContextCache::hashKeyIdInfo(kid_info))) {
+        map<vector<uint8_t>, Entry>::iterator it = mEntries.find(key);
+        if ((it != mEntries.end()) && (it->second.expiry > CdmTaskRunner::now())) {
+            atomicStoreRelease(&it->second.lastUsed, atomicAdd(&mTick, (uint64_t)1));
+            *is_key_exist = it->second.isKeyExist;
+            found = true;
+        }
+    }
+    mLock.unlock();
+
+    return found;
+}
+
+void KeyExistIndex::add(const MH_keyIdInfo_t& kid_info, bool is_key_exist, uint64_t generation)
+{
+    bool stable = mKeyCache->stable();
+    uint64_t current = mKeyCache->generation();
+    uint64_t now = CdmTaskRunner::now();
+    vector<uint8_t> key;
+    Entry entry;
+
+    makeKey(kid_info, key);
+    entry.isKeyExist = is_key_exist;
+    entry.expiry = now + MCDM_KEY_EXIST_INDEX_TTL;
+    entry.lastUsed = atomicAdd(&mTick, (uint64_t)1);
+
+    mLock.writeLock();
+    if (mGeneration != current) {
+        mEntries.clear();
+        mFilter.assign(mFilter.size(), 0);
+        mDropped = 0;
+        mGeneration = current;
+    }
+    if (stable && (generation == current)) {
+        if ((mEntries.find(key) == mEntries.end()) && (mEntries.size() >= MCDM_KEY_EXIST_INDEX_SIZE)) {
+            makeRoom(now);
+        }
+        mEntries[key] = entry;
+        filterAdd(KeyContextCache::hashKeyIdInfo(kid_info));
+    }
+    mLock.unlock();
+}
+
+/* Called with mLock held exclusively. Drop the expired answers, or the least recently used one when none is expired. */
+void KeyExistIndex::makeRoom(uint64_t now)
+{
+    map<vector<uint8_t>, Entry>::iterator victim = mEntries.begin();
+    size_t size = mEntries.size();
+
+    for (map<vector<uint8_t>, Entry>::iterator it = mEntries.begin(); it != mEntries.end(); ) {
+        if (it->second.expiry <= now) {
+            mEntries.erase(it++);
+        } else {
+            if (it->second.lastUsed < victim->second.lastUsed) {
+                victim = it;
+            }
+            ++it;
+        }
+    }
+    if (mEntries.size() == size) {
+        mEntries.erase(victim);
+    }
+
+    /* Bits of dropped answers stay in the filter, it is rebuilt before they make most lookups search the index. */
+    mDropped += (uint32_t)(size - mEntries.size());
+    if (mDropped >= MCDM_KEY_EXIST_INDEX_SIZE) {
+        rebuildFilter();
+    }
+}
+
+/* Called with mLock held exclusively. */
+void KeyExistIndex::rebuildFilter()
+{
+    MH_keyIdInfo_t kid_info;
+
+    mFilter.assign(mFilter.size(), 0);
+    for (map<vector<uint8_t>, Entry>::iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+        kid_info.type = (MH_keyIdInfoType)it->first[0];
+        kid_info.length = it->first.size() - 1;
+        kid_info.data = const_cast<uint8_t*>(&it->first[1]);
+        filterAdd(KeyContextCache::hashKeyIdInfo(kid_info));
+    }
+    mDropped = 0;
+}
+
+void KeyExistIndex::makeKey(const MH_keyIdInfo_t& kid_info, vector<uint8_t>& key)
+{
+    key.reserve(kid_info.length + 1);
+    key.push_back((uint8_t)kid_info.type);
+    key.insert(key.end(), kid_info.data, kid_info.data + kid_info.length);
+}
+
+/* The probes are made from the two halves of the hash. */
+bool KeyExistIndex::filterContains(uint64_t hash) const
+{
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32);
+
+    for (uint32_t i = 0; i < MCDM_KEY_EXIST_FILTER_PROBES; i++) {
+        size_t bit = (h1 + i * h2) % MCDM_KEY_EXIST_FILTER_BITS;
+        if ((mFilter[bit / 32] & (1U << (bit % 32))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KeyExistIndex::filterAdd(uint64_t hash)
+{
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32);
+
+    for (uint32_t i = 0; i < MCDM_KEY_EXIST_FILTER_PROBES; i++) {
+        size_t bit = (h1 + i * h2) % MCDM_KEY_EXIST_FILTER_BITS;
+        mFilter[bit / 32] |= (1U << (bit % 32));
+    }
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+
+#define LOG_TAG "LicenseExchangeManager"
+#include "MarlinLog.h"
+
+#include "LicenseExchangeManager.h"
+#include "MarlinCdmEngine.h"
+
+using namespace marlincdm;
+
+LicenseExchangeManager::LicenseExchangeManager(MarlinCdmEngine* engine,
+                                               CdmTaskRunner* step_runner,
+                                               CdmTaskRunner* timer_runner)
+    : mEngine(engine),
+      mStepRunner(step_runner),
+      mTimerRunner(timer_runner),
+      mNextToken(1),
+      mShuttingDown(false)
+{
+    MARLINLOG_ENTER();
+}
+
+LicenseExchangeManager::~LicenseExchangeManager()
+{
+    MARLINLOG_ENTER();
+
+    vector<uint64_t> tokens;
+
+    mMutex.lock();
+    for (map<uint64_t, Exchange*>::iterator it = mExchanges.begin(); it != mExchanges.end(); ++it) {
+        tokens.push_back(it->first);
+    }
+    mMutex.unlock();
+
+    for (vector<uint64_t>::iterator it = tokens.begin(); it != tokens.end(); ++it) {
+        finish(*it, ERROR_CANCELED);
+    }
+}
+
+void LicenseExchangeManager::shutdown()
+{
+    mMutex.lock();
+    mShuttingDown = true;
+    mMutex.unlock();
+}
+
+mcdm_status_t LicenseExchangeManager::start(mcdm_session_handle_t session,
+                                            const mcdm_buffer_t& init_data,
+                                            mcdm_license_transport_t transport,
+                                            mcdm_license_callback_t callback,
+                                            void* user_data,
+                                            uint32_t timeout_ms,
+                                            uint64_t* token)
+{
+    Exchange* exchange = new Exchange();
+
+    exchange->session = session;
+    exchange->initData.assign(init_data.data, init_data.data + init_data.len);
+    exchange->transport = transport;
+    exchange->callback = callback;
+    exchange->userData = user_data;
+    exchange->state = MCDM_LICENSE_STATE_GENERATING;
+    exchange->canceled = false;
+    exchange->running = false;
+    exchange->finished = false;
+
+    mMutex.lock();
+    if (mExchanges.size() >= MCDM_LICENSE_EXCHANGE_MAX) {
+        mMutex.unlock();
+        LOGE("ERROR : Too many license acquisitions in flight.\n");
+        delete exchange;
+        return ERROR_BUFFER_FULL;
+    }
+    /* The steps of two acquisitions would mix the request messages of the session. */
+    for (map<uint64_t, Exchange*>::iterator it = mExchanges.begin(); it != mExchanges.end(); ++it) {
+        if (it->second->session == session) {
+            mMutex.unlock();
+            LOGE("ERROR : License acquisition of the session is in flight.\n");
+            delete exchange;
+            return ERROR_ILLEGAL_ARGUMENT;
+        }
+    }
+    exchange->token = mNextToken++;
+    mExchanges[exchange->token] = exchange;
+    mMutex.unlock();
+
+    *token = exchange->token;
+    if (post(mStepRunner, stepTask, *token, 0) != OK) {
+        LOGE("ERROR : Could not post license acquisition.\n");
+        mMutex.lock();
+        mExchanges.erase(*token);
+        mMutex.unlock();
+        delete exchange;
+        return ERROR_UNKNOWN;
+    }
+    if ((timeout_ms != 0) && (post(mTimerRunner, timeoutTask, *token, timeout_ms) != OK)) {
+        LOGE("ERROR : Could not post timeout of license acquisition.\n");
+    }
+    return OK;
+}
+
+mcdm_status_t LicenseExchangeManager::submit(uint64_t token, const mcdm_buffer_t& response)
+{
+    mMutex.lock();
+    map<uint64_t, Exchange*>::iterator it = mExchanges.find(token);
+    if (it == mExchanges.end()) {
+        mMutex.unlock();
+        LOGE("ERROR : License acquisition is not found.\n");
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    Exchange* exchange = it->second;
+    if ((exchange->state != MCDM_LICENSE_STATE_WAITING_RESPONSE) || exchange->canceled) {
+        mMutex.unlock();
+        LOGE("ERROR : License acquisition is not waiting for a response.\n");
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    exchange->response.assign(response.data, response.data + response.len);
+    exchange->state = MCDM_LICENSE_STATE_PROCESSING;
+    mMutex.unlock();
+
+    if (post(mStepRunner, stepTask, token, 0) != OK) {
+        /* The engine is released, the acquisition is finished by the destructor. */
+        LOGE("ERROR : Could not post license response.\n");
+        return ERROR_UNKNOWN;
+    }
+    return OK;
+}
+
+mcdm_status_t LicenseExchangeManager::cancel(uint64_t token)
+{
+    mMutex.lock();
+    map<uint64_t, Exchange*>::iterator it = mExchanges.find(token);
+    if (it == mExchanges.end()) {
+        mMutex.unlock();
+        LOGE("ERROR : License acquisition is not found.\n");
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    if (it->second->canceled) {
+        mMutex.unlock();
+        return OK;
+    }
+    it->second->canceled = true;
+    mMutex.unlock();
+
+    /* Not queued behind a running step, see finish(). */
+    if (post(mTimerRunner, cancelTask, token, 0) != OK) {
+        LOGE("ERROR : Could not post cancellation of license acquisition.\n");
+        return ERROR_UNKNOWN;
+    }
+    return OK;
+}
+
+mcdm_status_t LicenseExchangeManager::getState(uint64_t token, mcdm_license_state_t* state)
+{
+    mMutex.lock();
+    map<uint64_t, Exchange*>::iterator it = mExchanges.find(token);
+    if (it == mExchanges.end()) {
+        mMutex.unlock();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+    *state = it->second->state;
+    mMutex.unlock();
+
+    return OK;
+}
+
+mcdm_status_t LicenseExchangeManager::post(CdmTaskRunner* runner,
+                                           CdmTaskRunner::Task task,
+                                           uint64_t token,
+                                           uint32_t delay_ms)
+{
+    mcdm_status_t status = OK;
+    Job* job = new Job();
+
+    job->manager = this;
+    job->token = token;
+    job->deadline = CdmTaskRunner::now() + delay_ms;
+    if (delay_ms == 0) {
+        status = runner->post(task, job);
+    } else {
+        status = runner->postDelayed(task, job, delay_ms);
+    }
+    if (status != OK) {
+        delete job;
+    }
+    return status;
+}
+
+void LicenseExchangeManager::stepTask(void* arg)
+{
+    Job* job = static_cast<Job*>(arg);
+
+    job->manager->step(job->token);
+    delete job;
+}
+
+void LicenseExchangeManager::cancelTask(void* arg)
+{
+    Job* job = static_cast<Job*>(arg);
+
+    job->manager->finish(job->token, ERROR_CANCELED);
+    delete job;
+}
+
+void LicenseExchangeManager::timeoutTask(void* arg)
+{
+    Job* job = static_cast<Job*>(arg);
+
+    /* Run before the deadline by CdmTaskRunner::stop() when the engine is released. */
+    job->manager->finish(job->token, (CdmTaskRunner::now() < job->deadline) ? ERROR_CANCELED : ERROR_TIMEOUT);
+    delete job;
+}
+
+/*
+ * Run one step of an acquisition. The steps of the step runner do not run at the same time, a step
+ * which finishes while the agent or the transport is called by another thread is freed by that thread.
+ */
+void LicenseExchangeManager::step(uint64_t token)
+{
+    mcdm_status_t status = OK;
+    mcdm_license_state_t state = MCDM_LICENSE_STATE_GENERATING;
+    mcdm_buffer_t init_data;
+    mcdm_buffer_t response;
+    mcdm_buffer_t request;
+    bool endflag = false;
+    bool send = false;
+    bool finished = false;
+    bool shutting_down = false;
+
+    mMutex.lock();
+    map<uint64_t, Exchange*>::iterator it = mExchanges.find(token);
+    if ((it == mExchanges.end()) || it->second->canceled ||
+        (it->second->state == MCDM_LICENSE_STATE_WAITING_RESPONSE)) {
+        /* Finished, finished by the posted cancellation, or the response is not submitted yet. */
+        mMutex.unlock();
+        return;
+    }
+    if (mShuttingDown) {
+        /* The engine is being destroyed, the agent is not called any more. */
+        mMutex.unlock();
+        finish(token, ERROR_CANCELED);
+        return;
+    }
+    Exchange* exchange = it->second;
+    state = exchange->state;
+    exchange->running = true;
+    mMutex.unlock();
+
+    memset(&init_data, 0, sizeof(mcdm_buffer_t));
+    memset(&response, 0, sizeof(mcdm_buffer_t));
+    memset(&request, 0, sizeof(mcdm_buffer_t));
+    init_data.len = exchange->initData.size();
+    init_data.data = &exchange->initData[0];
+    init_data.fd = -1;
+    if (state == MCDM_LICENSE_STATE_GENERATING) {
+        status = mEngine->GenerateKeyRequest(exchange->session, init_data, &request);
+    } else {
+        /* The response is not changed by submit() until the request message is given to the transport. */
+        response.len = exchange->response.size();
+        response.data = &exchange->response[0];
+        response.fd = -1;
+        status = mEngine->AddKey(exchange->session, response, init_data, &endflag, &request);
+    }
+    if ((status == OK) && !endflag && (request.len == 0)) {
+        LOGE("ERROR : No request message to send.\n");
+        status = ERROR_UNKNOWN;
+    }
+
+    if ((status == OK) && !endflag) {
+        mMutex.lock();
+        send = !exchange->finished && !exchange->canceled;
+        if (send) {
+            exchange->state = MCDM_LICENSE_STATE_WAITING_RESPONSE;
+        }
+        mMutex.unlock();
+    }
+    if (send) {
+        /* The response may be submitted before the transport returns, its step is run after this one. */
+        exchange->transport(token, request, exchange->userData);
+    }
+    if ((request.data != NULL) && (request.fd < 0)) {
+        mEngine->ReleaseKeyRequestBuffer(exchange->session, &request);
+    }
+
+    mMutex.lock();
+    exchange->running = false;
+    finished = exchange->finished;
+    shutting_down = mShuttingDown;
+    mMutex.unlock();
+
+    if (finished) {
+        /* Timed out or canceled while the agent was called, the callback is already called. */
+        if (!shutting_down) {
+            mEngine->CancelKeyRequest(exchange->session);
+        }
+        delete exchange;
+        return;
+    }
+    if (status != OK) {
+        finish(token, status);
+    } else if (endflag) {
+        finish(token, OK);
+    }
+}
+
+void LicenseExchangeManager::finish(uint64_t token, mcdm_status_t status)
+{
+    mcdm_license_completion_t completion;
+    mcdm_license_callback_t callback = NULL;
+    bool running = false;
+    bool shutting_down = false;
+
+    mMutex.lock();
+    map<uint64_t, Exchange*>::iterator it = mExchanges.find(token);
+    if (it == mExchanges.end()) {
+        mMutex.unlock();
+        return;
+    }
+    Exchange* exchange = it->second;
+    mExchanges.erase(it);
+    /* A running step may free the exchange as soon as the mutex is unlocked. */
+    running = exchange->running;
+    exchange->finished = running;
+    completion.token = token;
+    completion.session_handle = exchange->session;
+    completion.status = status;
+    completion.user_data = exchange->userData;
+    callback = exchange->callback;
+    shutting_down = mShuttingDown;
+    mMutex.unlock();
+
+    /* Else the key request is canceled by the step after the agent returns. */
+    if (!running) {
+        if (((status == ERROR_CANCELED) || (status == ERROR_TIMEOUT)) && !shutting_down) {
+            /* The error of a closed session is ignored. */
+            mEngine->CancelKeyRequest(completion.session_handle);
+        }
+        delete exchange;
+    }
+    callback(completion);
+}
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
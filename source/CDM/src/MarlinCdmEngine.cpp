@@ -15,6 +15,7 @@
  */
 
 #include <sys/stat.h>
+#include <pthread.h>
 #include <cstring>
 #include <map>
 
@@ -22,7 +23,26 @@
 #include "MarlinLog.h"
 
 #include "MarlinCdmEngine.h"
-#include "CdmSessionManager.h"
+#include "KeyContextCache.h"
+#include "InitDataView.h"
+#include "DecryptWorkerPool.h"
+#include "TsPacketScanner.h"
+#include "CdmTaskRunner.h"
+#include "EcmStreamManager.h"
+#include "FdMappingCache.h"
+#include "CdmBufferPool.h"
+#include "CdmSession.h"
+#include "CdmSessionTable.h"
+#include "CAtomic.h"
+#include "DecryptStreamManager.h"
+#include "DecryptRingManager.h"
+#include "CdmFileDecryptor.h"
+#include "SessionHandlePool.h"
+#include "SessionReaper.h"
+#include "AgentHandlerPool.h"
+#include "LicenseExchangeManager.h"
+#include "ChallengeCache.h"
+#include "KeyExistIndex.h"
 
 using namespace marlincdm;
 
@@ -30,27 +50,98 @@ using namespace marlincdm;
 namespace {
     MarlinCdmEngine *sInstance = NULL;
     CMutex sMutex;
-    MarlinAgentHandler* mHandler = NULL;
+    AgentHandlerPool* mAgents = NULL;
+    MarlinAgentHandler* mHandler = NULL; // primary agent
     MH_agentHandle_t mHandle = NULL;
-    map<mcdm_session_id_t, MH_iptvesHandle_t> mCdmSessionMap;
+    CdmSessionTable* mCdmSessionTable = NULL;
+    KeyContextCache* mKeyCache = NULL;
+    DecryptWorkerPool* mDecryptPool = NULL;
+    CdmTaskRunner* mTaskRunner = NULL;
+    CdmTaskRunner* mLicenseRunner = NULL; // steps of the license acquisitions
+    EcmStreamManager* mEcmStreams = NULL;
+    FdMappingCache* mFdMappings = NULL;
+    CdmBufferPool* mBufferPool = NULL;
+    DecryptStreamManager* mDecryptStreams = NULL;
+    DecryptRingManager* mDecryptRings = NULL;
+    CdmFileDecryptor* mFileDecryptor = NULL;
+    SessionHandlePool* mSessionPool = NULL;
+    SessionReaper* mReaper = NULL;
+    LicenseExchangeManager* mLicenseExchanges = NULL;
+    ChallengeCache* mChallenges = NULL;
+    KeyExistIndex* mKeyIndex = NULL;
+
+    /* Preparation of a request message posted by PrepareKeyRequests() */
+    struct PrepareJob {
+        MarlinCdmEngine *engine;
+        mcdm_session_handle_t session;
+        vector<uint8_t> initData;
+        uint64_t sequence;
+    };
+
+    /* Scrambled payloads saved by DescrambleTs(), one buffer per thread which keeps its size over the calls. */
+    pthread_key_t sSavedPayloadKey;
+    pthread_once_t sSavedPayloadOnce = PTHREAD_ONCE_INIT;
+
+    void freeSavedPayloads(void* arg)
+    {
+        delete static_cast<vector<uint8_t>*>(arg);
+    }
+
+    void createSavedPayloadKey(void)
+    {
+        pthread_key_create(&sSavedPayloadKey, freeSavedPayloads);
+    }
+
+    vector<uint8_t>& getSavedPayloads()
+    {
+        pthread_once(&sSavedPayloadOnce, createSavedPayloadKey);
+
+        vector<uint8_t>* saved = static_cast<vector<uint8_t>*>(pthread_getspecific(sSavedPayloadKey));
+        if (saved == NULL) {
+            saved = new vector<uint8_t>();
+            pthread_setspecific(sSavedPayloadKey, saved);
+        }
+        return *saved;
+    }
 }
 
 MarlinCdmEngine::MarlinCdmEngine()
 {
     MARLINLOG_ENTER();
 
-    MH_status_t agentStatus = MH_ERR_OK;
-    MH_agentHandle_t handle = NULL;
-
-    mHandler = new MarlinAgentHandler();
+    /* initAgent() is called for each agent, the errors are logged by AgentHandlerPool. */
+    mAgents = new AgentHandlerPool(MCDM_AGENT_HANDLER_NUM);
+    mHandler = mAgents->handler(0);
     if (mHandler == NULL) {
         LOGE("ERROR : Could not allocate instance of MarlinAgentHandler.\n");
     } else {
-        agentStatus = mHandler->initAgent(&handle);
-        if (agentStatus != MH_ERR_OK) {
-            LOGE("ERROR : calling initAgent (%d).\n", agentStatus);
+        mHandle = mAgents->handle(0);
+        mCdmSessionTable = new CdmSessionTable();
+        mKeyCache = new KeyContextCache(mAgents, MCDM_KEY_CONTEXT_CACHE_SIZE * mAgents->size());
+        mKeyIndex = new KeyExistIndex(mKeyCache);
+        mDecryptPool = new DecryptWorkerPool(this);
+        mTaskRunner = new CdmTaskRunner();
+        if (mTaskRunner->start() != OK) {
+            LOGE("ERROR : Could not start CdmTaskRunner.\n");
+        }
+        mSessionPool = new SessionHandlePool(mAgents, mTaskRunner, mKeyCache);
+        if ((mHandle != NULL) && (mSessionPool->setSize(MCDM_SESSION_POOL_SIZE) != OK)) {
+            LOGE("ERROR : Could not fill SessionHandlePool.\n");
         }
-        mHandle = handle;
+        mChallenges = new ChallengeCache();
+        mLicenseRunner = new CdmTaskRunner();
+        if (mLicenseRunner->start() != OK) {
+            LOGE("ERROR : Could not start CdmTaskRunner of license acquisitions.\n");
+        }
+        mLicenseExchanges = new LicenseExchangeManager(this, mLicenseRunner, mTaskRunner);
+        mReaper = new SessionReaper(MCDM_SESSION_IDLE_TIMEOUT, MCDM_SESSION_MEMORY_BUDGET);
+        startReaper();
+        mEcmStreams = new EcmStreamManager(mKeyCache, mTaskRunner);
+        mFdMappings = new FdMappingCache(MCDM_FD_MAPPING_CACHE_SIZE);
+        mBufferPool = new CdmBufferPool();
+        mDecryptStreams = new DecryptStreamManager(mAgents, mKeyCache);
+        mDecryptRings = new DecryptRingManager(this);
+        mFileDecryptor = new CdmFileDecryptor(this);
     }
 
     MARLINLOG_EXIT();
@@ -60,18 +151,55 @@ MarlinCdmEngine::~MarlinCdmEngine()
 {
     MARLINLOG_ENTER();
 
-    MH_status_t agentStatus = MH_ERR_OK;
-
     if (mHandler != NULL) {
-        if(mHandle != NULL) {
-            agentStatus = mHandler->finAgent(mHandle);
-            if (agentStatus != MH_ERR_OK) {
-                LOGE("ERROR : calling finAgent (%d).\n", agentStatus);
-            }
+        delete mDecryptPool;
+        mDecryptPool = NULL;
+        delete mDecryptRings;
+        mDecryptRings = NULL;
+        delete mFileDecryptor;
+        mFileDecryptor = NULL;
+        /* Steps of license acquisitions run by stop() do not call the agent any more. */
+        mLicenseExchanges->shutdown();
+        mLicenseRunner->stop();
+        /* Prefetches refer to the ECM streams and the key cache. The reaper is run once more by stop(). */
+        mTaskRunner->stop();
+        delete mLicenseExchanges;
+        mLicenseExchanges = NULL;
+        delete mLicenseRunner;
+        mLicenseRunner = NULL;
+        delete mChallenges;
+        mChallenges = NULL;
+        delete mEcmStreams;
+        mEcmStreams = NULL;
+        delete mReaper;
+        mReaper = NULL;
+        delete mSessionPool;
+        mSessionPool = NULL;
+        delete mTaskRunner;
+        mTaskRunner = NULL;
+        delete mFdMappings;
+        mFdMappings = NULL;
+        delete mDecryptStreams;
+        mDecryptStreams = NULL;
+        delete mKeyIndex;
+        mKeyIndex = NULL;
+        delete mKeyCache;
+        mKeyCache = NULL;
+        vector<CdmSession*> sessions;
+        mCdmSessionTable->removeAll(sessions);
+        for (vector<CdmSession*>::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+            delete *it;
         }
-        delete mHandler;
+        delete mCdmSessionTable;
+        mCdmSessionTable = NULL;
+        delete mBufferPool;
+        mBufferPool = NULL;
         mHandler = NULL;
+        mHandle = NULL;
     }
+    /* finAgent() is called for each agent. */
+    delete mAgents;
+    mAgents = NULL;
 
     MARLINLOG_EXIT();
 }
@@ -82,6 +210,7 @@ mcdm_status_t MarlinCdmEngine::CheckKeyExist(const mcdm_buffer_t& init_data, boo
 
     mcdm_status_t status = OK;
     MH_status_t agentStatus = MH_ERR_OK;
+    uint32_t agent = 0;
     MH_keyIdInfo_t kid_info;
 
     memset(&kid_info, 0, sizeof(MH_keyIdInfo_t));
@@ -110,35 +239,49 @@ mcdm_status_t MarlinCdmEngine::CheckKeyExist(const mcdm_buffer_t& init_data, boo
         return ERROR_ILLEGAL_ARGUMENT;
     }
 
-    status = parseInitDataForKeyIdInfo(init_data, kid_info);
+    status = InitDataView(init_data).decodeKeyIdInfo(kid_info);
     if (status != OK) {
-        LOGE("ERROR : calling parseInitDataForKeyIdInfo.\n");
-        delete [] kid_info.data;
+        LOGE("ERROR : Invalid KeyID information in init_data.\n");
         MARLINLOG_EXIT();
         return status;
     }
 
-    agentStatus = mHandler->checkKeyExist(&kid_info, is_key_exist);
+    if (mKeyCache->contains(kid_info)) {
+        /* The key is resolved already. */
+        *is_key_exist = true;
+        MARLINLOG_EXIT();
+        return OK;
+    }
+
+    agent = mAgents->select();
+    mAgents->enter(agent);
+    agentStatus = mAgents->handler(agent)->checkKeyExist(&kid_info, is_key_exist);
+    mAgents->leave(agent);
     if (agentStatus != MH_ERR_OK) {
         LOGE("ERROR : calling checkKeyExist (%d).\n", agentStatus);
-        delete [] kid_info.data;
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
 
-    delete [] kid_info.data;
-
     MARLINLOG_EXIT();
     return OK;
 }
 
-mcdm_status_t MarlinCdmEngine::OpenSession(mcdm_session_id_t& session_id)
+mcdm_status_t MarlinCdmEngine::CheckKeyExistBatch(const mcdm_buffer_t* init_data,
+                                                  uint32_t init_data_num,
+                                                  uint8_t* is_key_exist)
 {
     MARLINLOG_ENTER();
 
+    mcdm_status_t status = OK;
     MH_status_t agentStatus = MH_ERR_OK;
-    MH_iptvesHandle_t iptves_handle = NULL;
-    CdmSessionManager* sm;
+    uint32_t agent = 0;
+    uint64_t generation = 0;
+    bool exist = false;
+    vector<MH_keyIdInfo_t> kid_infos(init_data_num);
+    vector<MH_keyIdInfo_t> unknown_kid_infos;
+    vector<uint32_t> unknown;
+    bool* unknown_exist = NULL;
 
     if (mHandler == NULL) {
         LOGE("ERROR : MarlinAgentHandler is NULL.\n");
@@ -152,46 +295,181 @@ mcdm_status_t MarlinCdmEngine::OpenSession(mcdm_session_id_t& session_id)
         return ERROR_UNKNOWN;
     }
 
-    sm = CdmSessionManager::getCdmSessionManager();
-    if (sm == NULL) {
-        LOGE("ERROR : CdmSessionManager is NULL.\n");
+    if (mKeyIndex == NULL) {
+        LOGE("ERROR : KeyExistIndex is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (is_key_exist == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    if (init_data == NULL) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    /* All init_data are checked before the agent is called. */
+    for (uint32_t i = 0; i < init_data_num; i++) {
+        memset(&kid_infos[i], 0, sizeof(MH_keyIdInfo_t));
+        if ((init_data[i].data == NULL) ||
+            (InitDataView(init_data[i]).decodeKeyIdInfo(kid_infos[i]) != OK)) {
+            LOGE("ERROR : Invalid KeyID information in init_data[%u].\n", i);
+            MARLINLOG_EXIT();
+            return ERROR_ILLEGAL_ARGUMENT;
+        }
+    }
+
+    memset(is_key_exist, 0, (init_data_num + 7) / 8);
+    /* Read before the agent is called, so that answers taken across a change of licenses are not remembered. */
+    generation = mKeyIndex->generation();
+    for (uint32_t i = 0; i < init_data_num; i++) {
+        if (mKeyIndex->lookup(kid_infos[i], &exist)) {
+            if (exist) {
+                is_key_exist[i / 8] |= (uint8_t)(1 << (i % 8));
+            }
+        } else {
+            unknown.push_back(i);
+            unknown_kid_infos.push_back(kid_infos[i]);
+        }
+    }
+
+    if (!unknown.empty()) {
+        unknown_exist = new bool[unknown.size()];
+        agent = mAgents->select();
+        mAgents->enter(agent);
+        agentStatus = mAgents->handler(agent)->checkKeyExistBatch(&unknown_kid_infos[0],
+                                                                  unknown.size(),
+                                                                  unknown_exist);
+        mAgents->leave(agent);
+        if (agentStatus != MH_ERR_OK) {
+            LOGE("ERROR : calling checkKeyExistBatch (%d).\n", agentStatus);
+            status = ERROR_UNKNOWN;
+        } else {
+            for (size_t j = 0; j < unknown.size(); j++) {
+                if (unknown_exist[j]) {
+                    is_key_exist[unknown[j] / 8] |= (uint8_t)(1 << (unknown[j] % 8));
+                }
+                mKeyIndex->add(unknown_kid_infos[j], unknown_exist[j], generation);
+            }
+        }
+        delete[] unknown_exist;
+    }
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::OpenSession(mcdm_session_id_t& session_id)
+{
+    mcdm_session_handle_t handle = MCDM_SESSION_HANDLE_INVALID;
+
+    return OpenSession(session_id, &handle);
+}
+
+mcdm_status_t MarlinCdmEngine::OpenSession(mcdm_session_id_t& session_id,
+                                           mcdm_session_handle_t* handle)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+    uint32_t agent = 0;
+    MH_iptvesHandle_t iptves_handle = NULL;
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
 
-    if (sm->getCdmSessionId(session_id) != OK) {
-        LOGE("ERROR : Could not create session id.\n");
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
 
-    if (mCdmSessionMap.count(session_id) != 0) {
+    if (handle == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    /* A handle initialized ahead by the pool saves initIPTVESHandle() on the thread of the caller. */
+    status = mSessionPool->acquire(session_id, &agent, &iptves_handle);
+    if (status != OK) {
+        session_id = "";
+        MARLINLOG_EXIT();
+        return status;
+    }
+
+    CdmSession* existing = getSession(session_id);
+    if (existing != NULL) {
+        releaseSession(existing);
         LOGE("ERROR : invalid session id.\n");
+        mSessionPool->retire(agent, iptves_handle, false);
         session_id = "";
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
 
-    agentStatus = mHandler->initIPTVESHandle(mHandle, session_id, &iptves_handle);
-    if (agentStatus != MH_ERR_OK) {
-        LOGE("ERROR : calling initIPTVESHandle (%d).\n", agentStatus);
+    CdmSession* session = new CdmSession();
+    session->sessionId = session_id;
+    session->iptvesHandle = iptves_handle;
+    session->agent = agent;
+    session->refCount = 1;
+    session->lastUsed = SessionReaper::now();
+    session->closed = false;
+    session->keyRequested = false;
+    session->responseProcessed = false;
+    session->request = NULL;
+    session->requestSize = 0;
+    session->agentRequest = false;
+    session->memorySize = sessionMemorySize(session);
+    /* Least recently used sessions are closed to make room for the new one. */
+    if (!keepMemoryBudget(session->memorySize)) {
+        LOGE("ERROR : Memory budget of sessions is exceeded.\n");
+        mSessionPool->retire(agent, iptves_handle, false);
+        delete session;
         session_id = "";
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
-
-    mCdmSessionMap[session_id] = iptves_handle;
+    if (mCdmSessionTable->insert(session) != OK) {
+        mSessionPool->retire(agent, iptves_handle, false);
+        delete session;
+        session_id = "";
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+    *handle = session->handle;
+    if (mReaper->idleTimeout() != 0) {
+        mReaper->schedule(session->handle, session->lastUsed + mReaper->idleTimeout());
+    }
 
     MARLINLOG_EXIT();
     return OK;
 }
 
 mcdm_status_t MarlinCdmEngine::CloseSession(const mcdm_session_id_t& session_id)
+{
+    /* Taken out of the table first, so that concurrent CloseSession() calls of the session do not both close it. */
+    return closeSession((mCdmSessionTable != NULL) ? mCdmSessionTable->remove(session_id) : NULL);
+}
+
+mcdm_status_t MarlinCdmEngine::CloseSession(mcdm_session_handle_t handle)
+{
+    return closeSession((mCdmSessionTable != NULL) ? mCdmSessionTable->remove(handle) : NULL);
+}
+
+mcdm_status_t MarlinCdmEngine::closeSession(CdmSession* session)
 {
     MARLINLOG_ENTER();
 
-    MH_status_t agentStatus = MH_ERR_OK;
-    MH_iptvesHandle_t handle = NULL;
+    bool licenses_changed = false;
 
     if (mHandler == NULL) {
         LOGE("ERROR : MarlinAgentHandler is NULL.\n");
@@ -205,37 +483,179 @@ mcdm_status_t MarlinCdmEngine::CloseSession(const mcdm_session_id_t& session_id)
         return ERROR_UNKNOWN;
     }
 
-    handle = getIPTVEShandle(session_id);
-    if (handle == NULL) {
-        LOGE("ERROR : calling getIPTVEShandle. session_id(%s).\n", session_id.c_str());
+    if (session == NULL) {
+        LOGE("ERROR : Session is not opened.\n");
         MARLINLOG_EXIT();
         return ERROR_SESSION_NOT_OPENED;
     }
 
-    agentStatus = mHandler->finIPTVESHandle(handle);
-    if (agentStatus != MH_ERR_OK) {
-        LOGE("ERROR : calling finIPTVESHandle (%d).\n", agentStatus);
-        MARLINLOG_EXIT();
-        return ERROR_UNKNOWN;
-    }
+    /* Calls of the session which are running are finished first. */
+    session->mutex.lock();
+    session->closed = true;
+    licenses_changed = session->responseProcessed;
+    session->mutex.unlock();
 
-    mCdmSessionMap.erase(session_id);
+    /*
+     * finIPTVESHandle() runs on the task runner, off the thread of the caller. When the session may hold
+     * licenses, retire() drops the key contexts before it returns, so that they are not used after
+     * CloseSession() returns. Other sessions keep their key contexts otherwise.
+     */
+    mChallenges->drop(session->handle);
+    mSessionPool->retire(session->agent, session->iptvesHandle, licenses_changed);
+    mCdmSessionTable->releaseHandle(session);
+    /* The reference of the table. The session is freed when the calls waiting on it have failed. */
+    releaseSession(session);
 
     MARLINLOG_EXIT();
     return OK;
 }
 
+/* Memory held for a session by the CDM, and the estimate of its IPTV-ES handle. */
+uint32_t MarlinCdmEngine::sessionMemorySize(CdmSession* session)
+{
+    return sizeof(CdmSession) + session->sessionId.capacity() + session->requestSize + MCDM_SESSION_HANDLE_MEMORY_SIZE;
+}
+
+void MarlinCdmEngine::startReaper()
+{
+    if (!mReaper->isEnabled() || !mReaper->start()) {
+        return;
+    }
+    if (mTaskRunner->postDelayed(reapTask, this, MCDM_SESSION_REAPER_INTERVAL) != OK) {
+        mReaper->stop();
+    }
+}
+
+void MarlinCdmEngine::reapTask(void* arg)
+{
+    static_cast<MarlinCdmEngine*>(arg)->reapSessions();
+}
+
+/* Run on the task runner every MCDM_SESSION_REAPER_INTERVAL while a limit is set. */
+void MarlinCdmEngine::reapSessions()
+{
+    uint32_t now = SessionReaper::now();
+    vector<mcdm_session_handle_t> handles;
+
+    mReaper->expire(now, handles);
+    for (vector<mcdm_session_handle_t>::iterator it = handles.begin(); it != handles.end(); ++it) {
+        expireSession(*it, now);
+    }
+    /* Request messages may have grown the sessions over the budget. */
+    keepMemoryBudget(0);
+
+    if (!mReaper->isEnabled() ||
+        (mTaskRunner->postDelayed(reapTask, this, MCDM_SESSION_REAPER_INTERVAL) != OK)) {
+        mReaper->stop();
+        /* A limit may have been set after the check. */
+        startReaper();
+    }
+}
+
+void MarlinCdmEngine::expireSession(mcdm_session_handle_t handle, uint32_t now)
+{
+    uint32_t idle_timeout = mReaper->idleTimeout();
+    CdmSession* removed = NULL;
+
+    /* Not by lockSession(), which would update lastUsed. */
+    CdmSession* session = mCdmSessionTable->find(handle);
+    if (session == NULL) {
+        /* Closed already. */
+        return;
+    }
+    session->mutex.lock();
+    if (session->closed || (idle_timeout == 0)) {
+        /* Not scheduled again, SetSessionIdleTimeout() schedules the sessions when the timeout is set. */
+    } else if ((now - session->lastUsed) < idle_timeout) {
+        mReaper->schedule(handle, session->lastUsed + idle_timeout);
+    } else {
+        removed = mCdmSessionTable->remove(handle);
+    }
+    session->mutex.unlock();
+    releaseSession(session);
+
+    if (removed != NULL) {
+        LOGD("Session is closed by idle timeout. session_id(%s).\n", removed->sessionId.c_str());
+        closeSession(removed);
+        mReaper->countEviction(true);
+    }
+}
+
+/*
+ * Close least recently used sessions until reserved bytes more are in the memory budget.
+ * It returns false when the budget is still exceeded.
+ */
+bool MarlinCdmEngine::keepMemoryBudget(uint32_t reserved)
+{
+    uint64_t memory_budget = mReaper->memoryBudget();
+    uint64_t memory_size = 0;
+    CdmSession* removed = NULL;
+    vector<CdmSession*> victims;
+
+    if (memory_budget == 0) {
+        return true;
+    }
+    memory_size = mCdmSessionTable->memorySize() + reserved;
+    if (memory_size <= memory_budget) {
+        return true;
+    }
+    /* The victims are found by one scan of the table, not one scan per victim. */
+    mCdmSessionTable->findLeastRecentlyUsed(memory_size - memory_budget, victims);
+    for (vector<CdmSession*>::iterator it = victims.begin(); it != victims.end(); ++it) {
+        CdmSession* session = *it;
+        removed = NULL;
+        /* Sessions closed by others meanwhile may have made room already. */
+        if ((mCdmSessionTable->memorySize() + reserved) > memory_budget) {
+            session->mutex.lock();
+            removed = session->closed ? NULL : mCdmSessionTable->remove(session->handle);
+            session->mutex.unlock();
+        }
+        releaseSession(session);
+
+        if (removed != NULL) {
+            LOGD("Session is closed by memory budget. session_id(%s).\n", removed->sessionId.c_str());
+            closeSession(removed);
+            mReaper->countEviction(false);
+        }
+    }
+    return (mCdmSessionTable->memorySize() + reserved) <= memory_budget;
+}
+
 mcdm_status_t MarlinCdmEngine::GenerateKeyRequest(const mcdm_session_id_t& session_id,
                                                   const mcdm_buffer_t& init_data,
                                                   mcdm_buffer_t* request)
+{
+    CdmSession* session = lockSession(session_id);
+    mcdm_status_t status = generateKeyRequest(session, init_data, request);
+
+    unlockSession(session);
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::GenerateKeyRequest(mcdm_session_handle_t session_handle,
+                                                  const mcdm_buffer_t& init_data,
+                                                  mcdm_buffer_t* request)
+{
+    CdmSession* session = lockSession(session_handle);
+    mcdm_status_t status = generateKeyRequest(session, init_data, request);
+
+    unlockSession(session);
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::generateKeyRequest(CdmSession* session,
+                                                  const mcdm_buffer_t& init_data,
+                                                  mcdm_buffer_t* request)
 {
     MARLINLOG_ENTER();
 
     mcdm_status_t status = OK;
     MH_status_t agentStatus = MH_ERR_OK;
     MH_iptvesHandle_t handle = NULL;
+    MarlinAgentHandler* handler = NULL;
     MH_challengeParameter_t mh_chal_param;
     MH_buffer_t mh_request;
+    vector<uint8_t> prepared;
 
     memset(&mh_chal_param, 0, sizeof(MH_challengeParameter_t));
     memset(&mh_request, 0, sizeof(MH_buffer_t));
@@ -264,43 +684,47 @@ mcdm_status_t MarlinCdmEngine::GenerateKeyRequest(const mcdm_session_id_t& sessi
         return ERROR_ILLEGAL_ARGUMENT;
     }
 
-    handle = getIPTVEShandle(session_id);
-    if (handle == NULL) {
-        LOGE("ERROR : calling getIPTVEShandle. session_id(%s).\n", session_id.c_str());
+    if ((session == NULL) || session->closed) {
+        LOGE("ERROR : Session is not opened.\n");
         MARLINLOG_EXIT();
         return ERROR_SESSION_NOT_OPENED;
     }
+    handle = session->iptvesHandle;
+    handler = mAgents->handler(session->agent);
+    /* The request message of the previous call is reclaimed when the caller did not release it. */
+    releaseRequest(session);
+
+    /* A request message prepared by PrepareKeyRequests() on the handle of the session for init_data is given at once. */
+    if (!session->keyRequested && (mChallenges != NULL) &&
+        mChallenges->take(session->handle, init_data, prepared)) {
+        session->keyRequested = true;
+        status = copyRequest(session, &prepared[0], prepared.size(), request);
+        MARLINLOG_EXIT();
+        return status;
+    }
 
-    status = parseInitDataForChallengeParameter(init_data, mh_chal_param);
+    status = InitDataView(init_data).decodeChallengeParameter(mh_chal_param);
     if (status != OK) {
-        LOGE("ERROR : calling parseInitDataForChallengeParameter.\n");
-        delete [] mh_chal_param.server_uri_data;
-        delete [] mh_chal_param.kid_info.data;
+        LOGE("ERROR : Invalid challenge parameter in init_data.\n");
         MARLINLOG_EXIT();
         return status;
     }
 
-    agentStatus = mHandler->createChallengeRequest(handle,
+    agentStatus = handler->createChallengeRequest(handle,
                                                    &mh_chal_param,
                                                    &mh_request);
     if (agentStatus != MH_ERR_OK) {
         LOGE("ERROR : calling createChallengeRequest (%d).\n", agentStatus);
-        mHandler->freeRequestBuffer(handle);
-        delete [] mh_chal_param.server_uri_data;
-        delete [] mh_chal_param.kid_info.data;
+        handler->freeRequestBuffer(handle);
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
+    session->keyRequested = true;
 
-    request->len = mh_request.len;
-    request->data = mh_request.data;
-    request->fd = mh_request.fd;
-
-    delete [] mh_chal_param.server_uri_data;
-    delete [] mh_chal_param.kid_info.data;
+    status = setRequest(session, mh_request, request);
 
     MARLINLOG_EXIT();
-    return OK;
+    return status;
 }
 
 mcdm_status_t MarlinCdmEngine::AddKey(const mcdm_session_id_t& session_id,
@@ -308,12 +732,39 @@ mcdm_status_t MarlinCdmEngine::AddKey(const mcdm_session_id_t& session_id,
                                       const mcdm_buffer_t& init_data,
                                       bool* endflag,
                                       mcdm_buffer_t* request)
+{
+    CdmSession* session = lockSession(session_id);
+    mcdm_status_t status = addKey(session, key, init_data, endflag, request);
+
+    unlockSession(session);
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::AddKey(mcdm_session_handle_t session_handle,
+                                      const mcdm_buffer_t& key,
+                                      const mcdm_buffer_t& init_data,
+                                      bool* endflag,
+                                      mcdm_buffer_t* request)
+{
+    CdmSession* session = lockSession(session_handle);
+    mcdm_status_t status = addKey(session, key, init_data, endflag, request);
+
+    unlockSession(session);
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::addKey(CdmSession* session,
+                                      const mcdm_buffer_t& key,
+                                      const mcdm_buffer_t& init_data,
+                                      bool* endflag,
+                                      mcdm_buffer_t* request)
 {
     MARLINLOG_ENTER();
 
     mcdm_status_t status = OK;
     MH_status_t agentStatus = MH_ERR_OK;
     MH_iptvesHandle_t handle = NULL;
+    MarlinAgentHandler* handler = NULL;
     MH_buffer_t mh_response;
     MH_buffer_t mh_request;
     MH_challengeParameter_t mh_chal_param;
@@ -345,63 +796,74 @@ mcdm_status_t MarlinCdmEngine::AddKey(const mcdm_session_id_t& session_id,
     mh_response.data = key.data;
     mh_response.fd = key.fd;
 
-    handle = getIPTVEShandle(session_id);
-    if (handle == NULL) {
-        LOGE("ERROR : calling getIPTVEShandle. session_id(%s).\n", session_id.c_str());
+    if ((session == NULL) || session->closed) {
+        LOGE("ERROR : Session is not opened.\n");
         MARLINLOG_EXIT();
         return ERROR_SESSION_NOT_OPENED;
     }
-
-    agentStatus = mHandler->freeRequestBuffer(handle);
-    if (agentStatus != MH_ERR_OK) {
-        LOGE("ERROR : calling freeRequestBuffer (%d).\n", agentStatus);
-        MARLINLOG_EXIT();
-        return ERROR_UNKNOWN;
-    }
+    handle = session->iptvesHandle;
+    handler = mAgents->handler(session->agent);
+    /* The request message of the previous call is reclaimed when the caller did not release it. */
+    releaseRequest(session);
 
     if (init_data.data != NULL) {
-        status = parseInitDataForChallengeParameter(init_data, mh_chal_param);
+        status = InitDataView(init_data).decodeChallengeParameter(mh_chal_param);
         if (status != OK) {
-            LOGE("ERROR : calling parseInitDataForChallengeParameter.\n");
-            delete [] mh_chal_param.server_uri_data;
-            delete [] mh_chal_param.kid_info.data;
+            LOGE("ERROR : Invalid challenge parameter in init_data.\n");
             MARLINLOG_EXIT();
             return status;
         }
         mh_chal_param_p = &mh_chal_param;
     }
 
-    agentStatus = mHandler->processResponse(handle,
+    session->keyRequested = true;
+    session->responseProcessed = true;
+    agentStatus = handler->processResponse(handle,
                                             &mh_response,
                                             mh_chal_param_p,
                                             endflag,
                                             &mh_request);
     if (agentStatus != MH_ERR_OK) {
         LOGE("ERROR : calling processResponse (%d).\n", agentStatus);
-        mHandler->freeRequestBuffer(handle);
-        delete [] mh_chal_param.server_uri_data;
-        delete [] mh_chal_param.kid_info.data;
+        handler->freeRequestBuffer(handle);
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
 
-    request->len = mh_request.len;
-    request->data = mh_request.data;
-    request->fd = mh_request.fd;
+    /* Licenses may be changed by the response. */
+    mKeyCache->invalidate();
 
-    delete [] mh_chal_param.server_uri_data;
-    delete [] mh_chal_param.kid_info.data;
+    status = setRequest(session, mh_request, request);
 
     MARLINLOG_EXIT();
-    return OK;
+    return status;
 }
 
 mcdm_status_t MarlinCdmEngine::CancelKeyRequest(const mcdm_session_id_t& session_id)
+{
+    CdmSession* session = lockSession(session_id);
+    mcdm_status_t status = cancelKeyRequest(session);
+
+    unlockSession(session);
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::CancelKeyRequest(mcdm_session_handle_t session_handle)
+{
+    CdmSession* session = lockSession(session_handle);
+    mcdm_status_t status = cancelKeyRequest(session);
+
+    unlockSession(session);
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::cancelKeyRequest(CdmSession* session)
 {
     MARLINLOG_ENTER();
 
     MH_status_t agentStatus = MH_ERR_OK;
     MH_iptvesHandle_t handle = NULL;
+    MarlinAgentHandler* handler = NULL;
 
     if (mHandler == NULL) {
         LOGE("ERROR : MarlinAgentHandler is NULL.\n");
@@ -415,21 +877,16 @@ mcdm_status_t MarlinCdmEngine::CancelKeyRequest(const mcdm_session_id_t& session
         return ERROR_UNKNOWN;
     }
 
-    handle = getIPTVEShandle(session_id);
-    if (handle == NULL) {
-        LOGE("ERROR : calling getIPTVEShandle. session_id(%s).\n", session_id.c_str());
+    if ((session == NULL) || session->closed) {
+        LOGE("ERROR : Session is not opened.\n");
         MARLINLOG_EXIT();
         return ERROR_SESSION_NOT_OPENED;
     }
+    handle = session->iptvesHandle;
+    handler = mAgents->handler(session->agent);
+    releaseRequest(session);
 
-    agentStatus = mHandler->freeRequestBuffer(handle);
-    if (agentStatus != MH_ERR_OK) {
-        LOGE("ERROR : calling freeRequestBuffer (%d).\n", agentStatus);
-        MARLINLOG_EXIT();
-        return ERROR_UNKNOWN;
-    }
-
-    agentStatus = mHandler->cancelKeyRequest(handle);
+    agentStatus = handler->cancelKeyRequest(handle);
     if (agentStatus != MH_ERR_OK) {
         LOGE("ERROR : calling cancelKeyRequest (%d).\n", agentStatus);
         MARLINLOG_EXIT();
@@ -443,17 +900,38 @@ mcdm_status_t MarlinCdmEngine::CancelKeyRequest(const mcdm_session_id_t& session
 mcdm_status_t MarlinCdmEngine::Decrypt(const mcdm_buffer_t& init_data,
                                        mcdm_buffer_t* src_ptr,
                                        mcdm_buffer_t* dst_ptr)
+{
+    return decryptSample(init_data, MCDM_DECRYPT_MODE_AGENT_BUFFER, NULL, 0, src_ptr, dst_ptr);
+}
+
+mcdm_status_t MarlinCdmEngine::Decrypt(const mcdm_buffer_t& init_data,
+                                       const mcdm_subsample_t* subsamples,
+                                       uint32_t subsample_num,
+                                       mcdm_buffer_t* src_ptr,
+                                       mcdm_buffer_t* dst_ptr)
+{
+    return decryptSample(init_data, MCDM_DECRYPT_MODE_AGENT_BUFFER, subsamples, subsample_num, src_ptr, dst_ptr);
+}
+
+mcdm_status_t MarlinCdmEngine::Decrypt(const mcdm_buffer_t& init_data,
+                                       mcdm_decrypt_mode_t mode,
+                                       mcdm_buffer_t* src_ptr,
+                                       mcdm_buffer_t* dst_ptr)
+{
+    return decryptSample(init_data, mode, NULL, 0, src_ptr, dst_ptr);
+}
+
+mcdm_status_t MarlinCdmEngine::DecryptBatch(const mcdm_buffer_t& init_data,
+                                            mcdm_sample_t* samples,
+                                            uint32_t sample_num)
 {
     MARLINLOG_ENTER();
 
     mcdm_status_t status = OK;
     MH_status_t agentStatus = MH_ERR_OK;
-    MH_buffer_t mh_src_ptr;
-    MH_buffer_t mh_dst_ptr;
     MH_keyIdInfo_t kid_info;
+    KeyContext* key_context = NULL;
 
-    memset(&mh_src_ptr, 0, sizeof(MH_buffer_t));
-    memset(&mh_dst_ptr, 0, sizeof(MH_buffer_t));
     memset(&kid_info, 0, sizeof(MH_keyIdInfo_t));
 
     if (mHandler == NULL) {
@@ -468,77 +946,1235 @@ mcdm_status_t MarlinCdmEngine::Decrypt(const mcdm_buffer_t& init_data,
         return ERROR_UNKNOWN;
     }
 
-    if (dst_ptr == NULL) {
-        LOGE("ERROR : Output parameter is NULL.\n");
+    if ((init_data.data == NULL) || (samples == NULL) || (sample_num == 0)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
         MARLINLOG_EXIT();
         return ERROR_ILLEGAL_ARGUMENT;
     }
 
-    if ((init_data.data == NULL) || (src_ptr == NULL)) {
-        LOGE("ERROR : Input parameter is NULL.\n");
-        MARLINLOG_EXIT();
-        return ERROR_ILLEGAL_ARGUMENT;
+    for (uint32_t i = 0; i < sample_num; i++) {
+        status = checkSubsampleMap(samples[i].subsamples, samples[i].subsample_num, samples[i].src.len);
+        if (status != OK) {
+            LOGE("ERROR : calling checkSubsampleMap. sample(%u).\n", i);
+            MARLINLOG_EXIT();
+            return status;
+        }
+        if ((samples[i].dst.data != NULL) &&
+            (samples[i].dst.data != samples[i].src.data) &&
+            (samples[i].dst.len < samples[i].src.len)) {
+            LOGE("ERROR : Output buffer is too small. sample(%u).\n", i);
+            MARLINLOG_EXIT();
+            return ERROR_ILLEGAL_ARGUMENT;
+        }
     }
 
-    status = parseInitDataForKeyIdInfo(init_data, kid_info);
+    status = InitDataView(init_data).decodeKeyIdInfo(kid_info);
     if (status != OK) {
-        LOGE("ERROR : calling parseInitDataForKeyIdInfo.\n");
-        delete [] kid_info.data;
+        LOGE("ERROR : Invalid KeyID information in init_data.\n");
         MARLINLOG_EXIT();
         return status;
     }
 
-    mh_src_ptr.len = src_ptr->len;
-    mh_src_ptr.data = src_ptr->data;
-    mh_src_ptr.fd = src_ptr->fd;
+    status = mKeyCache->acquire(kid_info, &key_context);
+    if (status != OK) {
+        LOGE("ERROR : Could not resolve key context.\n");
+        MARLINLOG_EXIT();
+        return status;
+    }
 
-    agentStatus = mHandler->decrypt(&kid_info,
-                                    &mh_src_ptr,
-                                    &mh_dst_ptr);
+    /* The output buffer of the agent is one per thread, each sample without dst gets its own pooled buffer. */
+    vector<bool> pooled(sample_num, false);
+    for (uint32_t i = 0; (i < sample_num) && (status == OK); i++) {
+        if (samples[i].dst.data != NULL) {
+            continue;
+        }
+        samples[i].dst.data = mBufferPool->acquire(samples[i].src.len, NULL);
+        if (samples[i].dst.data == NULL) {
+            LOGE("ERROR : Could not allocate output buffer. sample(%u).\n", i);
+            status = ERROR_UNKNOWN;
+            break;
+        }
+        samples[i].dst.len = samples[i].src.len;
+        samples[i].dst.offset = 0;
+        samples[i].dst.fd = -1;
+        pooled[i] = true;
+    }
+
+    if (status == OK) {
+        /* mcdm_sample_t has the same layout as MH_sample_t, the samples are handed over without copy. */
+        mAgents->enter(key_context->agent);
+        agentStatus = mAgents->handler(key_context->agent)->decryptBatchWithKey(key_context->keyHandle,
+                                                                                (MH_sample_t*)samples,
+                                                                                sample_num);
+        mAgents->leave(key_context->agent);
+    }
+    mKeyCache->release(key_context);
+    if ((status != OK) || (agentStatus != MH_ERR_OK)) {
+        for (uint32_t i = 0; i < sample_num; i++) {
+            if (pooled[i]) {
+                mBufferPool->release(samples[i].dst.data, NULL);
+                samples[i].dst.data = NULL;
+                samples[i].dst.len = 0;
+            }
+        }
+    }
+    if (status != OK) {
+        MARLINLOG_EXIT();
+        return status;
+    }
     if (agentStatus != MH_ERR_OK) {
-        LOGE("ERROR : calling decrypt (%d).\n", agentStatus);
-        delete [] kid_info.data;
+        LOGE("ERROR : calling decryptBatchWithKey (%d).\n", agentStatus);
         MARLINLOG_EXIT();
-        return ERROR_UNKNOWN;
+        return (agentStatus == MH_ERR_TOO_SMALL_BUFFER) ? ERROR_ILLEGAL_ARGUMENT : ERROR_UNKNOWN;
     }
 
-    dst_ptr->len = mh_dst_ptr.len;
-    dst_ptr->data = mh_dst_ptr.data;
-    dst_ptr->fd = mh_dst_ptr.fd;
-
-    delete [] kid_info.data;
-
     MARLINLOG_EXIT();
     return OK;
 }
 
-mcdm_status_t MarlinCdmEngine::GetKeyReleases(mcdm_key_release_t** key_release,
-                                              uint32_t* key_release_num)
+mcdm_status_t MarlinCdmEngine::UnmapFdBuffer(int fd)
 {
     MARLINLOG_ENTER();
 
-    MH_status_t agentStatus = MH_ERR_OK;
-    MH_keyRelease_t* mh_key_release = NULL;
-
-    if (mHandler == NULL) {
-        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
-        MARLINLOG_EXIT();
-        return ERROR_UNKNOWN;
-    }
-
-    if (mHandle == NULL) {
-        LOGE("ERROR : This function is called in the wrong sequence.\n");
+    if (mFdMappings == NULL) {
+        LOGE("ERROR : FdMappingCache is NULL.\n");
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
 
-    if ((key_release == NULL) || (key_release_num == NULL)) {
-        LOGE("ERROR : Output parameter is NULL.\n");
+    if (fd < 0) {
+        LOGE("ERROR : Input parameter is invalid.\n");
         MARLINLOG_EXIT();
         return ERROR_ILLEGAL_ARGUMENT;
     }
 
-    agentStatus = mHandler->getKeyReleases(&mh_key_release, key_release_num);
+    mFdMappings->unmap(fd);
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::ReleaseBuffer(mcdm_buffer_t* buffer)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mBufferPool == NULL) {
+        LOGE("ERROR : CdmBufferPool is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((buffer == NULL) || (buffer->data == NULL)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    status = mBufferPool->release(buffer->data, NULL);
+    if (status != OK) {
+        LOGE("ERROR : Buffer is not allocated by MCDM_DECRYPT_MODE_POOL_BUFFER.\n");
+        MARLINLOG_EXIT();
+        return status;
+    }
+    buffer->data = NULL;
+    buffer->len = 0;
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::ReleaseKeyRequestBuffer(const mcdm_session_id_t& session_id,
+                                                       mcdm_buffer_t* request)
+{
+    CdmSession* session = lockSession(session_id);
+    mcdm_status_t status = releaseKeyRequestBuffer(session, request);
+
+    unlockSession(session);
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::ReleaseKeyRequestBuffer(mcdm_session_handle_t session_handle,
+                                                       mcdm_buffer_t* request)
+{
+    CdmSession* session = lockSession(session_handle);
+    mcdm_status_t status = releaseKeyRequestBuffer(session, request);
+
+    unlockSession(session);
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::releaseKeyRequestBuffer(CdmSession* session,
+                                                       mcdm_buffer_t* request)
+{
+    MARLINLOG_ENTER();
+
+    if (mBufferPool == NULL) {
+        LOGE("ERROR : CdmBufferPool is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((request == NULL) || (request->data == NULL)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    if ((session == NULL) || session->closed) {
+        LOGE("ERROR : Session is not opened.\n");
+        MARLINLOG_EXIT();
+        return ERROR_SESSION_NOT_OPENED;
+    }
+
+    if (request->data != session->request) {
+        LOGE("ERROR : Buffer is not the request message of the session.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    releaseRequest(session);
+    request->data = NULL;
+    request->len = 0;
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::AcquireLicenseAsync(const mcdm_session_id_t& session_id,
+                                                   const mcdm_buffer_t& init_data,
+                                                   mcdm_license_transport_t transport,
+                                                   mcdm_license_callback_t callback,
+                                                   void* user_data,
+                                                   uint32_t timeout_ms,
+                                                   uint64_t* token)
+{
+    mcdm_session_handle_t session_handle = MCDM_SESSION_HANDLE_INVALID;
+
+    CdmSession* session = getSession(session_id);
+    if (session != NULL) {
+        session_handle = session->handle;
+        releaseSession(session);
+    }
+    return AcquireLicenseAsync(session_handle, init_data, transport, callback, user_data, timeout_ms, token);
+}
+
+mcdm_status_t MarlinCdmEngine::AcquireLicenseAsync(mcdm_session_handle_t session_handle,
+                                                   const mcdm_buffer_t& init_data,
+                                                   mcdm_license_transport_t transport,
+                                                   mcdm_license_callback_t callback,
+                                                   void* user_data,
+                                                   uint32_t timeout_ms,
+                                                   uint64_t* token)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mLicenseExchanges == NULL) {
+        LOGE("ERROR : LicenseExchangeManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (token == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    if ((init_data.data == NULL) || (init_data.len == 0) || (transport == NULL) || (callback == NULL)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    CdmSession* session = getSession(session_handle);
+    if (session == NULL) {
+        LOGE("ERROR : Session is not opened.\n");
+        MARLINLOG_EXIT();
+        return ERROR_SESSION_NOT_OPENED;
+    }
+    releaseSession(session);
+
+    status = mLicenseExchanges->start(session_handle, init_data, transport, callback, user_data, timeout_ms, token);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::SubmitLicenseResponse(uint64_t token, const mcdm_buffer_t& response)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mLicenseExchanges == NULL) {
+        LOGE("ERROR : LicenseExchangeManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((response.data == NULL) || (response.len == 0)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    status = mLicenseExchanges->submit(token, response);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::CancelLicenseRequest(uint64_t token)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mLicenseExchanges == NULL) {
+        LOGE("ERROR : LicenseExchangeManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    status = mLicenseExchanges->cancel(token);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::GetLicenseState(uint64_t token, mcdm_license_state_t* state)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mLicenseExchanges == NULL) {
+        LOGE("ERROR : LicenseExchangeManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (state == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    status = mLicenseExchanges->getState(token, state);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::DescrambleTs(const mcdm_buffer_t& init_data,
+                                            mcdm_buffer_t* ts)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+    MH_keyIdInfo_t kid_info;
+    KeyContext* key_context = NULL;
+    vector<MH_sample_t> even;
+    vector<MH_sample_t> odd;
+
+    memset(&kid_info, 0, sizeof(MH_keyIdInfo_t));
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((init_data.data == NULL) || (ts == NULL) || (ts->data == NULL)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    TsPacketScanner scanner(ts->data, ts->len, getSavedPayloads());
+    status = scanner.scan(even, odd);
+    if (status != OK) {
+        LOGE("ERROR : Invalid TS packets. len(%zu).\n", ts->len);
+        MARLINLOG_EXIT();
+        return status;
+    }
+    if (scanner.getScrambledNum() == 0) {
+        MARLINLOG_EXIT();
+        return OK;
+    }
+
+    status = InitDataView(init_data).decodeKeyIdInfo(kid_info);
+    if (status != OK) {
+        LOGE("ERROR : Invalid KeyID information in init_data.\n");
+        MARLINLOG_EXIT();
+        return status;
+    }
+
+    status = mKeyCache->acquire(kid_info, &key_context);
+    if (status != OK) {
+        LOGE("ERROR : Could not resolve key context.\n");
+        MARLINLOG_EXIT();
+        return status;
+    }
+
+    /* One call per key parity, the payloads are decrypted in place. */
+    status = descramblePackets(key_context, MCDM_KEY_PARITY_EVEN, even, scanner);
+    if (status == OK) {
+        status = descramblePackets(key_context, MCDM_KEY_PARITY_ODD, odd, scanner);
+    }
+    mKeyCache->release(key_context);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::OpenEcmStream(uint32_t* stream_id)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mEcmStreams == NULL) {
+        LOGE("ERROR : EcmStreamManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (stream_id == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    status = mEcmStreams->open(stream_id);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::PushEcm(uint32_t stream_id,
+                                       mcdm_key_parity_t parity,
+                                       const mcdm_buffer_t& init_data)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+    MH_keyIdInfo_t kid_info;
+
+    memset(&kid_info, 0, sizeof(MH_keyIdInfo_t));
+
+    if (mEcmStreams == NULL) {
+        LOGE("ERROR : EcmStreamManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((init_data.data == NULL) ||
+        ((parity != MCDM_KEY_PARITY_EVEN) && (parity != MCDM_KEY_PARITY_ODD))) {
+        LOGE("ERROR : Input parameter is invalid.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    status = InitDataView(init_data).decodeKeyIdInfo(kid_info);
+    if (status != OK) {
+        LOGE("ERROR : Invalid KeyID information in init_data.\n");
+        MARLINLOG_EXIT();
+        return status;
+    }
+    if ((kid_info.type != KEY_ID_INFO_TYPE_ECM) || (kid_info.length == 0)) {
+        LOGE("ERROR : KeyID information is not ECM information.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    status = mEcmStreams->push(stream_id, parity, kid_info);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::DescrambleTs(uint32_t stream_id,
+                                            mcdm_buffer_t* ts)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+    KeyContext* key_context = NULL;
+    vector<MH_sample_t> samples[2];
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((mHandle == NULL) || (mEcmStreams == NULL)) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((ts == NULL) || (ts->data == NULL)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    TsPacketScanner scanner(ts->data, ts->len, getSavedPayloads());
+    status = scanner.scan(samples[MCDM_KEY_PARITY_EVEN], samples[MCDM_KEY_PARITY_ODD]);
+    if (status != OK) {
+        LOGE("ERROR : Invalid TS packets. len(%zu).\n", ts->len);
+        MARLINLOG_EXIT();
+        return status;
+    }
+
+    /* Each parity has the key context of its own crypto-period. */
+    for (int parity = MCDM_KEY_PARITY_EVEN; parity <= MCDM_KEY_PARITY_ODD; parity++) {
+        if (samples[parity].empty()) {
+            scanner.clearScramblingControl((mcdm_key_parity_t)parity);
+            continue;
+        }
+        status = mEcmStreams->acquire(stream_id, (mcdm_key_parity_t)parity, &key_context);
+        if (status != OK) {
+            LOGE("ERROR : Could not resolve key context of ECM stream (%u).\n", stream_id);
+            MARLINLOG_EXIT();
+            return status;
+        }
+        status = descramblePackets(key_context, (mcdm_key_parity_t)parity, samples[parity], scanner);
+        mKeyCache->release(key_context);
+        if (status != OK) {
+            MARLINLOG_EXIT();
+            return status;
+        }
+    }
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::CloseEcmStream(uint32_t stream_id)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mEcmStreams == NULL) {
+        LOGE("ERROR : EcmStreamManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    status = mEcmStreams->close(stream_id);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::OpenDecryptStream(const mcdm_buffer_t& init_data,
+                                                 const uint8_t* iv,
+                                                 uint32_t* stream_id)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+    MH_keyIdInfo_t kid_info;
+
+    memset(&kid_info, 0, sizeof(MH_keyIdInfo_t));
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mDecryptStreams == NULL) {
+        LOGE("ERROR : DecryptStreamManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (stream_id == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    if (init_data.data == NULL) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    status = InitDataView(init_data).decodeKeyIdInfo(kid_info);
+    if (status != OK) {
+        LOGE("ERROR : Invalid KeyID information in init_data.\n");
+        MARLINLOG_EXIT();
+        return status;
+    }
+
+    status = mDecryptStreams->open(kid_info, iv, stream_id);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::DecryptStreamChunk(uint32_t stream_id,
+                                                  mcdm_buffer_t* src_ptr,
+                                                  bool last,
+                                                  mcdm_buffer_t* dst_ptr)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+    MH_buffer_t mh_src_ptr;
+    MH_buffer_t mh_dst_ptr;
+    bool pooled = false;
+
+    memset(&mh_src_ptr, 0, sizeof(MH_buffer_t));
+    memset(&mh_dst_ptr, 0, sizeof(MH_buffer_t));
+
+    if (mDecryptStreams == NULL) {
+        LOGE("ERROR : DecryptStreamManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (dst_ptr == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    if ((src_ptr == NULL) || ((src_ptr->data == NULL) && (src_ptr->len > 0))) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    mh_src_ptr.len = src_ptr->len;
+    mh_src_ptr.data = src_ptr->data;
+    mh_src_ptr.fd = -1;
+
+    /* A partial block held from the last chunk may be output with this chunk. */
+    if (dst_ptr->data == NULL) {
+        mh_dst_ptr.len = src_ptr->len + MCDM_SIZE_AES_BLOCK - 1;
+        mh_dst_ptr.data = mBufferPool->acquire(mh_dst_ptr.len, NULL);
+        if (mh_dst_ptr.data == NULL) {
+            LOGE("ERROR : Could not allocate output buffer.\n");
+            MARLINLOG_EXIT();
+            return ERROR_UNKNOWN;
+        }
+        pooled = true;
+    } else {
+        if ((dst_ptr->data == src_ptr->data) || (dst_ptr->len < src_ptr->len + MCDM_SIZE_AES_BLOCK - 1)) {
+            LOGE("ERROR : Output buffer is too small or same as input buffer.\n");
+            MARLINLOG_EXIT();
+            return ERROR_ILLEGAL_ARGUMENT;
+        }
+        mh_dst_ptr.len = dst_ptr->len;
+        mh_dst_ptr.data = dst_ptr->data;
+    }
+    mh_dst_ptr.fd = -1;
+
+    status = mDecryptStreams->decrypt(stream_id, &mh_src_ptr, last, &mh_dst_ptr);
+    if (pooled && ((status != OK) || (mh_dst_ptr.len == 0))) {
+        mBufferPool->release(mh_dst_ptr.data, NULL);
+        mh_dst_ptr.data = NULL;
+    }
+    if (status != OK) {
+        MARLINLOG_EXIT();
+        return status;
+    }
+
+    dst_ptr->len = mh_dst_ptr.len;
+    dst_ptr->data = mh_dst_ptr.data;
+    dst_ptr->fd = -1;
+    dst_ptr->offset = 0;
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::CloseDecryptStream(uint32_t stream_id)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mDecryptStreams == NULL) {
+        LOGE("ERROR : DecryptStreamManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    status = mDecryptStreams->close(stream_id);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::OpenDecryptRing(const mcdm_buffer_t& init_data,
+                                               uint32_t capacity,
+                                               uint32_t* ring_id)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+    MH_keyIdInfo_t kid_info;
+
+    memset(&kid_info, 0, sizeof(MH_keyIdInfo_t));
+
+    if (mDecryptRings == NULL) {
+        LOGE("ERROR : DecryptRingManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (ring_id == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    if (init_data.data == NULL) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    /* init_data is checked once here, rather than failing every entry. */
+    status = InitDataView(init_data).decodeKeyIdInfo(kid_info);
+    if (status != OK) {
+        LOGE("ERROR : Invalid KeyID information in init_data.\n");
+        MARLINLOG_EXIT();
+        return status;
+    }
+
+    status = mDecryptRings->open(init_data, capacity, ring_id);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::PushDecryptRing(uint32_t ring_id,
+                                               const mcdm_decrypt_ring_entry_t& entry)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mDecryptRings == NULL) {
+        LOGE("ERROR : DecryptRingManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (((entry.sample.src.data == NULL) && (entry.sample.src.len > 0)) || (entry.sample.dst.data == NULL)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    status = mDecryptRings->push(ring_id, entry);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::PopDecryptRing(uint32_t ring_id,
+                                              mcdm_decrypt_ring_entry_t* entries,
+                                              uint32_t max_num,
+                                              uint32_t* num)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mDecryptRings == NULL) {
+        LOGE("ERROR : DecryptRingManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((entries == NULL) || (num == NULL)) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    status = mDecryptRings->pop(ring_id, entries, max_num, num);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::CloseDecryptRing(uint32_t ring_id)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mDecryptRings == NULL) {
+        LOGE("ERROR : DecryptRingManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    status = mDecryptRings->close(ring_id);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::DecryptTsFile(const mcdm_buffer_t& init_data,
+                                             int src_fd,
+                                             int dst_fd,
+                                             uint32_t thread_num)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+    MH_keyIdInfo_t kid_info;
+
+    memset(&kid_info, 0, sizeof(MH_keyIdInfo_t));
+
+    if (mFileDecryptor == NULL) {
+        LOGE("ERROR : CdmFileDecryptor is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((init_data.data == NULL) || (src_fd < 0) || (dst_fd < 0)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    /* init_data is checked once here, rather than failing every chunk. */
+    status = InitDataView(init_data).decodeKeyIdInfo(kid_info);
+    if (status != OK) {
+        LOGE("ERROR : Invalid KeyID information in init_data.\n");
+        MARLINLOG_EXIT();
+        return status;
+    }
+
+    status = mFileDecryptor->decryptTs(init_data, src_fd, dst_fd, thread_num);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::SetSessionPoolSize(uint32_t size)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mSessionPool == NULL) {
+        LOGE("ERROR : SessionHandlePool is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    status = mSessionPool->setSize(size);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::PrepareKeyRequests(const mcdm_session_handle_t* session_handles,
+                                                  const mcdm_buffer_t* init_data,
+                                                  uint32_t num,
+                                                  uint32_t ttl_ms)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+    CdmSession* session = NULL;
+    PrepareJob* job = NULL;
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mChallenges == NULL) {
+        LOGE("ERROR : ChallengeCache is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((((session_handles == NULL) || (init_data == NULL)) && (num != 0)) || (ttl_ms == 0)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    if (num > MCDM_CHALLENGE_CACHE_MAX) {
+        LOGE("ERROR : Too many init_data (%u).\n", num);
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    for (uint32_t i = 0; i < num; i++) {
+        if ((init_data[i].data == NULL) || (init_data[i].len == 0)) {
+            LOGE("ERROR : Input parameter is NULL.\n");
+            MARLINLOG_EXIT();
+            return ERROR_ILLEGAL_ARGUMENT;
+        }
+        session = getSession(session_handles[i]);
+        if (session == NULL) {
+            LOGE("ERROR : Session is not opened.\n");
+            MARLINLOG_EXIT();
+            return ERROR_SESSION_NOT_OPENED;
+        }
+        releaseSession(session);
+    }
+
+    for (uint32_t i = 0; (i < num) && (status == OK); i++) {
+        job = new PrepareJob();
+        job->engine = this;
+        job->session = session_handles[i];
+        job->initData.assign(init_data[i].data, init_data[i].data + init_data[i].len);
+        if (!mChallenges->reserve(job->session, init_data[i], ttl_ms, &job->sequence)) {
+            /* Prepared or posted already. */
+            delete job;
+            continue;
+        }
+        if (mTaskRunner->post(prepareTask, job) != OK) {
+            LOGE("ERROR : Could not post preparation of request message.\n");
+            mChallenges->drop(job->session);
+            delete job;
+            status = ERROR_UNKNOWN;
+        }
+    }
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+void MarlinCdmEngine::prepareTask(void* arg)
+{
+    PrepareJob* job = static_cast<PrepareJob*>(arg);
+
+    job->engine->prepareKeyRequest(job->session, job->initData, job->sequence);
+    delete job;
+}
+
+/*
+ * Make the request message of a preparation on the handle of its session, unless the session has made a key request
+ * since. The request message is kept before the session is unlocked, so GenerateKeyRequest() waiting on it finds it.
+ */
+void MarlinCdmEngine::prepareKeyRequest(mcdm_session_handle_t session_handle,
+                                        const vector<uint8_t>& init_data,
+                                        uint64_t sequence)
+{
+    MH_status_t agentStatus = MH_ERR_OK;
+    MarlinAgentHandler* handler = NULL;
+    MH_challengeParameter_t mh_chal_param;
+    MH_buffer_t mh_request;
+    mcdm_buffer_t data;
+    vector<uint8_t> prepared;
+    CdmSession* session = lockSession(session_handle);
+
+    memset(&mh_chal_param, 0, sizeof(MH_challengeParameter_t));
+    memset(&mh_request, 0, sizeof(MH_buffer_t));
+    memset(&data, 0, sizeof(mcdm_buffer_t));
+    data.len = init_data.size();
+    data.data = const_cast<uint8_t*>(&init_data[0]);
+    data.fd = -1;
+
+    if ((session == NULL) || session->closed || session->keyRequested) {
+        LOGD("Request message is not prepared, the session is closed or has requested keys.\n");
+    } else if (InitDataView(data).decodeChallengeParameter(mh_chal_param) != OK) {
+        LOGE("ERROR : Invalid challenge parameter in init_data.\n");
+    } else {
+        handler = mAgents->handler(session->agent);
+        agentStatus = handler->createChallengeRequest(session->iptvesHandle, &mh_chal_param, &mh_request);
+        if (agentStatus != MH_ERR_OK) {
+            LOGE("ERROR : calling createChallengeRequest (%d).\n", agentStatus);
+        } else if ((mh_request.data != NULL) && (mh_request.len != 0)) {
+            prepared.assign(mh_request.data, mh_request.data + mh_request.len);
+        } else {
+            /* A request message given by fd stays in the agent, it is not kept. */
+            LOGD("Request message is not prepared ahead.\n");
+        }
+        handler->freeRequestBuffer(session->iptvesHandle);
+    }
+    mChallenges->put(session_handle, sequence, prepared);
+    unlockSession(session);
+}
+
+mcdm_status_t MarlinCdmEngine::SetSessionIdleTimeout(uint32_t idle_timeout)
+{
+    MARLINLOG_ENTER();
+
+    uint32_t now = SessionReaper::now();
+    vector<mcdm_session_handle_t> handles;
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mReaper == NULL) {
+        LOGE("ERROR : SessionReaper is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    /* The open sessions are checked by the next tick, which schedules them for the new timeout. */
+    mReaper->setIdleTimeout(idle_timeout);
+    mReaper->clear();
+    if (idle_timeout != 0) {
+        mCdmSessionTable->getHandles(handles);
+        for (vector<mcdm_session_handle_t>::iterator it = handles.begin(); it != handles.end(); ++it) {
+            mReaper->schedule(*it, now);
+        }
+    }
+    startReaper();
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::SetSessionMemoryBudget(uint64_t memory_budget)
+{
+    MARLINLOG_ENTER();
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mReaper == NULL) {
+        LOGE("ERROR : SessionReaper is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    mReaper->setMemoryBudget(memory_budget);
+    if (!keepMemoryBudget(0)) {
+        LOGE("ERROR : Memory budget of sessions is exceeded.\n");
+    }
+    startReaper();
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::StartDecryptWorkers(uint32_t worker_num)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mDecryptPool == NULL) {
+        LOGE("ERROR : DecryptWorkerPool is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    status = mDecryptPool->start(worker_num);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::StopDecryptWorkers()
+{
+    MARLINLOG_ENTER();
+
+    if (mDecryptPool == NULL) {
+        LOGE("ERROR : DecryptWorkerPool is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    mDecryptPool->stop();
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::DecryptAsync(uint32_t stream_id,
+                                            const mcdm_buffer_t& init_data,
+                                            mcdm_sample_t* sample,
+                                            mcdm_decrypt_callback_t callback,
+                                            void* user_data,
+                                            uint64_t* request_id)
+{
+    MARLINLOG_ENTER();
+
+    mcdm_status_t status = OK;
+
+    if (mDecryptPool == NULL) {
+        LOGE("ERROR : DecryptWorkerPool is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((init_data.data == NULL) || (sample == NULL)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    status = mDecryptPool->submit(stream_id, init_data, sample, callback, user_data, request_id);
+
+    MARLINLOG_EXIT();
+    return status;
+}
+
+mcdm_status_t MarlinCdmEngine::PollDecryptCompletions(mcdm_decrypt_completion_t* completions,
+                                                      uint32_t max_num,
+                                                      uint32_t* num)
+{
+    MARLINLOG_ENTER();
+
+    if (mDecryptPool == NULL) {
+        LOGE("ERROR : DecryptWorkerPool is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((completions == NULL) || (num == NULL)) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    *num = mDecryptPool->poll(completions, max_num);
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::GetKeyReleases(mcdm_key_release_t** key_release,
+                                              uint32_t* key_release_num)
+{
+    MARLINLOG_ENTER();
+
+    MH_status_t agentStatus = MH_ERR_OK;
+    MH_keyRelease_t* mh_key_release = NULL;
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if ((key_release == NULL) || (key_release_num == NULL)) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    agentStatus = mHandler->getKeyReleases(&mh_key_release, key_release_num);
     if (agentStatus != MH_ERR_OK) {
         LOGE("ERROR : calling getKeyReleases (%d).\n", agentStatus);
         MARLINLOG_EXIT();
@@ -556,6 +2192,7 @@ mcdm_status_t MarlinCdmEngine::AddKeyReleaseCommit(const mcdm_key_release_t& key
     MARLINLOG_ENTER();
 
     MH_status_t agentStatus = MH_ERR_OK;
+    MH_keyRelease_t mh_key_release;
 
     if (mHandler == NULL) {
         LOGE("ERROR : MarlinAgentHandler is NULL.\n");
@@ -569,13 +2206,17 @@ mcdm_status_t MarlinCdmEngine::AddKeyReleaseCommit(const mcdm_key_release_t& key
         return ERROR_UNKNOWN;
     }
 
-    agentStatus = mHandler->addKeyReleaseCommit((MH_keyRelease_t*)&key_release);
+    mh_key_release = *(const MH_keyRelease_t*)&key_release;
+
+    agentStatus = mHandler->addKeyReleaseCommit(&mh_key_release);
     if (agentStatus != MH_ERR_OK) {
         LOGE("ERROR : calling addKeyReleaseCommit (%d).\n", agentStatus);
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
 
+    mKeyCache->invalidate();
+
     MARLINLOG_EXIT();
     return OK;
 }
@@ -617,108 +2258,536 @@ mcdm_status_t MarlinCdmEngine::FreeKeyReleasesBuffer(mcdm_key_release_t* key_rel
     return OK;
 }
 
+mcdm_status_t MarlinCdmEngine::GetKeyCacheStats(mcdm_key_cache_stats_t* stats)
+{
+    MARLINLOG_ENTER();
+
+    if (mKeyCache == NULL) {
+        LOGE("ERROR : KeyContextCache is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (stats == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    mKeyCache->getStatistics(stats);
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::GetEcmStreamStats(mcdm_ecm_stream_stats_t* stats)
+{
+    MARLINLOG_ENTER();
+
+    if (mEcmStreams == NULL) {
+        LOGE("ERROR : EcmStreamManager is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (stats == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    mEcmStreams->getStatistics(stats);
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::GetDecryptWorkerStats(mcdm_decrypt_worker_stats_t* stats)
+{
+    MARLINLOG_ENTER();
+
+    if (mDecryptPool == NULL) {
+        LOGE("ERROR : DecryptWorkerPool is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (stats == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    mDecryptPool->getStatistics(stats);
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::GetBufferPoolStats(mcdm_buffer_pool_stats_t* stats)
+{
+    MARLINLOG_ENTER();
+
+    if (mBufferPool == NULL) {
+        LOGE("ERROR : CdmBufferPool is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (stats == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    mBufferPool->getStatistics(stats);
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::GetSessionStats(mcdm_session_stats_t* stats)
+{
+    MARLINLOG_ENTER();
+
+    if ((mCdmSessionTable == NULL) || (mReaper == NULL)) {
+        LOGE("ERROR : SessionReaper is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
+
+    if (stats == NULL) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    mCdmSessionTable->getStatistics(stats);
+    mReaper->getStatistics(stats);
+
+    MARLINLOG_EXIT();
+    return OK;
+}
+
 MH_iptvesHandle_t MarlinCdmEngine::getIPTVEShandle(const mcdm_session_id_t& session_id)
 {
     MARLINLOG_ENTER();
 
     MH_iptvesHandle_t handle = NULL;
 
-    if (mCdmSessionMap.count(session_id) == 0) {
-        LOGD("ERROR : invalid session id.\n");
-    } else {
-        handle = mCdmSessionMap[session_id];
+    CdmSession* session = getSession(session_id);
+    if (session != NULL) {
+        handle = session->iptvesHandle;
+        releaseSession(session);
     }
 
     MARLINLOG_EXIT();
     return handle;
 }
 
-mcdm_status_t MarlinCdmEngine::parseInitDataForKeyIdInfo(const mcdm_buffer_t& init_data, MH_keyIdInfo_t& kid_info)
+CdmSession* MarlinCdmEngine::getSession(const mcdm_session_id_t& session_id)
 {
-    MARLINLOG_ENTER();
+    CdmSession* session = NULL;
+
+    if (mCdmSessionTable != NULL) {
+        session = mCdmSessionTable->find(session_id);
+    }
+    if (session == NULL) {
+        LOGD("ERROR : invalid session id. session_id(%s).\n", session_id.c_str());
+    }
+    return session;
+}
 
-    /* KeyID information Type */
-    kid_info.type = (MH_keyIdInfoType)init_data.data[MCDM_INDEX_KID_INFO_TYPE];
+CdmSession* MarlinCdmEngine::getSession(mcdm_session_handle_t handle)
+{
+    CdmSession* session = NULL;
+
+    if (mCdmSessionTable != NULL) {
+        session = mCdmSessionTable->find(handle);
+    }
+    if (session == NULL) {
+        LOGD("ERROR : invalid session handle. handle(%08x).\n", handle);
+    }
+    return session;
+}
 
-    /* KeyID information length */
-    kid_info.length = (size_t)MCDM_GET_LEN(&init_data.data[MCDM_INDEX_KID_INFO_LEN]);
+/* The session is returned with a reference and its lock held, or NULL. It is given back by unlockSession(). */
+CdmSession* MarlinCdmEngine::lockSession(const mcdm_session_id_t& session_id)
+{
+    CdmSession* session = getSession(session_id);
 
-    if (kid_info.length > 0) {
-        /* KeyID information data */
-        kid_info.data = new uint8_t[kid_info.length];
-        if(kid_info.data == NULL) {
-            LOGE("ERROR : Could not allocate memory.\n");
-            MARLINLOG_EXIT();
-            return ERROR_UNKNOWN;
+    if (session != NULL) {
+        session->mutex.lock();
+    }
+    return session;
+}
+
+CdmSession* MarlinCdmEngine::lockSession(mcdm_session_handle_t handle)
+{
+    CdmSession* session = getSession(handle);
+
+    if (session != NULL) {
+        session->mutex.lock();
+    }
+    return session;
+}
+
+void MarlinCdmEngine::unlockSession(CdmSession* session)
+{
+    if (session != NULL) {
+        if (!session->closed) {
+            session->lastUsed = SessionReaper::now();
+            mCdmSessionTable->account(session, sessionMemorySize(session));
         }
-        memcpy(kid_info.data, &init_data.data[MCDM_INDEX_KID_INFO_DATA], kid_info.length);
+        session->mutex.unlock();
+        releaseSession(session);
     }
+}
 
-    MARLINLOG_EXIT();
+/* Give back a reference taken by getSession(). The last reference frees the session. */
+void MarlinCdmEngine::releaseSession(CdmSession* session)
+{
+    if (atomicSub(&session->refCount, (uint32_t)1) == 0) {
+        /* A message held by the agent is freed with the handle, which is retired by CloseSession(). */
+        session->agentRequest = false;
+        releaseRequest(session);
+        delete session;
+    }
+}
+
+/* The request message is copied into the buffer pool, so that the buffer of the agent is freed at once. */
+mcdm_status_t MarlinCdmEngine::setRequest(CdmSession* session,
+                                          const MH_buffer_t& mh_request,
+                                          mcdm_buffer_t* request)
+{
+    mcdm_status_t status = OK;
+    MH_status_t agentStatus = MH_ERR_OK;
+
+    if ((mh_request.data == NULL) || (mh_request.len == 0) || (mBufferPool == NULL)) {
+        /* No message, or a message given by fd stays in the agent. */
+        session->agentRequest = (mh_request.len > 0) || (mh_request.fd >= 0);
+        request->len = mh_request.len;
+        request->data = mh_request.data;
+        request->fd = mh_request.fd;
+        request->offset = mh_request.offset;
+        return OK;
+    }
+
+    status = copyRequest(session, mh_request.data, mh_request.len, request);
+    agentStatus = mAgents->handler(session->agent)->freeRequestBuffer(session->iptvesHandle);
+    if (agentStatus != MH_ERR_OK) {
+        LOGE("ERROR : calling freeRequestBuffer (%d).\n", agentStatus);
+    }
+    return status;
+}
+
+/* Give a pooled copy of a request message to the caller, it is freed by releaseRequest(). */
+mcdm_status_t MarlinCdmEngine::copyRequest(CdmSession* session,
+                                           const uint8_t* data,
+                                           uint32_t len,
+                                           mcdm_buffer_t* request)
+{
+    uint8_t* copy = mBufferPool->acquire(len, session);
+
+    if (copy == NULL) {
+        LOGE("ERROR : Could not allocate request buffer.\n");
+        return ERROR_UNKNOWN;
+    }
+    memcpy(copy, data, len);
+
+    session->request = copy;
+    session->requestSize = len;
+    request->len = len;
+    request->data = copy;
+    request->fd = -1;
+    request->offset = 0;
     return OK;
 }
 
-mcdm_status_t MarlinCdmEngine::parseInitDataForChallengeParameter(const mcdm_buffer_t& init_data, MH_challengeParameter_t& chal_param)
+/* The copy of a request message is freed by setRequest() on the agent side already, a message given by fd is freed here. */
+void MarlinCdmEngine::releaseRequest(CdmSession* session)
+{
+    MH_status_t agentStatus = MH_ERR_OK;
+
+    if (session->request != NULL) {
+        mBufferPool->release(session->request, session);
+        session->request = NULL;
+        session->requestSize = 0;
+    }
+    if (session->agentRequest) {
+        agentStatus = mAgents->handler(session->agent)->freeRequestBuffer(session->iptvesHandle);
+        if (agentStatus != MH_ERR_OK) {
+            LOGE("ERROR : calling freeRequestBuffer (%d).\n", agentStatus);
+        }
+        session->agentRequest = false;
+    }
+}
+
+mcdm_status_t MarlinCdmEngine::decryptSample(const mcdm_buffer_t& init_data,
+                                              mcdm_decrypt_mode_t mode,
+                                              const mcdm_subsample_t* subsamples,
+                                              uint32_t subsample_num,
+                                              mcdm_buffer_t* src_ptr,
+                                              mcdm_buffer_t* dst_ptr)
 {
     MARLINLOG_ENTER();
 
-    /* RequestType */
-    chal_param.req_type = (MH_requestType)init_data.data[MCDM_INDEX_REQ_TYPE];
+    mcdm_status_t status = OK;
+    MH_status_t agentStatus = MH_ERR_OK;
+    MH_buffer_t mh_src_ptr;
+    MH_buffer_t mh_dst_ptr;
+    MH_keyIdInfo_t kid_info;
+    KeyContext* key_context = NULL;
+    FdMapping* src_mapping = NULL;
+    FdMapping* dst_mapping = NULL;
+    bool src_by_fd = false;
+
+    memset(&mh_src_ptr, 0, sizeof(MH_buffer_t));
+    memset(&mh_dst_ptr, 0, sizeof(MH_buffer_t));
+    memset(&kid_info, 0, sizeof(MH_keyIdInfo_t));
+
+    if (mHandler == NULL) {
+        LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
 
-    /* ActionID */
-    chal_param.action_id = (MH_actionId)init_data.data[MCDM_INDEX_ACT_ID];
+    if (mHandle == NULL) {
+        LOGE("ERROR : This function is called in the wrong sequence.\n");
+        MARLINLOG_EXIT();
+        return ERROR_UNKNOWN;
+    }
 
-    /* ActionParameter */
-    chal_param.act_param = (MH_actionParam)init_data.data[MCDM_INDEX_ACT_PARAM];
+    if ((dst_ptr == NULL) && (mode != MCDM_DECRYPT_MODE_IN_PLACE)) {
+        LOGE("ERROR : Output parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
 
-    /* PrivateDataTag & PrivateData */
-    memcpy(chal_param.private_data, &init_data.data[MCDM_INDEX_PRIVATE_DATA], MCDM_SIZE_PRIVATE_DATA);
+    if ((init_data.data == NULL) || (src_ptr == NULL)) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
 
-    /* UsageRuleReference */
-    memcpy(chal_param.urr_data, &init_data.data[MCDM_INDEX_URR_DATA], MCDM_SIZE_URR_DATA);
+    /* A zero-initialized buffer (fd 0) is not taken as a buffer given by fd. */
+    if ((src_ptr->data == NULL) && ((src_ptr->fd < 0) || (src_ptr->len == 0))) {
+        LOGE("ERROR : Input parameter is NULL.\n");
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
 
-    /* DRMServerURI length */
-    chal_param.server_uri_length = 
-        (size_t)MCDM_GET_LEN(&init_data.data[MCDM_INDEX_SERVER_URI_LEN]);
+    status = checkSubsampleMap(subsamples, subsample_num, src_ptr->len);
+    if (status != OK) {
+        LOGE("ERROR : calling checkSubsampleMap.\n");
+        MARLINLOG_EXIT();
+        return status;
+    }
 
-    if (chal_param.server_uri_length > 0) {
-        /* DRMServerURI data */
-        chal_param.server_uri_data = new uint8_t[chal_param.server_uri_length];
-        if(chal_param.server_uri_data == NULL) {
-            LOGE("ERROR : Could not allocate memory.\n");
+    mh_src_ptr.len = src_ptr->len;
+    mh_src_ptr.data = src_ptr->data;
+    mh_src_ptr.fd = src_ptr->fd;
+    mh_src_ptr.offset = 0;
+
+    /* The agent decides the owner of the output buffer from mh_dst_ptr.(see MH_buffer_t) */
+    switch (mode) {
+    case MCDM_DECRYPT_MODE_AGENT_BUFFER:
+    case MCDM_DECRYPT_MODE_IN_PLACE:
+        break;
+    case MCDM_DECRYPT_MODE_CALLER_BUFFER:
+        if ((dst_ptr->data == NULL) || (dst_ptr->data == src_ptr->data)) {
+            LOGE("ERROR : Output buffer is not supplied.\n");
+            MARLINLOG_EXIT();
+            return ERROR_ILLEGAL_ARGUMENT;
+        }
+        if (dst_ptr->len < src_ptr->len) {
+            LOGE("ERROR : Output buffer is too small (%zu/%zu).\n", dst_ptr->len, src_ptr->len);
+            MARLINLOG_EXIT();
+            return ERROR_ILLEGAL_ARGUMENT;
+        }
+        mh_dst_ptr.len = dst_ptr->len;
+        mh_dst_ptr.data = dst_ptr->data;
+        mh_dst_ptr.fd = dst_ptr->fd;
+        break;
+    case MCDM_DECRYPT_MODE_FD_BUFFER:
+        if ((dst_ptr->data != NULL) || (dst_ptr->fd < 0) || (dst_ptr->len == 0)) {
+            LOGE("ERROR : Output buffer is not given by fd.\n");
+            MARLINLOG_EXIT();
+            return ERROR_ILLEGAL_ARGUMENT;
+        }
+        if (dst_ptr->len < src_ptr->len) {
+            LOGE("ERROR : Output buffer is too small (%zu/%zu).\n", dst_ptr->len, src_ptr->len);
+            MARLINLOG_EXIT();
+            return ERROR_ILLEGAL_ARGUMENT;
+        }
+        break;
+    case MCDM_DECRYPT_MODE_POOL_BUFFER:
+        if (mBufferPool == NULL) {
+            LOGE("ERROR : CdmBufferPool is NULL.\n");
             MARLINLOG_EXIT();
             return ERROR_UNKNOWN;
         }
-        memcpy(chal_param.server_uri_data, 
-                &init_data.data[MCDM_INDEX_SERVER_URI_DATA],
-                chal_param.server_uri_length);
+        break;
+    default:
+        LOGE("ERROR : Invalid decrypt mode (%d).\n", mode);
+        MARLINLOG_EXIT();
+        return ERROR_ILLEGAL_ARGUMENT;
     }
 
-    /* KeyID information Type */
-    chal_param.kid_info.type = 
-        (MH_keyIdInfoType)init_data.data[MCDM_INDEX_KID_INFO_TYPE_EXT(chal_param.server_uri_length)];
-
-    /* KeyID information length */
-    chal_param.kid_info.length = 
-        (size_t)MCDM_GET_LEN(&init_data.data[MCDM_INDEX_KID_INFO_LEN_EXT(chal_param.server_uri_length)]);
+    status = InitDataView(init_data).decodeKeyIdInfo(kid_info);
+    if (status != OK) {
+        LOGE("ERROR : Invalid KeyID information in init_data.\n");
+        MARLINLOG_EXIT();
+        return status;
+    }
 
-    if (chal_param.kid_info.length > 0) {
-        /* KeyID information data */
-        chal_param.kid_info.data = new uint8_t[chal_param.kid_info.length];
-        if(chal_param.kid_info.data == NULL) {
-            LOGE("ERROR : Could not allocate memory.\n");
+    /* Buffers given by fd are decrypted in their mappings without copy. */
+    src_by_fd = (src_ptr->data == NULL) && (src_ptr->fd >= 0) && (src_ptr->len > 0);
+    if (src_by_fd) {
+        status = mFdMappings->acquire(src_ptr->fd, src_ptr->offset, src_ptr->len,
+                                      (mode == MCDM_DECRYPT_MODE_IN_PLACE), &src_mapping, &mh_src_ptr.data);
+        if (status != OK) {
+            LOGE("ERROR : Could not map input buffer.\n");
+            MARLINLOG_EXIT();
+            return status;
+        }
+        mh_src_ptr.offset = src_ptr->offset;
+    }
+    if (mode == MCDM_DECRYPT_MODE_FD_BUFFER) {
+        status = mFdMappings->acquire(dst_ptr->fd, dst_ptr->offset, dst_ptr->len, true,
+                                      &dst_mapping, &mh_dst_ptr.data);
+        if (status != OK) {
+            LOGE("ERROR : Could not map output buffer.\n");
+            mFdMappings->release(src_mapping, false);
+            MARLINLOG_EXIT();
+            return status;
+        }
+        mh_dst_ptr.len = dst_ptr->len;
+        mh_dst_ptr.fd = dst_ptr->fd;
+        mh_dst_ptr.offset = dst_ptr->offset;
+    }
+    if (mode == MCDM_DECRYPT_MODE_IN_PLACE) {
+        mh_dst_ptr = mh_src_ptr;
+    }
+    if (mode == MCDM_DECRYPT_MODE_POOL_BUFFER) {
+        /* The agent writes into the pooled buffer as a buffer supplied by the caller. */
+        mh_dst_ptr.data = mBufferPool->acquire(src_ptr->len, NULL);
+        if (mh_dst_ptr.data == NULL) {
+            LOGE("ERROR : Could not allocate output buffer.\n");
+            mFdMappings->release(src_mapping, false);
             MARLINLOG_EXIT();
             return ERROR_UNKNOWN;
         }
-        memcpy(chal_param.kid_info.data, 
-                &init_data.data[MCDM_INDEX_KID_INFO_DATA_EXT(chal_param.server_uri_length)], 
-                chal_param.kid_info.length);
+        mh_dst_ptr.len = src_ptr->len;
+        mh_dst_ptr.fd = -1;
+    }
+
+    status = mKeyCache->acquire(kid_info, &key_context);
+    if (status == OK) {
+        /* mcdm_subsample_t has the same layout as MH_subsample_t. */
+        mAgents->enter(key_context->agent);
+        agentStatus = mAgents->handler(key_context->agent)->decryptWithKey(key_context->keyHandle,
+                                                                           (const MH_subsample_t*)subsamples,
+                                                                           subsample_num,
+                                                                           &mh_src_ptr,
+                                                                           &mh_dst_ptr);
+        mAgents->leave(key_context->agent);
+        mKeyCache->release(key_context);
+    }
+    mFdMappings->release(src_mapping, (mode == MCDM_DECRYPT_MODE_IN_PLACE));
+    mFdMappings->release(dst_mapping, true);
+    if ((mode == MCDM_DECRYPT_MODE_POOL_BUFFER) && ((status != OK) || (agentStatus != MH_ERR_OK))) {
+        mBufferPool->release(mh_dst_ptr.data, NULL);
+    }
+    if (status != OK) {
+        LOGE("ERROR : Could not resolve key context.\n");
+        MARLINLOG_EXIT();
+        return status;
+    }
+    if (agentStatus != MH_ERR_OK) {
+        LOGE("ERROR : calling decryptWithKey (%d).\n", agentStatus);
+        MARLINLOG_EXIT();
+        return (agentStatus == MH_ERR_TOO_SMALL_BUFFER) ? ERROR_ILLEGAL_ARGUMENT : ERROR_UNKNOWN;
+    }
+
+    if (dst_ptr != NULL) {
+        dst_ptr->len = mh_dst_ptr.len;
+        if ((mode == MCDM_DECRYPT_MODE_IN_PLACE) && src_by_fd) {
+            /* Decrypted data stays in fd of the input buffer. */
+            dst_ptr->data = NULL;
+            dst_ptr->fd = src_ptr->fd;
+            dst_ptr->offset = src_ptr->offset;
+        } else if (mode != MCDM_DECRYPT_MODE_FD_BUFFER) {
+            dst_ptr->data = mh_dst_ptr.data;
+            dst_ptr->fd = mh_dst_ptr.fd;
+            dst_ptr->offset = mh_dst_ptr.offset;
+        }
     }
 
     MARLINLOG_EXIT();
     return OK;
 }
 
+mcdm_status_t MarlinCdmEngine::descramblePackets(KeyContext* key_context,
+                                                 mcdm_key_parity_t parity,
+                                                 vector<MH_sample_t>& samples,
+                                                 TsPacketScanner& scanner)
+{
+    MH_status_t agentStatus = MH_ERR_OK;
+
+    if (samples.empty()) {
+        /* Only packets without payload */
+        scanner.clearScramblingControl(parity);
+        return OK;
+    }
+
+    /* The agent may fail after some payloads are decrypted, they are put back as scrambled then. */
+    scanner.savePayloads(samples);
+
+    /* mcdm_key_parity_t has the same values as MH_keyParity. */
+    mAgents->enter(key_context->agent);
+    agentStatus = mAgents->handler(key_context->agent)->decryptBatchWithKey(key_context->keyHandle,
+                                                                            (MH_keyParity)parity,
+                                                                            &samples[0],
+                                                                            (uint32_t)samples.size());
+    mAgents->leave(key_context->agent);
+    if (agentStatus != MH_ERR_OK) {
+        LOGE("ERROR : calling decryptBatchWithKey (%d).\n", agentStatus);
+        scanner.restorePayloads(samples);
+        return ERROR_UNKNOWN;
+    }
+    scanner.clearScramblingControl(parity);
+    return OK;
+}
+
+mcdm_status_t MarlinCdmEngine::checkSubsampleMap(const mcdm_subsample_t* subsamples,
+                                                 uint32_t subsample_num,
+                                                 size_t len)
+{
+    size_t total = 0;
+
+    if (subsamples == NULL) {
+        return (subsample_num == 0) ? OK : ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    if (subsample_num == 0) {
+        LOGE("ERROR : Subsample map is empty.\n");
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    for (uint32_t i = 0; i < subsample_num; i++) {
+        total += subsamples[i].clear_bytes;
+        total += subsamples[i].encrypted_bytes;
+    }
+
+    if (total != len) {
+        LOGE("ERROR : Subsample map does not cover the buffer (%zu/%zu).\n", total, len);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    return OK;
+}
+
 MarlinCdmEngine* MarlinCdmEngine::getMarlinCdmEngine()
 {
     MH_status_t agentStatus = MH_ERR_OK;
@@ -751,19 +2820,22 @@ mcdm_status_t MarlinCdmEngine::releaseMarlinCdmEngine(bool &end_flag)
     sMutex.lock();
     if (mHandler == NULL) {
         LOGE("ERROR : MarlinAgentHandler is NULL.\n");
+        sMutex.unlock();
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
 
     if (mHandle == NULL) {
         LOGE("ERROR : This function is called in the wrong sequence.\n");
+        sMutex.unlock();
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
 
     agentStatus = mHandler->decreaseRefCount();
     if (agentStatus != MH_ERR_OK) {
-        LOGE("ERROR : calling increaseRefCount (%d).\n", agentStatus);
+        LOGE("ERROR : calling decreaseRefCount (%d).\n", agentStatus);
+        sMutex.unlock();
         MARLINLOG_EXIT();
         return ERROR_UNKNOWN;
     }
@@ -779,8 +2851,6 @@ mcdm_status_t MarlinCdmEngine::releaseMarlinCdmEngine(bool &end_flag)
         end_flag = false;
     }
 
-    sMutex.unlock();
-
     MARLINLOG_EXIT();
     return OK;
 }
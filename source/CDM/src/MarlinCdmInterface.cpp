@@ -50,6 +50,19 @@ mcdm_status_t MarlinCdmInterface::CheckKeyExist(const mcdm_buffer_t& init_data,
     return sEngine->CheckKeyExist(init_data, is_key_exist);
 }
 
+mcdm_status_t MarlinCdmInterface::CheckKeyExistBatch(const mcdm_buffer_t* init_data,
+                                                     uint32_t init_data_num,
+                                                     uint8_t* is_key_exist)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->CheckKeyExistBatch(init_data,
+                                       init_data_num,
+                                       is_key_exist);
+}
+
 mcdm_status_t MarlinCdmInterface::OpenSession(mcdm_session_id_t& session_id)
 {
     if (sEngine == NULL) {
@@ -59,6 +72,17 @@ mcdm_status_t MarlinCdmInterface::OpenSession(mcdm_session_id_t& session_id)
     return sEngine->OpenSession(session_id);
 }
 
+mcdm_status_t MarlinCdmInterface::OpenSession(mcdm_session_id_t& session_id,
+                                              mcdm_session_handle_t* handle)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->OpenSession(session_id,
+                                handle);
+}
+
 mcdm_status_t MarlinCdmInterface::CloseSession(const mcdm_session_id_t& session_id)
 {
     if (sEngine == NULL) {
@@ -68,6 +92,15 @@ mcdm_status_t MarlinCdmInterface::CloseSession(const mcdm_session_id_t& session_
     return sEngine->CloseSession(session_id);
 }
 
+mcdm_status_t MarlinCdmInterface::CloseSession(mcdm_session_handle_t handle)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->CloseSession(handle);
+}
+
 mcdm_status_t MarlinCdmInterface::GenerateKeyRequest(const mcdm_session_id_t& session_id,
                                                      const mcdm_buffer_t& init_data,
                                                      mcdm_buffer_t* request)
@@ -81,6 +114,19 @@ mcdm_status_t MarlinCdmInterface::GenerateKeyRequest(const mcdm_session_id_t& se
                                                  request);
 }
 
+mcdm_status_t MarlinCdmInterface::GenerateKeyRequest(mcdm_session_handle_t session_handle,
+                                                     const mcdm_buffer_t& init_data,
+                                                     mcdm_buffer_t* request)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->GenerateKeyRequest(session_handle,
+                                       init_data,
+                                       request);
+}
+
 mcdm_status_t MarlinCdmInterface::AddKey(const mcdm_session_id_t& session_id,
                                          const mcdm_buffer_t& key,
                                          const mcdm_buffer_t& init_data,
@@ -98,6 +144,23 @@ mcdm_status_t MarlinCdmInterface::AddKey(const mcdm_session_id_t& session_id,
                                      request);
 }
 
+mcdm_status_t MarlinCdmInterface::AddKey(mcdm_session_handle_t session_handle,
+                                         const mcdm_buffer_t& key,
+                                         const mcdm_buffer_t& init_data,
+                                         bool* endflag,
+                                         mcdm_buffer_t* request)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->AddKey(session_handle,
+                           key,
+                           init_data,
+                           endflag,
+                           request);
+}
+
 mcdm_status_t MarlinCdmInterface::CancelKeyRequest(const mcdm_session_id_t& session_id)
 {
     if (sEngine == NULL) {
@@ -107,6 +170,15 @@ mcdm_status_t MarlinCdmInterface::CancelKeyRequest(const mcdm_session_id_t& sess
     return sEngine->CancelKeyRequest(session_id);
 }
 
+mcdm_status_t MarlinCdmInterface::CancelKeyRequest(mcdm_session_handle_t session_handle)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->CancelKeyRequest(session_handle);
+}
+
 mcdm_status_t MarlinCdmInterface::Decrypt(const mcdm_buffer_t& init_data,
                                           mcdm_buffer_t* src_ptr,
                                           mcdm_buffer_t* dst_ptr)
@@ -120,6 +192,405 @@ mcdm_status_t MarlinCdmInterface::Decrypt(const mcdm_buffer_t& init_data,
                                       dst_ptr);
 }
 
+mcdm_status_t MarlinCdmInterface::Decrypt(const mcdm_buffer_t& init_data,
+                                          const mcdm_subsample_t* subsamples,
+                                          uint32_t subsample_num,
+                                          mcdm_buffer_t* src_ptr,
+                                          mcdm_buffer_t* dst_ptr)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->Decrypt(init_data,
+                            subsamples,
+                            subsample_num,
+                            src_ptr,
+                            dst_ptr);
+}
+
+mcdm_status_t MarlinCdmInterface::Decrypt(const mcdm_buffer_t& init_data,
+                                          mcdm_decrypt_mode_t mode,
+                                          mcdm_buffer_t* src_ptr,
+                                          mcdm_buffer_t* dst_ptr)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->Decrypt(init_data,
+                            mode,
+                            src_ptr,
+                            dst_ptr);
+}
+
+mcdm_status_t MarlinCdmInterface::DecryptBatch(const mcdm_buffer_t& init_data,
+                                               mcdm_sample_t* samples,
+                                               uint32_t sample_num)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->DecryptBatch(init_data,
+                                 samples,
+                                 sample_num);
+}
+
+mcdm_status_t MarlinCdmInterface::UnmapFdBuffer(int fd)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->UnmapFdBuffer(fd);
+}
+
+mcdm_status_t MarlinCdmInterface::ReleaseBuffer(mcdm_buffer_t* buffer)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->ReleaseBuffer(buffer);
+}
+
+mcdm_status_t MarlinCdmInterface::ReleaseKeyRequestBuffer(const mcdm_session_id_t& session_id,
+                                                          mcdm_buffer_t* request)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->ReleaseKeyRequestBuffer(session_id,
+                                            request);
+}
+
+mcdm_status_t MarlinCdmInterface::ReleaseKeyRequestBuffer(mcdm_session_handle_t session_handle,
+                                                          mcdm_buffer_t* request)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->ReleaseKeyRequestBuffer(session_handle,
+                                            request);
+}
+
+mcdm_status_t MarlinCdmInterface::AcquireLicenseAsync(const mcdm_session_id_t& session_id,
+                                                      const mcdm_buffer_t& init_data,
+                                                      mcdm_license_transport_t transport,
+                                                      mcdm_license_callback_t callback,
+                                                      void* user_data,
+                                                      uint32_t timeout_ms,
+                                                      uint64_t* token)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->AcquireLicenseAsync(session_id,
+                                        init_data,
+                                        transport,
+                                        callback,
+                                        user_data,
+                                        timeout_ms,
+                                        token);
+}
+
+mcdm_status_t MarlinCdmInterface::AcquireLicenseAsync(mcdm_session_handle_t session_handle,
+                                                      const mcdm_buffer_t& init_data,
+                                                      mcdm_license_transport_t transport,
+                                                      mcdm_license_callback_t callback,
+                                                      void* user_data,
+                                                      uint32_t timeout_ms,
+                                                      uint64_t* token)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->AcquireLicenseAsync(session_handle,
+                                        init_data,
+                                        transport,
+                                        callback,
+                                        user_data,
+                                        timeout_ms,
+                                        token);
+}
+
+mcdm_status_t MarlinCdmInterface::SubmitLicenseResponse(uint64_t token, const mcdm_buffer_t& response)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->SubmitLicenseResponse(token,
+                                          response);
+}
+
+mcdm_status_t MarlinCdmInterface::CancelLicenseRequest(uint64_t token)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->CancelLicenseRequest(token);
+}
+
+mcdm_status_t MarlinCdmInterface::GetLicenseState(uint64_t token, mcdm_license_state_t* state)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->GetLicenseState(token,
+                                    state);
+}
+
+mcdm_status_t MarlinCdmInterface::DescrambleTs(const mcdm_buffer_t& init_data,
+                                               mcdm_buffer_t* ts)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->DescrambleTs(init_data,
+                                 ts);
+}
+
+mcdm_status_t MarlinCdmInterface::OpenEcmStream(uint32_t* stream_id)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->OpenEcmStream(stream_id);
+}
+
+mcdm_status_t MarlinCdmInterface::PushEcm(uint32_t stream_id,
+                                          mcdm_key_parity_t parity,
+                                          const mcdm_buffer_t& init_data)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->PushEcm(stream_id,
+                            parity,
+                            init_data);
+}
+
+mcdm_status_t MarlinCdmInterface::DescrambleTs(uint32_t stream_id,
+                                               mcdm_buffer_t* ts)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->DescrambleTs(stream_id,
+                                 ts);
+}
+
+mcdm_status_t MarlinCdmInterface::CloseEcmStream(uint32_t stream_id)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->CloseEcmStream(stream_id);
+}
+
+mcdm_status_t MarlinCdmInterface::OpenDecryptStream(const mcdm_buffer_t& init_data,
+                                                    const uint8_t* iv,
+                                                    uint32_t* stream_id)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->OpenDecryptStream(init_data,
+                                      iv,
+                                      stream_id);
+}
+
+mcdm_status_t MarlinCdmInterface::DecryptStreamChunk(uint32_t stream_id,
+                                                     mcdm_buffer_t* src_ptr,
+                                                     bool last,
+                                                     mcdm_buffer_t* dst_ptr)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->DecryptStreamChunk(stream_id,
+                                       src_ptr,
+                                       last,
+                                       dst_ptr);
+}
+
+mcdm_status_t MarlinCdmInterface::CloseDecryptStream(uint32_t stream_id)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->CloseDecryptStream(stream_id);
+}
+
+mcdm_status_t MarlinCdmInterface::OpenDecryptRing(const mcdm_buffer_t& init_data,
+                                                  uint32_t capacity,
+                                                  uint32_t* ring_id)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->OpenDecryptRing(init_data,
+                                    capacity,
+                                    ring_id);
+}
+
+mcdm_status_t MarlinCdmInterface::PushDecryptRing(uint32_t ring_id,
+                                                  const mcdm_decrypt_ring_entry_t& entry)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->PushDecryptRing(ring_id,
+                                    entry);
+}
+
+mcdm_status_t MarlinCdmInterface::PopDecryptRing(uint32_t ring_id,
+                                                 mcdm_decrypt_ring_entry_t* entries,
+                                                 uint32_t max_num,
+                                                 uint32_t* num)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->PopDecryptRing(ring_id,
+                                   entries,
+                                   max_num,
+                                   num);
+}
+
+mcdm_status_t MarlinCdmInterface::CloseDecryptRing(uint32_t ring_id)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->CloseDecryptRing(ring_id);
+}
+
+mcdm_status_t MarlinCdmInterface::DecryptTsFile(const mcdm_buffer_t& init_data,
+                                                int src_fd,
+                                                int dst_fd,
+                                                uint32_t thread_num)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->DecryptTsFile(init_data,
+                                  src_fd,
+                                  dst_fd,
+                                  thread_num);
+}
+
+mcdm_status_t MarlinCdmInterface::SetSessionPoolSize(uint32_t size)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->SetSessionPoolSize(size);
+}
+
+mcdm_status_t MarlinCdmInterface::PrepareKeyRequests(const mcdm_session_handle_t* session_handles,
+                                                     const mcdm_buffer_t* init_data,
+                                                     uint32_t num,
+                                                     uint32_t ttl_ms)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->PrepareKeyRequests(session_handles,
+                                       init_data,
+                                       num,
+                                       ttl_ms);
+}
+
+mcdm_status_t MarlinCdmInterface::SetSessionIdleTimeout(uint32_t idle_timeout)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->SetSessionIdleTimeout(idle_timeout);
+}
+
+mcdm_status_t MarlinCdmInterface::SetSessionMemoryBudget(uint64_t memory_budget)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->SetSessionMemoryBudget(memory_budget);
+}
+
+mcdm_status_t MarlinCdmInterface::StartDecryptWorkers(uint32_t worker_num)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->StartDecryptWorkers(worker_num);
+}
+
+mcdm_status_t MarlinCdmInterface::StopDecryptWorkers()
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->StopDecryptWorkers();
+}
+
+mcdm_status_t MarlinCdmInterface::DecryptAsync(uint32_t stream_id,
+                                               const mcdm_buffer_t& init_data,
+                                               mcdm_sample_t* sample,
+                                               mcdm_decrypt_callback_t callback,
+                                               void* user_data,
+                                               uint64_t* request_id)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->DecryptAsync(stream_id,
+                                 init_data,
+                                 sample,
+                                 callback,
+                                 user_data,
+                                 request_id);
+}
+
+mcdm_status_t MarlinCdmInterface::PollDecryptCompletions(mcdm_decrypt_completion_t* completions,
+                                                         uint32_t max_num,
+                                                         uint32_t* num)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->PollDecryptCompletions(completions, max_num, num);
+}
+
 mcdm_status_t MarlinCdmInterface::GetKeyReleases(mcdm_key_release_t** key_release,
                                                  uint32_t* key_release_num)
 {
@@ -150,6 +621,51 @@ mcdm_status_t MarlinCdmInterface::FreeKeyReleasesBuffer(mcdm_key_release_t* key_
     return sEngine->FreeKeyReleasesBuffer(key_release, key_release_num);
 }
 
+mcdm_status_t MarlinCdmInterface::GetKeyCacheStats(mcdm_key_cache_stats_t* stats)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->GetKeyCacheStats(stats);
+}
+
+mcdm_status_t MarlinCdmInterface::GetEcmStreamStats(mcdm_ecm_stream_stats_t* stats)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->GetEcmStreamStats(stats);
+}
+
+mcdm_status_t MarlinCdmInterface::GetDecryptWorkerStats(mcdm_decrypt_worker_stats_t* stats)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->GetDecryptWorkerStats(stats);
+}
+
+mcdm_status_t MarlinCdmInterface::GetBufferPoolStats(mcdm_buffer_pool_stats_t* stats)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->GetBufferPoolStats(stats);
+}
+
+mcdm_status_t MarlinCdmInterface::GetSessionStats(mcdm_session_stats_t* stats)
+{
+    if (sEngine == NULL) {
+        LOGE("ERROR : instance of MarlinCdmEngine is NULL.\n");
+        return ERROR_UNKNOWN;
+    }
+    return sEngine->GetSessionStats(stats);
+}
+
 MarlinCdmInterface *MarlinCdmInterface::getMarlinCdmInterface()
 {
     MARLINLOG_ENTER();
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SessionHandlePool"
+#include "MarlinLog.h"
+
+#include "SessionHandlePool.h"
+#include "CdmSessionManager.h"
+
+using namespace marlincdm;
+
+SessionHandlePool::SessionHandlePool(AgentHandlerPool* agents, CdmTaskRunner* task_runner, KeyContextCache* key_cache)
+    : mAgents(agents),
+      mTaskRunner(task_runner),
+      mKeyCache(key_cache),
+      mSize(0),
+      mRefilling(false)
+{
+    MARLINLOG_ENTER();
+}
+
+SessionHandlePool::~SessionHandlePool()
+{
+    MARLINLOG_ENTER();
+
+    for (deque<Entry>::iterator it = mReady.begin(); it != mReady.end(); ++it) {
+        finalize(it->agent, it->handle);
+    }
+    mReady.clear();
+}
+
+mcdm_status_t SessionHandlePool::setSize(uint32_t size)
+{
+    bool post = false;
+
+    if (size > MCDM_SESSION_POOL_MAX) {
+        LOGE("ERROR : Pool size is too large (%u).\n", size);
+        return ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    mMutex.lock();
+    mSize = size;
+    post = needRefill();
+    mMutex.unlock();
+
+    if (post && (mTaskRunner->post(refillTask, this) != OK)) {
+        LOGE("ERROR : Could not post refill of session handles.\n");
+        mMutex.lock();
+        mRefilling = false;
+        mMutex.unlock();
+        return ERROR_UNKNOWN;
+    }
+    return OK;
+}
+
+bool SessionHandlePool::take(mcdm_session_id_t& session_id, uint32_t* agent, MH_iptvesHandle_t* handle)
+{
+    bool taken = false;
+    bool post = false;
+
+    mMutex.lock();
+    if (!mReady.empty()) {
+        session_id = mReady.front().sessionId;
+        *agent = mReady.front().agent;
+        *handle = mReady.front().handle;
+        mReady.pop_front();
+        taken = true;
+    }
+    post = needRefill();
+    mMutex.unlock();
+
+    if (post && (mTaskRunner->post(refillTask, this) != OK)) {
+        mMutex.lock();
+        mRefilling = false;
+        mMutex.unlock();
+    }
+    return taken;
+}
+
+mcdm_status_t SessionHandlePool::acquire(mcdm_session_id_t& session_id, uint32_t* agent, MH_iptvesHandle_t* handle)
+{
+    Entry entry;
+
+    if (take(session_id, agent, handle)) {
+        return OK;
+    }
+    if (!init(entry)) {
+        return ERROR_UNKNOWN;
+    }
+    session_id = entry.sessionId;
+    *agent = entry.agent;
+    *handle = entry.handle;
+    return OK;
+}
+
+void SessionHandlePool::retire(uint32_t agent, MH_iptvesHandle_t handle, bool licenses_changed)
+{
+    RetireJob* job = new RetireJob();
+
+    job->pool = this;
+    job->agent = agent;
+    job->handle = handle;
+    job->licensesChanged = licenses_changed;
+    if (licenses_changed) {
+        mKeyCache->beginChange();
+    }
+    if (mTaskRunner->post(retireTask, job) != OK) {
+        /* The runner is stopping, finalize here. */
+        delete job;
+        finalize(agent, handle);
+        if (licenses_changed) {
+            mKeyCache->endChange();
+        }
+    }
+}
+
+void SessionHandlePool::refillTask(void* arg)
+{
+    static_cast<SessionHandlePool*>(arg)->refill();
+}
+
+void SessionHandlePool::retireTask(void* arg)
+{
+    RetireJob* job = static_cast<RetireJob*>(arg);
+
+    job->pool->finalize(job->agent, job->handle);
+    /* Licenses may be dropped with the handle. */
+    if (job->licensesChanged) {
+        job->pool->mKeyCache->endChange();
+    }
+    delete job;
+}
+
+/* Initialize or finalize one handle, and post the next step while the pool is not of its size. */
+void SessionHandlePool::refill()
+{
+    Entry entry;
+    bool surplus = false;
+
+    mMutex.lock();
+    if (mReady.size() > mSize) {
+        entry = mReady.back();
+        mReady.pop_back();
+        surplus = true;
+    } else if (mReady.size() == mSize) {
+        mRefilling = false;
+        mMutex.unlock();
+        return;
+    }
+    mMutex.unlock();
+
+    if (surplus) {
+        finalize(entry.agent, entry.handle);
+    } else {
+        if (!init(entry)) {
+            /* Retried by the next take(), not in a loop here. */
+            mMutex.lock();
+            mRefilling = false;
+            mMutex.unlock();
+            return;
+        }
+        mMutex.lock();
+        mReady.push_back(entry);
+        mMutex.unlock();
+    }
+
+    if (mTaskRunner->post(refillTask, this) != OK) {
+        mMutex.lock();
+        mRefilling = false;
+        mMutex.unlock();
+    }
+}
+
+/* Called with mMutex held. It marks the refill as posted when it returns true. */
+bool SessionHandlePool::needRefill()
+{
+    if (mRefilling || (mReady.size() == mSize)) {
+        return false;
+    }
+    mRefilling = true;
+    return true;
+}
+
+/* Take a new session ID and initialize a handle for it, on the agent with the fewest sessions. */
+bool SessionHandlePool::init(Entry& entry)
+{
+    MH_status_t agentStatus = MH_ERR_OK;
+    CdmSessionManager* sm = CdmSessionManager::getCdmSessionManager();
+
+    if ((sm == NULL) || (sm->getCdmSessionId(entry.sessionId) != OK)) {
+        LOGE("ERROR : Could not create session id.\n");
+        return false;
+    }
+    entry.agent = mAgents->assign();
+    agentStatus = mAgents->handler(entry.agent)->initIPTVESHandle(mAgents->handle(entry.agent),
+                                                                  entry.sessionId, &entry.handle);
+    if (agentStatus != MH_ERR_OK) {
+        LOGE("ERROR : calling initIPTVESHandle (%d).\n", agentStatus);
+        mAgents->unassign(entry.agent);
+        return false;
+    }
+    return true;
+}
+
+void SessionHandlePool::finalize(uint32_t agent, MH_iptvesHandle_t handle)
+{
+    MH_status_t agentStatus = mAgents->handler(agent)->finIPTVESHandle(handle);
+    if (agentStatus != MH_ERR_OK) {
+        LOGE("ERROR : calling finIPTVESHandle (%d).\n", agentStatus);
+    }
+    mAgents->unassign(agent);
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SessionReaper"
+#include "MarlinLog.h"
+
+#include "SessionReaper.h"
+
+using namespace marlincdm;
+
+SessionReaper::SessionReaper(uint32_t idle_timeout, uint64_t memory_budget)
+    : mTick(now()),
+      mIdleTimeout(idle_timeout),
+      mMemoryBudget(memory_budget),
+      mRunning(0),
+      mIdleEvictions(0),
+      mMemoryEvictions(0)
+{
+    MARLINLOG_ENTER();
+}
+
+SessionReaper::~SessionReaper()
+{
+    MARLINLOG_ENTER();
+}
+
+uint32_t SessionReaper::now()
+{
+    return (uint32_t)(CdmTaskRunner::now() / 1000);
+}
+
+void SessionReaper::setIdleTimeout(uint32_t idle_timeout)
+{
+    atomicStore(&mIdleTimeout, idle_timeout);
+}
+
+uint32_t SessionReaper::idleTimeout()
+{
+    return atomicLoad(&mIdleTimeout);
+}
+
+void SessionReaper::setMemoryBudget(uint64_t memory_budget)
+{
+    atomicStore(&mMemoryBudget, memory_budget);
+}
+
+uint64_t SessionReaper::memoryBudget()
+{
+    return atomicLoad(&mMemoryBudget);
+}
+
+bool SessionReaper::isEnabled()
+{
+    return (idleTimeout() != 0) || (memoryBudget() != 0);
+}
+
+void SessionReaper::schedule(mcdm_session_handle_t handle, uint32_t deadline)
+{
+    Timer timer;
+
+    mMutex.lock();
+    if (!mScheduled.insert(handle).second) {
+        mMutex.unlock();
+        return;
+    }
+    timer.handle = handle;
+    timer.deadline = deadline;
+    /* A deadline which has passed is expired by the next tick. */
+    if ((int32_t)(deadline - mTick) <= 0) {
+        timer.deadline = mTick + 1;
+    }
+    mWheel[timer.deadline % MCDM_SESSION_REAPER_WHEEL_SIZE].push_back(timer);
+    mMutex.unlock();
+}
+
+void SessionReaper::expire(uint32_t now, vector<mcdm_session_handle_t>& handles)
+{
+    uint32_t ticks = 0;
+
+    mMutex.lock();
+    /* Every slot is visited once when the reaper is late for more than the wheel. */
+    ticks = now - mTick;
+    if (ticks > MCDM_SESSION_REAPER_WHEEL_SIZE) {
+        ticks = MCDM_SESSION_REAPER_WHEEL_SIZE;
+    }
+    for (uint32_t i = 1; i <= ticks; i++) {
+        vector<Timer>& slot = mWheel[(now - ticks + i) % MCDM_SESSION_REAPER_WHEEL_SIZE];
+        size_t kept = 0;
+        for (size_t j = 0; j < slot.size(); j++) {
+            if ((int32_t)(slot[j].deadline - now) <= 0) {
+                handles.push_back(slot[j].handle);
+                mScheduled.erase(slot[j].handle);
+            } else {
+                slot[kept++] = slot[j];
+            }
+        }
+        slot.resize(kept);
+    }
+    mTick = now;
+    mMutex.unlock();
+}
+
+void SessionReaper::clear()
+{
+    mMutex.lock();
+    for (uint32_t i = 0; i < MCDM_SESSION_REAPER_WHEEL_SIZE; i++) {
+        mWheel[i].clear();
+    }
+    mScheduled.clear();
+    mMutex.unlock();
+}
+
+bool SessionReaper::start()
+{
+    return atomicCompareAndSwap(&mRunning, (uint32_t)0, (uint32_t)1);
+}
+
+void SessionReaper::stop()
+{
+    atomicStore(&mRunning, (uint32_t)0);
+}
+
+void SessionReaper::countEviction(bool idle)
+{
+    if (idle) {
+        atomicAdd(&mIdleEvictions, (uint64_t)1);
+    } else {
+        atomicAdd(&mMemoryEvictions, (uint64_t)1);
+    }
+}
+
+void SessionReaper::getStatistics(mcdm_session_stats_t* stats)
+{
+    stats->idle_evictions = atomicLoad(&mIdleEvictions);
+    stats->memory_evictions = atomicLoad(&mMemoryEvictions);
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
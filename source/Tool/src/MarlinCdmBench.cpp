@@ -0,0 +1,810 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmark of Marlin CDM, which runs each measurement on 1 to thread_num threads.
+ *
+ * usage : marlin_cdm_bench <mode> [thread_num] [seconds]
+ *
+ *  agents : Decrypt() of 64 KiB samples, spread over the agent handlers of the engine.
+ *  sessions : OpenSession() and CloseSession() churn, each thread keeping a few sessions open,
+ *             which contends on the shards of the session table.
+ *  async : DecryptAsync() of 64 KiB samples on 1 to thread_num decrypt workers. Each completion
+ *          submits its sample again, so that every worker always has samples to decrypt.
+ *  parse : Decoding of Initialization data by InitDataView, the KeyID information of Decrypt() and
+ *          the challenge parameter of GenerateKeyRequest(), in nanoseconds per decoding.
+ *  cipher : AES-128 CBC decryption and CTR of 1 MiB buffers by MarlinAesCipher, with each kernel
+ *           which the CPU supports.
+ *  file : DecryptTsFile() of a 137 MB file of scrambled TS packets into another file on 1 to thread_num
+ *         threads. Both files are made in TMPDIR (/tmp by default) and removed, and stay in the page cache.
+ *  zap : Latency of OpenSession() on one thread, without the pool of IPTV-ES handles and with
+ *        MCDM_SESSION_POOL_MAX handles. Each session is closed and the next one is opened 1 ms later,
+ *        so that the pool is refilled in between as on a channel change.
+ *  keyexist : Presence of the keys of 256 services on one thread, by CheckKeyExist() for each service
+ *             and by CheckKeyExistBatch(), whose first call fills the index of key presence.
+ *
+ * thread_num is the number of online cores by default, and each measurement takes seconds (2 by default).
+ * The content key is provisioned to the software decryption of the agent handler.
+ *
+ * The number of agent handlers is MCDM_AGENT_HANDLER_NUM, which is fixed when the library is built.
+ * To compare agent counts, build the library and the benchmark again for each value, e.g.
+ *   make clean && make bench ARCH_CFLAGS=-DMCDM_AGENT_HANDLER_NUM=4
+ * The software decryption does not serialize the calls of a handle, so the agent count makes
+ * a difference only with a Marlin agent which does.
+ * In the same way, the number of shards of the session table is MCDM_SESSION_TABLE_SHARD_NUM.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "AgentHandlerPool.h"
+#include "CAtomic.h"
+#include "CdmFileDecryptor.h"
+#include "CdmSessionTable.h"
+#include "DecryptWorkerPool.h"
+#include "InitDataView.h"
+#include "MarlinAesCipher.h"
+#include "MarlinCdmInterface.h"
+#include "SessionHandlePool.h"
+
+/* Size of a sample given to Decrypt() */
+#define MCDM_BENCH_SAMPLE_SIZE (64 * 1024)
+
+/* Number of sessions kept open by each thread of the session churn */
+#define MCDM_BENCH_OPEN_SESSIONS 8
+
+/* Number of samples in flight for each decrypt worker */
+#define MCDM_BENCH_ASYNC_DEPTH 4
+
+/* Size of a buffer given to MarlinAesCipher */
+#define MCDM_BENCH_CIPHER_SIZE (1024 * 1024)
+
+/* Size of the file given to DecryptTsFile(), a whole number of TS packets */
+#define MCDM_BENCH_FILE_SIZE (188 * 1024 * 714)
+
+/* Microseconds between a CloseSession() and the next OpenSession() of the zap mode */
+#define MCDM_BENCH_ZAP_INTERVAL 1000
+
+/* Number of services of the keyexist mode, the key of the first one is provisioned */
+#define MCDM_BENCH_SERVICES 256
+
+/* Number of decodings between the checks of the end of the measurement */
+#define MCDM_BENCH_PARSE_BATCH 1024
+
+/* Default seconds of a measurement */
+#define MCDM_BENCH_SECONDS 2
+
+using namespace marlincdm;
+
+namespace {
+
+uint8_t gKeyId[] = { 0x4D, 0x42, 0x45, 0x4E }; // PSSH information of the benchmark content
+uint8_t gInitData[] = { KEY_ID_INFO_TYPE_PSSH, 0x00, 0x00, 0x00, sizeof(gKeyId), 0x4D, 0x42, 0x45, 0x4E };
+uint8_t gServerUri[] = "https://license.example/iptves";
+/* Challenge parameter with gServerUri and the KeyID information of gInitData, made by benchParse() */
+uint8_t gChallengeInitData[MCDM_INDEX_SERVER_URI_DATA + sizeof(gServerUri) + sizeof(gInitData)];
+
+volatile uint32_t gRunning = 0;
+volatile uint32_t gInFlight = 0;
+volatile uint64_t gDecryptedBytes = 0;
+volatile uint32_t gAsyncFailed = 0;
+volatile uint32_t gParseChallenge = 0;
+volatile uint32_t gCipherCtr = 0;
+MarlinAesCipher* gCipher = NULL;
+
+struct AsyncSample {
+    MarlinCdmInterface* cdm;
+    uint32_t streamId;
+    mcdm_buffer_t initData;
+    mcdm_sample_t sample;
+    std::vector<uint8_t> src;
+    std::vector<uint8_t> dst;
+};
+
+struct Worker {
+    pthread_t thread;
+    MarlinCdmInterface* cdm;
+    uint64_t operations;
+    uint64_t bytes;
+    bool failed;
+};
+
+struct Mode {
+    const char* name;
+    int (*run)(MarlinCdmInterface* cdm, uint32_t thread_num, uint32_t seconds);
+};
+
+int usage(const char* name);
+
+bool parseNumber(const char* text, uint32_t* value)
+{
+    char* end_ptr = NULL;
+    unsigned long number = strtoul(text, &end_ptr, 10);
+
+    if ((*text == '\0') || (*end_ptr != '\0') || (number == 0)) {
+        return false;
+    }
+    *value = (uint32_t)number;
+    return true;
+}
+
+/* The content key store of the software decryption is shared by all agent handlers. */
+bool provisionContentKey()
+{
+    MarlinAgentHandler handler;
+    MH_keyIdInfo_t kid_info;
+    MH_contentKey_t content_key;
+
+    kid_info.type = KEY_ID_INFO_TYPE_PSSH;
+    kid_info.length = sizeof(gKeyId);
+    kid_info.data = gKeyId;
+    content_key.mode = CIPHER_MODE_AES_128_CTR;
+    for (uint32_t i = 0; i < MH_CONTENT_KEY_SIZE; i++) {
+        content_key.key[i] = (uint8_t)(i * 17 + 1);
+    }
+    memset(content_key.iv, 0, MH_CONTENT_IV_SIZE);
+
+    return handler.setContentKey(&kid_info, &content_key) == MH_ERR_OK;
+}
+
+void* decryptLoop(void* arg)
+{
+    Worker* worker = static_cast<Worker*>(arg);
+    std::vector<uint8_t> src(MCDM_BENCH_SAMPLE_SIZE, 0xA5);
+    std::vector<uint8_t> dst(MCDM_BENCH_SAMPLE_SIZE);
+    mcdm_buffer_t init_data;
+    mcdm_buffer_t src_buffer;
+    mcdm_buffer_t dst_buffer;
+
+    memset(&init_data, 0, sizeof(mcdm_buffer_t));
+    init_data.len = sizeof(gInitData);
+    init_data.data = gInitData;
+    init_data.fd = -1;
+
+    while (atomicLoadAcquire(&gRunning) != 0) {
+        memset(&src_buffer, 0, sizeof(mcdm_buffer_t));
+        src_buffer.len = src.size();
+        src_buffer.data = &src[0];
+        src_buffer.fd = -1;
+        dst_buffer = src_buffer;
+        dst_buffer.data = &dst[0];
+        if (worker->cdm->Decrypt(init_data, &src_buffer, &dst_buffer) != OK) {
+            worker->failed = true;
+            break;
+        }
+        worker->operations++;
+        worker->bytes += src.size();
+    }
+    return NULL;
+}
+
+/* The oldest session of the thread is closed for each new one. */
+void* sessionLoop(void* arg)
+{
+    Worker* worker = static_cast<Worker*>(arg);
+    mcdm_session_handle_t handles[MCDM_BENCH_OPEN_SESSIONS];
+    mcdm_session_id_t session_id;
+    uint32_t oldest = 0;
+
+    for (uint32_t i = 0; i < MCDM_BENCH_OPEN_SESSIONS; i++) {
+        handles[i] = MCDM_SESSION_HANDLE_INVALID;
+    }
+
+    while (atomicLoadAcquire(&gRunning) != 0) {
+        if ((handles[oldest] != MCDM_SESSION_HANDLE_INVALID) &&
+            (worker->cdm->CloseSession(handles[oldest]) != OK)) {
+            worker->failed = true;
+            break;
+        }
+        handles[oldest] = MCDM_SESSION_HANDLE_INVALID;
+        if (worker->cdm->OpenSession(session_id, &handles[oldest]) != OK) {
+            worker->failed = true;
+            break;
+        }
+        oldest = (oldest + 1) % MCDM_BENCH_OPEN_SESSIONS;
+        worker->operations++;
+    }
+
+    for (uint32_t i = 0; i < MCDM_BENCH_OPEN_SESSIONS; i++) {
+        if (handles[i] != MCDM_SESSION_HANDLE_INVALID) {
+            worker->cdm->CloseSession(handles[i]);
+        }
+    }
+    return NULL;
+}
+
+void asyncDone(const mcdm_decrypt_completion_t& completion);
+
+bool submitAsync(AsyncSample* async)
+{
+    memset(&async->sample, 0, sizeof(mcdm_sample_t));
+    async->sample.src.len = async->src.size();
+    async->sample.src.data = &async->src[0];
+    async->sample.src.fd = -1;
+    async->sample.dst = async->sample.src;
+    async->sample.dst.data = &async->dst[0];
+
+    return async->cdm->DecryptAsync(async->streamId, async->initData, &async->sample, asyncDone, async, NULL) == OK;
+}
+
+/* Called on a decrypt worker. The sample is submitted again until the measurement ends. */
+void asyncDone(const mcdm_decrypt_completion_t& completion)
+{
+    AsyncSample* async = static_cast<AsyncSample*>(completion.user_data);
+
+    if (completion.status == OK) {
+        atomicAdd(&gDecryptedBytes, (uint64_t)async->src.size());
+    } else {
+        atomicStore(&gAsyncFailed, (uint32_t)1);
+    }
+    if ((completion.status == OK) && (atomicLoadAcquire(&gRunning) != 0) && submitAsync(async)) {
+        return;
+    }
+    atomicSub(&gInFlight, (uint32_t)1);
+}
+
+/* The decoded fields are given to an empty asm, so that the decoding is not optimized away. */
+void* parseLoop(void* arg)
+{
+    Worker* worker = static_cast<Worker*>(arg);
+    bool challenge = (atomicLoadAcquire(&gParseChallenge) != 0);
+    mcdm_buffer_t init_data;
+    MH_keyIdInfo_t kid_info;
+    MH_challengeParameter_t chal_param;
+
+    memset(&init_data, 0, sizeof(mcdm_buffer_t));
+    init_data.len = challenge ? sizeof(gChallengeInitData) : sizeof(gInitData);
+    init_data.data = challenge ? gChallengeInitData : gInitData;
+    init_data.fd = -1;
+
+    while (atomicLoadAcquire(&gRunning) != 0) {
+        for (uint32_t i = 0; i < MCDM_BENCH_PARSE_BATCH; i++) {
+            mcdm_status_t status = challenge ? InitDataView(init_data).decodeChallengeParameter(chal_param) :
+                                               InitDataView(init_data).decodeKeyIdInfo(kid_info);
+            if (status != OK) {
+                worker->failed = true;
+                return NULL;
+            }
+            __asm__ __volatile__("" : : "r"(&kid_info), "r"(&chal_param), "r"(&init_data) : "memory");
+        }
+        worker->operations += MCDM_BENCH_PARSE_BATCH;
+    }
+    return NULL;
+}
+
+void* cipherLoop(void* arg)
+{
+    Worker* worker = static_cast<Worker*>(arg);
+    bool ctr = (atomicLoadAcquire(&gCipherCtr) != 0);
+    std::vector<uint8_t> src(MCDM_BENCH_CIPHER_SIZE, 0xA5);
+    std::vector<uint8_t> dst(MCDM_BENCH_CIPHER_SIZE);
+    uint8_t iv[MH_AES_BLOCK_SIZE];
+
+    while (atomicLoadAcquire(&gRunning) != 0) {
+        memset(iv, 0, sizeof(iv));
+        if (ctr) {
+            gCipher->cryptCtr(iv, &src[0], &dst[0], MCDM_BENCH_CIPHER_SIZE / MH_AES_BLOCK_SIZE);
+        } else {
+            gCipher->decryptCbc(iv, &src[0], &dst[0], MCDM_BENCH_CIPHER_SIZE / MH_AES_BLOCK_SIZE);
+        }
+        worker->operations++;
+        worker->bytes += MCDM_BENCH_CIPHER_SIZE;
+    }
+    return NULL;
+}
+
+/* Run body on thread_num threads for seconds, and sum up the workers. It returns the elapsed seconds. */
+double runWorkers(void* (*body)(void*), MarlinCdmInterface* cdm, uint32_t thread_num, uint32_t seconds,
+                  Worker* total)
+{
+    std::vector<Worker> workers(thread_num);
+    struct timeval start;
+    struct timeval end;
+    uint32_t started = 0;
+
+    memset(total, 0, sizeof(Worker));
+    atomicStoreRelease(&gRunning, (uint32_t)1);
+    gettimeofday(&start, NULL);
+    for (; started < thread_num; started++) {
+        memset(&workers[started], 0, sizeof(Worker));
+        workers[started].cdm = cdm;
+        if (pthread_create(&workers[started].thread, NULL, body, &workers[started]) != 0) {
+            total->failed = true;
+            break;
+        }
+    }
+    sleep(seconds);
+    atomicStoreRelease(&gRunning, (uint32_t)0);
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total->operations += workers[i].operations;
+        total->bytes += workers[i].bytes;
+        total->failed = total->failed || workers[i].failed;
+    }
+    gettimeofday(&end, NULL);
+
+    return (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+int benchAgents(MarlinCdmInterface* cdm, uint32_t thread_num, uint32_t seconds)
+{
+    Worker total;
+
+    if (!provisionContentKey()) {
+        fprintf(stderr, "Could not provision the content key\n");
+        return 1;
+    }
+
+    fprintf(stdout, "agent handlers : %u\n", (uint32_t)MCDM_AGENT_HANDLER_NUM);
+    for (uint32_t n = 1; n <= thread_num; n++) {
+        double elapsed = runWorkers(decryptLoop, cdm, n, seconds, &total);
+        if (total.failed) {
+            fprintf(stderr, "Could not decrypt on %u threads\n", n);
+            return 1;
+        }
+        fprintf(stdout, "threads %3u : %10.1f MB/s\n", n, (double)total.bytes / elapsed / 1000000.0);
+    }
+    return 0;
+}
+
+int benchSessions(MarlinCdmInterface* cdm, uint32_t thread_num, uint32_t seconds)
+{
+    Worker total;
+
+    /* The sessions kept open by all threads must fit in the slots of the table. */
+    if (thread_num > MCDM_SESSION_TABLE_SLOT_NUM / MCDM_BENCH_OPEN_SESSIONS) {
+        thread_num = MCDM_SESSION_TABLE_SLOT_NUM / MCDM_BENCH_OPEN_SESSIONS;
+    }
+
+    fprintf(stdout, "session table shards : %u, slots : %u\n", (uint32_t)MCDM_SESSION_TABLE_SHARD_NUM,
+            (uint32_t)MCDM_SESSION_TABLE_SLOT_NUM);
+    for (uint32_t n = 1; n <= thread_num; n++) {
+        double elapsed = runWorkers(sessionLoop, cdm, n, seconds, &total);
+        if (total.failed) {
+            fprintf(stderr, "Could not open or close sessions on %u threads\n", n);
+            return 1;
+        }
+        fprintf(stdout, "threads %3u : %10.0f sessions/s\n", n, (double)total.operations / elapsed);
+    }
+    return 0;
+}
+
+int benchAsync(MarlinCdmInterface* cdm, uint32_t thread_num, uint32_t seconds)
+{
+    std::vector<AsyncSample> samples;
+    struct timeval start;
+    struct timeval end;
+    double first = 0.0;
+
+    if (!provisionContentKey()) {
+        fprintf(stderr, "Could not provision the content key\n");
+        return 1;
+    }
+    if (thread_num > MCDM_DECRYPT_WORKER_MAX) {
+        thread_num = MCDM_DECRYPT_WORKER_MAX;
+    }
+
+    fprintf(stdout, "online cores : %ld, samples in flight per worker : %u\n", sysconf(_SC_NPROCESSORS_ONLN),
+            (uint32_t)MCDM_BENCH_ASYNC_DEPTH);
+    samples.resize(thread_num * MCDM_BENCH_ASYNC_DEPTH);
+    for (uint32_t i = 0; i < samples.size(); i++) {
+        samples[i].cdm = cdm;
+        samples[i].streamId = i;
+        memset(&samples[i].initData, 0, sizeof(mcdm_buffer_t));
+        samples[i].initData.len = sizeof(gInitData);
+        samples[i].initData.data = gInitData;
+        samples[i].initData.fd = -1;
+        samples[i].src.assign(MCDM_BENCH_SAMPLE_SIZE, 0xA5);
+        samples[i].dst.resize(MCDM_BENCH_SAMPLE_SIZE);
+    }
+
+    for (uint32_t n = 1; n <= thread_num; n++) {
+        if (cdm->StartDecryptWorkers(n) != OK) {
+            fprintf(stderr, "Could not start %u decrypt workers\n", n);
+            return 1;
+        }
+        atomicStore(&gDecryptedBytes, (uint64_t)0);
+        atomicStoreRelease(&gRunning, (uint32_t)1);
+        gettimeofday(&start, NULL);
+        for (uint32_t i = 0; i < n * MCDM_BENCH_ASYNC_DEPTH; i++) {
+            atomicAdd(&gInFlight, (uint32_t)1);
+            if (!submitAsync(&samples[i])) {
+                atomicSub(&gInFlight, (uint32_t)1);
+                atomicStore(&gAsyncFailed, (uint32_t)1);
+                break;
+            }
+        }
+        sleep(seconds);
+        atomicStoreRelease(&gRunning, (uint32_t)0);
+        gettimeofday(&end, NULL);
+        /* The samples are not submitted again after gRunning is cleared. */
+        while (atomicLoad(&gInFlight) != 0) {
+            usleep(1000);
+        }
+        cdm->StopDecryptWorkers();
+
+        if (atomicLoad(&gAsyncFailed) != 0) {
+            fprintf(stderr, "Could not decrypt on %u decrypt workers\n", n);
+            return 1;
+        }
+        double elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_usec - start.tv_usec) / 1000000.0;
+        double throughput = (double)atomicLoad(&gDecryptedBytes) / elapsed / 1000000.0;
+        if (n == 1) {
+            first = throughput;
+        }
+        /* Scaling against one worker */
+        fprintf(stdout, "workers %3u : %10.1f MB/s (x%.2f)\n", n, throughput, (first > 0.0) ? throughput / first : 0.0);
+    }
+    return 0;
+}
+
+int benchParse(MarlinCdmInterface* cdm, uint32_t thread_num, uint32_t seconds)
+{
+    Worker total;
+    uint8_t* data = gChallengeInitData;
+
+    memset(gChallengeInitData, 0, sizeof(gChallengeInitData));
+    data[MCDM_INDEX_REQ_TYPE] = (uint8_t)REQUEST_TYPE_PERMISSION;
+    data[MCDM_INDEX_ACT_ID] = (uint8_t)ACT_ID_EXTRACT_SIMPLE_KEY;
+    data[MCDM_INDEX_SERVER_URI_LEN + 3] = (uint8_t)sizeof(gServerUri);
+    memcpy(&data[MCDM_INDEX_SERVER_URI_DATA], gServerUri, sizeof(gServerUri));
+    memcpy(&data[MCDM_INDEX_KID_INFO_TYPE_EXT(sizeof(gServerUri))], gInitData, sizeof(gInitData));
+
+    fprintf(stdout, "init_data : KeyID information %u bytes, challenge parameter %u bytes\n",
+            (uint32_t)sizeof(gInitData), (uint32_t)sizeof(gChallengeInitData));
+    for (uint32_t n = 1; n <= thread_num; n++) {
+        double nanoseconds[2];
+        for (uint32_t challenge = 0; challenge < 2; challenge++) {
+            atomicStore(&gParseChallenge, challenge);
+            double elapsed = runWorkers(parseLoop, cdm, n, seconds, &total);
+            if (total.failed || (total.operations == 0)) {
+                fprintf(stderr, "Could not decode init_data on %u threads\n", n);
+                return 1;
+            }
+            /* Time of one decoding on one thread */
+            nanoseconds[challenge] = elapsed * n * 1000000000.0 / (double)total.operations;
+        }
+        fprintf(stdout, "threads %3u : %8.1f ns (KeyID information), %8.1f ns (challenge parameter)\n",
+                n, nanoseconds[0], nanoseconds[1]);
+    }
+    return 0;
+}
+
+int benchCipher(MarlinCdmInterface* cdm, uint32_t thread_num, uint32_t seconds)
+{
+    static const char* const names[] = { "portable", "AES-NI", "VAES" };
+    MarlinAesCipher::Implementation selected = MarlinAesCipher::getImplementation();
+    MarlinAesCipher cipher;
+    uint8_t key[MH_AES_128_KEY_SIZE];
+    Worker total;
+
+    for (uint32_t i = 0; i < MH_AES_128_KEY_SIZE; i++) {
+        key[i] = (uint8_t)(i * 17 + 1);
+    }
+    cipher.setKey(key);
+    gCipher = &cipher;
+
+    fprintf(stdout, "kernel selected for the CPU : %s\n", names[selected]);
+    for (int impl = MarlinAesCipher::IMPL_PORTABLE; impl <= MarlinAesCipher::IMPL_VAES; impl++) {
+        if (!MarlinAesCipher::setImplementation((MarlinAesCipher::Implementation)impl)) {
+            fprintf(stdout, "%-8s : not supported\n", names[impl]);
+            continue;
+        }
+        for (uint32_t n = 1; n <= thread_num; n++) {
+            double throughput[2];
+            for (uint32_t ctr = 0; ctr < 2; ctr++) {
+                atomicStore(&gCipherCtr, ctr);
+                double elapsed = runWorkers(cipherLoop, cdm, n, seconds, &total);
+                throughput[ctr] = (double)total.bytes / elapsed / 1000000.0;
+            }
+            fprintf(stdout, "%-8s threads %3u : %10.1f MB/s (CBC), %10.1f MB/s (CTR)\n",
+                    names[impl], n, throughput[0], throughput[1]);
+        }
+    }
+    MarlinAesCipher::setImplementation(selected);
+    gCipher = NULL;
+    return 0;
+}
+
+/* Make an unlinked temporary file. */
+int openTemporaryFile()
+{
+    const char* dir = getenv("TMPDIR");
+    std::vector<char> path;
+    const char name[] = "/marlin_cdm_bench.XXXXXX";
+
+    if ((dir == NULL) || (*dir == '\0')) {
+        dir = "/tmp";
+    }
+    path.assign(dir, dir + strlen(dir));
+    path.insert(path.end(), name, name + sizeof(name));
+    int fd = mkstemp(&path[0]);
+    if (fd >= 0) {
+        unlink(&path[0]);
+    }
+    return fd;
+}
+
+/* Fill the file with packets of one PID, which are scrambled with the even key. */
+bool writeScrambledTs(int fd)
+{
+    std::vector<uint8_t> chunk(188 * 1024);
+    uint8_t counter = 0;
+
+    for (size_t i = 0; i < chunk.size(); i += 188) {
+        chunk[i] = 0x47;
+        chunk[i + 1] = 0x01;
+        chunk[i + 2] = 0x00;
+        chunk[i + 3] = (uint8_t)(0x80 | 0x10 | counter);
+        counter = (counter + 1) & 0x0F;
+        for (size_t j = 4; j < 188; j++) {
+            chunk[i + j] = (uint8_t)(i + j);
+        }
+    }
+    for (size_t written = 0; written < MCDM_BENCH_FILE_SIZE; written += chunk.size()) {
+        if (pwrite(fd, &chunk[0], chunk.size(), (off_t)written) != (ssize_t)chunk.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int benchFile(MarlinCdmInterface* cdm, uint32_t thread_num, uint32_t seconds)
+{
+    mcdm_buffer_t init_data;
+    struct timeval start;
+    struct timeval end;
+    int result = 0;
+
+    if (!provisionContentKey()) {
+        fprintf(stderr, "Could not provision the content key\n");
+        return 1;
+    }
+    int src_fd = openTemporaryFile();
+    int dst_fd = openTemporaryFile();
+    if ((src_fd < 0) || (dst_fd < 0) || !writeScrambledTs(src_fd)) {
+        fprintf(stderr, "Could not make the temporary files\n");
+        result = 1;
+    }
+
+    memset(&init_data, 0, sizeof(mcdm_buffer_t));
+    init_data.len = sizeof(gInitData);
+    init_data.data = gInitData;
+    init_data.fd = -1;
+
+    if (result == 0) {
+        fprintf(stdout, "file : %u bytes, chunk : %u bytes\n", (uint32_t)MCDM_BENCH_FILE_SIZE,
+                (uint32_t)MCDM_FILE_DECRYPT_CHUNK_SIZE);
+    }
+    for (uint32_t n = 1; (result == 0) && (n <= thread_num) && (n <= MCDM_FILE_DECRYPT_THREAD_MAX); n++) {
+        uint64_t bytes = 0;
+        double elapsed = 0.0;
+
+        /* The whole file is decrypted at least once. */
+        gettimeofday(&start, NULL);
+        do {
+            if (cdm->DecryptTsFile(init_data, src_fd, dst_fd, n) != OK) {
+                fprintf(stderr, "Could not decrypt the file on %u threads\n", n);
+                result = 1;
+                break;
+            }
+            bytes += MCDM_BENCH_FILE_SIZE;
+            gettimeofday(&end, NULL);
+            elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_usec - start.tv_usec) / 1000000.0;
+        } while (elapsed < seconds);
+        if (result == 0) {
+            fprintf(stdout, "threads %3u : %10.1f MB/s\n", n, (double)bytes / elapsed / 1000000.0);
+        }
+    }
+
+    if (src_fd >= 0) {
+        close(src_fd);
+    }
+    if (dst_fd >= 0) {
+        close(dst_fd);
+    }
+    return result;
+}
+
+uint64_t nowNanoseconds()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/* thread_num is not used, a channel change opens one session at a time. */
+int benchZap(MarlinCdmInterface* cdm, uint32_t thread_num, uint32_t seconds)
+{
+    static const uint32_t pool_sizes[] = { 0, MCDM_SESSION_POOL_MAX };
+    mcdm_session_id_t session_id;
+    mcdm_session_handle_t handle = MCDM_SESSION_HANDLE_INVALID;
+
+    for (uint32_t i = 0; i < sizeof(pool_sizes) / sizeof(pool_sizes[0]); i++) {
+        uint64_t zaps = 0;
+        uint64_t total = 0;
+        uint64_t longest = 0;
+
+        if (cdm->SetSessionPoolSize(pool_sizes[i]) != OK) {
+            fprintf(stderr, "Could not set the pool size %u\n", pool_sizes[i]);
+            return 1;
+        }
+        /* The pool is filled on the task thread. */
+        usleep(100 * 1000);
+
+        uint64_t end = nowNanoseconds() + (uint64_t)seconds * 1000000000ULL;
+        while (nowNanoseconds() < end) {
+            uint64_t start = nowNanoseconds();
+            if (cdm->OpenSession(session_id, &handle) != OK) {
+                fprintf(stderr, "Could not open a session with the pool size %u\n", pool_sizes[i]);
+                return 1;
+            }
+            uint64_t elapsed = nowNanoseconds() - start;
+            cdm->CloseSession(handle);
+            zaps++;
+            total += elapsed;
+            longest = (elapsed > longest) ? elapsed : longest;
+            usleep(MCDM_BENCH_ZAP_INTERVAL);
+        }
+        fprintf(stdout, "pool %2u : OpenSession() %8.1f us on average, %8.1f us at most (%llu sessions)\n",
+                pool_sizes[i], (double)total / (double)zaps / 1000.0, (double)longest / 1000.0,
+                (unsigned long long)zaps);
+    }
+    cdm->SetSessionPoolSize(MCDM_SESSION_POOL_SIZE);
+    return 0;
+}
+
+/* thread_num is not used, the guide is drawn by one thread. */
+int benchKeyExist(MarlinCdmInterface* cdm, uint32_t thread_num, uint32_t seconds)
+{
+    std::vector<uint8_t> data(MCDM_BENCH_SERVICES * sizeof(gInitData));
+    std::vector<mcdm_buffer_t> init_data(MCDM_BENCH_SERVICES);
+    uint8_t bitmap[(MCDM_BENCH_SERVICES + 7) / 8];
+    bool is_key_exist = false;
+    uint64_t start = 0;
+    uint64_t end = 0;
+    uint64_t guides = 0;
+
+    if (!provisionContentKey()) {
+        fprintf(stderr, "Could not provision the content key\n");
+        return 1;
+    }
+    for (uint32_t i = 0; i < MCDM_BENCH_SERVICES; i++) {
+        uint8_t* service = &data[i * sizeof(gInitData)];
+        memcpy(service, gInitData, sizeof(gInitData));
+        /* The last bytes of the KeyID information differ from the provisioned one except for service 0. */
+        service[sizeof(gInitData) - 2] ^= (uint8_t)(i >> 8);
+        service[sizeof(gInitData) - 1] ^= (uint8_t)i;
+        memset(&init_data[i], 0, sizeof(mcdm_buffer_t));
+        init_data[i].len = sizeof(gInitData);
+        init_data[i].data = service;
+        init_data[i].fd = -1;
+    }
+
+    fprintf(stdout, "services : %u\n", (uint32_t)MCDM_BENCH_SERVICES);
+
+    end = nowNanoseconds() + (uint64_t)seconds * 1000000000ULL;
+    start = nowNanoseconds();
+    for (guides = 0; (guides == 0) || (nowNanoseconds() < end); guides++) {
+        for (uint32_t i = 0; i < MCDM_BENCH_SERVICES; i++) {
+            if (cdm->CheckKeyExist(init_data[i], &is_key_exist) != OK) {
+                fprintf(stderr, "Could not check the key of service %u\n", i);
+                return 1;
+            }
+        }
+    }
+    fprintf(stdout, "CheckKeyExist() per service : %10.1f us per guide\n",
+            (double)(nowNanoseconds() - start) / (double)guides / 1000.0);
+
+    start = nowNanoseconds();
+    if (cdm->CheckKeyExistBatch(&init_data[0], MCDM_BENCH_SERVICES, bitmap) != OK) {
+        fprintf(stderr, "Could not check the keys of the services\n");
+        return 1;
+    }
+    fprintf(stdout, "CheckKeyExistBatch() first  : %10.1f us per guide\n",
+            (double)(nowNanoseconds() - start) / 1000.0);
+    if ((bitmap[0] & 0x01) == 0) {
+        fprintf(stderr, "The key of service 0 is not found\n");
+        return 1;
+    }
+
+    end = nowNanoseconds() + (uint64_t)seconds * 1000000000ULL;
+    start = nowNanoseconds();
+    for (guides = 0; (guides == 0) || (nowNanoseconds() < end); guides++) {
+        if (cdm->CheckKeyExistBatch(&init_data[0], MCDM_BENCH_SERVICES, bitmap) != OK) {
+            fprintf(stderr, "Could not check the keys of the services\n");
+            return 1;
+        }
+    }
+    fprintf(stdout, "CheckKeyExistBatch() again  : %10.1f us per guide\n",
+            (double)(nowNanoseconds() - start) / (double)guides / 1000.0);
+    return 0;
+}
+
+const Mode gModes[] = {
+    { "agents", benchAgents },
+    { "sessions", benchSessions },
+    { "async", benchAsync },
+    { "parse", benchParse },
+    { "cipher", benchCipher },
+    { "file", benchFile },
+    { "zap", benchZap },
+    { "keyexist", benchKeyExist },
+};
+
+int usage(const char* name)
+{
+    fprintf(stderr, "usage : %s <", name);
+    for (uint32_t i = 0; i < sizeof(gModes) / sizeof(gModes[0]); i++) {
+        fprintf(stderr, "%s%s", (i > 0) ? "|" : "", gModes[i].name);
+    }
+    fprintf(stderr, "> [thread_num] [seconds]\n");
+    return 2;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t thread_num = 0;
+    uint32_t seconds = MCDM_BENCH_SECONDS;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    const Mode* mode = NULL;
+    int result = 0;
+
+    if ((argc < 2) || (argc > 4)) {
+        return usage(argv[0]);
+    }
+    thread_num = (cores > 0) ? (uint32_t)cores : 1;
+    if ((argc >= 3) && !parseNumber(argv[2], &thread_num)) {
+        return usage(argv[0]);
+    }
+    if ((argc == 4) && !parseNumber(argv[3], &seconds)) {
+        return usage(argv[0]);
+    }
+    for (uint32_t i = 0; i < sizeof(gModes) / sizeof(gModes[0]); i++) {
+        if (strcmp(argv[1], gModes[i].name) == 0) {
+            mode = &gModes[i];
+        }
+    }
+    if (mode == NULL) {
+        return usage(argv[0]);
+    }
+
+    MarlinCdmInterface* cdm = MarlinCdmInterface::getMarlinCdmInterface();
+    if (cdm == NULL) {
+        fprintf(stderr, "Could not get instance of MarlinCdmInterface\n");
+        return 1;
+    }
+
+    result = mode->run(cdm, thread_num, seconds);
+
+    MarlinCdmInterface::releaseMarlinCdmInterface();
+    return result;
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */
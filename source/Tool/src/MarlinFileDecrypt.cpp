@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2014 Marlin Trust Management Organization
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Command line tool which decrypts a recorded MPEG-2 TS file with the licenses held by the agent.
+ *
+ * usage : marlin_file_decrypt <init_data file> <input file> <output file> [thread_num]
+ *
+ * The output file may be the input file to decrypt it in place.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "MarlinCdmInterface.h"
+
+using namespace marlincdm;
+
+namespace {
+
+int usage(const char* name)
+{
+    fprintf(stderr, "usage : %s <init_data file> <input file> <output file> [thread_num]\n", name);
+    return 2;
+}
+
+/* Read the whole Initialization data file. The caller frees data. */
+bool readInitData(const char* path, mcdm_buffer_t* init_data)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+    if ((fstat(fd, &st) != 0) || (st.st_size <= 0)) {
+        close(fd);
+        return false;
+    }
+    init_data->data = static_cast<uint8_t*>(malloc((size_t)st.st_size));
+    init_data->len = 0;
+    if (init_data->data == NULL) {
+        close(fd);
+        return false;
+    }
+    while (init_data->len < (size_t)st.st_size) {
+        ssize_t done = read(fd, init_data->data + init_data->len, (size_t)st.st_size - init_data->len);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (done == 0) {
+            break;
+        }
+        init_data->len += (size_t)done;
+    }
+    close(fd);
+    return init_data->len == (size_t)st.st_size;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    mcdm_buffer_t init_data;
+    uint32_t thread_num = 0;
+    int src_fd = -1;
+    int dst_fd = -1;
+    struct stat st;
+    struct timeval start;
+    struct timeval end;
+    mcdm_status_t status = OK;
+
+    if ((argc < 4) || (argc > 5)) {
+        return usage(argv[0]);
+    }
+    if (argc == 5) {
+        char* end_ptr = NULL;
+        unsigned long value = strtoul(argv[4], &end_ptr, 10);
+        if ((*argv[4] == '\0') || (*end_ptr != '\0')) {
+            return usage(argv[0]);
+        }
+        thread_num = (uint32_t)value;
+    }
+
+    memset(&init_data, 0, sizeof(mcdm_buffer_t));
+    init_data.fd = -1;
+    if (!readInitData(argv[1], &init_data)) {
+        fprintf(stderr, "Could not read %s\n", argv[1]);
+        free(init_data.data);
+        return 1;
+    }
+
+    src_fd = open(argv[2], O_RDONLY);
+    if ((src_fd < 0) || (fstat(src_fd, &st) != 0)) {
+        fprintf(stderr, "Could not open %s : %s\n", argv[2], strerror(errno));
+        free(init_data.data);
+        return 1;
+    }
+    /* Not truncated here, the output of an in place decryption is the input. */
+    dst_fd = open(argv[3], O_WRONLY | O_CREAT, 0644);
+    if (dst_fd < 0) {
+        fprintf(stderr, "Could not open %s : %s\n", argv[3], strerror(errno));
+        close(src_fd);
+        free(init_data.data);
+        return 1;
+    }
+
+    MarlinCdmInterface* cdm = MarlinCdmInterface::getMarlinCdmInterface();
+    if (cdm == NULL) {
+        fprintf(stderr, "Could not get instance of MarlinCdmInterface\n");
+        status = ERROR_UNKNOWN;
+    } else {
+        gettimeofday(&start, NULL);
+        status = cdm->DecryptTsFile(init_data, src_fd, dst_fd, thread_num);
+        gettimeofday(&end, NULL);
+        MarlinCdmInterface::releaseMarlinCdmInterface();
+    }
+
+    if (status == OK) {
+        double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_usec - start.tv_usec) / 1000000.0;
+        fprintf(stdout, "%lld bytes in %.3f s (%.1f MB/s)\n", (long long)st.st_size, seconds,
+                (seconds > 0) ? (double)st.st_size / seconds / 1000000.0 : 0.0);
+    } else {
+        fprintf(stderr, "Could not decrypt %s (%d)\n", argv[2], status);
+    }
+
+    close(dst_fd);
+    close(src_fd);
+    free(init_data.data);
+    return (status == OK) ? 0 : 1;
+}
+
+
+/*
+ * 2015 - Copyright Marlin Trust Management Organization
+ */